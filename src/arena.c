@@ -1,6 +1,7 @@
 #include "arena.h"
 #include "allocator.h"
 #include "util/align.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,6 +85,22 @@ void arena_destroy(Arena *arena) {
     free(arena);
 }
 
+// Compared as integers: ordering two pointers into different objects is
+// undefined, and whether they are the same object is the question asked.
+bool arena_owns(const Arena *arena, const void *ptr) {
+    uintptr_t address = (uintptr_t)ptr;
+
+    for (const ArenaBlock *block = arena->first_block; block; block = block->next) {
+        uintptr_t start = (uintptr_t)block->memory;
+
+        if (address >= start && address < start + block->capacity) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void *arena_alloc(Arena *arena, size_t size) {
     ArenaBlock *block = arena->current_block;
 
@@ -119,6 +136,31 @@ void arena_reset(Arena *arena) {
     arena->current_block = arena->first_block;
 }
 
+ArenaMark arena_mark(const Arena *arena) {
+    return (ArenaMark){.block = arena->current_block, .offset = arena->current_block->offset};
+}
+
+// Everything since the mark is in its block or one after it: a block is only
+// ever started after the current one, and those past the current one are
+// empty until it reaches them.
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    ArenaBlock *block = mark.block;
+
+#ifdef ARENA_POISON
+    memset((char *)block->memory + mark.offset, ARENA_POISON, block->offset - mark.offset);
+#endif
+    block->offset = mark.offset;
+
+    for (block = block->next; block; block = block->next) {
+#ifdef ARENA_POISON
+        memset(block->memory, ARENA_POISON, block->offset);
+#endif
+        block->offset = 0;
+    }
+
+    arena->current_block = mark.block;
+}
+
 static void *arena_allocator_alloc(void *ctx, size_t size) { return arena_alloc((Arena *)ctx, size); }
 
 static void arena_allocator_free(void *ctx, void *ptr) {
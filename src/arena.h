@@ -2,6 +2,7 @@
 #define GAB_ARENA_H
 
 #include "allocator.h"
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct ArenaBlock {
@@ -19,11 +20,30 @@ typedef struct Arena {
     size_t block_size;
 } Arena;
 
+// A point in an arena's allocations, to rewind it to once what came after has
+// turned out not to be wanted.
+typedef struct {
+    ArenaBlock *block;
+    size_t offset;
+} ArenaMark;
+
 Arena *arena_create(size_t capacity);
 void *arena_alloc(Arena *arena, size_t size);
 void arena_reset(Arena *arena);
 void arena_destroy(Arena *arena);
 
+ArenaMark arena_mark(const Arena *arena);
+
+// Reclaims everything allocated since 'mark' was taken, as arena_reset does
+// everything: the blocks are kept for what is allocated next. Nothing handed
+// out since may be used again.
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+// Whether 'ptr' points into memory this arena handed out, or could have. Walks
+// every block, so it is for the rare question of who owns something, not for
+// a path that runs per allocation.
+bool arena_owns(const Arena *arena, const void *ptr);
+
 Allocator arena_allocator(Arena *arena);
 
 #endif
@@ -39,6 +39,17 @@ typedef struct {
     // It sits here rather than on the resolver because a function body starts a
     // fresh count: a loop outside a declaration is not one the body can leave.
     unsigned int loop_depth;
+
+    // Inside a function body at all, which 'yield' needs: a top level runs as
+    // frame zero of a load, never as a coroutine.
+    bool in_function;
+
+    // Inside a 'parallel for' body: the block depth of the loop's own scope,
+    // so that a variable declared there or shallower is one every iteration
+    // shares, and the loop depth of the body, which a 'break' at that depth
+    // would leave. Zero outside one.
+    int parallel_depth;
+    unsigned int parallel_loop_depth;
 } FuncContext;
 
 typedef struct {
@@ -63,6 +74,18 @@ typedef struct {
 
     FuncContext func_context;
 
+    // The one place each may appear right now: the 'spawn' a 'let' is being
+    // initialised with, and the variable a 'join' is reading. A task handle
+    // anywhere else -- copied, passed, stored, returned -- would give the task
+    // a second owner, or none that is sure to join it.
+    const ASTExpr *bound_spawn;
+    const ASTExpr *joined_task;
+
+    // The operand a field access or a deref is reading through. A 'parallel
+    // for' body may read through a pointer its iterations share, but not hold
+    // one of its own: anything it wrote through that would be a race.
+    const ASTExpr *read_through;
+
     Diagnostics *diagnostics;
 } ResolverState;
 
@@ -168,8 +191,14 @@ static const char *type_name(ResolverState *state, Type *type) {
         return type->name->data;
     }
 
+    // A task of a call that returns nothing is 'task' alone, as such a call's
+    // type is 'none'.
+    if (type->kind == TYPE_TASK && !type->pointee) {
+        return "task";
+    }
+
     const char *pointee = type_name(state, type->pointee);
-    const char *prefix = type->is_ref ? "ref " : "*";
+    const char *prefix = type->kind == TYPE_TASK ? "task " : type->is_ref ? "ref " : "*";
     size_t length = strlen(prefix) + strlen(pointee) + 1;
     char *out = arena_alloc(state->compile_arena, length);
 
@@ -438,6 +467,32 @@ static void lower_method_call(ASTExpr *expr, Symbol *method, ReceiverAdjustment
     expr->symbol = method;
 }
 
+// Whether every iteration of the 'parallel for' being resolved sees this same
+// variable, rather than one of its own. The loop's counter counts: each chunk
+// of iterations steps a copy.
+static bool parallel_shares(const ResolverState *state, const Symbol *symbol) {
+    return state->func_context.parallel_depth > 0 && symbol && symbol->kind == SYMBOL_VAR &&
+           symbol->scope_depth <= state->func_context.parallel_depth;
+}
+
+// A shared pointer is only read through in a 'parallel for': copied, passed or
+// stored, it would give an iteration a way to write what the others read.
+static void check_parallel_read(ResolverState *state, ASTExpr *expr) {
+    if (!expr->type || (!type_is_pointer(expr->type) && !type_is_task(expr->type))) {
+        return;
+    }
+
+    if (!parallel_shares(state, expr->symbol) || state->read_through == expr) {
+        return;
+    }
+
+    diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+               "every iteration of a 'parallel for' shares this %s; read through it, but do not copy, pass or "
+               "store it",
+               type_name(state, expr->type));
+    expr->type = resolver_error_type(state);
+}
+
 // How the receiver has to be adjusted to reach parameter zero, reported through
 // 'out'. Returns false when no adjustment bridges the two, having said why.
 static bool reconcile_receiver(ResolverState *state, ASTExpr *expr, ASTExpr *receiver, Type *declared,
@@ -454,6 +509,15 @@ static bool reconcile_receiver(ResolverState *state, ASTExpr *expr, ASTExpr *rec
             return false;
         }
 
+        // An implicit '&x', refused where the explicit one would be.
+        if (parallel_shares(state, receiver->symbol)) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "cannot call '%s' on a variable every iteration of a 'parallel for' shares, since it "
+                       "takes a pointer receiver",
+                       name->data);
+            return false;
+        }
+
         // The address is loose for the duration of the call, so the slot it
         // names must survive the whole block — exactly as for '&x'.
         Symbol *addressed = addressed_symbol(receiver);
@@ -556,6 +620,9 @@ static void resolve_method_call(ResolverState *state, ASTExpr *expr) {
 
     lower_method_call(expr, method, adjustment);
 
+    // A builtin method answered by an instruction carries the tag over, so
+    // codegen emits it rather than a call to a body that does not exist.
+    expr->call.intrinsic = method->func.intrinsic;
     expr->type = method->func.return_type;
 }
 
@@ -744,6 +811,206 @@ static bool resolve_cast(ResolverState *state, ASTExpr *expr) {
     return true;
 }
 
+// The free names an intrinsic answers to, and how many operands each takes.
+// 'len' is absent: it is a method on string, and a free 'len(s)' stays an
+// undeclared name.
+static const struct {
+    const char *name;
+    Intrinsic intrinsic;
+    size_t arity;
+} intrinsic_names[] = {
+    {"sqrt", INTRINSIC_SQRT, 1}, {"floor", INTRINSIC_FLOOR, 1}, {"ceil", INTRINSIC_CEIL, 1},
+    {"abs", INTRINSIC_ABS, 1},   {"min", INTRINSIC_MIN, 2},     {"max", INTRINSIC_MAX, 2},
+    {"clamp", INTRINSIC_CLAMP, 3},
+};
+
+// 'sqrt(x)', 'min(a, b)' and the rest: a call to a name no declaration claims,
+// but which names an intrinsic, is checked here and tagged for codegen. Returns
+// false when the name is not one, leaving the node for the call path.
+//
+// A declaration wins. A host that already binds 'extern func sqrt' keeps its
+// own, and a script's 'func min' is the min its author meant; only an otherwise
+// undeclared name reaches the builtin. That is what lets these be added without
+// taking a name from any program that compiled before they existed.
+//
+// Unlike a function, an intrinsic may be defined over more than one type, so
+// it cannot be a Symbol with one parameter list. 'min' takes two ints or two
+// floats and yields what it was given, which a signature cannot say.
+static bool resolve_intrinsic(ResolverState *state, ASTExpr *expr) {
+    StringRef name = expr->call.target->var.name;
+    const char *intrinsic_name = NULL;
+    Intrinsic intrinsic = INTRINSIC_NONE;
+    size_t arity = 0;
+
+    for (size_t i = 0; i < sizeof(intrinsic_names) / sizeof(intrinsic_names[0]); i++) {
+        if (strlen(intrinsic_names[i].name) == name.length &&
+            memcmp(intrinsic_names[i].name, name.data, name.length) == 0) {
+            intrinsic_name = intrinsic_names[i].name;
+            intrinsic = intrinsic_names[i].intrinsic;
+            arity = intrinsic_names[i].arity;
+            break;
+        }
+    }
+
+    if (intrinsic == INTRINSIC_NONE ||
+        scope_symbol_lookup(state->current_scope, resolver_intern(state, name))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < expr->call.args.size; i++) {
+        ast_script_expr_visit(state, expr->call.args.data[i]);
+    }
+
+    // Nothing after this reads the target: the intrinsic is the callee.
+    ast_expr_free(expr->call.target);
+    expr->call.target = NULL;
+
+    if (expr->call.args.size != arity) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "expected %zu argument(s), found %zu", arity,
+                   expr->call.args.size);
+        expr->type = resolver_error_type(state);
+        return true;
+    }
+
+    Type *type = expr->call.args.data[0]->type;
+
+    for (size_t i = 0; i < arity; i++) {
+        Type *arg_type = expr->call.args.data[i]->type;
+
+        if (is_error_type(arg_type)) {
+            expr->type = resolver_error_type(state);
+            return true;
+        }
+
+        if (arg_type != type) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "cannot apply '%s' to %s and %s",
+                       intrinsic_name, type_name(state, type), type_name(state, arg_type));
+            expr->type = resolver_error_type(state);
+            return true;
+        }
+    }
+
+    bool float_only =
+        intrinsic == INTRINSIC_SQRT || intrinsic == INTRINSIC_FLOOR || intrinsic == INTRINSIC_CEIL;
+
+    if (float_only && type->kind != TYPE_FLOAT) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'%s' requires a float, found %s",
+                   intrinsic_name, type_name(state, type));
+        expr->type = resolver_error_type(state);
+        return true;
+    }
+
+    if (!is_numeric_type(type)) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'%s' requires a numeric type, found %s",
+                   intrinsic_name, type_name(state, type));
+        expr->type = resolver_error_type(state);
+        return true;
+    }
+
+    // A fresh value, so it inherits no symbol, as a conversion does not.
+    expr->call.intrinsic = intrinsic;
+    expr->type = type;
+    return true;
+}
+
+// Whether a value may be handed to another thread as it is: one that names
+// nothing, so the copy a task gets shares no memory with the frame that spawned
+// it. A pointer of either kind fails -- a 'ref T' borrows across threads, and a
+// '*T' argument stays its caller's, since a parameter never owns what it is
+// given -- and so does a struct carrying one.
+static bool type_is_sendable(const Type *type) {
+    switch (type->kind) {
+    case TYPE_INT:
+    case TYPE_FLOAT:
+    case TYPE_BOOL:
+    case TYPE_STRING:
+        return true;
+    case TYPE_STRUCT:
+        for (size_t i = 0; i < type->field_count; i++) {
+            if (!type_is_sendable(type->fields[i].type)) {
+                return false;
+            }
+        }
+
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 'spawn f(x)': the call a task will make on another thread, checked as a call
+// and then for what may cross to that thread. The arguments go by value and
+// must share nothing; the result comes back the same way, or as an object the
+// task made and the joiner comes to own.
+static void resolve_spawn(ResolverState *state, ASTExpr *expr) {
+    ASTExpr *call = expr->unary.target;
+
+    if (state->bound_spawn != expr) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                   "'spawn' must initialize a 'let', so the task has a variable to be joined through");
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    // Cleared before the call is visited, so a 'spawn' among its arguments is
+    // not taken for the bound one.
+    state->bound_spawn = NULL;
+
+    // Module code has no caller to join for it, so a task there could outlive
+    // the run that made it.
+    if (!state->func_context.in_function) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'spawn' is only valid inside a function");
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    if (call->kind != EXPR_CALL) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'spawn' takes a call");
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    ast_script_expr_visit(state, call);
+
+    if (call->type && call->type->kind == TYPE_ERROR) {
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    // A builtin answered by an instruction has no body to run elsewhere, and an
+    // extern's body is the host's, which has not said it may run on a thread
+    // the host never made.
+    if (call->call.intrinsic != INTRINSIC_NONE || !call->symbol || call->symbol->func.is_extern) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'spawn' takes a call to a script function");
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    for (size_t i = 0; i < call->call.args.size; i++) {
+        ASTExpr *arg = call->call.args.data[i];
+
+        if (!is_error_type(arg->type) && !type_is_sendable(arg->type)) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, arg->span,
+                       "argument %zu is %s, which a task would share with its caller; pass values", i + 1,
+                       type_name(state, arg->type));
+            expr->type = resolver_error_type(state);
+            return;
+        }
+    }
+
+    Type *result = call->type;
+
+    if (result && !type_is_sendable(result) && !(type_is_pointer(result) && !result->is_ref)) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                   "a task cannot return %s; return values, or an object the joiner will own",
+                   type_name(state, result));
+        expr->type = resolver_error_type(state);
+        return;
+    }
+
+    expr->type = type_registry_task_of(state->current_scope->type_registry, result);
+}
+
 void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
     if (!expr) {
         return;
@@ -793,8 +1060,39 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
             break;
         }
 
+        // A channel names a queue, not a value: there is nothing in a slot to
+        // read, and 'send' and 'receive' find it by name.
+        if (entry->kind == SYMBOL_CHANNEL) {
+            char *name = string_ref_to_cstr(expr->var.name);
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "'%s' is a channel; it can only be named by 'send' and 'receive'", name);
+            free(name);
+
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
+        if (entry->kind == SYMBOL_VAR && entry->var.sent) {
+            char *name = string_ref_to_cstr(expr->var.name);
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "'%s' was sent, and holds nothing from there to the end of its block", name);
+            free(name);
+
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
         expr->symbol = entry;
         expr->type = entry->var.type;
+
+        if (type_is_task(entry->var.type) && state->joined_task != expr) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "a task can only be joined; it cannot be copied, passed or stored");
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
+        check_parallel_read(state, expr);
         break;
     }
     case EXPR_CALL: {
@@ -816,6 +1114,13 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
             break;
         }
 
+        // 'sqrt(x)' and its kin, where nothing declared the name. Checked after
+        // the conversion, which a type name settles, and before the symbol
+        // lookup, which would report the name undeclared.
+        if (expr->call.target && expr->call.target->kind == EXPR_VARIABLE && resolve_intrinsic(state, expr)) {
+            break;
+        }
+
         ast_script_expr_visit(state, expr->call.target);
 
         for (size_t i = 0; i < expr->call.args.size; i++) {
@@ -849,8 +1154,13 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
         break;
     }
     case EXPR_FIELD: {
+        const ASTExpr *outer_read = state->read_through;
+        state->read_through = expr->field.target;
+
         ast_script_expr_visit(state, expr->field.target);
 
+        state->read_through = outer_read;
+
         Type *target_type = expr->field.target->type;
 
         if (is_error_type(target_type)) {
@@ -887,6 +1197,8 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
         // Field access addresses the target's slots, so it inherits the
         // target's symbol and stays assignable through the chain.
         expr->symbol = expr->field.target->symbol;
+
+        check_parallel_read(state, expr);
         break;
     }
     case EXPR_ADDR_OF: {
@@ -906,6 +1218,13 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
             break;
         }
 
+        if (parallel_shares(state, expr->unary.target->symbol)) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "cannot borrow a variable every iteration of a 'parallel for' shares");
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
         // '&o' where 'o' owns would be a borrow of an owning pointer, and
         // 'ref *T' cannot be written: 'ref' does not combine with '*'. Producing
         // a value nothing can name is worse than refusing it here, where the
@@ -943,8 +1262,13 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
         break;
     }
     case EXPR_DEREF: {
+        const ASTExpr *outer_read = state->read_through;
+        state->read_through = expr->unary.target;
+
         ast_script_expr_visit(state, expr->unary.target);
 
+        state->read_through = outer_read;
+
         Type *target_type = expr->unary.target->type;
 
         if (is_error_type(target_type)) {
@@ -964,6 +1288,8 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
         // The address itself lives in the target's slots, so a deref stays
         // assignable through whatever the target was.
         expr->symbol = expr->unary.target->symbol;
+
+        check_parallel_read(state, expr);
         break;
     }
     case EXPR_NEG: {
@@ -1036,6 +1362,43 @@ void ast_script_expr_visit(ResolverState *state, ASTExpr *expr) {
         expr->type = type_registry_pointer_to(state->current_scope->type_registry, type);
         break;
     }
+    case EXPR_SPAWN: {
+        resolve_spawn(state, expr);
+        break;
+    }
+    case EXPR_JOIN: {
+        ASTExpr *task = expr->unary.target;
+
+        if (task->kind != EXPR_VARIABLE) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span,
+                       "'join' takes the variable a task was spawned into");
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
+        const ASTExpr *outer = state->joined_task;
+
+        state->joined_task = task;
+        ast_script_expr_visit(state, task);
+        state->joined_task = outer;
+
+        if (is_error_type(task->type)) {
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
+        if (!type_is_task(task->type)) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, expr->span, "'join' takes a task, found %s",
+                       type_name(state, task->type));
+            expr->type = resolver_error_type(state);
+            break;
+        }
+
+        // The call's result, fresh from the task: a temporary like a call's own,
+        // and owned by whoever takes it when it is a '*T'.
+        expr->type = task->type->pointee;
+        break;
+    }
     case EXPR_LITERAL: {
         expr->type = type_registry_get_builtin(state->current_scope->type_registry, expr->lit.kind);
         break;
@@ -1314,6 +1677,39 @@ static void declare_method(ResolverState *state, ASTStmt *stmt) {
     stmt->func_decl.symbol = method;
 }
 
+// 'extern channel inbox: *Event;'. What travels is an object on the heap, owned
+// by whoever holds the message: a struct, since only one carries the header a
+// receiver on another thread frees it by.
+static void declare_channel(ResolverState *state, ASTStmt *stmt) {
+    stmt->channel_decl.declared = true;
+
+    Type *element = ast_script_resolve_type(state, stmt->channel_decl.type_spec, stmt->span);
+
+    if (is_error_type(element)) {
+        return;
+    }
+
+    if (!type_is_pointer(element) || element->is_ref || !element->pointee ||
+        element->pointee->kind != TYPE_STRUCT) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span,
+                   "a channel carries objects it owns, '*T' for a struct T; found %s",
+                   type_name(state, element));
+        return;
+    }
+
+    String *name = resolver_intern(state, stmt->channel_decl.name);
+    Symbol *channel = scope_decl_channel(state->current_scope, name, element);
+
+    if (!channel) {
+        diag_error(state->diagnostics, GAB_ERR_NAME, stmt->span, "'%s' is already declared in this scope",
+                   name->data);
+        return;
+    }
+
+    channel->channel.module = state->module_name;
+    stmt->channel_decl.symbol = channel;
+}
+
 static void declare_func(ResolverState *state, ASTStmt *stmt) {
     stmt->func_decl.declared = true;
 
@@ -1339,11 +1735,12 @@ static void declare_func(ResolverState *state, ASTStmt *stmt) {
     stmt->func_decl.symbol = func;
 
     if (func) {
-        func->func.is_extern = stmt->func_decl.body == NULL;
+        func->func.is_extern = stmt->func_decl.body == NULL && !stmt->func_decl.deferred;
 
         if (func->func.is_extern) {
             func->func.name = resolver_intern(state, func_name);
             func->func.module = state->module_name;
+            func->func.is_pure = stmt->func_decl.is_pure;
         }
     }
 
@@ -1400,6 +1797,7 @@ static void resolve_func_body(ResolverState *state, ASTStmt *stmt) {
     FuncContext previous_context = state->func_context;
 
     state->func_context.return_type = stmt->func_decl.resolved_return_type;
+    state->func_context.in_function = true;
 
     ast_script_stmt_visit(state, stmt->func_decl.body);
 
@@ -1408,6 +1806,165 @@ static void resolve_func_body(ResolverState *state, ASTStmt *stmt) {
     resolver_exit_scope(state);
 }
 
+// The variable whose object a pointer read from it would reach into: 'e' for
+// 'e', 'e.inner' and '*e'.
+static void mark_alias_root(ASTExpr *expr) {
+    switch (expr->kind) {
+    case EXPR_VARIABLE:
+        if (expr->symbol && expr->symbol->kind == SYMBOL_VAR) {
+            expr->symbol->var.aliased = true;
+        }
+        break;
+    case EXPR_FIELD:
+        mark_alias_root(expr->field.target);
+        break;
+    case EXPR_DEREF:
+        mark_alias_root(expr->unary.target);
+        break;
+    default:
+        break;
+    }
+}
+
+// Records that a pointer value is being kept somewhere -- a variable or a
+// field -- so that whatever it was read from can no longer be sent: the copy
+// would go on reaching the object once another thread owns it.
+//
+// A call keeps nothing of its arguments unless it hands one back, and one
+// returning a pointer may; which argument is not known, so all of them count.
+static void note_pointer_alias(ASTExpr *value) {
+    if (!value || !type_is_pointer(value->type)) {
+        return;
+    }
+
+    if (value->kind != EXPR_CALL) {
+        mark_alias_root(value);
+        return;
+    }
+
+    for (size_t i = 0; i < value->call.args.size; i++) {
+        ASTExpr *arg = value->call.args.data[i];
+
+        if (type_is_pointer(arg->type)) {
+            mark_alias_root(arg);
+        }
+    }
+}
+
+// The channel a 'send' or 'receive' names, or NULL having said why not.
+static Symbol *resolve_channel(ResolverState *state, StringRef name, Span span) {
+    Symbol *symbol = scope_symbol_lookup(state->current_scope, resolver_intern(state, name));
+
+    if (!symbol || symbol->kind != SYMBOL_CHANNEL) {
+        char *text = string_ref_to_cstr(name);
+        diag_error(state->diagnostics, GAB_ERR_NAME, span, "'%s' is not a channel", text);
+        free(text);
+
+        return NULL;
+    }
+
+    return symbol;
+}
+
+// Whether 'send' may hand this value over. A fresh object is nobody's yet. A
+// variable has to be the only thing reaching its object, and has to stop being
+// named from here on: declared in this same block, so nothing after its block
+// ends can see it, never copied, and never borrowed from.
+static bool send_value_is_owned(ResolverState *state, ASTExpr *value) {
+    switch (value->kind) {
+    case EXPR_NEW:
+    case EXPR_CALL:
+    case EXPR_JOIN:
+        return true;
+    case EXPR_VARIABLE:
+        break;
+    default:
+        diag_error(state->diagnostics, GAB_ERR_TYPE, value->span,
+                   "'send' takes a variable that owns its object, or a new object");
+        return false;
+    }
+
+    Symbol *symbol = value->symbol;
+
+    if (!symbol || symbol->kind != SYMBOL_VAR) {
+        return false;
+    }
+
+    if (symbol->scope_depth != state->current_scope->depth) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, value->span,
+                   "a variable can only be sent from the block that declares it, so nothing after the 'send' "
+                   "can still name it");
+        return false;
+    }
+
+    if (symbol->pinned || symbol->var.aliased) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, value->span,
+                   "cannot send a variable whose object something else also reaches");
+        return false;
+    }
+
+    return true;
+}
+
+// The target of an assignment, which is written rather than read: a shared
+// pointer may be named as the thing written through, and it is the write
+// itself that a 'parallel for' body is refused when the variable is shared.
+static void resolve_assign_target(ResolverState *state, ASTExpr *target) {
+    const ASTExpr *outer_read = state->read_through;
+    state->read_through = target;
+
+    ast_script_expr_visit(state, target);
+
+    state->read_through = outer_read;
+
+    if (parallel_shares(state, target->symbol)) {
+        diag_error(state->diagnostics, GAB_ERR_TYPE, target->span,
+                   "a 'parallel for' body cannot assign to a variable its iterations share, or through one");
+    }
+}
+
+// 'parallel for let i: int = a; i < n; i += 1 { ... }': the counting loop, the
+// one shape whose iterations can be numbered up front and handed out in
+// chunks. The bound is read once, before any chunk starts.
+static bool parallel_for_has_shape(const ASTForStmt *ast) {
+    const ASTStmt *init = ast->init;
+
+    if (!init || init->kind != STMT_VAR_DECL || !init->var_decl.symbol || !init->var_decl.initializer) {
+        return false;
+    }
+
+    const Symbol *counter = init->var_decl.symbol;
+
+    if (!counter->var.type || counter->var.type->kind != TYPE_INT) {
+        return false;
+    }
+
+    const ASTExpr *condition = ast->condition;
+
+    if (!condition || condition->kind != EXPR_BIN_OP || condition->bin_op.op != BIN_OP_LESS ||
+        condition->bin_op.left->kind != EXPR_VARIABLE || condition->bin_op.left->symbol != counter) {
+        return false;
+    }
+
+    const Type *bound = condition->bin_op.right->type;
+
+    if (!bound || bound->kind != TYPE_INT) {
+        return false;
+    }
+
+    const ASTStmt *post = ast->post;
+
+    if (!post || post->kind != STMT_COMPOUND_ASSIGN || post->compound_assign.op != BIN_OP_ADD ||
+        post->compound_assign.target->kind != EXPR_VARIABLE ||
+        post->compound_assign.target->symbol != counter) {
+        return false;
+    }
+
+    const ASTExpr *step = post->compound_assign.value;
+
+    return step->kind == EXPR_LITERAL && step->lit.kind == TYPE_INT && step->lit.as_int == 1;
+}
+
 void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
     if (!stmt) {
         return;
@@ -1419,6 +1976,11 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         break;
     }
     case STMT_VAR_DECL: {
+        // The one place a 'spawn' may stand. See ResolverState::bound_spawn.
+        if (stmt->var_decl.initializer && stmt->var_decl.initializer->kind == EXPR_SPAWN) {
+            state->bound_spawn = stmt->var_decl.initializer;
+        }
+
         ast_script_expr_visit(state, stmt->var_decl.initializer);
 
         Type *type;
@@ -1459,6 +2021,8 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         // and returns to check against.
         var->var.pointee_depth = pointee_depth(stmt->var_decl.initializer);
 
+        note_pointer_alias(stmt->var_decl.initializer);
+
         stmt->var_decl.symbol = var;
         break;
     }
@@ -1484,9 +2048,11 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         break;
     }
     case STMT_ASSIGN: {
-        ast_script_expr_visit(state, stmt->assign.target);
+        resolve_assign_target(state, stmt->assign.target);
         ast_script_expr_visit(state, stmt->assign.value);
 
+        note_pointer_alias(stmt->assign.value);
+
         Type *target_type = stmt->assign.target->type;
         Type *value_type = stmt->assign.value->type;
 
@@ -1521,7 +2087,7 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         break;
     }
     case STMT_COMPOUND_ASSIGN: {
-        ast_script_expr_visit(state, stmt->compound_assign.target);
+        resolve_assign_target(state, stmt->compound_assign.target);
         ast_script_expr_visit(state, stmt->compound_assign.value);
 
         Type *target_type = stmt->compound_assign.target->type;
@@ -1592,12 +2158,36 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
             }
         }
 
+        // Visited after the body, matching when it runs, though it is the
+        // initializer's scope either way. A 'parallel for' visits it first
+        // instead, as its shape is checked before the body: the body is only
+        // resolvable as one once the counter is known to be the loop's own.
+        if (stmt->forstmt.parallel) {
+            ast_script_stmt_visit(state, stmt->forstmt.post);
+
+            if (!parallel_for_has_shape(&stmt->forstmt)) {
+                diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span,
+                           "'parallel for' takes a counting loop: 'parallel for let i: int = a; i < n; i += 1'");
+            }
+
+            FuncContext outer = state->func_context;
+
+            state->func_context.loop_depth++;
+            state->func_context.parallel_depth = state->current_scope->depth;
+            state->func_context.parallel_loop_depth = state->func_context.loop_depth;
+
+            ast_script_stmt_visit(state, stmt->forstmt.body);
+
+            state->func_context = outer;
+
+            resolver_exit_scope(state);
+            break;
+        }
+
         state->func_context.loop_depth++;
         ast_script_stmt_visit(state, stmt->forstmt.body);
         state->func_context.loop_depth--;
 
-        // Visited after the body, matching when it runs, though it is the
-        // initializer's scope either way.
         ast_script_stmt_visit(state, stmt->forstmt.post);
 
         resolver_exit_scope(state);
@@ -1607,6 +2197,14 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         if (state->func_context.loop_depth == 0) {
             diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span, "'%s' is only valid inside a loop",
                        stmt->jump.is_break ? "break" : "continue");
+            break;
+        }
+
+        // A 'continue' ends one iteration, which every chunk can do alone. A
+        // 'break' would end the others' too, and they may already be done.
+        if (stmt->jump.is_break && state->func_context.parallel_depth > 0 &&
+            state->func_context.loop_depth == state->func_context.parallel_loop_depth) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span, "'break' cannot leave a 'parallel for'");
         }
         break;
     }
@@ -1623,6 +2221,14 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
     case STMT_RETURN: {
         ast_script_expr_visit(state, stmt->ret.result);
 
+        // An iteration runs on whichever thread took its chunk, which has no
+        // caller to return to.
+        if (state->func_context.parallel_depth > 0) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span,
+                       "'return' cannot leave a 'parallel for'");
+            break;
+        }
+
         Type *expected = state->func_context.return_type;
         Type *actual = stmt->ret.result ? stmt->ret.result->type : NULL;
 
@@ -1647,6 +2253,109 @@ void ast_script_stmt_visit(ResolverState *state, ASTStmt *stmt) {
         check_pointer_lifetime(state, stmt->ret.result, 0, stmt->span, "returned");
         break;
     }
+    case STMT_YIELD: {
+        ast_script_expr_visit(state, stmt->yield.value);
+
+        if (!state->func_context.in_function) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span,
+                       "'yield' is only valid inside a function");
+            break;
+        }
+
+        if (state->func_context.parallel_depth > 0) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span, "'yield' cannot leave a 'parallel for'");
+            break;
+        }
+
+        // A yielded value is handed over as a returned one is, so it is checked
+        // against the same declared type; a bare 'yield;' is the no-value case.
+        Type *expected = state->func_context.return_type;
+        Type *actual = stmt->yield.value ? stmt->yield.value->type : NULL;
+
+        bool poisoned = (expected && expected->kind == TYPE_ERROR) || (actual && actual->kind == TYPE_ERROR);
+        bool accepted = actual && expected ? type_accepts(expected, actual) : actual == expected;
+
+        if (!poisoned && !accepted) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span, "yields %s, but %s was declared",
+                       type_name(state, actual), type_name(state, expected));
+            break;
+        }
+
+        // Unlike a return, the function goes on owning what it yields once it
+        // is resumed, so handing out an owning pointer would give the object
+        // two owners.
+        if (actual && actual->kind == TYPE_POINTER && !actual->is_ref) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->span,
+                       "cannot yield an owning pointer; the function still owns it once resumed");
+            break;
+        }
+
+        // The yielded value outlives the frame just as a returned one does: the
+        // host holds it across the suspension and may resume the coroutine to
+        // its end.
+        check_pointer_lifetime(state, stmt->yield.value, 0, stmt->span, "yielded");
+        break;
+    }
+    case STMT_CHANNEL_DECL: {
+        if (!stmt->channel_decl.declared) {
+            declare_channel(state, stmt);
+        }
+        break;
+    }
+    case STMT_SEND: {
+        ast_script_expr_visit(state, stmt->send.value);
+
+        Symbol *channel = resolve_channel(state, stmt->send.channel, stmt->span);
+        Type *value_type = stmt->send.value->type;
+
+        if (!channel || is_error_type(value_type)) {
+            break;
+        }
+
+        if (value_type != channel->channel.element) {
+            diag_error(state->diagnostics, GAB_ERR_TYPE, stmt->send.value->span,
+                       "this channel carries %s, not %s", type_name(state, channel->channel.element),
+                       type_name(state, value_type));
+            break;
+        }
+
+        if (!send_value_is_owned(state, stmt->send.value)) {
+            break;
+        }
+
+        if (stmt->send.value->kind == EXPR_VARIABLE) {
+            stmt->send.value->symbol->var.sent = true;
+        }
+
+        stmt->send.symbol = channel;
+        break;
+    }
+    case STMT_RECEIVE: {
+        Symbol *channel = resolve_channel(state, stmt->receive.channel, stmt->span);
+
+        // The variable's scope is the first block and nothing else, which is
+        // why the block's statements are visited here rather than as a block
+        // of their own: a 'send' of it is then from the block that declares it.
+        resolver_enter_scope(state);
+
+        Type *element = channel ? channel->channel.element : resolver_error_type(state);
+        Symbol *var =
+            scope_decl_var(state->current_scope, resolver_intern(state, stmt->receive.name), element);
+
+        stmt->receive.symbol = var;
+        stmt->receive.channel_symbol = channel;
+
+        ASTStmtList *body = &stmt->receive.then_block->block.list;
+
+        for (size_t i = 0; i < body->size; i++) {
+            ast_script_stmt_visit(state, body->data[i]);
+        }
+
+        resolver_exit_scope(state);
+
+        ast_script_stmt_visit(state, stmt->receive.else_block);
+        break;
+    }
     }
 }
 
@@ -1685,6 +2394,14 @@ bool ast_script_resolve(Arena *compile_arena, ASTScript *script, Scope *global_s
         }
     }
 
+    for (size_t i = 0; i < script->statements.size; i++) {
+        ASTStmt *stmt = script->statements.data[i];
+
+        if (stmt && stmt->kind == STMT_CHANNEL_DECL) {
+            declare_channel(&state, stmt);
+        }
+    }
+
     for (size_t i = 0; i < script->statements.size; i++) {
         ASTStmt *stmt = script->statements.data[i];
 
@@ -1699,3 +2416,29 @@ bool ast_script_resolve(Arena *compile_arena, ASTScript *script, Scope *global_s
 
     return diagnostics_count(diagnostics) == errors_before;
 }
+
+bool ast_resolve_deferred(Arena *compile_arena, ASTStmt *func_decl, Symbol *symbol, Scope *module_scope,
+                          ModuleScopeMap *module_scopes, const ASTImportList *imports, String *module_name,
+                          Diagnostics *diagnostics) {
+    ResolverState state = {
+        .compile_arena = compile_arena,
+        .global_scope = module_scope,
+        .current_scope = module_scope,
+        .module_scopes = module_scopes,
+        .imports = imports,
+        .module_name = module_name,
+        .diagnostics = diagnostics,
+    };
+
+    size_t errors_before = diagnostics_count(diagnostics);
+
+    // Declared when the unit loaded, so only what the declaration pass would
+    // have left on the node is put back.
+    func_decl->func_decl.symbol = symbol;
+    func_decl->func_decl.resolved_return_type = symbol->func.return_type;
+    func_decl->func_decl.declared = true;
+
+    resolve_func_body(&state, func_decl);
+
+    return diagnostics_count(diagnostics) == errors_before;
+}
@@ -49,4 +49,12 @@ bool ast_script_resolve(Arena *compile_arena, ASTScript *script, Scope *global_s
                         ModuleScopeMap *module_scopes, Diagnostics *diagnostics);
 void ast_script_destroy(ASTScript *script);
 
+// Resolves the body of a function a lazy load declared without one: 'func_decl'
+// is the declaration parsed back, 'symbol' what the load declared it as, and
+// the rest is what the unit it came from resolved against. The body sees the
+// module as it is now, not as it was when the unit loaded.
+bool ast_resolve_deferred(Arena *compile_arena, ASTStmt *func_decl, Symbol *symbol, Scope *module_scope,
+                          ModuleScopeMap *module_scopes, const ASTImportList *imports, String *module_name,
+                          Diagnostics *diagnostics);
+
 #endif
@@ -37,6 +37,7 @@ ASTExpr *ast_call_expr_create(Span span, ASTExpr *target, ASTExprList args) {
     node->kind = EXPR_CALL;
     node->call.target = target;
     node->call.args = args;
+    node->call.intrinsic = INTRINSIC_NONE;
     return node;
 }
 
@@ -92,6 +93,20 @@ ASTExpr *ast_new_expr_create(Span span, TypeSpec *type_spec) {
     return node;
 }
 
+ASTExpr *ast_spawn_expr_create(Span span, ASTExpr *call) {
+    ASTExpr *node = ast_expr_create(span);
+    node->kind = EXPR_SPAWN;
+    node->unary.target = call;
+    return node;
+}
+
+ASTExpr *ast_join_expr_create(Span span, ASTExpr *task) {
+    ASTExpr *node = ast_expr_create(span);
+    node->kind = EXPR_JOIN;
+    node->unary.target = task;
+    return node;
+}
+
 void ast_expr_free(ASTExpr *expr) {
     if (!expr)
         return;
@@ -117,6 +132,8 @@ void ast_expr_free(ASTExpr *expr) {
     case EXPR_DEREF:
     case EXPR_NEG:
     case EXPR_NOT:
+    case EXPR_SPAWN:
+    case EXPR_JOIN:
         ast_expr_free(expr->unary.target);
         break;
     case EXPR_CAST:
@@ -2,6 +2,7 @@
 #define GAB_AST_EXPR_H
 
 #include "diagnostics.h"
+#include "intrinsic.h"
 #include "string/string.h"
 #include "symbol_table.h"
 #include "type.h"
@@ -32,6 +33,8 @@ typedef enum {
     EXPR_NOT,
     EXPR_CAST,
     EXPR_NEW,
+    EXPR_SPAWN,
+    EXPR_JOIN,
 } ExprKind;
 
 typedef enum {
@@ -80,9 +83,15 @@ typedef struct ASTExpr {
         // 'target' is what was called, and is only read during resolution:
         // afterwards the callee is on 'symbol' and the arguments are complete,
         // so codegen never looks at it.
+        //
+        // 'intrinsic' is set by the resolver when the call is one codegen
+        // answers with an instruction rather than a call -- 's.len()', or
+        // 'sqrt(x)' where no declaration claims the name. Such a call has no
+        // callee symbol to jump to, only its arguments.
         struct {
             ASTExpr *target;
             ASTExprList args;
+            Intrinsic intrinsic;
         } call;
 
         struct {
@@ -96,6 +105,9 @@ typedef struct ASTExpr {
 
         // '&target', '*target', '-target' and '!target'. All are prefix forms
         // over a single operand, so they share a shape.
+        //
+        // So are 'spawn target', whose target is the call a task will make, and
+        // 'join target', whose target is the variable holding the task.
         struct {
             ASTExpr *target;
         } unary;
@@ -136,6 +148,8 @@ ASTExpr *ast_neg_expr_create(Span span, ASTExpr *target);
 ASTExpr *ast_not_expr_create(Span span, ASTExpr *target);
 ASTExpr *ast_cast_expr_create(Span span, ASTExpr *operand);
 ASTExpr *ast_new_expr_create(Span span, TypeSpec *type_spec);
+ASTExpr *ast_spawn_expr_create(Span span, ASTExpr *call);
+ASTExpr *ast_join_expr_create(Span span, ASTExpr *task);
 void ast_expr_free(ASTExpr *node);
 
 #endif
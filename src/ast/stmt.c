@@ -36,6 +36,9 @@ ASTStmt *ast_func_decl_stmt_create(Span span, StringRef name, ASTField *receiver
     stmt->func_decl.symbol = NULL;
     stmt->func_decl.resolved_return_type = NULL;
     stmt->func_decl.declared = false;
+    stmt->func_decl.is_pure = false;
+    stmt->func_decl.deferred = false;
+    stmt->func_decl.source_offset = 0;
     return stmt;
 }
 
@@ -82,6 +85,7 @@ ASTStmt *ast_for_stmt_create(Span span, ASTStmt *init, ASTExpr *condition, ASTSt
     stmt->forstmt.condition = condition;
     stmt->forstmt.post = post;
     stmt->forstmt.body = body;
+    stmt->forstmt.parallel = false;
     return stmt;
 }
 
@@ -106,6 +110,45 @@ ASTStmt *ast_return_stmt_create(Span span, ASTExpr *result) {
     return stmt;
 }
 
+ASTStmt *ast_yield_stmt_create(Span span, ASTExpr *value) {
+    ASTStmt *stmt = ast_stmt_create(span);
+    stmt->kind = STMT_YIELD;
+    stmt->yield.value = value;
+    return stmt;
+}
+
+ASTStmt *ast_channel_decl_stmt_create(Span span, StringRef name, TypeSpec *type_spec) {
+    ASTStmt *stmt = ast_stmt_create(span);
+    stmt->kind = STMT_CHANNEL_DECL;
+    stmt->channel_decl.name = name;
+    stmt->channel_decl.type_spec = type_spec;
+    stmt->channel_decl.symbol = NULL;
+    stmt->channel_decl.declared = false;
+    return stmt;
+}
+
+ASTStmt *ast_send_stmt_create(Span span, StringRef channel, ASTExpr *value) {
+    ASTStmt *stmt = ast_stmt_create(span);
+    stmt->kind = STMT_SEND;
+    stmt->send.channel = channel;
+    stmt->send.value = value;
+    stmt->send.symbol = NULL;
+    return stmt;
+}
+
+ASTStmt *ast_receive_stmt_create(Span span, StringRef name, StringRef channel, ASTStmt *then_block,
+                                 ASTStmt *else_block) {
+    ASTStmt *stmt = ast_stmt_create(span);
+    stmt->kind = STMT_RECEIVE;
+    stmt->receive.name = name;
+    stmt->receive.channel = channel;
+    stmt->receive.then_block = then_block;
+    stmt->receive.else_block = else_block;
+    stmt->receive.symbol = NULL;
+    stmt->receive.channel_symbol = NULL;
+    return stmt;
+}
+
 void ast_stmt_destroy(ASTStmt *stmt) {
     if (!stmt)
         return;
@@ -158,6 +201,19 @@ void ast_stmt_destroy(ASTStmt *stmt) {
     case STMT_RETURN:
         ast_expr_free(stmt->ret.result);
         break;
+    case STMT_YIELD:
+        ast_expr_free(stmt->yield.value);
+        break;
+    case STMT_CHANNEL_DECL:
+        type_spec_destroy(stmt->channel_decl.type_spec);
+        break;
+    case STMT_SEND:
+        ast_expr_free(stmt->send.value);
+        break;
+    case STMT_RECEIVE:
+        ast_stmt_destroy(stmt->receive.then_block);
+        ast_stmt_destroy(stmt->receive.else_block);
+        break;
     }
 
     free(stmt);
@@ -40,6 +40,10 @@ typedef enum {
     STMT_FOR,
     STMT_JUMP,
     STMT_RETURN,
+    STMT_YIELD,
+    STMT_CHANNEL_DECL,
+    STMT_SEND,
+    STMT_RECEIVE,
 } StmtKind;
 
 typedef struct {
@@ -77,6 +81,16 @@ typedef struct {
     // function, which nothing above it could have seen, is declared by the
     // body walk instead.
     bool declared;
+
+    // 'extern pure func'. Only an extern can be declared so: a script body's
+    // purity is the compiler's to find out, not the author's to claim.
+    bool is_pure;
+
+    // A body the parser skipped rather than built, in a unit loaded with its
+    // bodies deferred: 'body' is NULL, as an extern's is, but there is one, and
+    // it starts with the declaration at this byte offset of the source.
+    bool deferred;
+    size_t source_offset;
 } ASTFuncDecl;
 
 typedef struct {
@@ -114,11 +128,16 @@ typedef struct {
 // 'for cond { }' fills only the condition, and the three-clause form fills what
 // it was given -- so an omitted condition means the same thing in each: loop
 // forever.
+//
+// 'parallel for' is the three-clause counting form with its iterations split
+// across threads. It is still this node: what it may contain is a resolver
+// question, and its shape is the one codegen already recognises.
 typedef struct {
     struct ASTStmt *init;
     ASTExpr *condition;
     struct ASTStmt *post;
     struct ASTStmt *body;
+    bool parallel;
 } ASTForStmt;
 
 // 'break' and 'continue'. They differ only in which end of the loop they jump
@@ -135,6 +154,46 @@ typedef struct {
     ASTExpr *result;
 } ASTReturnStmt;
 
+// Suspends the coroutine running the function, handing 'value' -- NULL for a
+// bare 'yield;' -- to whoever resumed it.
+typedef struct {
+    ASTExpr *value;
+} ASTYieldStmt;
+
+// 'extern channel inbox: *Event;'. A name for a queue the host creates and
+// attaches; the script only says what travels through it.
+typedef struct {
+    StringRef name;
+    TypeSpec *type_spec;
+
+    Symbol *symbol; // Filled during symbol/type resolution
+
+    // As ASTFuncDecl::declared.
+    bool declared;
+} ASTChannelDecl;
+
+// 'send inbox, e;'. Hands the object 'value' owns to the channel; the variable
+// that held it holds nothing afterwards.
+typedef struct {
+    StringRef channel;
+    ASTExpr *value;
+
+    Symbol *symbol; // The channel, filled during resolution
+} ASTSendStmt;
+
+// 'receive e from inbox { ... } else { ... }'. Takes the oldest message if
+// there is one and runs the first block with 'e' owning it; runs the second,
+// which may be left out, if the channel was empty. Never waits.
+typedef struct {
+    StringRef name;
+    StringRef channel;
+    struct ASTStmt *then_block;
+    struct ASTStmt *else_block;
+
+    Symbol *symbol;         // 'e', filled during resolution
+    Symbol *channel_symbol; // The channel, likewise
+} ASTReceiveStmt;
+
 typedef struct ASTStmt {
     StmtKind kind;
 
@@ -150,6 +209,10 @@ typedef struct ASTStmt {
         ASTJumpStmt jump;
         ASTBlockStmt block;
         ASTReturnStmt ret;
+        ASTYieldStmt yield;
+        ASTChannelDecl channel_decl;
+        ASTSendStmt send;
+        ASTReceiveStmt receive;
     };
 
     Span span; // Source position, for diagnostics
@@ -167,5 +230,10 @@ ASTStmt *ast_for_stmt_create(Span span, ASTStmt *init, ASTExpr *condition, ASTSt
 ASTStmt *ast_jump_stmt_create(Span span, bool is_break);
 ASTStmt *ast_block_stmt_create(Span span, ASTStmtList list);
 ASTStmt *ast_return_stmt_create(Span span, ASTExpr *result);
+ASTStmt *ast_yield_stmt_create(Span span, ASTExpr *value);
+ASTStmt *ast_channel_decl_stmt_create(Span span, StringRef name, TypeSpec *type_spec);
+ASTStmt *ast_send_stmt_create(Span span, StringRef channel, ASTExpr *value);
+ASTStmt *ast_receive_stmt_create(Span span, StringRef name, StringRef channel, ASTStmt *then_block,
+                                 ASTStmt *else_block);
 
 #endif
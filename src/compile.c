@@ -10,11 +10,21 @@
 #include "vm/codegen.h"
 #include "vm/interp.h"
 #include "vm/link.h"
+#include "vm/unit_cache.h"
 #include "vm/vm.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // Whether 'module' imports 'other', directly. One hop is enough: a cycle is
 // refused as it forms, so no chain of imports can already contain one.
@@ -69,76 +79,372 @@ static bool check_imports(VM *vm, const ASTScript *script, Diagnostics *diagnost
     return ok;
 }
 
-bool compile_unit(VM *vm, const char *source, FuncPrototype *out, Diagnostics *diagnostics) {
-    // Reclaimed at the start of a compile rather than the end of one, so
-    // everything a compile produced — diagnostics included — stays readable
-    // until the next compile begins.
-    arena_reset(vm->env.compile_arena);
+// One unit on its way through the pipeline, held apart from the VM so that
+// several can be on their way at once. Each stage below takes one of these and
+// leaves what the next stage needs on it.
+typedef struct {
+    // 'source_length' bytes, not necessarily terminated.
+    const char *source;
+    size_t source_length;
 
-    Lexer lexer = lexer_create(source, vm->env.compile_arena, &vm->env.strings, diagnostics);
-    Parser parser = parser_create(&lexer, diagnostics);
-    ASTScript *script = ast_script_create();
+    // The file 'source' is mapped from, if it is. The module adopts it once
+    // the unit links, as it does 'keep'; a unit that does not unmaps it.
+    SourceMapping mapping;
 
-    // Each stage is a precondition for the next: a failure must stop the
-    // pipeline rather than let a malformed AST reach codegen.
-    Unit *unit = NULL;
-    String *module_name = NULL;
-    Scope *target = NULL;
-    Scope *staging = NULL;
+    // The allocation the link packed the unit's code into (see Unit::code),
+    // which the module adopts alongside 'keep'.
+    void *code;
+
+    // What dies with the compile -- the AST, the scopes of blocks, the
+    // diagnostics -- and what outlives it: everything the unit declares, and
+    // the code generated for it. For a lone compile these are the VM's compile
+    // arena and one of the unit's own; for a batch, both are the unit's own.
+    // The module the unit fills adopts 'keep' once the unit links.
+    Arena *arena;
+    Arena *keep;
+
+    // Whose the strings the compile is first to intern are, for a lone
+    // compile; NULL for one whose strings are the pool's own. See
+    // StringOwner.
+    StringOwner *owner;
+
+    Diagnostics *diagnostics;
+
+    ASTScript *script;
+    String *module_name;
+    Scope *target;
+    Scope *staging;
+
+    // The modules the unit imports, interned as it parses: a batch orders its
+    // units by them, and the edges are recorded only once the unit has linked,
+    // long after the AST they were spelled in has gone.
+    StringList imported;
+
+    // Whether the unit's function bodies wait to be compiled until reached,
+    // as the VM said when the compile began. See DeferredBody.
+    bool defer_bodies;
+
+    // For a unit being written to a cache, where the parser records each
+    // body's span. See unit_cache.h.
+    ParserBodySpanList *record_spans;
+
+    // Set when the unit's bodies come from elsewhere -- a unit cache, a VM
+    // image -- rather than from compiling them: every one is deferred and
+    // none kept for later, and each the known spans cover is jumped over
+    // without being lexed.
+    bool bodies_supplied;
+    const ParserBodySpan *known_spans;
+    size_t known_count;
+
+    // Whether 'source' already lives as long as what the unit declares, so
+    // recording the unit as loaded need not copy it again.
+    bool source_kept;
+
+    Unit *unit;
+
+    // Whether the unit linked, which decides who 'keep' goes to.
+    bool linked;
+
+    // Whether the module the unit declares into is one its compile created,
+    // which a compile that fails takes back with it.
+    bool created_module;
+} UnitCompile;
+
+static void unit_compile_init(UnitCompile *compile, const char *source, size_t length, Arena *arena,
+                              Arena *keep, Diagnostics *diagnostics, bool defer_bodies) {
+    *compile = (UnitCompile){
+        .source = source,
+        .source_length = length,
+        .arena = arena,
+        .keep = keep,
+        .diagnostics = diagnostics,
+        .defer_bodies = defer_bodies,
+        .script = ast_script_create(),
+        .imported = string_list_create(),
+    };
+}
+
+// Whatever the compile still holds, linked or not.
+static void unit_compile_free(UnitCompile *compile) {
+    if (compile->script) {
+        ast_script_destroy(compile->script);
+    }
+
+    if (compile->unit) {
+        unit_free(compile->unit);
+    }
+
+    string_list_free(&compile->imported);
+}
+
+// The block size of a lone compile's own arena. Most units are a few
+// declarations, which one block holds.
+#define COMPILE_LONE_ARENA_BLOCK 2048
+
+static bool compile_arena_owns(const Type *type, void *ctx) { return arena_owns(ctx, type); }
+
+// Undoes what a compile that did not link left in the VM, so that a host
+// loading a unit that keeps failing -- an editor's, as it is typed -- does not
+// grow with each attempt. What the unit declared is all in 'keep', which goes
+// whole, once what points into it from outside is gone: the '*T' interned on
+// its types, the module it created if no other unit has filled it since, and
+// the strings it was first to ask for.
+static void compile_rollback(VM *vm, UnitCompile *compile) {
+    Environment *env = &vm->env;
 
-    // Interned before the AST goes, since the edges are recorded only once the
-    // unit has linked and the StringRefs point into the source by then.
-    StringList imported = string_list_create();
+    // Only a unit that declared a type can have had a '*T' interned on one,
+    // so most failures skip the walk of the registry.
+    if (compile->staging && compile->staging->types->size > 0) {
+        type_registry_forget(env->global_scope.type_registry, compile_arena_owns, compile->keep);
+    }
+
+    if (compile->created_module) {
+        Module *module = environment_module(env, compile->module_name);
+
+        // Its own arena alone: no unit has linked into it.
+        if (module && module->arenas.size == 1) {
+            environment_module_drop(env, compile->module_name);
+        }
+    }
+
+    if (compile->owner) {
+        string_pool_withdraw(&env->strings, compile->owner);
+    }
 
-    if (parser_parse(&parser, script) && check_imports(vm, script, diagnostics)) {
-        module_name = string_from_ref(&vm->env.strings, script->module_name);
-        target = environment_module_scope(&vm->env, module_name);
+    arena_destroy(compile->keep);
+}
 
-        // Declared into a scope of its own, merged into the target only once the
-        // whole compile has succeeded: a name is declared once and never
-        // replaced, so a compile that fails partway must leave nothing behind
-        // for the retry to collide with.
-        //
-        // Allocated from the target's arena rather than the compile arena, since
-        // what a unit declares outlives the compile that declared it. Only the
-        // staging scope's own struct is short-lived.
-        staging = arena_alloc(vm->env.compile_arena, sizeof(Scope));
-        scope_init_staging(staging, target->arena, &vm->env.strings, target);
+// Where 'keep' goes once the compile is over, and the source's mapping and the
+// packed code with it: to the module the unit linked into, or else back. See
+// compile_rollback.
+static void compile_settle_keep(VM *vm, UnitCompile *compile) {
+    if (compile->linked) {
+        environment_module_adopt(&vm->env, compile->module_name, compile->keep);
 
-        for (size_t i = 0; i < script->imports.size; i++) {
-            string_list_add(&imported, string_from_ref(&vm->env.strings, script->imports.data[i].name));
+        if (compile->mapping.data) {
+            environment_module_adopt_source(&vm->env, compile->module_name, compile->mapping);
         }
 
-        if (ast_script_resolve(vm->env.compile_arena, script, staging, vm->env.module_scopes, diagnostics)) {
-            unit = codegen_generate(script, vm->env.arena, &vm->env.strings, diagnostics);
+        if (compile->code) {
+            environment_module_adopt_code(&vm->env, compile->module_name, compile->code);
         }
+    } else {
+        compile_rollback(vm, compile);
+        source_mapping_free(compile->mapping);
     }
+}
 
-    // Nothing reads the AST once codegen has run, so the compile owns it end to
-    // end and only the unit outlives this call.
-    ast_script_destroy(script);
+// A compile of one unit on the VM's thread, which nothing else is interning
+// alongside: everything it declares goes in an arena of its own, and every
+// string it is first to ask for is its own too.
+static void compile_lone_init(VM *vm, UnitCompile *compile, const char *source, size_t length,
+                              Diagnostics *diagnostics, bool defer_bodies) {
+    Arena *keep = arena_create(COMPILE_LONE_ARENA_BLOCK);
 
-    if (!unit) {
+    unit_compile_init(compile, source, length, vm->env.compile_arena, keep, diagnostics, defer_bodies);
+
+    compile->owner = arena_alloc(keep, sizeof(StringOwner));
+    *compile->owner = (StringOwner){0};
+    vm->env.strings.owner = compile->owner;
+}
+
+static void compile_lone_free(VM *vm, UnitCompile *compile) {
+    vm->env.strings.owner = NULL;
+
+    // The unit first: freeing it reads the prototypes it made from 'keep'.
+    unit_compile_free(compile);
+    compile_settle_keep(vm, compile);
+}
+
+// The module scope the unit declares into, once its module is known. The
+// strings a lone compile interned so far, the module's own name among them,
+// join the module's as of now: another unit of the module asking for one
+// later does not make it shared.
+static void compile_target(VM *vm, UnitCompile *compile) {
+    compile->created_module = !environment_module(&vm->env, compile->module_name);
+    compile->target = environment_module_scope(&vm->env, compile->module_name);
+
+    if (compile->owner) {
+        compile->owner->joined = &environment_module(&vm->env, compile->module_name)->strings;
+    }
+}
+
+// Terminated, whether or not 'text' was.
+static char *compile_copy_len(Arena *arena, const char *text, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+static char *compile_copy(Arena *arena, const char *text) {
+    return compile_copy_len(arena, text, strlen(text));
+}
+
+static bool compile_parse(VM *vm, UnitCompile *compile) {
+    // A deferred body is parsed again when it is reached, long after the
+    // caller's string is gone, so the unit is parsed from a copy that lives as
+    // long as what it declares. Its imports' names point into it too.
+    if (compile->defer_bodies && !compile->source_kept) {
+        compile->source = compile_copy_len(compile->keep, compile->source, compile->source_length);
+        compile->source_kept = true;
+    }
+
+    Lexer lexer = lexer_create_len(compile->source, compile->source_length, compile->arena, &vm->env.strings,
+                                   compile->diagnostics);
+    Parser parser = parser_create(&lexer, compile->diagnostics);
+    parser.defer_bodies = compile->defer_bodies;
+    parser.record_spans = compile->record_spans;
+
+    if (compile->bodies_supplied) {
+        parser.defer_bodies = true;
+        parser.known_spans = compile->known_spans;
+        parser.known_count = compile->known_count;
+    }
+
+    if (!parser_parse(&parser, compile->script)) {
         return false;
     }
 
-    if (!link_check(&vm->program, unit, diagnostics)) {
-        unit_free(unit);
+    compile->module_name = string_from_ref(&vm->env.strings, compile->script->module_name);
+
+    for (size_t i = 0; i < compile->script->imports.size; i++) {
+        StringRef name = compile->script->imports.data[i].name;
+
+        string_list_add(&compile->imported, string_from_ref(&vm->env.strings, name));
+    }
+
+    return true;
+}
+
+// ---- Deferred bodies ----
+
+// What every deferred body of one unit resolves against, kept from the
+// compile that deferred them. Allocated, with the bodies, from the arena the
+// unit's declarations live in.
+struct DeferredUnit {
+    const char *source;
+    size_t source_length;
+
+    Scope *scope;
+    String *module_name;
+    ASTImportList imports;
+
+    // Where a body's code and whatever else its compile must keep go, and
+    // whose the strings it is first to intern are.
+    Arena *keep;
+    StringOwner *owner;
+};
+
+static void compile_defer_unit(UnitCompile *compile) {
+    ASTScript *script = compile->script;
+    DeferredUnit *deferred = arena_alloc(compile->keep, sizeof(DeferredUnit));
+
+    // The list's array is the arena's, so it is never freed as a list.
+    ASTImport *imports = arena_alloc(compile->keep, (script->imports.size + 1) * sizeof(ASTImport));
+    // A unit importing nothing has no array to copy from.
+    if (script->imports.size) {
+        memcpy(imports, script->imports.data, script->imports.size * sizeof(ASTImport));
+    }
+
+    *deferred = (DeferredUnit){
+        .source = compile->source,
+        .source_length = compile->source_length,
+        .scope = compile->target,
+        .module_name = compile->module_name,
+        .imports = {.data = imports, .size = script->imports.size, .capacity = script->imports.size},
+        .keep = compile->keep,
+        .owner = compile->owner,
+    };
+
+    for (size_t i = 0; i < compile->unit->prototypes.size; i++) {
+        DeferredBody *body = compile->unit->prototypes.data[i]->deferred;
+
+        if (body) {
+            body->unit = deferred;
+        }
+    }
+}
+
+// Resolves and generates code for a parsed unit whose imports were checked and
+// whose module scope exists. Reads the environment and writes nothing of it
+// but through interning, so units that import nothing of each other's may do
+// this at once.
+static bool compile_generate(VM *vm, UnitCompile *compile) {
+    ASTScript *script = compile->script;
+
+    // Declared into a scope of its own, merged into the target only once the
+    // whole compile has succeeded: a name is declared once and never replaced,
+    // so a compile that fails partway must leave nothing behind for the retry
+    // to collide with.
+    //
+    // Allocated from the arena that outlives the compile, since what a unit
+    // declares outlives the compile that declared it. Only the staging scope's
+    // own struct is short-lived.
+    compile->staging = arena_alloc(compile->arena, sizeof(Scope));
+    scope_init_staging(compile->staging, compile->keep, &vm->env.strings, compile->target);
+
+    if (ast_script_resolve(compile->arena, script, compile->staging, vm->env.module_scopes,
+                           compile->diagnostics)) {
+        compile->unit = codegen_generate(script, compile->keep, &vm->env.strings, compile->diagnostics);
+    }
+
+    if (compile->unit && compile->unit->deferred_count > 0 && !compile->bodies_supplied) {
+        compile_defer_unit(compile);
+    }
+
+    // Nothing reads the AST once codegen has run, so only the unit outlives
+    // this stage.
+    ast_script_destroy(script);
+    compile->script = NULL;
+
+    return compile->unit != NULL;
+}
+
+static bool compile_link(VM *vm, UnitCompile *compile, FuncPrototype *out) {
+    Unit *unit = compile->unit;
+
+    if (!link_check(&vm->program, unit, compile->diagnostics)) {
         return false;
     }
 
     // Both installs, once neither can refuse.
     link_install(&vm->program, unit);
-    scope_merge_staged(target, staging);
+    scope_merge_staged(compile->target, compile->staging);
+    compile->linked = true;
+
+    // The module's once the compile settles: its prototypes run from it.
+    compile->code = unit->code;
+    unit->code = NULL;
 
     // Recorded only now: an edge from a unit that did not load would refuse an
     // import that should be allowed.
-    for (size_t i = 0; i < imported.size; i++) {
+    for (size_t i = 0; i < compile->imported.size; i++) {
         module_import_list_add(&vm->env.module_imports,
-                               (ModuleImport){.from = module_name, .to = imported.data[i]});
+                               (ModuleImport){.from = compile->module_name, .to = compile->imported.data[i]});
     }
 
-    string_list_free(&imported);
+    const char *name = compile->diagnostics->module ? compile->diagnostics->module : "<script>";
+
+    // A copy of the source only if the host asked for one: it costs as much as
+    // the source again, for as long as the module lives. A unit that keeps one
+    // anyway -- a lazy one, a mapped file -- costs nothing more to record.
+    const char *source = NULL;
+
+    if (compile->source_kept) {
+        source = compile->source;
+    } else if (vm->env.keep_sources) {
+        source = compile_copy_len(compile->keep, compile->source, compile->source_length);
+    }
+
+    loaded_unit_list_add(&vm->env.loaded_units,
+                         (LoadedUnit){
+                             .module = compile->module_name,
+                             .name = compile_copy(compile->keep, name),
+                             .source = source,
+                             .source_length = source ? compile->source_length : 0,
+                         });
 
     // Linking took the prototypes and types; what is left is the top-level
     // frame, which belongs to the caller.
@@ -149,7 +455,1374 @@ bool compile_unit(VM *vm, const char *source, FuncPrototype *out, Diagnostics *d
     unit->top_level.refs = frame_ref_list_create();
     unit->prototypes.size = 0;
 
-    unit_free(unit);
+    return true;
+}
+
+// Every stage of a lone compile begun by compile_lone_init, and its end.
+static bool compile_lone_run(VM *vm, UnitCompile *compile, FuncPrototype *out) {
+    // Each stage is a precondition for the next: a failure must stop the
+    // pipeline rather than let a malformed AST reach codegen.
+    bool ok = compile_parse(vm, compile) && check_imports(vm, compile->script, compile->diagnostics);
+
+    if (ok) {
+        compile_target(vm, compile);
+        ok = compile_generate(vm, compile) && compile_link(vm, compile, out);
+    }
+
+    compile_lone_free(vm, compile);
+
+    return ok;
+}
+
+bool compile_unit(VM *vm, const char *source, FuncPrototype *out, Diagnostics *diagnostics) {
+    return compile_unit_len(vm, source, strlen(source), out, diagnostics);
+}
+
+bool compile_unit_len(VM *vm, const char *source, size_t length, FuncPrototype *out,
+                      Diagnostics *diagnostics) {
+    // Reclaimed at the start of a compile rather than the end of one, so
+    // everything a compile produced — diagnostics included — stays readable
+    // until the next compile begins.
+    arena_reset(vm->env.compile_arena);
+
+    UnitCompile compile;
+    compile_lone_init(vm, &compile, source, length, diagnostics, vm->env.defer_bodies);
+
+    return compile_lone_run(vm, &compile, out);
+}
+
+// ---- Source files ----
+
+// Private and read-only, so the unit is lexed from the file's own pages. The
+// lexer stops at the length, so the end of the file need not be followed by
+// anything.
+static bool compile_map_file(const char *path, SourceMapping *mapping, Diagnostics *diagnostics) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "could not open '%s'", path);
+        return false;
+    }
+
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0;
+
+    // A position in the source is an int wherever it is kept.
+    if (ok && info.st_size > INT_MAX) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "'%s' is too large to load", path);
+        close(fd);
+
+        return false;
+    }
+
+    *mapping = (SourceMapping){0};
+
+    // An empty file cannot be mapped, and needs no mapping to be read.
+    if (ok && info.st_size > 0) {
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        ok = data != MAP_FAILED;
+        *mapping = (SourceMapping){.data = ok ? data : NULL, .size = ok ? (size_t)info.st_size : 0};
+    }
+
+    // The mapping holds the file open itself.
+    close(fd);
+
+    if (!ok) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "could not map '%s'", path);
+    }
+
+    return ok;
+}
+
+bool compile_unit_file(VM *vm, const char *path, FuncPrototype *out, Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    SourceMapping mapping;
+
+    if (!compile_map_file(path, &mapping, diagnostics)) {
+        return false;
+    }
+
+    UnitCompile compile;
+    compile_lone_init(vm, &compile, mapping.data ? mapping.data : "", mapping.size, diagnostics,
+                      vm->env.defer_bodies);
+
+    // Kept as the unit's source, in place of the copy of it a unit keeps: the
+    // mapping lives as long as the module does.
+    compile.mapping = mapping;
+    compile.source_kept = true;
+
+    return compile_lone_run(vm, &compile, out);
+}
+
+// ---- Unit caches ----
+
+bool compile_unit_save(VM *vm, const char *source, FuncPrototype *out, void **data, size_t *size,
+                       Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    // Eager whatever the VM defers: a cache holds every body compiled, so
+    // every body is compiled to write it.
+    UnitCompile compile;
+    compile_lone_init(vm, &compile, source, strlen(source), diagnostics, false);
+
+    ParserBodySpanList spans = parser_body_span_list_create();
+    compile.record_spans = &spans;
+
+    UnitCacheBuffer buffer = {0};
+    bool ok = compile_parse(vm, &compile) && check_imports(vm, compile.script, diagnostics);
+
+    if (ok) {
+        compile_target(vm, &compile);
+        ok = compile_generate(vm, &compile);
+    }
+
+    // Written between codegen and the link, while every operand is still the
+    // unit's own numbering and the modules are as they were before the unit.
+    if (ok && !unit_cache_write(&vm->env, compile.unit, compile.staging, compile.target, compile.module_name,
+                                &compile.imported, &spans, unit_cache_hash_source(source), &buffer)) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "the unit cache could not be written");
+        ok = false;
+    }
+
+    ok = ok && compile_link(vm, &compile, out);
+
+    if (ok) {
+        *data = buffer.data;
+        *size = buffer.size;
+    } else {
+        free(buffer.data);
+    }
+
+    parser_body_span_list_free(&spans);
+    compile_lone_free(vm, &compile);
+
+    return ok;
+}
+
+bool compile_unit_cached(VM *vm, const char *source, const void *data, size_t size, FuncPrototype *out,
+                         Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    // Refused before anything is parsed, so a stale cache declares nothing and
+    // costs nothing but the hash.
+    UnitCache cache;
+    if (!unit_cache_open(&cache, vm->env.compile_arena, data, size, unit_cache_hash_source(source),
+                         diagnostics)) {
+        return false;
+    }
+
+    UnitCompile compile;
+    compile_lone_init(vm, &compile, source, strlen(source), diagnostics, false);
+    compile.bodies_supplied = true;
+    compile.known_spans = cache.spans;
+    compile.known_count = cache.body_count;
+
+    bool ok = compile_parse(vm, &compile) && check_imports(vm, compile.script, diagnostics);
+
+    if (ok) {
+        compile_target(vm, &compile);
+        ok = compile_generate(vm, &compile);
+    }
+
+    // Checked once the unit has declared, as the cache's fingerprints were
+    // taken: a method the unit adds to a struct it imports is then part of
+    // that struct on both sides.
+    ok = ok && unit_cache_current(&cache, &vm->env, compile.target, diagnostics) &&
+         unit_cache_fill(&cache, &vm->env, compile.unit, compile.staging, compile.module_name, diagnostics) &&
+         compile_link(vm, &compile, out);
+
+    compile_lone_free(vm, &compile);
+
+    return ok;
+}
+
+bool compile_unit_stubs(VM *vm, const char *source, FuncPrototype *out, Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    // The source is the image's, mapped for as long as the VM lives.
+    UnitCompile compile;
+    compile_lone_init(vm, &compile, source, strlen(source), diagnostics, false);
+    compile.bodies_supplied = true;
+    compile.source_kept = true;
+
+    bool ok = compile_parse(vm, &compile) && check_imports(vm, compile.script, diagnostics);
+
+    if (ok) {
+        compile_target(vm, &compile);
+        ok = compile_generate(vm, &compile) && compile_link(vm, &compile, out);
+    }
+
+    compile_lone_free(vm, &compile);
+
+    return ok;
+}
+
+// ---- Batches ----
+
+// A batch unit's arenas start small: most units are a few declarations, and
+// four hundred of them each holding a large first block would be most of what
+// the batch allocated.
+#define COMPILE_BATCH_ARENA_BLOCK 1024
+
+// Enough threads for any machine a batch is likely to meet; past this, more
+// would only wait on interning.
+#define COMPILE_MAX_THREADS 32
+
+typedef struct {
+    VM *vm;
+    UnitCompile *compiles;
+    bool *ok;
+
+    // Which of the batch's units this round runs, and how far through them
+    // the threads have claimed.
+    const size_t *members;
+    size_t count;
+    atomic_size_t next;
+
+    bool (*stage)(VM *vm, UnitCompile *compile);
+} CompileRound;
+
+static void *compile_round_worker(void *arg) {
+    CompileRound *round = arg;
+
+    for (;;) {
+        size_t claimed = atomic_fetch_add(&round->next, 1);
+
+        if (claimed >= round->count) {
+            return NULL;
+        }
+
+        size_t unit = round->members[claimed];
+        round->ok[unit] = round->stage(round->vm, &round->compiles[unit]);
+    }
+}
+
+// Runs 'stage' over the round's units on as many threads as there are cores,
+// the calling one among them, and returns once every unit has been through it.
+// A thread that could not be started only leaves more for the rest.
+static void compile_round_run(CompileRound *round) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t helpers = cores > 1 ? (size_t)cores - 1 : 0;
+
+    if (helpers > round->count - 1) {
+        helpers = round->count - 1;
+    }
+
+    if (helpers > COMPILE_MAX_THREADS) {
+        helpers = COMPILE_MAX_THREADS;
+    }
+
+    pthread_t threads[COMPILE_MAX_THREADS];
+    size_t started = 0;
+
+    environment_share_interning(&round->vm->env, true);
+
+    for (size_t i = 0; i < helpers; i++) {
+        if (pthread_create(&threads[started], NULL, compile_round_worker, round) == 0) {
+            started++;
+        }
+    }
+
+    compile_round_worker(round);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    environment_share_interning(&round->vm->env, false);
+}
+
+// Which round each unit compiles in. A unit waits for every unit of the batch
+// declaring a module it imports, and for the units before it declaring into
+// its own module -- two units filling one module in the same round would each
+// miss what the other declared. Everything else may compile together.
+//
+// The longest chain of waiting, found by relaxing until nothing moves. A unit
+// still moving after as many passes as there are units is waiting on itself:
+// the batch's imports form a cycle, and it is the unit reported.
+static bool compile_batch_rounds(const UnitCompile *compiles, size_t count, size_t *rounds, size_t *cyclic) {
+    for (size_t i = 0; i < count; i++) {
+        rounds[i] = 0;
+    }
+
+    for (size_t pass = 0; pass <= count; pass++) {
+        bool moved = false;
+
+        for (size_t unit = 0; unit < count; unit++) {
+            const UnitCompile *waiting = &compiles[unit];
+
+            for (size_t other = 0; other < count; other++) {
+                const String *declares = compiles[other].module_name;
+                bool after = false;
+
+                if (declares == waiting->module_name) {
+                    after = other < unit;
+                } else {
+                    for (size_t i = 0; i < waiting->imported.size && !after; i++) {
+                        after = waiting->imported.data[i] == declares;
+                    }
+                }
+
+                if (after && rounds[unit] <= rounds[other]) {
+                    rounds[unit] = rounds[other] + 1;
+                    moved = true;
+                }
+            }
+        }
+
+        if (!moved) {
+            return true;
+        }
+    }
+
+    for (size_t unit = 0; unit < count; unit++) {
+        if (rounds[unit] >= count) {
+            *cyclic = unit;
+            return false;
+        }
+    }
+
+    *cyclic = 0;
+
+    return false;
+}
+
+// Copies a unit's first error into the caller's sink, whose arena outlives
+// the unit's own.
+static void compile_batch_report(const UnitCompile *compile, Diagnostics *diagnostics) {
+    for (size_t i = 0; i < diagnostics_count(compile->diagnostics); i++) {
+        const Diagnostic *diag = diagnostics_get(compile->diagnostics, i);
+
+        diag_error(diagnostics, diag->kind, diag->span, "%s", diag->message);
+        return;
+    }
+
+    diag_error(diagnostics, GAB_ERR_SYNTAX, (Span){0}, "compilation failed");
+}
+
+bool compile_batch(VM *vm, const CompileSource *sources, size_t count, FuncPrototype *top_levels,
+                   size_t *order, size_t *linked, size_t *failed, Diagnostics *diagnostics) {
+    *linked = 0;
+    *failed = 0;
+
+    if (count == 0) {
+        return true;
+    }
+
+    UnitCompile *compiles = calloc(count, sizeof(UnitCompile));
+    Diagnostics *sinks = calloc(count, sizeof(Diagnostics));
+    bool *ok = calloc(count, sizeof(bool));
+    size_t *rounds = calloc(count, sizeof(size_t));
+    size_t *members = calloc(count, sizeof(size_t));
+    size_t *generating = calloc(count, sizeof(size_t));
+
+    if (!compiles || !sinks || !ok || !rounds || !members || !generating) {
+        free(compiles);
+        free(sinks);
+        free(ok);
+        free(rounds);
+        free(members);
+        free(generating);
+
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "out of memory");
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Arena *arena = arena_create(COMPILE_BATCH_ARENA_BLOCK);
+
+        diagnostics_init(&sinks[i], arena, sources[i].name);
+        unit_compile_init(&compiles[i], sources[i].source, strlen(sources[i].source), arena,
+                          arena_create(COMPILE_BATCH_ARENA_BLOCK), &sinks[i], vm->env.defer_bodies);
+        members[i] = i;
+    }
+
+    // Parsing needs nothing from any other unit, so every unit parses at once.
+    CompileRound parse = {.vm = vm, .compiles = compiles, .ok = ok, .members = members, .count = count,
+                          .stage = compile_parse};
+    atomic_init(&parse.next, 0);
+    compile_round_run(&parse);
+
+    // Failures are reported as a sequence of loads would have met them: the
+    // first in the batch's order, whichever thread got there first.
+    bool success = true;
+
+    for (size_t i = 0; i < count && success; i++) {
+        if (!ok[i]) {
+            *failed = i;
+            compile_batch_report(&compiles[i], diagnostics);
+            success = false;
+        }
+    }
+
+    size_t cyclic = 0;
+
+    if (success && !compile_batch_rounds(compiles, count, rounds, &cyclic)) {
+        *failed = cyclic;
+        diag_error(diagnostics, GAB_ERR_NAME, compiles[cyclic].script->module_span,
+                   "the units of this batch import each other's modules in a cycle");
+        success = false;
+    }
+
+    for (size_t current = 0; success; current++) {
+        size_t in_round = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (rounds[i] == current) {
+                members[in_round++] = i;
+            }
+        }
+
+        if (in_round == 0) {
+            break;
+        }
+
+        // Checked, and their module scopes created, here on one thread, so
+        // that no compile in the round has to write to the environment.
+        CompileRound generate = {.vm = vm, .compiles = compiles, .ok = ok, .members = generating,
+                                 .stage = compile_generate};
+        atomic_init(&generate.next, 0);
+
+        for (size_t i = 0; i < in_round; i++) {
+            UnitCompile *compile = &compiles[members[i]];
+
+            ok[members[i]] = check_imports(vm, compile->script, compile->diagnostics);
+
+            if (ok[members[i]]) {
+                compile_target(vm, compile);
+                generating[generate.count++] = members[i];
+            }
+        }
+
+        if (generate.count > 0) {
+            compile_round_run(&generate);
+        }
+
+        // Linked in the batch's order within the round, stopping at the first
+        // unit that failed: the units before it stay loaded, as they would
+        // have after the same loads one at a time.
+        for (size_t i = 0; i < in_round; i++) {
+            size_t unit = members[i];
+
+            if (!ok[unit] || !compile_link(vm, &compiles[unit], &top_levels[*linked])) {
+                *failed = unit;
+                compile_batch_report(&compiles[unit], diagnostics);
+                success = false;
+                break;
+            }
+
+            order[*linked] = unit;
+            (*linked)++;
+        }
+    }
+
+    // Every unit's second arena goes to its module, or back if the unit did not
+    // link. See compile_settle_keep.
+    for (size_t i = 0; i < count; i++) {
+        unit_compile_free(&compiles[i]);
+        compile_settle_keep(vm, &compiles[i]);
+        diagnostics_free(&sinks[i]);
+
+        arena_destroy(compiles[i].arena);
+    }
+
+    free(compiles);
+    free(sinks);
+    free(ok);
+    free(rounds);
+    free(members);
+    free(generating);
+
+    return success;
+}
+
+// ---- Loads off the VM's thread ----
+
+struct CompileAsync {
+    VM *vm;
+
+    // The worker's own, so nothing it allocates is shared with the VM thread:
+    // the copy of the source and the name, the AST, the diagnostics -- and in
+    // 'compile.keep', what the unit declares, which the VM keeps once done.
+    Arena *arena;
+    Diagnostics diagnostics;
+    UnitCompile compile;
+
+    // Whether the unit names a module the VM did not have when the load began.
+    // Its scope is the compile's own until the unit links, and only then
+    // registered: a module appearing under the VM thread's feet would be a
+    // write to the map every lookup by name reads.
+    bool creates_module;
+
+    bool ok;
+    bool threaded;
+    pthread_t thread;
+    atomic_bool done;
+};
+
+// The first three stages of compile_unit, against the environment as the load
+// found it. Reads it and writes nothing of it but through interning, which is
+// shared for as long as the load is pending.
+static void *compile_async_worker(void *arg) {
+    CompileAsync *job = arg;
+    VM *vm = job->vm;
+    UnitCompile *compile = &job->compile;
+
+    bool ok = compile_parse(vm, compile) && check_imports(vm, compile->script, compile->diagnostics);
+
+    if (ok) {
+        Scope **existing = module_scope_map_lookup(vm->env.module_scopes, compile->module_name);
+
+        if (existing) {
+            compile->target = *existing;
+        } else {
+            compile->target = arena_alloc(compile->keep, sizeof(Scope));
+            scope_init_module(compile->target, compile->keep, &vm->env.strings, &vm->env.global_scope);
+            job->creates_module = true;
+        }
+
+        ok = compile_generate(vm, compile);
+    }
+
+    job->ok = ok;
+    atomic_store_explicit(&job->done, true, memory_order_release);
+
+    return NULL;
+}
+
+CompileAsync *compile_unit_async(VM *vm, const char *name, const char *source) {
+    CompileAsync *job = calloc(1, sizeof(CompileAsync));
+    if (!job) {
+        return NULL;
+    }
+
+    // Copied, so the host's strings need only last the call.
+    job->vm = vm;
+    job->arena = arena_create(COMPILE_BATCH_ARENA_BLOCK);
+    diagnostics_init(&job->diagnostics, job->arena, compile_copy(job->arena, name));
+    unit_compile_init(&job->compile, compile_copy(job->arena, source), strlen(source), job->arena,
+                      arena_create(COMPILE_BATCH_ARENA_BLOCK), &job->diagnostics, vm->env.defer_bodies);
+    atomic_init(&job->done, false);
+
+    vm->pending_load = job;
+    environment_share_interning(&vm->env, true);
+
+    // A thread that could not be started only means compiling here, now: the
+    // load is as pending as it would have been, and already done.
+    job->threaded = pthread_create(&job->thread, NULL, compile_async_worker, job) == 0;
+
+    if (!job->threaded) {
+        compile_async_worker(job);
+    }
+
+    return job;
+}
+
+bool compile_async_ready(const CompileAsync *job) {
+    return atomic_load_explicit(&job->done, memory_order_acquire);
+}
+
+VM *compile_async_vm(const CompileAsync *job) { return job->vm; }
+
+// Waits for the worker without finishing the load: what the worker reads, the
+// VM thread may then write, though the load is still pending.
+static void compile_async_wait(CompileAsync *job) {
+    if (job->threaded) {
+        pthread_join(job->thread, NULL);
+        job->threaded = false;
+    }
+}
+
+// Waits for the worker, after which the environment is the VM thread's alone
+// again.
+static void compile_async_join(CompileAsync *job) {
+    compile_async_wait(job);
+
+    environment_share_interning(&job->vm->env, false);
+    job->vm->pending_load = NULL;
+}
+
+// As a batch does with its units' arenas. A unit that created its module
+// links with the module's scope in 'keep', which the module then adopts as its
+// first arena.
+static void compile_async_free(CompileAsync *job) {
+    unit_compile_free(&job->compile);
+    compile_settle_keep(job->vm, &job->compile);
+    diagnostics_free(&job->diagnostics);
+
+    arena_destroy(job->arena);
+
+    free(job);
+}
+
+bool compile_async_finish(CompileAsync *job, FuncPrototype *out, Diagnostics *diagnostics) {
+    VM *vm = job->vm;
+    UnitCompile *compile = &job->compile;
+
+    compile_async_join(job);
+
+    bool ok = job->ok && compile_link(vm, compile, out);
+
+    if (ok && job->creates_module) {
+        module_scope_map_insert(vm->env.module_scopes, compile->module_name, compile->target);
+    }
+
+    if (!ok) {
+        compile_batch_report(compile, diagnostics);
+    }
+
+    compile_async_free(job);
+
+    return ok;
+}
+
+void compile_async_discard(CompileAsync *job) {
+    compile_async_join(job);
+    compile_async_free(job);
+}
+
+// ---- Savepoints ----
+
+// What a compile into an arena that outlives it -- a deferred body into its
+// unit's, a reload into its module's -- takes back if it fails: everything it
+// allocated there, and the strings it was first to ask for, which it interns
+// under 'owner' until it is done.
+typedef struct {
+    Arena *arena;
+    ArenaMark mark;
+    StringOwner *owner;
+} CompileSavepoint;
+
+// 'joins' is whose the compile's strings are if it succeeds, or NULL for the
+// pool's own, which are never taken back.
+static CompileSavepoint compile_savepoint(Arena *arena, StringOwner *joins) {
+    CompileSavepoint savepoint = {.arena = arena, .mark = arena_mark(arena)};
+
+    if (joins) {
+        savepoint.owner = arena_alloc(arena, sizeof(StringOwner));
+        *savepoint.owner = (StringOwner){.joined = joins};
+    }
+
+    return savepoint;
+}
+
+// Once whatever the compile made from the arena has been freed: a unit's
+// prototypes are read as they go.
+static void compile_savepoint_rewind(VM *vm, const CompileSavepoint *savepoint) {
+    if (savepoint->owner) {
+        string_pool_withdraw(&vm->env.strings, savepoint->owner);
+    }
+
+    arena_rewind(savepoint->arena, savepoint->mark);
+}
+
+// ---- Deferred bodies, once reached ----
+
+// Kept in the unit's arena, so it is still there for every later call to
+// report.
+static const Diagnostic *compile_deferred_failure(const DeferredBody *body, const Diagnostics *diagnostics) {
+    Arena *arena = body->unit->keep;
+    Diagnostic *failure = arena_alloc(arena, sizeof(Diagnostic));
+
+    if (diagnostics_count(diagnostics) > 0) {
+        *failure = *diagnostics_get(diagnostics, 0);
+        failure->message = compile_copy(arena, failure->message);
+    } else {
+        *failure = (Diagnostic){
+            .kind = GAB_ERR_CODEGEN,
+            .span = {.line = body->line, .column = body->column},
+            .message = "the function's body could not be compiled",
+        };
+    }
+
+    return failure;
+}
+
+const Diagnostic *compile_deferred(VM *vm, FuncPrototype *proto) {
+    DeferredBody *body = proto->deferred;
+
+    if (!body || body->failure) {
+        return body ? body->failure : NULL;
+    }
+
+    // A body declares its locals and interns its types into what a pending
+    // load's worker may be reading, and allocates from an arena the worker may
+    // be allocating from if the unit is its own. Finished first, then; the
+    // load stays pending.
+    if (vm->pending_load) {
+        compile_async_wait(vm->pending_load);
+    }
+
+    const DeferredUnit *unit = body->unit;
+    Arena *scratch = arena_create(COMPILE_BATCH_ARENA_BLOCK);
+
+    // A body may be reached in the middle of anything, a load's top level
+    // included, so whatever owner was set is put back after.
+    StringOwner *owner = vm->env.strings.owner;
+    CompileSavepoint savepoint = compile_savepoint(unit->keep, unit->owner);
+    vm->env.strings.owner = savepoint.owner;
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, scratch, unit->module_name->data);
+
+    // Lexed from where the declaration starts, as if the unit began there, so
+    // every token is where it was the first time and every error is too.
+    Lexer lexer =
+        lexer_create_len(unit->source, unit->source_length, scratch, &vm->env.strings, &diagnostics);
+    lexer.pos = (int)body->offset;
+    lexer.line = body->line;
+    lexer.column = body->column;
+
+    Parser parser = parser_create(&lexer, &diagnostics);
+    ASTStmt *decl = parser_parse_func_decl(&parser);
+
+    // Against the module as it is now rather than as it was when the unit
+    // loaded: what the unit declared is all still there, and a later unit
+    // filling the same module can only have added to it.
+    //
+    // The parser recovers from a mistake to find the next, so a declaration
+    // coming back is not by itself a parse that succeeded.
+    Unit *generated = NULL;
+
+    if (decl && !diagnostics_has_errors(&diagnostics) &&
+        ast_resolve_deferred(scratch, decl, body->symbol, unit->scope, vm->env.module_scopes, &unit->imports,
+                             unit->module_name, &diagnostics)) {
+        generated = codegen_generate_deferred(decl, unit->keep, &vm->env.strings, &diagnostics);
+    }
+
+    if (decl) {
+        ast_stmt_destroy(decl);
+    }
+
+    bool ok = generated && link_check(&vm->program, generated, &diagnostics);
+
+    if (ok) {
+        link_install(&vm->program, generated);
+
+        // Into the prototype every caller's operand already names, so nothing
+        // compiled against the stub has to change.
+        frame_ref_list_free(&proto->refs);
+        proto->chunk = generated->top_level.chunk;
+        proto->max_registers = generated->top_level.max_registers;
+        proto->refs = generated->top_level.refs;
+        proto->deferred = NULL;
+
+        generated->top_level.chunk = NULL;
+        generated->top_level.refs = frame_ref_list_create();
+    }
+
+    vm->env.strings.owner = owner;
+    unit_free(generated);
+
+    // A body that fails is never compiled again, so what it left would stay
+    // as long as its module; only the failure is kept.
+    if (!ok) {
+        compile_savepoint_rewind(vm, &savepoint);
+        body->failure = compile_deferred_failure(body, &diagnostics);
+    }
+
+    vm->program.deferred_pending--;
+    diagnostics_free(&diagnostics);
+    arena_destroy(scratch);
+
+    return body->failure;
+}
+
+const Diagnostic *compile_deferred_all(VM *vm) {
+    const Diagnostic *first = NULL;
+
+    // Every body is tried, not only those up to the first that fails: what is
+    // left deferred afterwards is only what cannot compile. One that failed
+    // before answers with its failure and is not compiled again.
+    for (size_t i = 0; i < vm->program.prototypes.size; i++) {
+        FuncPrototype *proto = vm->program.prototypes.data[i];
+
+        if (proto && proto->deferred) {
+            const Diagnostic *failure = compile_deferred(vm, proto);
+
+            if (!first) {
+                first = failure;
+            }
+        }
+    }
+
+    return first;
+}
+
+// ---- Reloading ----
+
+// One side of a reload: a unit's source parsed for its declarations, every
+// body skipped over and where it lay recorded.
+typedef struct {
+    const char *source;
+    size_t length;
+    ASTScript *script;
+    ParserBodySpanList spans;
+} ReloadSource;
+
+static bool reload_parse(VM *vm, ReloadSource *side, const char *source, size_t length,
+                         Diagnostics *diagnostics) {
+    *side = (ReloadSource){
+        .source = source,
+        .length = length,
+        .script = ast_script_create(),
+        .spans = parser_body_span_list_create(),
+    };
+
+    Lexer lexer = lexer_create_len(source, length, vm->env.compile_arena, &vm->env.strings, diagnostics);
+    Parser parser = parser_create(&lexer, diagnostics);
+    parser.defer_bodies = true;
+    parser.record_spans = &side->spans;
+
+    return parser_parse(&parser, side->script);
+}
+
+static void reload_source_free(ReloadSource *side) {
+    if (side->script) {
+        ast_script_destroy(side->script);
+    }
+
+    parser_body_span_list_free(&side->spans);
+}
+
+static bool reload_is_decl(const ASTStmt *stmt) {
+    return stmt->kind == STMT_FUNC_DECL || stmt->kind == STMT_STRUCT_DECL || stmt->kind == STMT_CHANNEL_DECL;
+}
+
+static StringRef reload_decl_name(const ASTStmt *stmt) {
+    switch (stmt->kind) {
+    case STMT_FUNC_DECL:
+        return stmt->func_decl.name;
+    case STMT_STRUCT_DECL:
+        return stmt->struct_decl.name;
+    default:
+        return stmt->channel_decl.name;
+    }
+}
+
+// Whether two declarations are of one thing: the same kind under the same
+// name, on the same receiver for a method.
+static bool reload_same_name(const ASTStmt *a, const ASTStmt *b) {
+    if (a->kind != b->kind || !string_ref_equals_ref(reload_decl_name(a), reload_decl_name(b))) {
+        return false;
+    }
+
+    if (a->kind != STMT_FUNC_DECL) {
+        return true;
+    }
+
+    const ASTField *ra = a->func_decl.receiver;
+    const ASTField *rb = b->func_decl.receiver;
+
+    return ra && rb ? string_ref_equals_ref(ra->type_spec->name, rb->type_spec->name) : ra == rb;
+}
+
+// Compared as written rather than as resolved: both sides name types in the
+// same environment, so equal spellings are equal types.
+static bool reload_same_spec(const TypeSpec *a, const TypeSpec *b) {
+    if (!a || !b) {
+        return a == b;
+    }
+
+    return a->pointer_depth == b->pointer_depth && a->is_ref == b->is_ref &&
+           string_ref_equals_ref(a->name, b->name);
+}
+
+// Fields compare by name too; parameters by type alone, since a parameter's
+// name is the body's business and nothing a caller was compiled against.
+static bool reload_same_fields(const ASTFieldList *a, const ASTFieldList *b, bool names) {
+    if (a->size != b->size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->size; i++) {
+        if (!reload_same_spec(a->data[i]->type_spec, b->data[i]->type_spec) ||
+            (names && !string_ref_equals_ref(a->data[i]->name, b->data[i]->name))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool reload_is_extern(const ASTStmt *stmt) {
+    return !stmt->func_decl.body && !stmt->func_decl.deferred;
+}
+
+// Whether two declarations of one thing declare it alike: every signature a
+// call was compiled against, every layout an allocation or a field access
+// was, and every channel's element.
+static bool reload_same_decl(const ASTStmt *a, const ASTStmt *b) {
+    switch (a->kind) {
+    case STMT_FUNC_DECL: {
+        const ASTField *ra = a->func_decl.receiver;
+        const ASTField *rb = b->func_decl.receiver;
+
+        return (ra ? reload_same_spec(ra->type_spec, rb->type_spec) : true) &&
+               reload_same_spec(a->func_decl.return_type, b->func_decl.return_type) &&
+               reload_same_fields(&a->func_decl.params, &b->func_decl.params, false) &&
+               reload_is_extern(a) == reload_is_extern(b) && a->func_decl.is_pure == b->func_decl.is_pure;
+    }
+    case STMT_STRUCT_DECL:
+        return reload_same_fields(&a->struct_decl.fields, &b->struct_decl.fields, true);
+    default:
+        return reload_same_spec(a->channel_decl.type_spec, b->channel_decl.type_spec);
+    }
+}
+
+static const ASTStmt *reload_find_decl(const ASTScript *script, const ASTStmt *decl) {
+    for (size_t i = 0; i < script->statements.size; i++) {
+        const ASTStmt *stmt = script->statements.data[i];
+
+        if (reload_is_decl(stmt) && reload_same_name(stmt, decl)) {
+            return stmt;
+        }
+    }
+
+    return NULL;
+}
+
+// Whether the new source declares exactly what the loaded one did, each thing
+// alike. Every mismatch is reported, so one reload shows every edit a reload
+// cannot make.
+static bool reload_check_decls(const ASTScript *loaded, const ASTScript *edited, Diagnostics *diagnostics) {
+    if (!string_ref_equals_ref(loaded->module_name, edited->module_name)) {
+        diag_error(diagnostics, GAB_ERR_NAME, edited->module_span, "the unit was loaded into module '%.*s'",
+                   (int)loaded->module_name.length, loaded->module_name.data);
+        return false;
+    }
+
+    bool ok = true;
+
+    for (size_t i = 0; i < edited->statements.size; i++) {
+        const ASTStmt *stmt = edited->statements.data[i];
+
+        if (!reload_is_decl(stmt)) {
+            continue;
+        }
+
+        StringRef name = reload_decl_name(stmt);
+        const ASTStmt *was = reload_find_decl(loaded, stmt);
+
+        if (!was) {
+            diag_error(diagnostics, GAB_ERR_NAME, stmt->span,
+                       "'%.*s' is new, and a reload can only change what the unit already declares",
+                       (int)name.length, name.data);
+            ok = false;
+        } else if (!reload_same_decl(was, stmt)) {
+            diag_error(diagnostics, GAB_ERR_TYPE, stmt->span,
+                       "'%.*s' is declared otherwise than when it loaded, and a reload changes only bodies",
+                       (int)name.length, name.data);
+            ok = false;
+        }
+    }
+
+    for (size_t i = 0; i < loaded->statements.size; i++) {
+        const ASTStmt *stmt = loaded->statements.data[i];
+
+        if (reload_is_decl(stmt) && !reload_find_decl(edited, stmt)) {
+            StringRef name = reload_decl_name(stmt);
+
+            diag_error(diagnostics, GAB_ERR_NAME, edited->module_span,
+                       "'%.*s' is no longer declared, and a reload cannot take away what the unit declared",
+                       (int)name.length, name.data);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+// A function's text, from its 'func' to the token after its body. A body is
+// the first one skipped after its declaration starts, whatever nests in it.
+static StringRef reload_func_text(const ReloadSource *side, const ASTStmt *stmt) {
+    size_t start = stmt->func_decl.source_offset;
+
+    for (size_t i = 0; i < side->spans.size; i++) {
+        if (side->spans.data[i].start > start) {
+            return (StringRef){.data = side->source + start, .length = side->spans.data[i].resume - start};
+        }
+    }
+
+    return (StringRef){.data = side->source + start, .length = side->length - start};
+}
+
+// What the loaded unit declared the function as, which every caller and
+// every handle already names by its prototype.
+static Symbol *reload_symbol(VM *vm, Scope *module, const ASTStmt *stmt) {
+    String *name = string_from_ref(&vm->env.strings, stmt->func_decl.name);
+    const ASTField *receiver = stmt->func_decl.receiver;
+
+    if (!receiver) {
+        return scope_symbol_lookup(module, name);
+    }
+
+    String *receiver_name = string_from_ref(&vm->env.strings, receiver->type_spec->name);
+    Type *base = scope_type_lookup_local(module, receiver_name);
+
+    return base ? type_find_method(base, name) : NULL;
+}
+
+// One body the reload changes, compiled and waiting to be swapped in.
+typedef struct {
+    FuncPrototype *proto;
+    Unit *generated;
+} ReloadBody;
+
+#define reload_body_list_item_free(item) unit_free((item).generated)
+GAB_LIST(ReloadBodyList, reload_body_list, ReloadBody)
+
+// Compiled as a lazy load's deferred body is: parsed back from its 'func',
+// and resolved against the declaration the module already has.
+static Unit *reload_compile_body(VM *vm, const ReloadSource *side, const ASTStmt *stmt, Symbol *symbol,
+                                 Scope *module, String *module_name, Diagnostics *diagnostics) {
+    Lexer lexer = lexer_create_len(side->source, side->length, vm->env.compile_arena, &vm->env.strings,
+                                   diagnostics);
+    lexer.pos = (int)stmt->func_decl.source_offset;
+    lexer.line = stmt->span.line;
+    lexer.column = stmt->span.column;
+
+    Parser parser = parser_create(&lexer, diagnostics);
+    ASTStmt *decl = parser_parse_func_decl(&parser);
+    Unit *generated = NULL;
+
+    if (decl && !diagnostics_has_errors(diagnostics) &&
+        ast_resolve_deferred(vm->env.compile_arena, decl, symbol, module, vm->env.module_scopes,
+                             &side->script->imports, module_name, diagnostics)) {
+        generated = codegen_generate_deferred(decl, module->arena, &vm->env.strings, diagnostics);
+    }
+
+    if (decl) {
+        ast_stmt_destroy(decl);
+    }
+
+    return generated;
+}
+
+// Into the prototype every call and every handle already names. The old body
+// is freed: nothing can be running it, since a reload is refused while a run
+// or a suspended coroutine could be.
+static void reload_swap(VM *vm, FuncPrototype *proto, Unit *generated) {
+    if (proto->chunk) {
+        chunk_free(proto->chunk);
+    }
+
+    // One still waiting to compile is counted as pending; one that failed to
+    // already stopped being.
+    if (proto->deferred && !proto->deferred->failure) {
+        vm->program.deferred_pending--;
+    }
+
+    frame_ref_list_free(&proto->refs);
+    proto->chunk = generated->top_level.chunk;
+    proto->max_registers = generated->top_level.max_registers;
+    proto->refs = generated->top_level.refs;
+    proto->deferred = NULL;
+
+    generated->top_level.chunk = NULL;
+    generated->top_level.refs = frame_ref_list_create();
+}
+
+// Compiles every body 'edited' changes. False, with the first error, if one
+// does not compile.
+static bool reload_compile_changed(VM *vm, const ReloadSource *loaded, const ReloadSource *edited,
+                                   ReloadBodyList *bodies, Diagnostics *diagnostics) {
+    String *module_name = string_from_ref(&vm->env.strings, edited->script->module_name);
+    Scope **module = module_scope_map_lookup(vm->env.module_scopes, module_name);
+
+    for (size_t i = 0; i < edited->script->statements.size; i++) {
+        const ASTStmt *stmt = edited->script->statements.data[i];
+
+        if (stmt->kind != STMT_FUNC_DECL || !stmt->func_decl.deferred) {
+            continue;
+        }
+
+        // The same text compiles to the same code against the same
+        // declarations, so only a body that reads otherwise is compiled.
+        const ASTStmt *was = reload_find_decl(loaded->script, stmt);
+
+        if (string_ref_equals_ref(reload_func_text(loaded, was), reload_func_text(edited, stmt))) {
+            continue;
+        }
+
+        Symbol *symbol = module ? reload_symbol(vm, *module, stmt) : NULL;
+
+        if (!symbol || symbol->func.func_index >= vm->program.prototypes.size) {
+            diag_error(diagnostics, GAB_ERR_NAME, stmt->span, "'%.*s' has no body in this VM to replace",
+                       (int)stmt->func_decl.name.length, stmt->func_decl.name.data);
+            return false;
+        }
+
+        Unit *generated = reload_compile_body(vm, edited, stmt, symbol, *module, module_name, diagnostics);
+
+        if (!generated) {
+            return false;
+        }
+
+        reload_body_list_add(bodies, (ReloadBody){
+                                         .proto = vm->program.prototypes.data[symbol->func.func_index],
+                                         .generated = generated,
+                                     });
+    }
+
+    return true;
+}
+
+bool compile_reload(VM *vm, const char *name, const char *source, Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    // The latest unit loaded under the name, as a load that replaced it would
+    // have been.
+    LoadedUnit *unit = NULL;
+
+    for (size_t i = vm->env.loaded_units.size; i > 0 && !unit; i--) {
+        if (strcmp(vm->env.loaded_units.data[i - 1].name, name) == 0) {
+            unit = &vm->env.loaded_units.data[i - 1];
+        }
+    }
+
+    if (!unit) {
+        diag_error(diagnostics, GAB_ERR_NAME, (Span){0}, "no unit named '%s' is loaded", name);
+        return false;
+    }
+
+    if (!unit->source) {
+        diag_error(diagnostics, GAB_ERR_NAME, (Span){0},
+                   "unit '%s' was loaded without its source kept; see gab_keep_sources", name);
+        return false;
+    }
+
+    ReloadSource loaded = {0};
+    ReloadSource edited = {0};
+    ReloadBodyList bodies = reload_body_list_create();
+
+    // The unit's strings are its module's, so parsing it again shares none of
+    // them, and what only the new bodies name is the module's too. The bodies
+    // are compiled into the module's own arena, where a reload that fails
+    // leaves nothing.
+    Module *module = environment_module(&vm->env, unit->module);
+    CompileSavepoint savepoint = compile_savepoint(module->arenas.data[0], &module->strings);
+    vm->env.strings.owner = savepoint.owner;
+
+    bool ok = reload_parse(vm, &loaded, unit->source, unit->source_length, diagnostics) &&
+              reload_parse(vm, &edited, source, strlen(source), diagnostics) &&
+              check_imports(vm, edited.script, diagnostics) &&
+              reload_check_decls(loaded.script, edited.script, diagnostics) &&
+              reload_compile_changed(vm, &loaded, &edited, &bodies, diagnostics);
+
+    // Every body checked before any is installed, so a reload that fails
+    // leaves every function as it was. An install only appends to the
+    // program's tables, which nothing reads until a swapped body does.
+    size_t installed = 0;
+
+    for (size_t i = 0; ok && i < bodies.size; i++) {
+        ok = link_check(&vm->program, bodies.data[i].generated, diagnostics);
+
+        if (ok) {
+            link_install(&vm->program, bodies.data[i].generated);
+            installed++;
+        }
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < bodies.size; i++) {
+            reload_swap(vm, bodies.data[i].proto, bodies.data[i].generated);
+        }
+
+        String *module_name = string_from_ref(&vm->env.strings, edited.script->module_name);
+
+        for (size_t i = 0; i < edited.script->imports.size; i++) {
+            String *imported = string_from_ref(&vm->env.strings, edited.script->imports.data[i].name);
+
+            module_import_list_add(&vm->env.module_imports,
+                                   (ModuleImport){.from = module_name, .to = imported});
+        }
+
+        // What the next reload compares against, and what an image keeps.
+        unit->source = compile_copy(module->arenas.data[0], source);
+        unit->source_length = strlen(source);
+    }
+
+    vm->env.strings.owner = NULL;
+
+    reload_body_list_free(&bodies);
+    reload_source_free(&edited);
+    reload_source_free(&loaded);
+
+    // Unless a body was installed before another failed its check: the
+    // program's tables may hold its literals now, and keep them.
+    if (!ok && installed == 0) {
+        compile_savepoint_rewind(vm, &savepoint);
+    }
+
+    return ok;
+}
+
+// ---- Freeing modules ----
+
+bool compile_module_unused(VM *vm, String *module, Diagnostics *diagnostics) {
+    if (!environment_module(&vm->env, module)) {
+        diag_error(diagnostics, GAB_ERR_NAME, (Span){0}, "no module '%s' is loaded", module->data);
+        return false;
+    }
+
+    // Only types cross modules, and only into one that imports theirs, so an
+    // importer is the only thing that could still point into this module.
+    for (size_t i = 0; i < vm->env.module_imports.size; i++) {
+        const ModuleImport *edge = &vm->env.module_imports.data[i];
+
+        if (edge->to == module && edge->from != module) {
+            diag_error(diagnostics, GAB_ERR_NAME, (Span){0}, "'%s' imports '%s', which is still loaded",
+                       edge->from->data, module->data);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+typedef struct {
+    const Environment *env;
+    String *module;
+} ModuleOwnership;
+
+static bool compile_module_owns(const Type *type, void *ctx) {
+    const ModuleOwnership *ownership = ctx;
+
+    return environment_module_owns(ownership->env, ownership->module, type);
+}
+
+// Empties every slot of the program's tables the module filled. What the
+// module declared was allocated from its arenas, which is how its slots are
+// told apart; a literal is its module's if the module alone asked for it.
+static void compile_module_vacate(VM *vm, String *module, Module *record) {
+    Program *program = &vm->program;
+    const Environment *env = &vm->env;
+
+    for (size_t i = 0; i < program->prototypes.size; i++) {
+        FuncPrototype *proto = program->prototypes.data[i];
+
+        if (!proto || !environment_module_owns(env, module, proto)) {
+            continue;
+        }
+
+        if (proto->deferred && !proto->deferred->failure) {
+            program->deferred_pending--;
+        }
+
+        func_proto_free(proto);
+        program->prototypes.data[i] = NULL;
+    }
+
+    for (size_t i = 0; i < program->extern_protos.size; i++) {
+        ExternProto *proto = &program->extern_protos.data[i];
+
+        if (proto->symbol && environment_module_owns(env, module, proto->symbol)) {
+            *proto = (ExternProto){0};
+        }
+    }
+
+    for (size_t i = 0; i < program->heap_types.size; i++) {
+        const Type *type = program->heap_types.data[i];
+
+        if (type && environment_module_owns(env, module, type)) {
+            program->heap_types.data[i] = NULL;
+        }
+    }
+
+    for (size_t i = 0; i < program->strings.size; i++) {
+        String *text = program->strings.data[i];
+
+        if (text && string_pool_owned_by(&vm->env.strings, text, &record->strings)) {
+            program->strings.data[i] = NULL;
+        }
+    }
+
+    // What the host attached goes too: a later unit's channel may take the
+    // slot, and must not find another's queue in it.
+    for (size_t i = 0; i < program->channels.size; i++) {
+        const Symbol *channel = program->channels.data[i];
+
+        if (channel && environment_module_owns(env, module, channel)) {
+            program->channels.data[i] = NULL;
+
+            if (i < vm->channel_capacity) {
+                vm->channels[i] = NULL;
+            }
+        }
+    }
+}
+
+void compile_module_free(VM *vm, String *module) {
+    Environment *env = &vm->env;
+    Module *record = environment_module(env, module);
+
+    compile_module_vacate(vm, module, record);
+
+    ModuleOwnership ownership = {.env = env, .module = module};
+    type_registry_forget(env->global_scope.type_registry, compile_module_owns, &ownership);
+
+    // In order, since an image declares the units again in the order they
+    // are listed.
+    size_t kept = 0;
+
+    for (size_t i = 0; i < env->loaded_units.size; i++) {
+        if (env->loaded_units.data[i].module != module) {
+            env->loaded_units.data[kept++] = env->loaded_units.data[i];
+        }
+    }
+
+    env->loaded_units.size = kept;
+    kept = 0;
+
+    for (size_t i = 0; i < env->module_imports.size; i++) {
+        if (env->module_imports.data[i].from != module) {
+            env->module_imports.data[kept++] = env->module_imports.data[i];
+        }
+    }
+
+    env->module_imports.size = kept;
+
+    // Before the module goes: whose a string is, is found through the owners
+    // in its arenas. The maps dropping the module compare its name's address,
+    // so it may be among those freed.
+    string_pool_release(&env->strings, &record->strings);
+    environment_module_drop(env, module);
+
+    env->modules_freed = true;
+}
+
+bool compile_declare(VM *vm, const char *source, ASTScript *script, Diagnostics *diagnostics) {
+    arena_reset(vm->env.compile_arena);
+
+    Lexer lexer = lexer_create(source, vm->env.compile_arena, &vm->env.strings, diagnostics);
+    Parser parser = parser_create(&lexer, diagnostics);
+
+    if (!parser_parse(&parser, script) || !check_imports(vm, script, diagnostics)) {
+        return false;
+    }
+
+    String *module_name = string_from_ref(&vm->env.strings, script->module_name);
+    Scope *target = environment_module_scope(&vm->env, module_name);
+
+    // Staged exactly as compile_unit does, so a unit that fails to resolve
+    // declares nothing here either.
+    Scope *staging = arena_alloc(vm->env.compile_arena, sizeof(Scope));
+    scope_init_staging(staging, target->arena, &vm->env.strings, target);
+
+    if (!ast_script_resolve(vm->env.compile_arena, script, staging, vm->env.module_scopes, diagnostics)) {
+        return false;
+    }
+
+    scope_merge_staged(target, staging);
+
+    for (size_t i = 0; i < script->imports.size; i++) {
+        String *imported = string_from_ref(&vm->env.strings, script->imports.data[i].name);
+
+        module_import_list_add(&vm->env.module_imports, (ModuleImport){.from = module_name, .to = imported});
+    }
 
     return true;
 }
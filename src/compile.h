@@ -21,6 +21,139 @@ typedef struct VM VM;
 // reclaims — so they stay readable until then, but not past it.
 bool compile_unit(VM *vm, const char *source, FuncPrototype *out, Diagnostics *diagnostics);
 
+// As compile_unit, with the source 'length' bytes long and not necessarily
+// terminated. It is copied, as compile_unit's is.
+bool compile_unit_len(VM *vm, const char *source, size_t length, FuncPrototype *out,
+                      Diagnostics *diagnostics);
+
+// As compile_unit, with the source the contents of the file at 'path', lexed
+// from a read-only mapping of it rather than read into memory first. A unit
+// that links keeps the mapping, in place of a copy of its source, for as long
+// as its module is loaded; one that fails unmaps it at once. Truncating the
+// file meanwhile makes reading what was cut off fault.
+bool compile_unit_file(VM *vm, const char *path, FuncPrototype *out, Diagnostics *diagnostics);
+
+// As compile_unit, and writes the unit's function bodies, compiled, to a cache
+// a later compile_unit_cached of the same source can fill them from. The cache
+// is malloc'd, '*data' and '*size' are set only on success, and the caller
+// frees it. Every body is compiled, whether or not the VM defers them.
+bool compile_unit_save(VM *vm, const char *source, FuncPrototype *out, void **data, size_t *size,
+                       Diagnostics *diagnostics);
+
+// As compile_unit, with every function body taken from a cache compile_unit_save
+// wrote rather than lexed, parsed and generated. Refused, declaring nothing, if
+// the cache is of other source or was compiled against modules laid out
+// otherwise than this VM's. See unit_cache.h.
+bool compile_unit_cached(VM *vm, const char *source, const void *data, size_t size, FuncPrototype *out,
+                         Diagnostics *diagnostics);
+
+// As compile_unit, but generating no function body: each is left the stub a
+// lazy load leaves (see DeferredBody), with nothing kept to compile it from,
+// for the caller to fill before anything can reach it. How a VM image declares
+// a unit again. 'source' must live as long as the VM, and is not copied.
+bool compile_unit_stubs(VM *vm, const char *source, FuncPrototype *out, Diagnostics *diagnostics);
+
+// One unit of a batch: its source and the name its diagnostics carry.
+typedef struct {
+    const char *name;
+    const char *source;
+} CompileSource;
+
+// Compiles and links several units, on as many threads as there are cores,
+// into the VM. Every unit parses at once; then the units resolve and generate
+// code in rounds, each round every unit whose imports the earlier rounds have
+// already linked, and link one at a time between rounds. Units filling the
+// same module keep the batch's order, and modules may be imported by units
+// before or after the ones declaring them.
+//
+// The top levels of the units that linked go to 'top_levels', in the order
+// they linked and so in an order that runs each after what it imports; there
+// are '*linked' of them, which the caller owns, and 'order' holds the index in
+// 'sources' of each. On failure the units linked
+// before the failing one stay loaded, '*failed' is its index in 'sources',
+// and 'diagnostics' holds its first error.
+bool compile_batch(VM *vm, const CompileSource *sources, size_t count, FuncPrototype *top_levels,
+                   size_t *order, size_t *linked, size_t *failed, Diagnostics *diagnostics);
+
+// A unit compiling on a thread of its own. See compile_unit_async.
+typedef struct CompileAsync CompileAsync;
+
+// Begins compile_unit's lexing, parsing, resolution and codegen on another
+// thread, against the environment as it stands, and returns at once; 'name'
+// and 'source' are copied. Linking is left for compile_async_finish, on the
+// VM's thread, where it is cheap. NULL if out of memory.
+//
+// The VM is left free to run while the compile does, but not to load: its
+// 'pending_load' is set until the finish, and nothing may write to the
+// environment the compile is reading before then.
+CompileAsync *compile_unit_async(VM *vm, const char *name, const char *source);
+
+// Whether the compile is done, so that finishing would not wait for it.
+bool compile_async_ready(const CompileAsync *job);
+
+// The VM the job will link into.
+VM *compile_async_vm(const CompileAsync *job);
+
+// Waits for the compile if it is not done, then links it as compile_unit
+// would have, and frees the job either way. 'out' and 'diagnostics' are as
+// for compile_unit, the diagnostics holding the unit's first error.
+bool compile_async_finish(CompileAsync *job, FuncPrototype *out, Diagnostics *diagnostics);
+
+// Waits for the compile and frees the job without linking anything.
+void compile_async_discard(CompileAsync *job);
+
+// Compiles a body a lazy load deferred (see Environment::defer_bodies), the
+// first time anything is about to run it. NULL once the prototype has a chunk
+// to run; otherwise the error that kept it from having one, which is what every
+// later call gets too, without compiling again.
+//
+// Only on the thread that owns the VM, and never while a run on another thread
+// could reach the prototype: it is written in place.
+const Diagnostic *compile_deferred(VM *vm, FuncPrototype *proto);
+
+// Compiles every body still deferred, so nothing is left to compile when it is
+// reached -- a validation pass, and what has to happen before any other thread
+// can run the program. NULL if every one of them compiled; otherwise the first
+// error, in the order the functions were loaded.
+const Diagnostic *compile_deferred_all(VM *vm);
+
+// Compiles 'source' again in place of the unit last loaded as 'name', which it
+// must declare exactly as the unit did: the same functions with the same
+// signatures, the same structs laid out alike, the same channels. Only the
+// bodies whose text changed are compiled, each into the prototype it had, so
+// every call compiled against it and every handle to it reaches the new body.
+// The top level is not run again.
+//
+// False, with every declaration it cannot reconcile or the first error of a
+// body, and nothing changed. Only when nothing is running and no coroutine is
+// suspended: the old bodies are freed.
+bool compile_reload(VM *vm, const char *name, const char *source, Diagnostics *diagnostics);
+
+// Whether 'module' is loaded and no other loaded module imports it, which is
+// what compile_module_free needs of it. False, with why, if not.
+bool compile_module_unused(VM *vm, String *module, Diagnostics *diagnostics);
+
+// Frees a module compile_module_unused accepted: its prototypes and their
+// code, its types and what the registry interned on them, the strings no other
+// module asked for, its units and its scope. The program's slots it held are
+// emptied for later units. 'module' is among the strings freed. Only when
+// nothing is running and no coroutine is suspended.
+void compile_module_free(VM *vm, String *module);
+
+typedef struct ASTScript ASTScript;
+
+// Parses and resolves a unit into 'script' and declares what it names, without
+// generating code, binding externs, or running anything. For a tool that reads
+// declarations -- gab-bindgen -- rather than a host that runs them: nothing in
+// the unit has a body afterwards, so a VM used this way must never call into
+// it.
+//
+// 'script' is the caller's, so it can walk what was declared in source order;
+// the symbols and types on it live as long as the VM. Its names point into
+// 'source', which must outlive it. Later units may import this one exactly as
+// they could a loaded one.
+bool compile_declare(VM *vm, const char *source, ASTScript *script, Diagnostics *diagnostics);
+
 // Compile, run, and discard, reporting any diagnostics to stderr. The
 // convenience path for a caller with nothing to say about failure.
 void compile_and_run(VM *vm, const char *source);
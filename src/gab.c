@@ -9,14 +9,23 @@
 #include "type.h"
 #include "type_registry.h"
 #include "vm/args.h"
+#include "vm/channel.h"
+#include "vm/image.h"
 #include "vm/interp.h"
 #include "vm/vm.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// The public name for a string header is a copy of the private one, so the two
+// must not drift.
+_Static_assert(sizeof(GabString) == sizeof(GabStringValue), "GabString mirrors GabStringValue");
+_Static_assert(offsetof(GabString, length) == offsetof(GabStringValue, length),
+               "GabString mirrors GabStringValue");
+
 // GabVM is the existing VM under another name: the handle is a cast, not a
 // wrapper, so there is no second object and no second lifetime to track. The
 // tag is only here to give the header something opaque to point at.
@@ -94,6 +103,8 @@ struct GabCall {
 // Builds the handle's cached call layout from its symbol's signature.
 static void gab_func_bind(GabFunc *fn);
 
+static GabStatus gab_call_frame(VM *vm, GabFunc *fn, const void *args, void *ret, GabError *err);
+
 // The slots a call block needs for this signature: one per parameter's worth of
 // slots, plus slot 0 for the return value.
 static unsigned int gab_signature_slots(const Symbol *symbol);
@@ -178,6 +189,52 @@ static void gab_error_from_diagnostics(GabError *err, const Diagnostics *diagnos
 
 GabVM *gab_vm_new(void) { return (GabVM *)vm_create(); }
 
+// Shared by gab_context_new and gab_vm_clone, which are one operation under
+// the two names a host reaches for it by.
+static GabVM *gab_share(GabVM *handle, const char *caller, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle) {
+        char message[256];
+        snprintf(message, sizeof(message), "%s requires a VM", caller);
+        gab_error_set(err, 0, 0, message);
+
+        return NULL;
+    }
+
+    VM *vm = (VM *)handle;
+
+    // Nothing may compile once another thread could be running the program, so
+    // what a lazy load left is compiled now. A body that fails stays failed,
+    // for whichever call reaches it to report.
+    if (!vm->owner) {
+        compile_deferred_all(vm);
+    }
+
+    // A context of a context shares the same program, so it is made from the
+    // VM that compiled it and the chain is never more than one link long.
+    VM *context = vm_create_context(vm->owner ? vm->owner : vm);
+    if (!context) {
+        gab_error_set(err, 0, 0, "out of memory");
+        return NULL;
+    }
+
+    return (GabVM *)context;
+}
+
+GabVM *gab_context_new(GabVM *vm, GabError *err) { return gab_share(vm, "gab_context_new", err); }
+
+GabVM *gab_vm_clone(GabVM *template_vm, GabError *err) { return gab_share(template_vm, "gab_vm_clone", err); }
+
+// The VM whose environment answers a query by name: the handle itself, or the
+// VM a context was made from. Names are compile-time data, which a context has
+// none of.
+static VM *gab_compiler(GabVM *handle) {
+    VM *vm = (VM *)handle;
+
+    return vm->owner ? vm->owner : vm;
+}
+
 void gab_vm_free(GabVM *handle) {
     if (!handle) {
         return;
@@ -185,6 +242,11 @@ void gab_vm_free(GabVM *handle) {
 
     VM *vm = (VM *)handle;
 
+    // Before anything the compile may be reading goes.
+    if (vm->pending_load) {
+        compile_async_discard(vm->pending_load);
+    }
+
     // Every handle this VM handed out. Freed here rather than in vm_free
     // because a GabFunc is this file's type: the VM tracked the pointers
     // without ever knowing what they were.
@@ -239,6 +301,8 @@ void gab_return_struct(GabArgs *args, const void *data, size_t size) { args_retu
 
 void gab_return_pointer(GabArgs *args, void *pointer) { args_return_pointer(args, pointer); }
 
+GabVM *gab_args_vm(GabArgs *args) { return (GabVM *)args->vm; }
+
 void gab_error(GabArgs *args, const char *message) {
     if (!args) {
         return;
@@ -247,16 +311,24 @@ void gab_error(GabArgs *args, const char *message) {
     vm_fail(args->vm, VM_RUN_ERR_EXTERN, message ? message : "the extern function failed");
 }
 
-bool gab_extern(GabVM *handle, const char *module, const char *name, GabExternFn fn, GabError *err) {
+// Registers a binding of either kind. 'binding' carries the body and its
+// shape; the names are filled in here once they are interned.
+static bool gab_extern_bind(GabVM *handle, const char *module, const char *name, ExternBinding binding,
+                            GabError *err) {
     gab_error_clear(err);
 
-    if (!handle || !name || !fn) {
+    if (!handle || !name || (!binding.fn && !binding.native)) {
         gab_error_set(err, 0, 0, "gab_extern requires a VM, a name, and a function");
         return false;
     }
 
     VM *vm = (VM *)handle;
 
+    if (vm->owner) {
+        gab_error_set(err, 0, 0, "an extern is bound on the VM a context was made from");
+        return false;
+    }
+
     // Interned rather than copied: the binding is matched against a declared
     // name, which is interned in the same pool, so identity is the comparison.
     String *interned_name = string_from_cstr(&vm->env.strings, name);
@@ -269,30 +341,171 @@ bool gab_extern(GabVM *handle, const char *module, const char *name, GabExternFn
     }
 
     for (size_t i = 0; i < vm->program.extern_bindings.size; i++) {
-        const ExternBinding *binding = &vm->program.extern_bindings.data[i];
+        const ExternBinding *existing = &vm->program.extern_bindings.data[i];
 
-        if (binding->name == interned_name && binding->module == interned_module) {
+        if (existing->name == interned_name && existing->module == interned_module) {
             gab_error_set(err, 0, 0, "an extern of this name is already bound in this module");
             return false;
         }
     }
 
-    extern_binding_list_add(&vm->program.extern_bindings,
-                            (ExternBinding){.module = interned_module, .name = interned_name, .fn = fn});
+    binding.module = interned_module;
+    binding.name = interned_name;
+
+    extern_binding_list_add(&vm->program.extern_bindings, binding);
 
     return true;
 }
 
-bool gab_load(GabVM *handle, const char *name, const char *src, GabError *err) {
-    gab_error_clear(err);
+bool gab_extern(GabVM *handle, const char *module, const char *name, GabExternFn fn, GabError *err) {
+    return gab_extern_bind(handle, module, name, (ExternBinding){.fn = fn, .shape = EXTERN_SHAPE_ARGS}, err);
+}
 
-    if (!handle || !src) {
-        gab_error_set(err, 0, 0, "gab_load requires a VM and a source string");
+// The typed registrations differ only in the shape they record. The pointer is
+// stored type-erased and cast back by the call that matches its shape.
+static bool gab_extern_native(GabVM *handle, const char *module, const char *name, GabNativeFn fn,
+                              ExternShape shape, GabError *err) {
+    return gab_extern_bind(handle, module, name, (ExternBinding){.native = fn, .shape = shape}, err);
+}
+
+bool gab_extern_i_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(int32_t), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_I_I, err);
+}
+
+bool gab_extern_ii_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(int32_t, int32_t),
+                     GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_II_I, err);
+}
+
+bool gab_extern_f_f(GabVM *vm, const char *module, const char *name, float (*fn)(float), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_F_F, err);
+}
+
+bool gab_extern_ff_f(GabVM *vm, const char *module, const char *name, float (*fn)(float, float),
+                     GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_FF_F, err);
+}
+
+bool gab_extern_p_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_P_V, err);
+}
+
+bool gab_extern_p_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(void *), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_P_I, err);
+}
+
+bool gab_extern_p_f(GabVM *vm, const char *module, const char *name, float (*fn)(void *), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_P_F, err);
+}
+
+bool gab_extern_p_p(GabVM *vm, const char *module, const char *name, void *(*fn)(void *), GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_P_P, err);
+}
+
+bool gab_extern_pi_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *, int32_t),
+                     GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_PI_V, err);
+}
+
+bool gab_extern_pf_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *, float),
+                     GabError *err) {
+    return gab_extern_native(vm, module, name, (GabNativeFn)fn, EXTERN_SHAPE_PF_V, err);
+}
+
+// Whether a task spawned on 'vm' or its program's owner is still running or
+// waiting to be joined, and 'caller' must be refused, with 'err' saying so.
+static bool gab_tasks_live(const VM *vm, const char *caller, GabError *err) {
+    const VM *owner = vm->owner ? vm->owner : vm;
+
+    if (atomic_load(&owner->live_tasks) == 0) {
         return false;
     }
 
-    VM *vm = (VM *)handle;
+    char message[256];
+    snprintf(message, sizeof(message), "%s cannot be called while a task spawned on this VM is unjoined",
+             caller);
+    gab_error_set(err, 0, 0, message);
+
+    return true;
+}
+
+// Whether 'vm' may install a compiled unit and run its top level now, which
+// every way of loading asks before it does. 'caller' names the function asked,
+// for the message.
+static bool gab_install_allowed(VM *vm, const char *caller, GabError *err) {
+    char message[256];
+
+    // Installing grows the program's tables, which may move them under a
+    // context running on another thread.
+    if (vm->context_count > 0) {
+        snprintf(message, sizeof(message), "%s cannot be called while contexts share this VM's program",
+                 caller);
+        gab_error_set(err, 0, 0, message);
+        return false;
+    }
+
+    // A unit's top level runs as frame zero, which a run in progress is using,
+    // and the compile would reset an arena that run may still be reading from.
+    if (vm_call_nested(vm)) {
+        snprintf(message, sizeof(message), "%s cannot be called from inside an extern", caller);
+        gab_error_set(err, 0, 0, message);
+        return false;
+    }
+
+    // The same tables, under a task a suspended coroutine left running on the
+    // pool. See VM::live_tasks.
+    if (gab_tasks_live(vm, caller, err)) {
+        return false;
+    }
+
+    return true;
+}
+
+// Whether 'vm' may load at all, which is the same question for every way of
+// loading.
+static bool gab_load_allowed(VM *vm, const char *caller, GabError *err) {
+    if (vm->owner) {
+        gab_error_set(err, 0, 0, "a context cannot load; load into the VM it was made from");
+        return false;
+    }
+
+    // See VM::pending_load.
+    if (vm->pending_load) {
+        char message[256];
+        snprintf(message, sizeof(message), "%s cannot be called while a gab_load_async is unfinished",
+                 caller);
+        gab_error_set(err, 0, 0, message);
+        return false;
+    }
+
+    return gab_install_allowed(vm, caller, err);
+}
+
+// Runs a unit's top level once it has linked, which declares the unit's
+// functions and types and initialises whatever it sets up: a load that did not
+// run it would leave the unit half present.
+static bool gab_run_loaded(VM *vm, FuncPrototype *compiled, GabError *err) {
+    if (interp_run_top_level(vm, compiled) != VM_RUN_OK) {
+        gab_error_set(err, 0, 0, vm->error.message);
+        func_proto_free(compiled);
+
+        return false;
+    }
+
+    // Kept only so its chunk is freed with the program. A unit is never looked
+    // up again: what it declared is reached by name, and the name it loaded
+    // under was a diagnostic label.
+    top_level_list_add(&vm->program.top_levels, *compiled);
+
+    return true;
+}
 
+// What gab_load, gab_load_len and gab_load_file share once their arguments
+// check out: the unit compiled by 'compile', from 'src' -- a source or a path,
+// as 'compile' takes it -- and then run.
+static bool gab_load_unit(VM *vm, const char *name, const char *src, size_t length,
+                          bool (*compile)(VM *, const char *, size_t, FuncPrototype *, Diagnostics *),
+                          GabError *err) {
     char unit_name[128];
     snprintf(unit_name, sizeof(unit_name), "%s", name ? name : "<script>");
 
@@ -302,7 +515,7 @@ bool gab_load(GabVM *handle, const char *name, const char *src, GabError *err) {
     // Compiled into a local: a failed load must leave whatever is already
     // loaded intact and running.
     FuncPrototype compiled = {0};
-    bool ok = compile_unit(vm, src, &compiled, &diagnostics);
+    bool ok = compile(vm, src, length, &compiled, &diagnostics);
 
     if (!ok) {
         // Nothing is printed: a host reports through its own console, and the
@@ -315,164 +528,685 @@ bool gab_load(GabVM *handle, const char *name, const char *src, GabError *err) {
 
     diagnostics_free(&diagnostics);
 
-    // The top level declares the unit's functions and types and initialises
-    // whatever it sets up, so a load that did not run it would leave the unit
-    // half present.
-    if (interp_run_top_level(vm, &compiled) != VM_RUN_OK) {
-        gab_error_set(err, 0, 0, vm->error.message);
-        func_proto_free(&compiled);
+    return gab_run_loaded(vm, &compiled, err);
+}
 
+bool gab_load(GabVM *handle, const char *name, const char *src, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !src) {
+        gab_error_set(err, 0, 0, "gab_load requires a VM and a source string");
         return false;
     }
 
-    // Kept only so its chunk is freed with the program. A unit is never looked
-    // up again: what it declared is reached by name, and the name it loaded
-    // under was a diagnostic label.
-    top_level_list_add(&vm->program.top_levels, compiled);
+    VM *vm = (VM *)handle;
 
-    return true;
+    if (!gab_load_allowed(vm, "gab_load", err)) {
+        return false;
+    }
+
+    return gab_load_unit(vm, name, src, strlen(src), &compile_unit_len, err);
 }
 
-// --- Types -----------------------------------------------------------------
+bool gab_load_len(GabVM *handle, const char *name, const char *src, size_t length, GabError *err) {
+    gab_error_clear(err);
 
-// The scope a module's names live in. NULL or "" is the default module; an
-// unknown module name is a miss, reported as NULL rather than falling back to
-// the root, so a typo'd module does not silently resolve to a root symbol.
-//
-// Types and functions both come through here: the namespace is the scope, and
-// the only difference downstream is which of the scope's two tables is read.
-static Scope *gab_namespace(VM *vm, const char *module) {
-    if (!module || module[0] == '\0') {
-        return NULL;
+    if (!handle || (!src && length)) {
+        gab_error_set(err, 0, 0, "gab_load_len requires a VM and a source buffer");
+        return false;
     }
 
-    String *interned = string_from_cstr(&vm->env.strings, module);
-    Scope **found = interned ? module_scope_map_lookup(vm->env.module_scopes, interned) : NULL;
+    // A position in the source is an int wherever it is kept.
+    if (length > INT_MAX) {
+        gab_error_set(err, 0, 0, "gab_load_len: the source is too large to load");
+        return false;
+    }
 
-    return found ? *found : NULL;
-}
+    VM *vm = (VM *)handle;
 
-const GabType *gab_find_type(GabVM *handle, const char *module, const char *name) {
-    if (!handle || !name) {
-        return NULL;
+    if (!gab_load_allowed(vm, "gab_load_len", err)) {
+        return false;
     }
 
-    VM *vm = (VM *)handle;
+    return gab_load_unit(vm, name, src ? src : "", length, &compile_unit_len, err);
+}
 
-    Scope *scope = gab_namespace(vm, module);
-    if (!scope) {
-        return NULL;
+static bool gab_compile_file(VM *vm, const char *path, size_t length, FuncPrototype *out,
+                             Diagnostics *diagnostics) {
+    (void)length;
+    return compile_unit_file(vm, path, out, diagnostics);
+}
+
+bool gab_load_file(GabVM *handle, const char *path, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !path) {
+        gab_error_set(err, 0, 0, "gab_load_file requires a VM and a path");
+        return false;
     }
 
-    // Interning is a lookup, not an insert-if-missing, only because the name
-    // of a type that exists is already in the pool.
-    String *interned = string_from_cstr(&vm->env.strings, name);
-    if (!interned) {
-        return NULL;
+    VM *vm = (VM *)handle;
+
+    if (!gab_load_allowed(vm, "gab_load_file", err)) {
+        return false;
     }
 
-    // Walks outward on a miss, so a module sees root-namespace types and
-    // builtins — the same visibility a script inside that module has, and the
-    // same walk gab_lookup does for symbols.
-    return (const GabType *)scope_type_lookup(scope, interned);
+    return gab_load_unit(vm, path, path, 0, &gab_compile_file, err);
 }
 
-size_t gab_type_size(const GabType *type) { return type ? ((const Type *)type)->size : 0; }
+// What gab_save_unit and gab_load_compiled compile with: a unit and a cache of
+// its bodies, one way or the other.
+typedef struct {
+    void **save_data;
+    size_t *save_size;
 
-size_t gab_type_align(const GabType *type) { return type ? ((const Type *)type)->alignment : 0; }
+    const void *data;
+    size_t size;
+} GabUnitCache;
 
-bool gab_field_offset(const GabType *handle, const char *field, size_t *out_offset) {
-    if (!handle || !field) {
+static bool gab_load_cache(VM *vm, const char *caller, const char *name, const char *src, GabUnitCache cache,
+                           GabError *err) {
+    if (!gab_load_allowed(vm, caller, err)) {
         return false;
     }
 
-    const Type *type = (const Type *)handle;
+    char unit_name[128];
+    snprintf(unit_name, sizeof(unit_name), "%s", name ? name : "<script>");
 
-    // Field names are interned, but this compares text so that a host can ask
-    // about a name the pool has never seen without inserting it.
-    for (size_t i = 0; i < type->field_count; i++) {
-        const TypeField *candidate = &type->fields[i];
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, unit_name);
 
-        if (candidate->name && strcmp(candidate->name->data, field) == 0) {
-            if (out_offset) {
-                *out_offset = candidate->offset;
-            }
+    FuncPrototype compiled = {0};
+    void *saved = NULL;
+    size_t saved_size = 0;
 
-            return true;
-        }
-    }
+    bool ok = cache.save_data ? compile_unit_save(vm, src, &compiled, &saved, &saved_size, &diagnostics)
+                              : compile_unit_cached(vm, src, cache.data, cache.size, &compiled, &diagnostics);
 
-    return false;
-}
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+        diagnostics_free(&diagnostics);
 
-// --- Heap objects ----------------------------------------------------------
+        return false;
+    }
 
-// The VM is taken but unused: an allocator is global today, and a host that
-// installs its own later would reach it through the VM rather than through a
-// changed signature.
-void *gab_new(GabVM *handle, const GabType *type) {
-    (void)handle;
+    diagnostics_free(&diagnostics);
 
-    if (!type) {
-        return NULL;
+    // A unit whose top level fails has not loaded, so there is no cache of it
+    // to give back either.
+    if (!gab_run_loaded(vm, &compiled, err)) {
+        free(saved);
+        return false;
     }
 
-    return gab_object_alloc(DEFAULT_ALLOCATOR, (const Type *)type);
+    if (cache.save_data) {
+        *cache.save_data = saved;
+        *cache.save_size = saved_size;
+    }
+
+    return true;
 }
 
-void gab_free(GabVM *handle, void *object) {
-    (void)handle;
+bool gab_save_unit(GabVM *handle, const char *name, const char *src, void **data, size_t *size,
+                   GabError *err) {
+    gab_error_clear(err);
 
-    gab_object_free(DEFAULT_ALLOCATOR, object);
-}
+    if (!handle || !src || !data || !size) {
+        gab_error_set(err, 0, 0, "gab_save_unit requires a VM, a source string and where to put the cache");
+        return false;
+    }
 
-// --- Calling ---------------------------------------------------------------
+    GabUnitCache cache = {.save_data = data, .save_size = size};
 
-GabFunc *gab_lookup(GabVM *handle, const char *module, const char *name, GabError *err) {
+    return gab_load_cache((VM *)handle, "gab_save_unit", name, src, cache, err);
+}
+
+bool gab_load_compiled(GabVM *handle, const char *name, const char *src, const void *data, size_t size,
+                       GabError *err) {
     gab_error_clear(err);
 
-    if (!handle || !name) {
-        gab_error_set(err, 0, 0, "gab_lookup requires a VM and a name");
-        return NULL;
+    if (!handle || !src || !data) {
+        gab_error_set(err, 0, 0, "gab_load_compiled requires a VM, a source string and a cache");
+        return false;
     }
 
-    VM *vm = (VM *)handle;
+    GabUnitCache cache = {.data = data, .size = size};
 
-    // A module scope parents to the root, so a bare lookup in a module also
-    // finds root declarations — the same visibility a script inside that
-    // module has.
-    Scope *scope = gab_namespace(vm, module);
+    return gab_load_cache((VM *)handle, "gab_load_compiled", name, src, cache, err);
+}
 
-    if (!scope) {
-        char message[256];
-        snprintf(message, sizeof(message), "no module named '%s'", module);
-        gab_error_set(err, 0, 0, message);
+bool gab_vm_snapshot(GabVM *handle, const char *path, GabError *err) {
+    gab_error_clear(err);
 
-        return NULL;
+    if (!handle || !path) {
+        gab_error_set(err, 0, 0, "gab_vm_snapshot requires a VM and a path");
+        return false;
     }
 
-    String *interned = string_from_cstr(&vm->env.strings, name);
-    Symbol *symbol = interned ? scope_symbol_lookup(scope, interned) : NULL;
-
-    if (!symbol) {
-        char message[256];
-        snprintf(message, sizeof(message), "'%s' is not declared", name);
-        gab_error_set(err, 0, 0, message);
+    VM *vm = (VM *)handle;
 
-        return NULL;
+    // A pending load would finish into tables the image had already taken.
+    if (!gab_load_allowed(vm, "gab_vm_snapshot", err)) {
+        return false;
     }
 
-    if (symbol->kind != SYMBOL_FUNC) {
-        char message[256];
-        snprintf(message, sizeof(message), "'%s' is not a function", name);
-        gab_error_set(err, 0, 0, message);
+    const Diagnostic *failure = compile_deferred_all(vm);
 
-        return NULL;
+    if (failure) {
+        gab_error_set(err, failure->span.line, failure->span.column, failure->message);
+        return false;
     }
 
-    // A parameter list cannot outgrow the slots a frame addresses. Refused here
-    // so the fill loops below cannot run past their arrays.
-    if (symbol->func.param_count > VM_MAX_FRAME_SLOTS) {
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, "<image>");
+
+    bool ok = image_write(vm, path, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+    }
+
+    diagnostics_free(&diagnostics);
+
+    return ok;
+}
+
+bool gab_vm_from_image(GabVM *handle, const char *path, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !path) {
+        gab_error_set(err, 0, 0, "gab_vm_from_image requires a VM and a path");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+
+    if (!gab_load_allowed(vm, "gab_vm_from_image", err)) {
+        return false;
+    }
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, "<image>");
+
+    bool ok = image_restore(vm, path, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+    }
+
+    diagnostics_free(&diagnostics);
+
+    return ok;
+}
+
+bool gab_reload(GabVM *handle, const char *name, const char *src, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !src) {
+        gab_error_set(err, 0, 0, "gab_reload requires a VM and a source string");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+
+    if (!gab_load_allowed(vm, "gab_reload", err)) {
+        return false;
+    }
+
+    // A suspended coroutine resumes at an offset into the body it left, which
+    // would be freed under it.
+    if (vm->live_coroutines > 0) {
+        gab_error_set(err, 0, 0, "gab_reload cannot be called while a coroutine of this VM is unfinished");
+        return false;
+    }
+
+    char unit_name[128];
+    snprintf(unit_name, sizeof(unit_name), "%s", name ? name : "<script>");
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, unit_name);
+
+    bool ok = compile_reload(vm, unit_name, src, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+    }
+
+    diagnostics_free(&diagnostics);
+
+    return ok;
+}
+
+bool gab_module_free(GabVM *handle, const char *module, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !module) {
+        gab_error_set(err, 0, 0, "gab_module_free requires a VM and a module name");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+
+    if (!gab_load_allowed(vm, "gab_module_free", err)) {
+        return false;
+    }
+
+    // A suspended coroutine's frames may name one of the module's prototypes.
+    if (vm->live_coroutines > 0) {
+        gab_error_set(err, 0, 0,
+                      "gab_module_free cannot be called while a coroutine of this VM is unfinished");
+        return false;
+    }
+
+    char module_name[128];
+    snprintf(module_name, sizeof(module_name), "%s", module);
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, module_name);
+
+    String *interned = string_from_cstr(&vm->env.strings, module);
+    bool ok = compile_module_unused(vm, interned, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+        diagnostics_free(&diagnostics);
+
+        return false;
+    }
+
+    diagnostics_free(&diagnostics);
+
+    // Before the symbols they name go. The VM owns its handles, so these are
+    // freed rather than left for gab_vm_free.
+    for (size_t i = vm->func_handles.size; i > 0; i--) {
+        GabFunc *fn = vm->func_handles.data[i - 1];
+
+        if (environment_module_owns(&vm->env, interned, fn->symbol)) {
+            func_handle_list_swap_remove(&vm->func_handles, i - 1, NULL);
+
+            free(fn->params_block);
+            free(fn);
+        }
+    }
+
+    compile_module_free(vm, interned);
+
+    return true;
+}
+
+bool gab_vm_compact(GabVM *handle, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle) {
+        gab_error_set(err, 0, 0, "gab_vm_compact requires a VM");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+
+    if (vm->owner) {
+        gab_error_set(err, 0, 0, "a context cannot be compacted; compact the VM it was made from");
+        return false;
+    }
+
+    // Contexts and an extern's caller run the code a compaction moves, as a
+    // suspended coroutine's frames go on to.
+    if (!gab_install_allowed(vm, "gab_vm_compact", err)) {
+        return false;
+    }
+
+    if (vm->live_coroutines > 0) {
+        gab_error_set(err, 0, 0,
+                      "gab_vm_compact cannot be called while a coroutine of this VM is unfinished");
+        return false;
+    }
+
+    vm_compact(vm);
+
+    return true;
+}
+
+bool gab_load_many(GabVM *handle, const GabSource *units, size_t count, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || (count > 0 && !units)) {
+        gab_error_set(err, 0, 0, "gab_load_many requires a VM and its units");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+
+    if (!gab_load_allowed(vm, "gab_load_many", err)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!units[i].source) {
+            gab_error_set(err, 0, 0, "gab_load_many requires a source string for every unit");
+            return false;
+        }
+    }
+
+    CompileSource *sources = malloc((count ? count : 1) * sizeof(CompileSource));
+    FuncPrototype *compiled = malloc((count ? count : 1) * sizeof(FuncPrototype));
+    size_t *order = malloc((count ? count : 1) * sizeof(size_t));
+
+    if (!sources || !compiled || !order) {
+        free(sources);
+        free(compiled);
+        free(order);
+        gab_error_set(err, 0, 0, "out of memory");
+
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        sources[i] =
+            (CompileSource){.name = units[i].name ? units[i].name : "<script>", .source = units[i].source};
+    }
+
+    // The batch's own sink, which only the failing unit's error is copied to.
+    arena_reset(vm->env.compile_arena);
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, "<batch>");
+
+    size_t linked = 0;
+    size_t failed = 0;
+    bool ok = compile_batch(vm, sources, count, compiled, order, &linked, &failed, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+
+        // Which unit it was, which a single load's caller knows already.
+        if (err) {
+            char message[2 * sizeof(err->message)];
+            snprintf(message, sizeof(message), "%s: %s", sources[failed].name, err->message);
+            gab_error_set(err, err->line, err->column, message);
+        }
+    }
+
+    diagnostics_free(&diagnostics);
+
+    // Whatever linked runs, failure or not: a unit linked without its top level
+    // would be half present, callable with nothing it sets up done. One top
+    // level failing does not stop the rest, any more than it would the loads
+    // after it one at a time; its unit stays linked, as under gab_load.
+    for (size_t i = 0; i < linked; i++) {
+        if (interp_run_top_level(vm, &compiled[i]) == VM_RUN_OK) {
+            top_level_list_add(&vm->program.top_levels, compiled[i]);
+            continue;
+        }
+
+        // The first failure is the one reported, named as a compile error is.
+        if (ok && err) {
+            char message[2 * sizeof(err->message)];
+            snprintf(message, sizeof(message), "%s: %s", sources[order[i]].name, vm->error.message);
+            gab_error_set(err, 0, 0, message);
+        }
+
+        ok = false;
+        func_proto_free(&compiled[i]);
+    }
+
+    free(sources);
+    free(compiled);
+    free(order);
+
+    return ok;
+}
+
+// A GabLoad is the compile itself; the handle only hides its type.
+GabLoad *gab_load_async(GabVM *handle, const char *name, const char *src, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !src) {
+        gab_error_set(err, 0, 0, "gab_load_async requires a VM and a source string");
+        return NULL;
+    }
+
+    VM *vm = (VM *)handle;
+
+    // Asked now as well as at the finish, so a load that could never finish
+    // is refused before it costs a compile.
+    if (!gab_load_allowed(vm, "gab_load_async", err)) {
+        return NULL;
+    }
+
+    CompileAsync *job = compile_unit_async(vm, name ? name : "<script>", src);
+
+    if (!job) {
+        gab_error_set(err, 0, 0, "out of memory");
+        return NULL;
+    }
+
+    return (GabLoad *)job;
+}
+
+bool gab_load_ready(const GabLoad *load) { return load && compile_async_ready((const CompileAsync *)load); }
+
+bool gab_load_finish(GabLoad *load, GabError *err) {
+    gab_error_clear(err);
+
+    if (!load) {
+        gab_error_set(err, 0, 0, "gab_load_finish requires a load");
+        return false;
+    }
+
+    CompileAsync *job = (CompileAsync *)load;
+    VM *vm = compile_async_vm(job);
+
+    if (!gab_install_allowed(vm, "gab_load_finish", err)) {
+        return false;
+    }
+
+    arena_reset(vm->env.compile_arena);
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, "<async>");
+
+    FuncPrototype compiled = {0};
+    bool ok = compile_async_finish(job, &compiled, &diagnostics);
+
+    if (!ok) {
+        gab_error_from_diagnostics(err, &diagnostics);
+        diagnostics_free(&diagnostics);
+
+        return false;
+    }
+
+    diagnostics_free(&diagnostics);
+
+    // Run and kept as gab_load runs and keeps one.
+    if (interp_run_top_level(vm, &compiled) != VM_RUN_OK) {
+        gab_error_set(err, 0, 0, vm->error.message);
+        func_proto_free(&compiled);
+
+        return false;
+    }
+
+    top_level_list_add(&vm->program.top_levels, compiled);
+
+    return true;
+}
+
+void gab_defer_bodies(GabVM *handle, bool defer) {
+    VM *vm = (VM *)handle;
+
+    if (vm && !vm->owner) {
+        vm->env.defer_bodies = defer;
+    }
+}
+
+void gab_keep_sources(GabVM *handle, bool keep) {
+    VM *vm = (VM *)handle;
+
+    if (vm && !vm->owner) {
+        vm->env.keep_sources = keep;
+    }
+}
+
+bool gab_compile_deferred(GabVM *handle, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle) {
+        gab_error_set(err, 0, 0, "gab_compile_deferred requires a VM");
+        return false;
+    }
+
+    // On a context the bodies were all settled when it was made, so this only
+    // reads back what failed then.
+    const Diagnostic *failure = compile_deferred_all(gab_compiler(handle));
+
+    if (failure) {
+        gab_error_set(err, failure->span.line, failure->span.column, failure->message);
+        return false;
+    }
+
+    return true;
+}
+
+// --- Types -----------------------------------------------------------------
+
+// The scope a module's names live in. NULL or "" is the default module; an
+// unknown module name is a miss, reported as NULL rather than falling back to
+// the root, so a typo'd module does not silently resolve to a root symbol.
+//
+// Types and functions both come through here: the namespace is the scope, and
+// the only difference downstream is which of the scope's two tables is read.
+static Scope *gab_namespace(VM *vm, const char *module) {
+    if (!module || module[0] == '\0') {
+        return NULL;
+    }
+
+    String *interned = string_from_cstr(&vm->env.strings, module);
+    Scope **found = interned ? module_scope_map_lookup(vm->env.module_scopes, interned) : NULL;
+
+    return found ? *found : NULL;
+}
+
+const GabType *gab_find_type(GabVM *handle, const char *module, const char *name) {
+    if (!handle || !name) {
+        return NULL;
+    }
+
+    VM *vm = gab_compiler(handle);
+
+    Scope *scope = gab_namespace(vm, module);
+    if (!scope) {
+        return NULL;
+    }
+
+    // Interning is a lookup, not an insert-if-missing, only because the name
+    // of a type that exists is already in the pool.
+    String *interned = string_from_cstr(&vm->env.strings, name);
+    if (!interned) {
+        return NULL;
+    }
+
+    // Walks outward on a miss, so a module sees root-namespace types and
+    // builtins — the same visibility a script inside that module has, and the
+    // same walk gab_lookup does for symbols.
+    return (const GabType *)scope_type_lookup(scope, interned);
+}
+
+size_t gab_type_size(const GabType *type) { return type ? ((const Type *)type)->size : 0; }
+
+size_t gab_type_align(const GabType *type) { return type ? ((const Type *)type)->alignment : 0; }
+
+bool gab_field_offset(const GabType *handle, const char *field, size_t *out_offset) {
+    if (!handle || !field) {
+        return false;
+    }
+
+    const Type *type = (const Type *)handle;
+
+    // Field names are interned, but this compares text so that a host can ask
+    // about a name the pool has never seen without inserting it.
+    for (size_t i = 0; i < type->field_count; i++) {
+        const TypeField *candidate = &type->fields[i];
+
+        if (candidate->name && strcmp(candidate->name->data, field) == 0) {
+            if (out_offset) {
+                *out_offset = candidate->offset;
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// --- Heap objects ----------------------------------------------------------
+
+// The VM is taken but unused: an allocator is global today, and a host that
+// installs its own later would reach it through the VM rather than through a
+// changed signature.
+void *gab_new(GabVM *handle, const GabType *type) {
+    (void)handle;
+
+    if (!type) {
+        return NULL;
+    }
+
+    return gab_object_alloc(DEFAULT_ALLOCATOR, (const Type *)type);
+}
+
+void gab_free(GabVM *handle, void *object) {
+    (void)handle;
+
+    gab_object_free(DEFAULT_ALLOCATOR, object);
+}
+
+// --- Calling ---------------------------------------------------------------
+
+GabFunc *gab_lookup(GabVM *handle, const char *module, const char *name, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !name) {
+        gab_error_set(err, 0, 0, "gab_lookup requires a VM and a name");
+        return NULL;
+    }
+
+    VM *vm = (VM *)handle;
+    VM *compiler = gab_compiler(handle);
+
+    // A module scope parents to the root, so a bare lookup in a module also
+    // finds root declarations — the same visibility a script inside that
+    // module has.
+    Scope *scope = gab_namespace(compiler, module);
+
+    if (!scope) {
+        char message[256];
+        snprintf(message, sizeof(message), "no module named '%s'", module);
+        gab_error_set(err, 0, 0, message);
+
+        return NULL;
+    }
+
+    String *interned = string_from_cstr(&compiler->env.strings, name);
+    Symbol *symbol = interned ? scope_symbol_lookup(scope, interned) : NULL;
+
+    if (!symbol) {
+        char message[256];
+        snprintf(message, sizeof(message), "'%s' is not declared", name);
+        gab_error_set(err, 0, 0, message);
+
+        return NULL;
+    }
+
+    if (symbol->kind != SYMBOL_FUNC) {
+        char message[256];
+        snprintf(message, sizeof(message), "'%s' is not a function", name);
+        gab_error_set(err, 0, 0, message);
+
+        return NULL;
+    }
+
+    // A parameter list cannot outgrow the slots a frame addresses. Refused here
+    // so the fill loops below cannot run past their arrays.
+    if (symbol->func.param_count > VM_MAX_FRAME_SLOTS) {
         char message[256];
         snprintf(message, sizeof(message), "'%s' has more parameters than a frame can hold", name);
         gab_error_set(err, 0, 0, message);
@@ -480,33 +1214,130 @@ GabFunc *gab_lookup(GabVM *handle, const char *module, const char *name, GabErro
         return NULL;
     }
 
+    // A body a lazy load deferred is compiled when it is looked up rather than
+    // at its first call, so one that does not compile is the lookup's error --
+    // where a host checks for one -- instead of a call's.
+    if (!vm->owner && !symbol->func.is_extern && symbol->func.func_index != SYMBOL_FUNC_NO_BODY) {
+        FuncPrototype *proto = vm->program.prototypes.data[symbol->func.func_index];
+        const Diagnostic *failure = compile_deferred(vm, proto);
+
+        if (failure) {
+            gab_error_set(err, failure->span.line, failure->span.column, failure->message);
+            return NULL;
+        }
+    }
+
     GabFunc *fn = calloc(1, sizeof(GabFunc));
     if (!fn) {
         gab_error_set(err, 0, 0, "out of memory");
         return NULL;
     }
 
-    if (!gab_func_alloc_params(fn, symbol->func.param_count)) {
-        free(fn);
-        gab_error_set(err, 0, 0, "out of memory");
+    if (!gab_func_alloc_params(fn, symbol->func.param_count)) {
+        free(fn);
+        gab_error_set(err, 0, 0, "out of memory");
+
+        return NULL;
+    }
+
+    fn->symbol = symbol;
+
+    gab_func_bind(fn);
+
+    // The VM owns it from here, for good: a handle cannot be released early. A
+    // context looking one up owns its own, freed with the context.
+    // A host looks a function up once and calls it for the life of the VM, so
+    // the handles a program accumulates are bounded by the functions it calls.
+    func_handle_list_add(&vm->func_handles, fn);
+
+    return fn;
+}
+
+int gab_func_arity(const GabFunc *fn) { return fn ? (int)fn->sig_param_count : 0; }
+
+// Appends a type's script spelling at 'at', never past 'size', and returns the
+// length it needed. A pointer's name is derived from its pointee, as the
+// resolver's diagnostics derive it.
+static size_t gab_spell_type(const Type *type, char *buffer, size_t size, size_t at) {
+    if (type->name) {
+        int written =
+            snprintf(at < size ? buffer + at : NULL, at < size ? size - at : 0, "%s", type->name->data);
+        return at + (size_t)written;
+    }
+
+    int written = snprintf(at < size ? buffer + at : NULL, at < size ? size - at : 0, "%s",
+                           type->is_ref ? "ref " : "*");
+
+    return gab_spell_type(type->pointee, buffer, size, at + (size_t)written);
+}
+
+size_t gab_func_signature(const GabFunc *fn, char *buffer, size_t size) {
+    if (!fn) {
+        return 0;
+    }
+
+    if (size > 0) {
+        buffer[0] = '\0';
+    }
+
+    const Symbol *symbol = fn->symbol;
+    size_t at = 0;
+
+    at += (size_t)snprintf(size > 0 ? buffer : NULL, size, "func(");
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        if (i > 0) {
+            at += (size_t)snprintf(at < size ? buffer + at : NULL, at < size ? size - at : 0, ", ");
+        }
+
+        at = gab_spell_type(symbol->func.params[i], buffer, size, at);
+    }
+
+    at += (size_t)snprintf(at < size ? buffer + at : NULL, at < size ? size - at : 0, ")");
+
+    if (symbol->func.return_type) {
+        at += (size_t)snprintf(at < size ? buffer + at : NULL, at < size ? size - at : 0, ": ");
+        at = gab_spell_type(symbol->func.return_type, buffer, size, at);
+    }
+
+    return at;
+}
+
+GabFunc *gab_lookup_typed(GabVM *vm, const char *module, const char *name, const char *signature,
+                          GabError *err) {
+    GabFunc *fn = gab_lookup(vm, module, name, err);
+
+    if (!fn || !signature) {
+        return fn;
+    }
+
+    // Sized to the spelling, as a signature has no bound on its length: a few
+    // 'ref LongStructName' parameters outgrow any fixed buffer.
+    size_t length = gab_func_signature(fn, NULL, 0);
+    char *declared = malloc(length + 1);
 
+    if (!declared) {
+        gab_error_set(err, 0, 0, "out of memory");
         return NULL;
     }
 
-    fn->symbol = symbol;
+    gab_func_signature(fn, declared, length + 1);
+    bool matches = strcmp(declared, signature) == 0;
 
-    gab_func_bind(fn);
+    if (!matches) {
+        // gab_error_set truncates a message too long for the error to hold.
+        char message[512];
+        snprintf(message, sizeof(message), "'%s' is declared as %s, not %s", name, declared, signature);
+        gab_error_set(err, 0, 0, message);
+    }
 
-    // The VM owns it from here, for good: a handle cannot be released early.
-    // A host looks a function up once and calls it for the life of the VM, so
-    // the handles a program accumulates are bounded by the functions it calls.
-    func_handle_list_add(&vm->func_handles, fn);
+    free(declared);
 
-    return fn;
+    // The handle stays the VM's, like every other; a caller refused it just
+    // never sees it.
+    return matches ? fn : NULL;
 }
 
-int gab_func_arity(const GabFunc *fn) { return fn ? (int)fn->sig_param_count : 0; }
-
 static unsigned int gab_signature_slots(const Symbol *symbol) {
     unsigned int slots = 1;
 
@@ -718,6 +1549,30 @@ bool gab_arg_pointer(GabCall *call, int index, void *pointer, const GabType *poi
     return true;
 }
 
+// An argument never set would otherwise pass whatever the buffer held — zero
+// on the first call, the previous frame's value on every one after. Once every
+// parameter has been supplied this is skipped for good, so the per-frame path
+// stays free.
+static bool gab_call_ready(const GabCall *call, GabError *err) {
+    if (call->args_pending == 0) {
+        return true;
+    }
+
+    for (size_t i = 0; i < call->fn->sig_param_count; i++) {
+        if (call->arg_set[i]) {
+            continue;
+        }
+
+        char message[256];
+        snprintf(message, sizeof(message), "argument %zu was never set", i);
+        gab_error_set(err, 0, 0, message);
+
+        return false;
+    }
+
+    return true;
+}
+
 GabStatus gab_call(GabVM *handle, GabCall *call, void *ret, GabError *err) {
     gab_error_clear(err);
 
@@ -726,27 +1581,135 @@ GabStatus gab_call(GabVM *handle, GabCall *call, void *ret, GabError *err) {
         return GAB_ERR_ARG;
     }
 
+    if (!gab_call_ready(call, err)) {
+        return GAB_ERR_ARG;
+    }
+
+    return gab_call_frame((VM *)handle, call->fn, call->args + VM_SLOT_SIZE, ret, err);
+}
+
+GabStatus gab_call_unchecked(GabVM *handle, GabFunc *fn, const void *args, void *ret, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !fn) {
+        gab_error_set(err, 0, 0, "gab_call_unchecked requires a VM and a function");
+        return GAB_ERR_ARG;
+    }
+
+    return gab_call_frame((VM *)handle, fn, args, ret, err);
+}
+
+void *gab_frame_args(GabVM *handle, GabFunc *fn) {
+    if (!handle || !fn) {
+        return NULL;
+    }
+
     VM *vm = (VM *)handle;
-    GabFunc *fn = call->fn;
 
-    // An argument never set would otherwise pass whatever the buffer held —
-    // zero on the first call, the previous frame's value on every one after.
-    // Once every parameter has been supplied this is skipped for good, so the
-    // per-frame path stays free.
-    if (call->args_pending > 0) {
-        for (size_t i = 0; i < fn->sig_param_count; i++) {
-            if (call->arg_set[i]) {
-                continue;
-            }
+    return vm->stack + vm_call_base(vm) + VM_SLOT_SIZE;
+}
 
-            char message[256];
-            snprintf(message, sizeof(message), "argument %zu was never set", i);
-            gab_error_set(err, 0, 0, message);
+GabStatus gab_frame_call(GabVM *handle, GabFunc *fn, GabError *err) {
+    gab_error_clear(err);
 
-            return GAB_ERR_ARG;
-        }
+    if (!handle || !fn) {
+        gab_error_set(err, 0, 0, "gab_frame_call requires a VM and a function");
+        return GAB_ERR_ARG;
+    }
+
+    return gab_call_frame((VM *)handle, fn, NULL, NULL, err);
+}
+
+const void *gab_frame_result(GabVM *handle, GabFunc *fn) {
+    if (!handle || !fn || fn->return_size == 0) {
+        return NULL;
+    }
+
+    VM *vm = (VM *)handle;
+
+    return vm->stack + vm_call_base(vm);
+}
+
+GabStatus gab_call_batch(GabVM *handle, GabFunc *fn, void *items, size_t stride, size_t count, void *results,
+                         size_t result_stride, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !fn || (!items && count > 0)) {
+        gab_error_set(err, 0, 0, "gab_call_batch requires a VM, a function and items");
+        return GAB_ERR_ARG;
+    }
+
+    // An extern is the host's own C; looping over it belongs on the host's side
+    // of the boundary, not this one.
+    if (fn->symbol->func.is_extern || fn->sig_param_count != 1) {
+        gab_error_set(err, 0, 0, "gab_call_batch requires a script function of one parameter");
+        return GAB_ERR_ARG;
+    }
+
+    const Type *param = fn->sig_params[0];
+
+    bool by_pointer = param->kind == TYPE_POINTER;
+    size_t item_size = by_pointer ? param->pointee->size : param->size;
+
+    if (!by_pointer && param->kind != TYPE_STRUCT) {
+        gab_error_set(err, 0, 0, "gab_call_batch requires a struct, 'ref T' or '*T' parameter");
+        return GAB_ERR_ARG;
+    }
+
+    if (stride < item_size) {
+        gab_error_set(err, 0, 0, "stride is smaller than the parameter's type");
+        return GAB_ERR_ARG;
+    }
+
+    if (results && (fn->return_size == 0 || result_stride < fn->return_size)) {
+        gab_error_set(err, 0, 0, "results need a returning function and a stride as wide as its result");
+        return GAB_ERR_ARG;
     }
 
+    VM *vm = (VM *)handle;
+    size_t base = vm_call_base(vm);
+
+    bool nested = vm_call_nested(vm);
+    VmError outer_error;
+
+    if (nested) {
+        outer_error = vm->error;
+    }
+
+    InterpBatch batch = {
+        .items = items,
+        .stride = stride,
+        .count = count,
+        .arg_bytes = param->size,
+        .by_pointer = by_pointer,
+        .results = results,
+        .result_stride = result_stride,
+        .result_size = fn->return_size,
+    };
+
+    size_t done = 0;
+
+    VmRunStatus status =
+        interp_run_batch(vm, vm->image->prototypes.data[fn->symbol->func.func_index], base, &batch, &done);
+
+    if (status != VM_RUN_OK) {
+        char message[sizeof(vm->error.message) + 64];
+        snprintf(message, sizeof(message), "item %zu: %s", done, vm->error.message);
+        gab_error_set(err, 0, 0, message);
+    }
+
+    if (nested) {
+        vm->error = outer_error;
+    }
+
+    return status == VM_RUN_OK ? GAB_OK : GAB_ERR_RUNTIME;
+}
+
+// Runs 'fn' on a frame whose parameters are copied from 'args', which starts at
+// the first parameter's slot, or are already in place when 'args' is NULL.
+// Shared by every call path, which differ only in how much they checked and
+// copied before getting here.
+static GabStatus gab_call_frame(VM *vm, GabFunc *fn, const void *args, void *ret, GabError *err) {
     // Which table the index is into is the declaration's own kind, the same
     // thing codegen reserved against.
     //
@@ -758,28 +1721,38 @@ GabStatus gab_call(GabVM *handle, GabCall *call, void *ret, GabError *err) {
     size_t func_index = fn->symbol->func.func_index;
 
     assert(func_index != SYMBOL_FUNC_NO_BODY && "a loaded function has a body");
-    assert(func_index < (is_extern ? vm->program.extern_protos.size : vm->program.prototypes.size) &&
+    assert(func_index < (is_extern ? vm->image->extern_protos.size : vm->image->prototypes.size) &&
            "an installed index names a body in its own table");
 
-    // The call block goes above anything a module run left in frame zero, so a
-    // host call never overwrites top-level state it might want to read after.
-    size_t base_slot = vm->stack_capacity / 2;
-    size_t base = base_slot * VM_SLOT_SIZE;
+    size_t base = vm_call_base(vm);
 
-    // Frame zero is not on the stack during a host call; the callee's frame is
-    // the only one, and it returns into its own slot 0.
-    vm->frame_count = 0;
-    vm->registers = vm->stack + base;
+    // A nested call reports its own failure to the extern that made it, and the
+    // run that extern is part of carries on as it was, error state included.
+    bool nested = vm_call_nested(vm);
+    VmError outer_error;
+
+    if (nested) {
+        outer_error = vm->error;
+    }
 
     // Arguments start at slot 1 of the block, matching where the callee's
     // frame — based here — expects its parameters.
-    memcpy(vm->stack + base + VM_SLOT_SIZE, call->args + VM_SLOT_SIZE, fn->arg_slots * VM_SLOT_SIZE);
+    if (args && fn->arg_slots > 0) {
+        memcpy(vm->stack + base + VM_SLOT_SIZE, args, fn->arg_slots * VM_SLOT_SIZE);
+    }
 
-    VmRunStatus status = is_extern ? interp_run_extern(vm, &vm->program.extern_protos.data[func_index], base)
-                                   : interp_run_frame(vm, vm->program.prototypes.data[func_index], base, 0);
+    VmRunStatus status = is_extern ? interp_run_extern(vm, &vm->image->extern_protos.data[func_index], base)
+                                   : interp_run_frame(vm, vm->image->prototypes.data[func_index], base, 0);
 
     if (status != VM_RUN_OK) {
         gab_error_set(err, 0, 0, vm->error.message);
+    }
+
+    if (nested) {
+        vm->error = outer_error;
+    }
+
+    if (status != VM_RUN_OK) {
         return GAB_ERR_RUNTIME;
     }
 
@@ -791,3 +1764,268 @@ GabStatus gab_call(GabVM *handle, GabCall *call, void *ret, GabError *err) {
 
     return GAB_OK;
 }
+
+struct GabCoroutine {
+    VM *vm;
+    GabFunc *fn;
+    VmCoroutine co;
+
+    // Counted in VM::live_coroutines until it finishes or is freed.
+    bool live;
+};
+
+// Uncounted once it can no longer resume into any frame.
+static void gab_coroutine_settle(GabCoroutine *co) {
+    if (co->live && co->co.done) {
+        co->live = false;
+        co->vm->live_coroutines--;
+    }
+}
+
+GabCoroutine *gab_coroutine_new(GabVM *handle, GabCall *call, GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !call) {
+        gab_error_set(err, 0, 0, "gab_coroutine_new requires a VM and a call");
+        return NULL;
+    }
+
+    GabFunc *fn = call->fn;
+
+    // An extern's body is C, which has no frames for a yield to leave behind.
+    if (fn->symbol->func.is_extern) {
+        gab_error_set(err, 0, 0, "a coroutine runs a script function, not an extern");
+        return NULL;
+    }
+
+    if (!gab_call_ready(call, err)) {
+        return NULL;
+    }
+
+    GabCoroutine *co = calloc(1, sizeof(GabCoroutine));
+    uint8_t *stack = vm_stack_map(VM_STACK_SIZE);
+
+    if (!co || !stack) {
+        free(co);
+        vm_stack_unmap(stack, VM_STACK_SIZE);
+
+        gab_error_set(err, 0, 0, "out of memory");
+        return NULL;
+    }
+
+    VM *vm = (VM *)handle;
+
+    co->vm = vm;
+    co->fn = fn;
+    co->live = true;
+    vm->live_coroutines++;
+
+    interp_coroutine_init(&co->co, vm->image->prototypes.data[fn->symbol->func.func_index], stack,
+                          VM_STACK_SIZE);
+
+    // The first frame is based at the bottom of the coroutine's own stack, so
+    // its parameters go at slot 1 there, as gab_call_frame puts them at slot 1
+    // of its block.
+    if (fn->arg_slots > 0) {
+        memcpy(stack + VM_SLOT_SIZE, call->args + VM_SLOT_SIZE, fn->arg_slots * VM_SLOT_SIZE);
+    }
+
+    return co;
+}
+
+GabStatus gab_resume(GabCoroutine *co, void *out, GabError *err) {
+    gab_error_clear(err);
+
+    if (!co) {
+        gab_error_set(err, 0, 0, "gab_resume requires a coroutine");
+        return GAB_ERR_ARG;
+    }
+
+    if (co->co.done) {
+        gab_error_set(err, 0, 0, "the coroutine has finished");
+        return GAB_ERR_ARG;
+    }
+
+    // Its frames are on the VM's frame array below whatever resumed it, and
+    // its stack is in use: there is nothing consistent to run a second time.
+    if (co->co.running) {
+        gab_error_set(err, 0, 0, "the coroutine is already running");
+        return GAB_ERR_ARG;
+    }
+
+    VM *vm = co->vm;
+
+    bool nested = vm_call_nested(vm);
+    VmError outer_error;
+
+    if (nested) {
+        outer_error = vm->error;
+    }
+
+    VmRunStatus status = interp_resume(vm, &co->co);
+    gab_coroutine_settle(co);
+
+    if (status != VM_RUN_OK) {
+        gab_error_set(err, 0, 0, vm->error.message);
+    }
+
+    if (nested) {
+        vm->error = outer_error;
+    }
+
+    if (status != VM_RUN_OK) {
+        return GAB_ERR_RUNTIME;
+    }
+
+    // Both a yield and a return leave their value at the bottom frame's r0.
+    if (out) {
+        memcpy(out, co->co.stack, co->fn->return_size);
+    }
+
+    return GAB_OK;
+}
+
+bool gab_coroutine_done(const GabCoroutine *co) { return !co || co->co.done; }
+
+void gab_coroutine_free(GabCoroutine *co) {
+    if (!co) {
+        return;
+    }
+
+    if (co->live) {
+        co->vm->live_coroutines--;
+    }
+
+    interp_coroutine_discard(&co->co);
+    vm_stack_unmap(co->co.stack, co->co.stack_capacity);
+
+    free(co);
+}
+
+// --- Channels --------------------------------------------------------------
+
+GabChannel *gab_channel_new(const GabType *handle, GabError *err) {
+    gab_error_clear(err);
+
+    const Type *type = (const Type *)handle;
+
+    // The receiver frees what it was handed by the header's type, and only a
+    // struct is ever behind a '*T' a script can own.
+    if (!type || type->kind != TYPE_STRUCT) {
+        gab_error_set(err, 0, 0, "a channel carries objects of a struct type");
+        return NULL;
+    }
+
+    Channel *channel = channel_create(type);
+    if (!channel) {
+        gab_error_set(err, 0, 0, "out of memory");
+        return NULL;
+    }
+
+    return channel;
+}
+
+void gab_channel_free(GabChannel *channel) { channel_destroy(channel); }
+
+bool gab_channel_attach(GabVM *handle, const char *module, const char *name, GabChannel *channel,
+                        GabError *err) {
+    gab_error_clear(err);
+
+    if (!handle || !name || !channel) {
+        gab_error_set(err, 0, 0, "gab_channel_attach requires a VM, a name and a channel");
+        return false;
+    }
+
+    VM *vm = (VM *)handle;
+    VM *compiler = gab_compiler(handle);
+
+    // Growing the table below would move it under a worker reading it through
+    // a task's channels.
+    if (gab_tasks_live(vm, "gab_channel_attach", err)) {
+        return false;
+    }
+
+    Scope *scope = gab_namespace(compiler, module);
+    if (!scope) {
+        char message[256];
+        snprintf(message, sizeof(message), "no module named '%s'", module);
+        gab_error_set(err, 0, 0, message);
+
+        return false;
+    }
+
+    String *interned = string_from_cstr(&compiler->env.strings, name);
+    Symbol *symbol = interned ? scope_symbol_lookup(scope, interned) : NULL;
+
+    if (!symbol || symbol->kind != SYMBOL_CHANNEL) {
+        char message[256];
+        snprintf(message, sizeof(message), "'%s' is not a channel", name);
+        gab_error_set(err, 0, 0, message);
+
+        return false;
+    }
+
+    if (symbol->channel.element->pointee != channel->type) {
+        char message[256];
+        snprintf(message, sizeof(message), "'%s' carries '*%s', not the channel's type", name,
+                 symbol->channel.element->pointee->name->data);
+        gab_error_set(err, 0, 0, message);
+
+        return false;
+    }
+
+    // Every declared channel was registered with the program at link, so the
+    // only way to miss here is a declaration that never linked.
+    const ChannelList *declared = &vm->image->channels;
+    size_t index = declared->size;
+
+    for (size_t i = 0; i < declared->size; i++) {
+        if (declared->data[i] == symbol) {
+            index = i;
+            break;
+        }
+    }
+
+    if (index == declared->size) {
+        char message[256];
+        snprintf(message, sizeof(message), "'%s' is not part of the loaded program", name);
+        gab_error_set(err, 0, 0, message);
+
+        return false;
+    }
+
+    // Grown to the program's count rather than by one, since a program's
+    // channels are all known by now and most hosts attach every one of them.
+    if (index >= vm->channel_capacity) {
+        Channel **grown = realloc(vm->channels, declared->size * sizeof(Channel *));
+        if (!grown) {
+            gab_error_set(err, 0, 0, "out of memory");
+            return false;
+        }
+
+        memset(grown + vm->channel_capacity, 0, (declared->size - vm->channel_capacity) * sizeof(Channel *));
+
+        vm->channels = grown;
+        vm->channel_capacity = declared->size;
+    }
+
+    vm->channels[index] = channel;
+
+    return true;
+}
+
+bool gab_channel_send(GabChannel *channel, void *object) {
+    if (!channel || !object) {
+        return false;
+    }
+
+    // The one check a host send costs: a script receiving it trusts the type
+    // its declaration promised, and nothing after this point looks again.
+    if (gab_object_of(object)->type != channel->type) {
+        return false;
+    }
+
+    return channel_send(channel, object);
+}
+
+void *gab_channel_receive(GabChannel *channel) { return channel ? channel_receive(channel) : NULL; }
@@ -13,6 +13,8 @@ typedef struct GabVM GabVM;
 typedef struct GabFunc GabFunc;
 typedef struct GabType GabType;
 typedef struct GabCall GabCall;
+typedef struct GabCoroutine GabCoroutine;
+typedef struct GabChannel GabChannel;
 
 typedef enum {
     GAB_OK,
@@ -22,6 +24,13 @@ typedef enum {
 
 } GabStatus;
 
+// A script 'string' as it crosses the boundary: where the characters are and
+// how many there are. Not NUL-terminated, and owning nothing.
+typedef struct {
+    const char *data;
+    int32_t length;
+} GabString;
+
 // The message is copied rather than pointed at, so a GabError outlives the
 // compile that produced it. Only the first error is reported this way; a host
 // that wants every message can still walk the diagnostics.
@@ -36,6 +45,34 @@ typedef struct {
 GabVM *gab_vm_new(void);
 void gab_vm_free(GabVM *vm);
 
+// --- Contexts --------------------------------------------------------------
+
+// A context is a GabVM that runs another's compiled program on a stack of its
+// own: N threads call into one set of loaded modules on N contexts, compiled
+// once and shared rather than loaded into N VMs. The program is read, never
+// written, by a run, so contexts on different threads need no lock between
+// them -- but each context is one thread's at a time, as a VM is.
+//
+// A context takes every call a VM does: gab_call, gab_call_batch, the in-place
+// calls, and gab_args_vm hands one to an extern running on it. It loads
+// nothing and binds no externs; both are refused. Handles from the VM work on
+// all its contexts, and are best looked up there before any thread starts:
+// a lookup reads the VM's compile-time tables, which no other call on any
+// context touches but a concurrent lookup does.
+//
+// The program stays fixed while contexts share it, so gab_load on the VM is
+// refused until every context has been freed -- load everything first. Contexts
+// are made and freed on one thread, with gab_vm_free, before the VM itself.
+GabVM *gab_context_new(GabVM *vm, GabError *err);
+
+// A VM for one short-lived session -- a match, a request -- made from a
+// template that has loaded everything sessions need. Nothing is lexed,
+// compiled or registered again: the clone is a context of the template, with
+// a stack and heap objects of its own, so making one costs an allocation
+// rather than a compile. The template is the clone's read-only image, so it
+// loads nothing more while clones exist and is freed after the last of them.
+GabVM *gab_vm_clone(GabVM *template_vm, GabError *err);
+
 // --- Loading ---------------------------------------------------------------
 
 // Compiles a unit and runs its top level, which is what declares its functions
@@ -56,8 +93,186 @@ void gab_vm_free(GabVM *vm);
 // own 'module' directive, and is what the host passes to gab_lookup and
 // gab_find_type. Two units may name the same module, and one unit's name is
 // never the other's.
+//
+// Refused while a task spawned on the VM is unjoined, which a coroutine that
+// yielded between its 'spawn' and its 'join' leaves running on the pool:
+// loading grows the tables the task reads. Every other way of loading, and
+// freeing or compacting what was loaded, is refused alike.
 bool gab_load(GabVM *vm, const char *name, const char *src, GabError *err);
 
+// As gab_load, with 'src' 'length' bytes long rather than terminated: a slice
+// of a larger buffer loads without a copy of it made to end it.
+bool gab_load_len(GabVM *vm, const char *name, const char *src, size_t length, GabError *err);
+
+// As gab_load, with the unit the contents of the file at 'path', which also
+// names it. The file is mapped rather than read: the unit is lexed from the
+// file's own pages, and the mapping is what the VM keeps of the source for as
+// long as the unit's module is loaded, until gab_module_free or gab_vm_free.
+// The file must not be truncated or written to in place meanwhile; replacing
+// it with a new file, as editors save, leaves the mapped one as it was.
+bool gab_load_file(GabVM *vm, const char *path, GabError *err);
+
+// One unit of gab_load_many, named as gab_load names one.
+typedef struct {
+    const char *name;
+    const char *source;
+} GabSource;
+
+// Loads many units as gab_load loads each, compiling them on as many threads
+// as the machine has cores. The units may come in any order: one importing a
+// module another declares compiles after it, and units whose modules do not
+// import each other compile at the same time. Only units declaring into the
+// same module keep the order given.
+//
+// Every top level runs once all have compiled, each after those of the modules
+// it imports. On failure 'err' names the unit that failed; the units that had
+// linked before it stay loaded, top levels run, as after the same loads one at
+// a time. A top level failing at run time stops no other: every linked unit's
+// runs, and 'err' names the first that failed.
+bool gab_load_many(GabVM *vm, const GabSource *units, size_t count, GabError *err);
+
+// A load begun by gab_load_async and not yet finished.
+typedef struct GabLoad GabLoad;
+
+// Begins loading a unit as gab_load does, doing the expensive part -- lexing,
+// parsing, resolution and code generation -- on a thread of its own, and
+// returns at once. 'name' and 'src' are copied. NULL on failure, with 'err'
+// filled; a unit that does not compile is reported by gab_load_finish.
+//
+// The VM keeps running meanwhile: calls, coroutines, lookups and externs all
+// work as before. What it cannot do is load -- gab_load, gab_load_many and a
+// second gab_load_async are refused until this one is finished, since the
+// compile reads what the VM has loaded as it stood when the load began. A VM
+// freed with a load pending waits for its compile and discards it.
+GabLoad *gab_load_async(GabVM *vm, const char *name, const char *src, GabError *err);
+
+// Whether the compile is done, so gab_load_finish would not wait. For a host
+// polling once a frame rather than blocking on it.
+bool gab_load_ready(const GabLoad *load);
+
+// Installs what the compile produced and runs the unit's top level, waiting for
+// the compile first if it is not done. Cheap once it is. Returns false, with
+// 'err' filled, if the unit failed to compile, link or run, and frees the load
+// either way -- except when refused outright, for the reasons gab_load is, in
+// which case the load stays pending and may be finished later.
+bool gab_load_finish(GabLoad *load, GabError *err);
+
+// Whether loads from now on leave function bodies uncompiled until something
+// first reaches them -- a call, or a gab_lookup -- so a large program starts in
+// the time it takes to read its declarations. Off unless a host turns it on.
+// Ignored on a context, which loads nothing.
+//
+// A load checks every signature, type and import as it would have, and reports
+// a mistake in any of them at once; a mistake inside a body is found only when
+// the body is compiled, and is then that call's GAB_ERR_RUNTIME or that
+// lookup's failure -- the same error every time after. A body resolves against
+// its module as it stands when it is compiled, so it sees what later units
+// added. Bodies are all compiled before a context, a clone or a task can run
+// any of them, since only the VM's own thread may.
+void gab_defer_bodies(GabVM *vm, bool defer);
+
+// Whether loads from now on keep a copy of each unit's source, for as long as
+// its module is loaded: gab_vm_snapshot writes it and gab_reload compares an
+// edit against it, and both refuse a unit loaded without one. Off unless a
+// host turns it on, since the copy costs as much memory as the source again.
+// A unit loaded lazily or by gab_load_file keeps what it was read from
+// anyway, at no further cost. Ignored on a context, which loads nothing.
+void gab_keep_sources(GabVM *vm, bool keep);
+
+// Compiles every body a lazy load left, and returns false with the first error
+// -- line and column included -- if any of them does not compile. Every body
+// is compiled eagerly afterwards, as if the load had not deferred them: the
+// check a CI run makes before a lazily-loaded program ships.
+bool gab_compile_deferred(GabVM *vm, GabError *err);
+
+// Loads a unit as gab_load does, and gives back its function bodies compiled,
+// as bytes a later gab_load_compiled of the same source can load instead of
+// compiling them again -- in this process or another, on the same build of
+// gab. '*data' is malloc'd, set only on success, and the host's to store and
+// to free(). Every body is compiled, whether or not the VM defers them.
+bool gab_save_unit(GabVM *vm, const char *name, const char *src, void **data, size_t *size, GabError *err);
+
+// Loads a unit as gab_load does, taking its function bodies from what
+// gab_save_unit gave back rather than lexing, parsing and compiling each. The
+// declarations and the top level are still read from 'src', which is what
+// makes the unit's names exist in this VM, but no body of it is so much as
+// lexed.
+//
+// Refused, with 'err' saying so and nothing loaded, if the cache was saved
+// from other source, by another build of gab, or against modules -- the
+// unit's own, as it stood before the unit, and those it reaches through its
+// imports -- that this VM has not loaded as they were; the host then loads
+// the source as usual. A cache is trusted as far as that goes, like the
+// source it stands for: its bytecode is run as the compiler's would be, so it
+// should come from where the source does.
+bool gab_load_compiled(GabVM *vm, const char *name, const char *src, const void *data, size_t size,
+                       GabError *err);
+
+// Writes everything 'vm' has loaded to 'path' as an image: every unit and the
+// bytecode of every function, with any body still deferred compiled first.
+// Nothing in the file is an address, so any process can map it. Refused for a
+// VM holding a unit loaded without its source kept; see gab_keep_sources.
+bool gab_vm_snapshot(GabVM *vm, const char *path, GabError *err);
+
+// Restores an image gab_vm_snapshot wrote into 'vm', which must be new and
+// have loaded nothing: the host registers its externs on it first, as it
+// would before loading the units, and they are bound again by name. The file
+// is mapped read-only and its bytecode run where it lies, so every process
+// restored from one image shares its pages; it must not change while a VM
+// restored from it lives. Top levels are not run again: what they did, they
+// did in the VM that wrote the image.
+//
+// Refused, with 'err' saying so, for a file another build or another kind of
+// machine wrote, or one whose units do not declare here as they did there. A
+// VM a restore failed on is only fit for gab_vm_free.
+bool gab_vm_from_image(GabVM *vm, const char *path, GabError *err);
+
+// Replaces the bodies of a loaded unit with those 'src' gives them, in place:
+// 'name' is the name the unit was loaded under, and 'src' must declare what
+// it did, alike -- every function with its signature, every struct with its
+// fields in order, every channel and extern. Each function whose text
+// changed is compiled and swapped in under the index it already had, so every
+// script call to it and every GabFunc for it runs the new body from the next
+// call on. The top level is not run again.
+//
+// Refused, with 'err' naming the first declaration that differs or the first
+// error in a body, and nothing replaced, if it cannot be done that way; the
+// edit then needs a new VM. Not while contexts share the VM, from inside an
+// extern, or while a coroutine made from it is unfinished; nor for a unit
+// loaded without its source kept, having nothing to compare against. See
+// gab_keep_sources.
+bool gab_reload(GabVM *vm, const char *name, const char *src, GabError *err);
+
+// Unloads 'module' and gives back what it took: every unit loaded into it, the
+// code of its functions, its types, its scope, and the strings no other module
+// uses. A module loaded again afterwards starts as new. Every GabFunc for one
+// of its functions is freed with it, and a GabType for one of its types, a
+// GabCall for one of its functions or an object of one of its types must not
+// be used again: the host drops those first.
+//
+// Refused, with 'err' saying why, while another loaded module imports it --
+// free that one first -- and likewise not while contexts share the VM, from
+// inside an extern, while a load is pending, or while a coroutine made from
+// the VM is unfinished. A VM a module was freed from can no longer be
+// snapshot.
+bool gab_module_free(GabVM *vm, const char *module, GabError *err);
+
+// Gives back the memory loading needed and running does not, for a VM that is
+// done loading or will be for a while: every unit's top level, which has run
+// and never runs again, and the room each of the VM's tables kept to grow in.
+// The bytecode and constants of every function, which each load packed
+// together for its own unit, are moved into one read-only region for the
+// whole program, laid out so that a function is near what it calls. Worth it
+// for a host keeping many small VMs alive, where that is much of what each
+// one takes.
+//
+// Nothing a host holds changes: GabFuncs, GabTypes and GabCalls work as they
+// did, and the VM may go on loading, reloading and freeing modules. Code
+// loaded afterwards is left where it is until the next compaction. Refused,
+// with 'err' saying why, on a context, while contexts share the VM, from
+// inside an extern, or while a coroutine made from the VM is unfinished.
+bool gab_vm_compact(GabVM *vm, GabError *err);
+
 // --- Extern functions ------------------------------------------------------
 
 // A function the host defines and a script calls. The script declares its
@@ -83,8 +298,52 @@ typedef void (*GabExternFn)(GabArgs *args);
 //
 // The binding outlives any one load, so a host registers its externs once at
 // startup and loads scripts against them.
+//
+// A body is not always called on the thread that called into the script. An
+// extern may be called from a task 'spawn' started, or from the body of a
+// 'parallel for', and those run on the VM's pool of threads -- several at once,
+// so one body may be running on many threads together, and alongside any other.
+// A body touching state of the host's own has to be safe to call that way, or
+// be reached only from code that never runs as a task. 'spawn' itself refuses
+// an extern as the call it starts, but not the externs what it starts calls.
 bool gab_extern(GabVM *vm, const char *module, const char *name, GabExternFn fn, GabError *err);
 
+// Binds a plain C function as an extern body, called with its arguments as
+// native values and its result stored straight back: no GabArgs is built and no
+// accessor runs. For the scalar leaf functions that make up most of a binding
+// layer, where reading arguments through gab_arg_get_* costs more than the work.
+//
+// The suffix names the C signature, parameters first and then the result: 'i'
+// is an int32_t for an 'int', 'f' a float for a 'float', 'p' a pointer for a
+// 'ref T' parameter or a '*T' or 'ref T' result, and 'v' no result. The
+// declaration a script gives the name is held against it when the script loads,
+// and a mismatch fails the load naming the function, exactly as an unregistered
+// one does.
+//
+// A '*T' result hands the object over to the script, as 'new' would: the body
+// returns one gab_new made and keeps nothing of it. A 'ref T' result names
+// something its owner goes on owning.
+//
+// Such a body cannot fail the run, since it has no GabArgs to call gab_error
+// with. A function that must is registered with gab_extern instead.
+//
+// Registration is otherwise gab_extern's: same namespace, same duplicate rule,
+// and it must come before the load that declares the name.
+bool gab_extern_i_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(int32_t), GabError *err);
+bool gab_extern_ii_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(int32_t, int32_t),
+                     GabError *err);
+bool gab_extern_f_f(GabVM *vm, const char *module, const char *name, float (*fn)(float), GabError *err);
+bool gab_extern_ff_f(GabVM *vm, const char *module, const char *name, float (*fn)(float, float),
+                     GabError *err);
+bool gab_extern_p_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *), GabError *err);
+bool gab_extern_p_i(GabVM *vm, const char *module, const char *name, int32_t (*fn)(void *), GabError *err);
+bool gab_extern_p_f(GabVM *vm, const char *module, const char *name, float (*fn)(void *), GabError *err);
+bool gab_extern_p_p(GabVM *vm, const char *module, const char *name, void *(*fn)(void *), GabError *err);
+bool gab_extern_pi_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *, int32_t),
+                     GabError *err);
+bool gab_extern_pf_v(GabVM *vm, const char *module, const char *name, void (*fn)(void *, float),
+                     GabError *err);
+
 // Reading an extern's arguments. The index counts declared parameters from
 // zero, and a receiver is parameter zero for a method.
 //
@@ -136,6 +395,17 @@ void gab_return_pointer(GabArgs *args, void *pointer);
 // after this call is read.
 void gab_error(GabArgs *args, const char *message);
 
+// The VM running the extern, so a body can call back into a script -- a host
+// 'for_each' invoking a script callback, say. A gab_call made from inside an
+// extern is nested in the run that called it: its frame goes above every frame
+// that run has pushed, and it returns into the body, which carries on with its
+// own arguments intact. Its failure is reported to the body through its
+// GabError and does not fail the outer run; a body that wants it to calls
+// gab_error.
+//
+// Loading a unit is not a call, and is refused from inside one.
+GabVM *gab_args_vm(GabArgs *args);
+
 // --- Types and layout ------------------------------------------------------
 
 // A script struct's layout is the C layout, which is the whole zero-
@@ -197,6 +467,20 @@ GabFunc *gab_lookup(GabVM *vm, const char *module, const char *name, GabError *e
 
 int gab_func_arity(const GabFunc *fn);
 
+// The signature a function was declared with, spelled the way a script writes
+// one: "func(ref Player, int): int", or "func(float)" returning nothing. Written
+// into 'buffer' and truncated to fit, like snprintf, and likewise returns the
+// length the whole spelling needs.
+size_t gab_func_signature(const GabFunc *fn, char *buffer, size_t size);
+
+// gab_lookup, refused unless the function still has the signature the caller
+// was written against, spelled as gab_func_signature spells it. What a
+// generated binding calls: a script edited since the header was generated
+// fails here, once, naming the function, rather than being called with a
+// frame laid out for another signature.
+GabFunc *gab_lookup_typed(GabVM *vm, const char *module, const char *name, const char *signature,
+                          GabError *err);
+
 // --- Staging arguments -----------------------------------------------------
 
 // A GabCall is one caller's staged arguments for one function. A handle is
@@ -257,4 +541,127 @@ bool gab_arg_pointer(GabCall *call, int index, void *pointer, const GabType *poi
 // script still owns, and freeing it would be a double free.
 GabStatus gab_call(GabVM *vm, GabCall *call, void *ret, GabError *err);
 
+// Calls a function with its arguments already laid out as its frame expects
+// them, skipping every check gab_call and the gab_arg_* setters make. 'args'
+// holds the parameters from the first one's slot up: each at a multiple of four
+// bytes, a pointer taking eight, a string sixteen on LP64 -- its characters'
+// address, then an int32_t count, padded out to the pointer's alignment -- and
+// a bool widened to four.
+//
+// For a host whose arguments already sit in a C struct laid out as the
+// parameter list, so the one copy into the frame is the only one. The layout is
+// the caller's to get right -- the generated bindings fix theirs at build time
+// and verify the signature with gab_lookup_typed -- and a wrong one is a wrong
+// call, not an error.
+GabStatus gab_call_unchecked(GabVM *vm, GabFunc *fn, const void *args, void *ret, GabError *err);
+
+// --- Calling in place ------------------------------------------------------
+
+// A call with no staging at all. gab_frame_args is where the callee's
+// parameters live in the VM's own stack, laid out as gab_call_unchecked's
+// 'args'; the host writes them there, gab_frame_call runs on them as they
+// stand, and the result is read where it landed, at gab_frame_result. Each
+// argument is written once, by the host, and a struct result is never copied
+// out unless the host copies it.
+//
+// Unchecked, like gab_call_unchecked, and more fragile than GabCall in two
+// ways. The area is shared: anything else that calls into the VM between
+// writing the arguments and the call -- or between the call and reading the
+// result -- overwrites them. And it is not kept: the callee's frame is built on
+// top of it, so arguments are written afresh for every call rather than set
+// once and reused.
+//
+// gab_frame_result is NULL for a function that returns nothing.
+void *gab_frame_args(GabVM *vm, GabFunc *fn);
+GabStatus gab_frame_call(GabVM *vm, GabFunc *fn, GabError *err);
+const void *gab_frame_result(GabVM *vm, GabFunc *fn);
+
+// --- Calling over an array -------------------------------------------------
+
+// Runs a one-parameter function once for each of 'count' items laid out
+// 'stride' bytes apart from 'items'. A parameter 'ref T' or '*T' is handed each
+// item's address, so a script that writes through it writes the host's array;
+// a struct parameter is handed a copy. When 'results' is not NULL, item i's
+// result is written at 'results + i * result_stride'.
+//
+// The function, the strides and the frame are checked once for the whole
+// batch, and no argument is staged: this is for the same small function over
+// many entities, where per-call setup would otherwise cost more than the
+// script. A pointer parameter's items must be what it points to; only that
+// they fit the stride is checked.
+//
+// Stops at the first item that fails, with GAB_ERR_RUNTIME and the item's
+// index in the message. Items before it have run and written their results;
+// none after it have.
+GabStatus gab_call_batch(GabVM *vm, GabFunc *fn, void *items, size_t stride, size_t count, void *results,
+                         size_t result_stride, GabError *err);
+
+// --- Coroutines ------------------------------------------------------------
+
+// A call that can stop part way. Inside one, 'yield v;' hands 'v' to the host
+// and suspends the whole call -- every frame of it, however deep the yield --
+// until the host resumes it, when it carries on from the statement after.
+// A yield has the type of the function it is written in, and a function
+// called as a plain gab_call fails at its first yield.
+//
+// gab_coroutine_new takes the function and its arguments from a GabCall whose
+// arguments are all set, copying them: the call may be changed or freed after.
+// Nothing runs until the first gab_resume.
+//
+// Each coroutine has its own stack, reserved rather than allocated: it costs
+// address space up front and memory only as deep as its frames reach, and it
+// never moves, so a 'ref' to a local is still good after a resume.
+GabCoroutine *gab_coroutine_new(GabVM *vm, GabCall *call, GabError *err);
+
+// Runs the coroutine until it yields or returns, writing the value either
+// hands back to 'out' when that is not NULL -- as wide as the function's return
+// type. A coroutine that returned, or failed, is done and is not resumed again:
+// resuming it is GAB_ERR_ARG. A coroutine may be resumed from an extern,
+// including one running in another coroutine, but not from inside itself.
+GabStatus gab_resume(GabCoroutine *co, void *out, GabError *err);
+
+bool gab_coroutine_done(const GabCoroutine *co);
+
+// Frees a coroutine whether or not it finished, releasing whatever its
+// suspended frames still own. Coroutines are freed before their VM.
+void gab_coroutine_free(GabCoroutine *co);
+
+// --- Channels --------------------------------------------------------------
+
+// A queue of heap objects between threads, passed without copying: a message
+// is the object itself, and sending it hands over the only reference. A script
+// names one it was given with 'extern channel inbox: *Order;' and uses it with
+// 'send inbox, order;' -- after which 'order' names nothing -- and
+// 'receive o from inbox { ... } else { ... }', which takes the oldest message
+// if there is one and runs the else block, without waiting, if there is not.
+//
+// Sends never wait and never fail for want of a receiver; receives are safe
+// from any number of threads but are taken one at a time. The host owns a
+// channel and attaches it by name to each VM or context whose scripts use it.
+// What is still queued when it is freed is freed with it, by types the VM owns,
+// so channels are freed after the last run that uses them and before the VM.
+// Attaching the same channel to two contexts of one VM, on two threads, is the
+// whole of handing objects from one to the other.
+//
+// 'type' is the struct every message is an object of, as gab_find_type gives.
+// NULL when it is not a struct or memory ran out.
+GabChannel *gab_channel_new(const GabType *type, GabError *err);
+void gab_channel_free(GabChannel *channel);
+
+// Gives the 'extern channel' called 'name' in 'module' to the scripts run on
+// 'vm', and to the tasks they spawn. Refused unless the declaration's element is
+// a pointer to the channel's type. Attaching again replaces the earlier one; a
+// run that reaches a channel never attached fails there. Refused, as gab_load
+// is, while a task spawned on the VM is unjoined.
+bool gab_channel_attach(GabVM *vm, const char *module, const char *name, GabChannel *channel, GabError *err);
+
+// Queues an object from gab_new of the channel's type, which the channel owns
+// from here. False, leaving the object the caller's, when it is NULL or of
+// another type, or memory ran out.
+bool gab_channel_send(GabChannel *channel, void *object);
+
+// The oldest message, which the caller now owns and frees with gab_free or
+// sends on, or NULL when there is none. Never waits.
+void *gab_channel_receive(GabChannel *channel);
+
 #endif
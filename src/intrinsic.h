@@ -0,0 +1,32 @@
+#ifndef GAB_INTRINSIC_H
+#define GAB_INTRINSIC_H
+
+// A call the compiler answers with an instruction of its own rather than a call
+// into a body. Each is something a host would otherwise have to bind as an
+// extern, paying for an Args block and an indirect call to compute what one
+// dispatch does: a string's length is already in its header, and a square root
+// is a single hardware instruction.
+//
+// Named by the resolver, which rewrites nothing: the node stays a call, and the
+// tag is what tells codegen to emit the instruction in place of OP_CALL.
+typedef enum {
+    INTRINSIC_NONE,
+
+    // 's.len()'. A method on the builtin string type, never a free name.
+    INTRINSIC_LEN,
+
+    // Free functions over the numeric types. The three below take a float and
+    // nothing else: an int has no fraction to round and no root to take
+    // without first choosing a rounding for it.
+    INTRINSIC_SQRT,
+    INTRINSIC_FLOOR,
+    INTRINSIC_CEIL,
+
+    // Defined for both int and float, on operands of one type.
+    INTRINSIC_ABS,
+    INTRINSIC_MIN,
+    INTRINSIC_MAX,
+    INTRINSIC_CLAMP,
+} Intrinsic;
+
+#endif
@@ -10,10 +10,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-char lexer_peek(Lexer *lexer) { return lexer->source[lexer->pos]; }
+// Past the end reads as the '\0' a terminated source would have there, so
+// nothing further in has to ask where the source ends.
+char lexer_peek(Lexer *lexer) {
+    return (size_t)lexer->pos < lexer->length ? lexer->source[lexer->pos] : '\0';
+}
+
+static char lexer_peek_next(Lexer *lexer) {
+    return (size_t)lexer->pos + 1 < lexer->length ? lexer->source[lexer->pos + 1] : '\0';
+}
 
 void lexer_eat(Lexer *lexer) {
-    if (lexer->source[lexer->pos] == '\n') {
+    if (lexer_peek(lexer) == '\n') {
         lexer->line++;
         lexer->column = 1;
     } else {
@@ -125,12 +133,24 @@ const char *token_description(TokenType type) {
         return "'new'";
     case TOKEN_REF:
         return "'ref'";
+    case TOKEN_SPAWN:
+        return "'spawn'";
+    case TOKEN_JOIN:
+        return "'join'";
+    case TOKEN_PARALLEL:
+        return "'parallel'";
+    case TOKEN_SEND:
+        return "'send'";
+    case TOKEN_RECEIVE:
+        return "'receive'";
     case TOKEN_MODULE:
         return "'module'";
     case TOKEN_IMPORT:
         return "'import'";
     case TOKEN_RETURN:
         return "'return'";
+    case TOKEN_YIELD:
+        return "'yield'";
     case TOKEN_IF:
         return "'if'";
     case TOKEN_ELSE:
@@ -150,6 +170,37 @@ const char *token_description(TokenType type) {
     return "unknown token";
 }
 
+// Grows the scratch buffer to hold at least 'needed' bytes. The buffer is
+// reused across literals, so it settles at the longest one in the file.
+static bool lexer_reserve(Lexer *lexer, size_t needed) {
+    if (needed <= lexer->scratch_capacity) {
+        return true;
+    }
+
+    size_t capacity = lexer->scratch_capacity ? lexer->scratch_capacity : 32;
+
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    char *grown = arena_alloc(lexer->arena, capacity);
+
+    if (!grown) {
+        return false;
+    }
+
+    // Only when there is something to carry over: the first growth has no
+    // buffer yet, and memcpy may not be handed a null even for zero bytes.
+    if (lexer->scratch) {
+        memcpy(grown, lexer->scratch, lexer->scratch_capacity);
+    }
+
+    lexer->scratch = grown;
+    lexer->scratch_capacity = capacity;
+
+    return true;
+}
+
 static Token lexer_number(Lexer *lexer) {
     Span opened = {.line = lexer->start_line, .column = lexer->start_column};
     const char *begin = lexer->source + lexer->pos;
@@ -169,9 +220,27 @@ static Token lexer_number(Lexer *lexer) {
         type = TOKEN_FLOAT;
     }
 
-    // strtol and strtod read up to the first character that cannot continue the
-    // number, and the scan above has already found where that is -- so the
-    // digits are converted in place rather than copied out to be terminated.
+    // strtol reads up to the first character that cannot continue the number,
+    // and the scan above has already found where that is -- so an int's digits
+    // are converted in place rather than copied out to be terminated. Unless
+    // the source ends with them, where nothing stops the read but what lies past
+    // the end. A float's are always copied: strtof goes on into an exponent the
+    // scan does not take, so '1.5e' ending the source reads past it, and '1.5e3'
+    // would convert as more than the token the lexer made of it.
+    if (type == TOKEN_FLOAT || (size_t)lexer->pos >= lexer->length) {
+        size_t digits = (size_t)(lexer->source + lexer->pos - begin);
+
+        if (!lexer_reserve(lexer, digits + 1)) {
+            diag_error(lexer->diagnostics, GAB_ERR_SYNTAX, opened, "numeric literal is too long");
+
+            return token_create(lexer, TOKEN_INVALID);
+        }
+
+        memcpy(lexer->scratch, begin, digits);
+        lexer->scratch[digits] = '\0';
+        begin = lexer->scratch;
+    }
+
     if (type == TOKEN_FLOAT) {
         return token_create_value(lexer, type, (TokenValue){.as_float = strtof(begin, NULL)});
     }
@@ -190,37 +259,6 @@ static Token lexer_number(Lexer *lexer) {
 
     return token_create_value(lexer, type, (TokenValue){.as_int = (int32_t)value});
 }
-// Grows the scratch buffer to hold at least 'needed' bytes. The buffer is
-// reused across literals, so it settles at the longest one in the file.
-static bool lexer_reserve(Lexer *lexer, size_t needed) {
-    if (needed <= lexer->scratch_capacity) {
-        return true;
-    }
-
-    size_t capacity = lexer->scratch_capacity ? lexer->scratch_capacity : 32;
-
-    while (capacity < needed) {
-        capacity *= 2;
-    }
-
-    char *grown = arena_alloc(lexer->arena, capacity);
-
-    if (!grown) {
-        return false;
-    }
-
-    // Only when there is something to carry over: the first growth has no
-    // buffer yet, and memcpy may not be handed a null even for zero bytes.
-    if (lexer->scratch) {
-        memcpy(grown, lexer->scratch, lexer->scratch_capacity);
-    }
-
-    lexer->scratch = grown;
-    lexer->scratch_capacity = capacity;
-
-    return true;
-}
-
 // The character an escape denotes, or -1 if the language defines none for it.
 static int escape_value(char ch) {
     switch (ch) {
@@ -353,6 +391,26 @@ static Token lexer_identifier(Lexer *lexer) {
         return token_create_ref(lexer, TOKEN_REF, ref);
     }
 
+    if (string_ref_equals_cstr(ref, "spawn")) {
+        return token_create_ref(lexer, TOKEN_SPAWN, ref);
+    }
+
+    if (string_ref_equals_cstr(ref, "join")) {
+        return token_create_ref(lexer, TOKEN_JOIN, ref);
+    }
+
+    if (string_ref_equals_cstr(ref, "parallel")) {
+        return token_create_ref(lexer, TOKEN_PARALLEL, ref);
+    }
+
+    if (string_ref_equals_cstr(ref, "send")) {
+        return token_create_ref(lexer, TOKEN_SEND, ref);
+    }
+
+    if (string_ref_equals_cstr(ref, "receive")) {
+        return token_create_ref(lexer, TOKEN_RECEIVE, ref);
+    }
+
     if (string_ref_equals_cstr(ref, "module")) {
         return token_create_ref(lexer, TOKEN_MODULE, ref);
     }
@@ -365,6 +423,10 @@ static Token lexer_identifier(Lexer *lexer) {
         return token_create_ref(lexer, TOKEN_RETURN, ref);
     }
 
+    if (string_ref_equals_cstr(ref, "yield")) {
+        return token_create_ref(lexer, TOKEN_YIELD, ref);
+    }
+
     if (string_ref_equals_cstr(ref, "true")) {
         return token_create_ref(lexer, TOKEN_TRUE, ref);
     }
@@ -377,8 +439,14 @@ static Token lexer_identifier(Lexer *lexer) {
 }
 
 Lexer lexer_create(const char *source, Arena *arena, StringPool *strings, Diagnostics *diagnostics) {
+    return lexer_create_len(source, strlen(source), arena, strings, diagnostics);
+}
+
+Lexer lexer_create_len(const char *source, size_t length, Arena *arena, StringPool *strings,
+                       Diagnostics *diagnostics) {
     return (Lexer){
         .source = source,
+        .length = length,
         .pos = 0,
         .line = 1,
         .column = 1,
@@ -446,7 +514,7 @@ static void lexer_skip_trivia(Lexer *lexer) {
             return;
         }
 
-        char next = lexer->source[lexer->pos + 1];
+        char next = lexer_peek_next(lexer);
 
         if (next == '/') {
             while (lexer_peek(lexer) != '\n' && lexer_peek(lexer) != '\0') {
@@ -465,7 +533,7 @@ static void lexer_skip_trivia(Lexer *lexer) {
             lexer_eat(lexer);
 
             // Nesting is not supported: the first '*/' closes the comment.
-            while (!(lexer_peek(lexer) == '*' && lexer->source[lexer->pos + 1] == '/')) {
+            while (!(lexer_peek(lexer) == '*' && lexer_peek_next(lexer) == '/')) {
                 if (lexer_peek(lexer) == '\0') {
                     diag_error(lexer->diagnostics, GAB_ERR_SYNTAX, (Span){.line = line, .column = column},
                                "unterminated block comment");
@@ -487,13 +555,14 @@ static void lexer_skip_trivia(Lexer *lexer) {
 Token lexer_next(Lexer *lexer) {
     lexer_skip_trivia(lexer);
 
+    lexer->start_pos = lexer->pos;
     lexer->start_line = lexer->line;
     lexer->start_column = lexer->column;
 
     // A leading '.' still starts a float, but only when a digit follows it;
     // otherwise it is field access.
     if (isdigit(lexer_peek(lexer)) ||
-        (lexer_peek(lexer) == '.' && isdigit((unsigned char)lexer->source[lexer->pos + 1]))) {
+        (lexer_peek(lexer) == '.' && isdigit((unsigned char)lexer_peek_next(lexer)))) {
         return lexer_number(lexer);
     }
 
@@ -53,6 +53,7 @@ typedef enum {
     TOKEN_MODULE,      // 'module'
     TOKEN_IMPORT,      // 'import'
     TOKEN_RETURN,      // 'return'
+    TOKEN_YIELD,       // 'yield'
     TOKEN_IF,          // 'if'
     TOKEN_ELSE,        // 'else'
     TOKEN_FOR,         // 'for'
@@ -62,6 +63,11 @@ typedef enum {
     TOKEN_FALSE,       // 'false'
     TOKEN_NEW,         // 'new'
     TOKEN_REF,         // 'ref'
+    TOKEN_SPAWN,       // 'spawn'
+    TOKEN_JOIN,        // 'join'
+    TOKEN_PARALLEL,    // 'parallel'
+    TOKEN_SEND,        // 'send'
+    TOKEN_RECEIVE,     // 'receive'
                        // END KEYWORDS
     TOKEN_IDENT,       // Variable and function names
 } TokenType;
@@ -90,13 +96,20 @@ typedef struct {
 } Token;
 
 typedef struct {
+    // Read up to 'length' and never past it, so a source need not be
+    // terminated: a file's mapping ends where the file does. A '\0' before
+    // then ends it too, as it always has.
     const char *source;
+    size_t length;
+
     int pos;
     int line;
     int column;
 
     // Start position of the token currently being built, so a token points at
-    // its first character rather than its last.
+    // its first character rather than its last. The offset too, which a token
+    // does not carry: punctuation has no lexeme to take it from.
+    int start_pos;
     int start_line;
     int start_column;
 
@@ -115,6 +128,11 @@ typedef struct {
 } Lexer;
 
 Lexer lexer_create(const char *source, Arena *arena, StringPool *strings, Diagnostics *diagnostics);
+
+// As lexer_create, for a source of 'length' bytes that need not be followed by
+// a '\0'.
+Lexer lexer_create_len(const char *source, size_t length, Arena *arena, StringPool *strings,
+                       Diagnostics *diagnostics);
 Token lexer_next(Lexer *lexer);
 
 Span token_span(Token token);
@@ -1,5 +1,7 @@
 #include "object.h"
 
+#include "vm/task.h"
+
 #include <assert.h>
 #include <string.h>
 
@@ -67,6 +69,13 @@ void gab_object_free(Allocator allocator, void *payload) {
 
     ObjectHeader *header = gab_object_of(payload);
 
+    // A task handle is owned like an object, but what it holds is a call that
+    // may still be running, which only the task can end.
+    if (header->type->kind == TYPE_TASK) {
+        task_discard(payload);
+        return;
+    }
+
     free_fields(allocator, header->type, (char *)payload);
 
     allocator.free(allocator.ctx, header);
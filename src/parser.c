@@ -19,9 +19,14 @@ static ASTField *parse_field(Parser *parser, const char *name_message);
 static TypeSpec *parse_type_spec(Parser *parser);
 static ASTStmt *parse_if_stmt(Parser *parser);
 static ASTStmt *parse_for_stmt(Parser *parser);
+static ASTStmt *parse_parallel_for_stmt(Parser *parser);
 static ASTStmt *parse_jump_stmt(Parser *parser);
 static ASTStmt *parse_block_stmt(Parser *parser);
 static ASTStmt *parse_return_stmt(Parser *parser);
+static ASTStmt *parse_yield_stmt(Parser *parser);
+static ASTStmt *parse_channel_decl_stmt(Parser *parser, Span span);
+static ASTStmt *parse_send_stmt(Parser *parser);
+static ASTStmt *parse_receive_stmt(Parser *parser);
 static ASTStmt *parse_expr_stmt(Parser *parser);
 static bool stmt_needs_terminator(ASTStmt *stmt);
 
@@ -233,9 +238,13 @@ static void parser_synchronize(Parser *parser) {
         case TOKEN_MODULE:
         case TOKEN_IF:
         case TOKEN_FOR:
+        case TOKEN_PARALLEL:
         case TOKEN_BREAK:
         case TOKEN_CONTINUE:
         case TOKEN_RETURN:
+        case TOKEN_YIELD:
+        case TOKEN_SEND:
+        case TOKEN_RECEIVE:
             return;
         default:
             parser_next_token(parser);
@@ -320,6 +329,10 @@ static ASTStmt *parse_statement(Parser *parser) {
         stmt = parse_for_stmt(parser);
         break;
     }
+    case TOKEN_PARALLEL: {
+        stmt = parse_parallel_for_stmt(parser);
+        break;
+    }
     case TOKEN_BREAK:
     case TOKEN_CONTINUE: {
         stmt = parse_jump_stmt(parser);
@@ -333,6 +346,18 @@ static ASTStmt *parse_statement(Parser *parser) {
         stmt = parse_return_stmt(parser);
         break;
     }
+    case TOKEN_YIELD: {
+        stmt = parse_yield_stmt(parser);
+        break;
+    }
+    case TOKEN_SEND: {
+        stmt = parse_send_stmt(parser);
+        break;
+    }
+    case TOKEN_RECEIVE: {
+        stmt = parse_receive_stmt(parser);
+        break;
+    }
     default: {
         stmt = parse_expr_stmt(parser);
         break;
@@ -545,6 +570,29 @@ static ASTStmt *parse_for_stmt(Parser *parser) {
     return ast_for_stmt_create(span, init, condition, post, body);
 }
 
+// 'parallel for ...': a loop like any other, marked. Whether it has the
+// counting shape the mark needs is the resolver's to say, with the loop's
+// variables in hand.
+static ASTStmt *parse_parallel_for_stmt(Parser *parser) {
+    Span span = parser_span(parser);
+
+    parser_next_token(parser); // eat "parallel"
+
+    if (!parser_expect(parser, TOKEN_FOR, "expected 'for' after 'parallel'")) {
+        return NULL;
+    }
+
+    ASTStmt *stmt = parse_for_stmt(parser);
+    if (!stmt) {
+        return NULL;
+    }
+
+    stmt->forstmt.parallel = true;
+    stmt->span = span;
+
+    return stmt;
+}
+
 static ASTStmt *parse_jump_stmt(Parser *parser) {
     Span span = parser_span(parser);
     bool is_break = parser->current.type == TOKEN_BREAK;
@@ -723,17 +771,91 @@ static ASTStmt *parse_struct_decl_stmt(Parser *parser) {
     return ast_struct_decl_stmt_create(span, name, fields);
 }
 
+// Steps over a block without building it: brace to matching brace, by token,
+// so a brace inside a string literal is not counted. Lexing is still done --
+// a character no token starts with is reported here rather than when the body
+// is finally compiled, which may be never.
+static bool parser_skip_block(Parser *parser) {
+    if (!parser_expect(parser, TOKEN_LBRACE, "expected '{'")) {
+        return false;
+    }
+
+    // Trusted rather than checked: whoever supplied the spans vouched that
+    // they were recorded from this same source.
+    if (parser->known_next < parser->known_count &&
+        parser->known_spans[parser->known_next].start == (size_t)parser->lexer->start_pos) {
+        const ParserBodySpan *span = &parser->known_spans[parser->known_next++];
+
+        parser->lexer->pos = (int)span->resume;
+        parser->lexer->line = span->line;
+        parser->lexer->column = span->column;
+
+        parser_next_token(parser);
+        return true;
+    }
+
+    size_t depth = 0;
+
+    do {
+        switch (parser->current.type) {
+        case TOKEN_LBRACE:
+            depth++;
+            break;
+        case TOKEN_RBRACE:
+            depth--;
+            break;
+        case TOKEN_EOF:
+            parser_error_found(parser, "expected '}' to close the block");
+            return false;
+        default:
+            break;
+        }
+
+        parser_next_token(parser);
+    } while (depth > 0);
+
+    return true;
+}
+
+ASTStmt *parser_parse_func_decl(Parser *parser) {
+    parser_next_token(parser);
+
+    if (parser->current.type != TOKEN_FUNC) {
+        parser_error_found(parser, "expected 'func'");
+        return NULL;
+    }
+
+    return parse_func_decl_stmt(parser);
+}
+
 // 'extern func f(x: int): int;' declares a signature whose body the host
 // supplies. The keyword is what makes a missing body a declaration rather than
 // an error, so the two spellings never have to be told apart by guessing.
+//
+// 'extern pure func' adds that the body has no effects and answers the same
+// arguments the same way. 'pure' is only a keyword in this one position, so a
+// script naming a variable 'pure' is unaffected.
+//
+// 'extern channel' is read here too, for the same reason: 'channel' is a
+// keyword only after 'extern'.
 static ASTStmt *parse_func_decl_stmt(Parser *parser) {
     Span span = parser_span(parser);
+    size_t source_offset = (size_t)(parser->current.lexeme.data - parser->lexer->source);
 
     bool is_extern = parser->current.type == TOKEN_EXTERN;
+    bool is_pure = false;
 
     if (is_extern) {
         parser_next_token(parser); // eat "extern"
 
+        if (parser->current.type == TOKEN_IDENT && string_ref_equals_cstr(parser->current.lexeme, "pure")) {
+            parser_next_token(parser); // eat "pure"
+            is_pure = true;
+        } else if (parser->current.type == TOKEN_IDENT &&
+                   string_ref_equals_cstr(parser->current.lexeme, "channel")) {
+            return parse_channel_decl_stmt(parser, span);
+        }
+
         if (!parser_expect(parser, TOKEN_FUNC, "expected 'func' after 'extern'")) {
             return NULL;
         }
@@ -828,10 +950,61 @@ static ASTStmt *parse_func_decl_stmt(Parser *parser) {
             return NULL;
         }
 
-        return ast_func_decl_stmt_create(span, func_name, receiver, func_type, func_params, NULL);
+        ASTStmt *stmt = ast_func_decl_stmt_create(span, func_name, receiver, func_type, func_params, NULL);
+        stmt->func_decl.is_pure = is_pure;
+
+        return stmt;
+    }
+
+    // Kept as where it starts, not as an AST: a body nothing calls costs its
+    // tokens once and nothing after. A mistake inside it is the compile's to
+    // find, when the body is reached.
+    if (parser->defer_bodies) {
+        size_t skipped_start = (size_t)parser->lexer->start_pos;
+
+        if (!parser_skip_block(parser)) {
+            ast_field_destroy(receiver);
+            type_spec_destroy(func_type);
+            ast_field_list_free(&func_params);
+
+            return NULL;
+        }
+
+        if (parser->record_spans) {
+            ParserBodySpan skipped = {
+                .start = skipped_start,
+                .resume = (size_t)parser->lexer->start_pos,
+                .line = parser->current.line,
+                .column = parser->current.column,
+            };
+
+            parser_body_span_list_add(parser->record_spans, skipped);
+        }
+
+        ASTStmt *stmt = ast_func_decl_stmt_create(span, func_name, receiver, func_type, func_params, NULL);
+        stmt->func_decl.deferred = true;
+        stmt->func_decl.source_offset = source_offset;
+
+        return stmt;
     }
 
+    size_t body_start = (size_t)parser->lexer->start_pos;
+
     ASTStmt *func_body = parse_block_stmt(parser);
+
+    // The token after the '}' is the current one now, and the last the lexer
+    // started, so its offset is the lexer's.
+    if (func_body && parser->record_spans) {
+        ParserBodySpan span = {
+            .start = body_start,
+            .resume = (size_t)parser->lexer->start_pos,
+            .line = parser->current.line,
+            .column = parser->current.column,
+        };
+
+        parser_body_span_list_add(parser->record_spans, span);
+    }
+
     if (!func_body) {
         // The return type is parsed before the body, so a body that fails to
         // parse leaves it owned by nobody: the node that would have taken it is
@@ -859,6 +1032,126 @@ static ASTStmt *parse_return_stmt(Parser *parser) {
     return ast_return_stmt_create(span, result);
 }
 
+// 'yield;' or 'yield value;'. The value is optional where return's is not: a
+// coroutine that computes nothing still has to be able to pause.
+static ASTStmt *parse_yield_stmt(Parser *parser) {
+    Span span = parser_span(parser);
+
+    parser_next_token(parser); // eat "yield"
+
+    if (parser->current.type == TOKEN_SEMICOLON) {
+        return ast_yield_stmt_create(span, NULL);
+    }
+
+    ASTExpr *value = parse_expression(parser);
+    if (!value) {
+        return NULL;
+    }
+
+    return ast_yield_stmt_create(span, value);
+}
+
+// 'extern channel inbox: *Event;', from the name on: parse_func_decl_stmt has
+// eaten the 'extern' that decided this was a channel.
+static ASTStmt *parse_channel_decl_stmt(Parser *parser, Span span) {
+    parser_next_token(parser); // eat "channel"
+
+    if (!parser_expect(parser, TOKEN_IDENT, "expected a channel name after 'channel'")) {
+        return NULL;
+    }
+
+    StringRef name = parser->current.lexeme;
+    parser_next_token(parser); // eat channel name
+
+    if (!parser_expect(parser, TOKEN_COLON, "expected ':' and the type a channel carries")) {
+        return NULL;
+    }
+
+    parser_next_token(parser); // eat ':'
+
+    TypeSpec *spec = parse_type_spec(parser);
+    if (!spec) {
+        return NULL;
+    }
+
+    return ast_channel_decl_stmt_create(span, name, spec);
+}
+
+// 'send inbox, e;'. The channel is a name rather than an expression: a channel
+// is only ever declared at module level, so there is nothing else it could be.
+static ASTStmt *parse_send_stmt(Parser *parser) {
+    Span span = parser_span(parser);
+
+    parser_next_token(parser); // eat "send"
+
+    if (!parser_expect(parser, TOKEN_IDENT, "expected a channel name after 'send'")) {
+        return NULL;
+    }
+
+    StringRef channel = parser->current.lexeme;
+    parser_next_token(parser); // eat channel name
+
+    if (!parser_expect(parser, TOKEN_COMMA, "expected ',' after the channel")) {
+        return NULL;
+    }
+
+    parser_next_token(parser); // eat ','
+
+    ASTExpr *value = parse_expression(parser);
+    if (!value) {
+        return NULL;
+    }
+
+    return ast_send_stmt_create(span, channel, value);
+}
+
+// 'receive e from inbox { ... } else { ... }'. 'from' is only a keyword here,
+// as 'pure' is only one after 'extern'.
+static ASTStmt *parse_receive_stmt(Parser *parser) {
+    Span span = parser_span(parser);
+
+    parser_next_token(parser); // eat "receive"
+
+    if (!parser_expect(parser, TOKEN_IDENT, "expected a variable name after 'receive'")) {
+        return NULL;
+    }
+
+    StringRef name = parser->current.lexeme;
+    parser_next_token(parser); // eat variable name
+
+    if (parser->current.type != TOKEN_IDENT || !string_ref_equals_cstr(parser->current.lexeme, "from")) {
+        parser_error_found(parser, "expected 'from' and a channel");
+        return NULL;
+    }
+
+    parser_next_token(parser); // eat "from"
+
+    if (!parser_expect(parser, TOKEN_IDENT, "expected a channel name after 'from'")) {
+        return NULL;
+    }
+
+    StringRef channel = parser->current.lexeme;
+    parser_next_token(parser); // eat channel name
+
+    ASTStmt *then_block = parse_block_stmt(parser);
+    if (!then_block) {
+        return NULL;
+    }
+
+    if (parser->current.type != TOKEN_ELSE) {
+        return ast_receive_stmt_create(span, name, channel, then_block, NULL);
+    }
+
+    parser_next_token(parser); // eat "else"
+    ASTStmt *else_block = parse_block_stmt(parser);
+    if (!else_block) {
+        ast_stmt_destroy(then_block);
+        return NULL;
+    }
+
+    return ast_receive_stmt_create(span, name, channel, then_block, else_block);
+}
+
 // Whether a token is a compound assignment operator, and which binary
 // operation it assigns the result of. 'op' may be NULL to ask only the former.
 static bool compound_assign_op(TokenType type, BinOp *op) {
@@ -938,11 +1231,12 @@ static bool stmt_needs_terminator(ASTStmt *stmt) {
     case STMT_FOR:
     case STMT_BLOCK:
     case STMT_STRUCT_DECL:
+    case STMT_RECEIVE:
         return false;
     // A body closes itself with '}'. An extern has none, so it ends the way
     // every other bodyless declaration does.
     case STMT_FUNC_DECL:
-        return stmt->func_decl.body == NULL;
+        return stmt->func_decl.body == NULL && !stmt->func_decl.deferred;
     default:
         return true;
     }
@@ -1080,6 +1374,22 @@ static ASTExpr *parse_unary(Parser *parser) {
         return ast_new_expr_create(span, spec);
     }
 
+    // 'spawn f(x)' and 'join t' take an operand like the prefixes below, but
+    // share no token with a binary operator. What the operand may be -- a call,
+    // a task variable -- is the resolver's to say, with the types in hand.
+    if (parser->current.type == TOKEN_SPAWN || parser->current.type == TOKEN_JOIN) {
+        bool spawn = parser->current.type == TOKEN_SPAWN;
+
+        parser_next_token(parser); // eat 'spawn' or 'join'
+
+        ASTExpr *target = parse_unary(parser);
+        if (!target) {
+            return NULL;
+        }
+
+        return spawn ? ast_spawn_expr_create(span, target) : ast_join_expr_create(span, target);
+    }
+
     // Most of these share a token with a binary operator -- '*' with
     // multiplication, '-' with subtraction -- and only its position tells the
     // two apart. Recursing into parse_unary is what makes them stack, so
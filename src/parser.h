@@ -4,8 +4,24 @@
 #include "ast/ast.h"
 #include "diagnostics.h"
 #include "lexer.h"
+#include "util/list.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+
+// Where a function's body lies in its source: the offset of its '{', and the
+// offset, line and column of the token after its '}'. Recorded by a compile
+// whose unit is to be cached, so a load from the cache can jump over each body
+// without lexing it, and by a reload, to tell which bodies it changes.
+typedef struct {
+    size_t start;
+    size_t resume;
+    int line;
+    int column;
+} ParserBodySpan;
+
+#define parser_body_span_list_item_free(item) ((void)(item))
+GAB_LIST(ParserBodySpanList, parser_body_span_list, ParserBodySpan)
 
 typedef struct {
     Lexer *lexer;
@@ -13,6 +29,20 @@ typedef struct {
     Token current;
 
     Diagnostics *diagnostics;
+
+    // Whether a function's body is skipped over rather than parsed, leaving
+    // the declaration marked deferred. See ASTFuncDecl::deferred.
+    bool defer_bodies;
+
+    // Where every body parsed or skipped is recorded, in source order, when
+    // set.
+    ParserBodySpanList *record_spans;
+
+    // Bodies whose spans are already known, in source order: a deferred body
+    // starting where the next of these does is jumped over rather than lexed.
+    const ParserBodySpan *known_spans;
+    size_t known_count;
+    size_t known_next;
 } Parser;
 
 Parser parser_create(Lexer *lexer, Diagnostics *diagnostics);
@@ -21,4 +51,8 @@ Parser parser_create(Lexer *lexer, Diagnostics *diagnostics);
 // authoritative; this is a convenience.
 bool parser_parse(Parser *parser, ASTScript *script);
 
+// Parses the one function declaration the lexer is positioned at, body and
+// all, for a body a lazy load deferred. NULL on a syntax error.
+ASTStmt *parser_parse_func_decl(Parser *parser);
+
 #endif
@@ -168,6 +168,8 @@ Symbol *scope_decl_var(Scope *scope, String *name, Type *type) {
     sym->pinned = false;
     sym->var.type = type;
     sym->var.pointee_depth = 0;
+    sym->var.aliased = false;
+    sym->var.sent = false;
 
     Symbol **decl = symbol_table_insert(scope->symbol_table, name, sym);
     if (!decl) {
@@ -191,6 +193,29 @@ Symbol *scope_decl_func(Scope *scope, String *name, Type *return_type) {
     sym->func.param_count = 0;
     sym->func.func_index = SYMBOL_FUNC_NO_BODY;
     sym->func.is_extern = false;
+    sym->func.is_pure = false;
+    sym->func.intrinsic = INTRINSIC_NONE;
+
+    Symbol **decl = symbol_table_insert(scope->symbol_table, name, sym);
+    if (!decl) {
+        return NULL;
+    }
+
+    return *decl;
+}
+
+Symbol *scope_decl_channel(Scope *scope, String *name, Type *element) {
+    if (scope_symbol_lookup_declaring(scope, name)) {
+        return NULL;
+    }
+
+    Symbol *sym = arena_alloc(scope->arena, sizeof(Symbol));
+    sym->kind = SYMBOL_CHANNEL;
+    sym->scope_depth = scope->depth;
+    sym->pinned = false;
+    sym->channel.element = element;
+    sym->channel.name = name;
+    sym->channel.module = NULL;
 
     Symbol **decl = symbol_table_insert(scope->symbol_table, name, sym);
     if (!decl) {
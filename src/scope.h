@@ -102,5 +102,6 @@ void scope_merge_staged(Scope *target, Scope *staged);
 
 Symbol *scope_decl_var(Scope *scope, String *name, Type *type);
 Symbol *scope_decl_func(Scope *scope, String *name, Type *return_type);
+Symbol *scope_decl_channel(Scope *scope, String *name, Type *element);
 
 #endif
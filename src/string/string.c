@@ -4,28 +4,55 @@
 #include "string/string_pool.h"
 #include "string/string_ref.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 void string_pool_init(StringPool *pool, Arena *arena) {
     string_map_init(&pool->map, STRING_POOL_INITIAL_CAPACITY);
     pool->arena = arena;
+    pool->owner = NULL;
+    pool->lock = NULL;
 }
 
-void string_pool_free(StringPool *pool) { string_map_free(&pool->map); }
+void string_pool_free(StringPool *pool) {
+    for (size_t i = 0; i < pool->map.capacity; i++) {
+        for (StringMapEntry *entry = pool->map.buckets[i]; entry; entry = entry->next) {
+            if (entry->value.allocated) {
+                free(entry->value.string);
+            }
+        }
+    }
 
-static String *string_from_cstr_len(StringPool *pool, const char *cstr, size_t length) {
+    string_map_free(&pool->map);
+}
+
+static String *string_intern(StringPool *pool, const char *cstr, size_t length) {
     StringKey key = {.data = cstr, .length = length};
 
-    String **saved = string_map_lookup(&pool->map, key);
+    InternedString *saved = string_map_lookup(&pool->map, key);
 
     if (saved) {
-        return *saved;
+        // Asked for by someone other than its owner, so shared from now on.
+        if (saved->owner && string_owner_root(saved->owner) != string_owner_root(pool->owner)) {
+            saved->owner = NULL;
+        }
+
+        return saved->string;
     }
 
-    String *string = arena_alloc(pool->arena, sizeof(String));
-    string->length = length;
+    // One allocation for the struct and its characters, so freeing it with
+    // its owner is one call.
+    String *string = pool->owner ? malloc(sizeof(String) + length + 1)
+                                 : arena_alloc(pool->arena, sizeof(String) + length + 1);
+
+    if (!string) {
+        fprintf(stderr, "gab: out of memory interning a string\n");
+        abort();
+    }
 
-    string->data = arena_alloc(pool->arena, length + 1);
+    string->length = length;
+    string->data = (char *)(string + 1);
 
     // An empty string has no characters to copy, and its data may be null.
     if (length) {
@@ -35,7 +62,75 @@ static String *string_from_cstr_len(StringPool *pool, const char *cstr, size_t l
 
     key.data = string->data;
 
-    return *string_map_insert(&pool->map, key, string);
+    InternedString interned = {.string = string, .owner = pool->owner, .allocated = pool->owner != NULL};
+
+    if (pool->owner) {
+        interned.previous = pool->owner->newest;
+        pool->owner->newest = string;
+    }
+
+    return string_map_insert(&pool->map, key, interned)->string;
+}
+
+bool string_pool_owned_by(StringPool *pool, const String *string, StringOwner *owner) {
+    StringKey key = {.data = string->data, .length = string->length};
+    InternedString *saved = string_map_lookup(&pool->map, key);
+
+    return saved && saved->owner && string_owner_root(saved->owner) == string_owner_root(owner);
+}
+
+void string_pool_release(StringPool *pool, StringOwner *owner) {
+    StringOwner *root = string_owner_root(owner);
+
+    for (size_t i = 0; i < pool->map.capacity; i++) {
+        StringMapEntry *entry = pool->map.buckets[i];
+
+        while (entry) {
+            StringMapEntry *next = entry->next;
+
+            if (entry->value.owner && string_owner_root(entry->value.owner) == root) {
+                String *string = entry->value.string;
+
+                // Before the string: the entry's key is its characters.
+                string_map_delete(&pool->map, entry->key);
+                free(string);
+            }
+
+            entry = next;
+        }
+    }
+}
+
+void string_pool_withdraw(StringPool *pool, StringOwner *owner) {
+    String *string = owner->newest;
+
+    while (string) {
+        StringKey key = {.data = string->data, .length = string->length};
+        InternedString *saved = string_map_lookup(&pool->map, key);
+        String *previous = saved->previous;
+
+        // One another owner asked for is shared now, and stays.
+        if (saved->owner == owner) {
+            string_map_delete(&pool->map, key);
+            free(string);
+        }
+
+        string = previous;
+    }
+
+    owner->newest = NULL;
+}
+
+static String *string_from_cstr_len(StringPool *pool, const char *cstr, size_t length) {
+    if (!pool->lock) {
+        return string_intern(pool, cstr, length);
+    }
+
+    pthread_mutex_lock(pool->lock);
+    String *string = string_intern(pool, cstr, length);
+    pthread_mutex_unlock(pool->lock);
+
+    return string;
 }
 
 String *string_from_cstr(StringPool *pool, const char *cstr) {
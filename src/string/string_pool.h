@@ -6,6 +6,8 @@
 #include "util/hash.h"
 #include "util/hash_map.h"
 
+#include <pthread.h>
+#include <stdbool.h>
 #include <string.h>
 
 #define STRING_POOL_INITIAL_CAPACITY 128
@@ -21,19 +23,82 @@ typedef struct {
     size_t length;
 } StringKey;
 
-GAB_HASH_MAP(StringMap, string_map, StringKey, String *)
+// Whose a string is while only one module has asked for it, which is what lets
+// gab_module_free reclaim the strings no other module uses. A compile starts
+// out with an owner of its own, since which module it fills is only known once
+// it has parsed, and joins the module's as soon as it is: the owner a string
+// answers to is the last in its chain of joins.
+//
+// Each owner also knows the strings it was first to ask for, newest first and
+// linked through their entries, so a compile that fails can take back its own
+// without a walk of the whole pool.
+typedef struct StringOwner {
+    struct StringOwner *joined;
+    String *newest;
+} StringOwner;
+
+static inline StringOwner *string_owner_root(StringOwner *owner) {
+    while (owner && owner->joined) {
+        owner = owner->joined;
+    }
+
+    return owner;
+}
+
+typedef struct {
+    String *string;
+
+    // NULL once anything but its owner has asked for the string, from which
+    // point it lives as long as the pool. See StringOwner.
+    StringOwner *owner;
+
+    // Whether the string was allocated on its own rather than from the pool's
+    // arena, which one interned for an owner is, so that it can be freed
+    // with that owner's module.
+    bool allocated;
+
+    // The string its first owner asked for before this one. See StringOwner.
+    String *previous;
+} InternedString;
+
+GAB_HASH_MAP(StringMap, string_map, StringKey, InternedString)
 
 // Interned strings live as long as the pool's arena, so the pool carries it and
-// callers never have to know where payloads come from.
+// callers never have to know where payloads come from -- but for those an
+// owner still holds alone, which string_pool_release frees.
 typedef struct StringPool {
     StringMap map; // buckets are malloc'd; the map resizes
     Arena *arena;  // String structs and their characters
+
+    // Whose the strings first interned from now on are, or NULL for the
+    // pool's own. Set only by a compile on the VM's thread, never while units
+    // compile on several at once.
+    StringOwner *owner;
+
+    // Taken around every lookup while units compile on several threads at
+    // once, and NULL otherwise: interning is a lookup and an insert into one
+    // map, and most compiles have the pool to themselves.
+    pthread_mutex_t *lock;
 } StringPool;
 
 void string_pool_init(StringPool *pool, Arena *arena);
 
-// Releases the bucket array only. Payloads go when the arena goes, so this must
-// run before that arena is destroyed.
+// Releases the bucket array and the strings allocated on their own. Payloads
+// in the arena go when it goes, so this must run before that arena is
+// destroyed.
 void string_pool_free(StringPool *pool);
 
+// Whether 'owner' alone has asked for 'string', so that releasing the owner
+// frees it.
+bool string_pool_owned_by(StringPool *pool, const String *string, StringOwner *owner);
+
+// Frees every string 'owner' alone has asked for. Whatever still points at one
+// must go with the owner's module.
+void string_pool_release(StringPool *pool, StringOwner *owner);
+
+// Frees every string 'owner' itself was first to ask for that nothing else has
+// asked for since, for a compile that failed: what it interned goes with it,
+// whichever module it joined. Costs as many lookups as it interned strings.
+void string_pool_withdraw(StringPool *pool, StringOwner *owner);
+
 #endif
@@ -1,6 +1,7 @@
 #ifndef GAB_SYMBOL_TABLE_H
 #define GAB_SYMBOL_TABLE_H
 
+#include "intrinsic.h"
 #include "scope.h"
 #include "string/string.h"
 #include "type.h"
@@ -17,6 +18,7 @@
 typedef enum {
     SYMBOL_VAR,
     SYMBOL_FUNC,
+    SYMBOL_CHANNEL,
 } SymbolKind;
 
 // What a name means. Written by the resolver and read for as long as the VM
@@ -44,6 +46,16 @@ typedef struct Symbol {
             // 0 when that is not known. A pointer may only be moved to a depth
             // at least this deep: anything shallower outlives its pointee.
             int pointee_depth;
+
+            // For an owning pointer variable: whether what it owns has been
+            // named anywhere that could still reach it after a 'send' --
+            // copied into another variable or a field, or read out of by a
+            // pointer that was -- and whether a 'send' has taken it. A variable
+            // is only sent while the first is false, and never named once the
+            // second is true, which is what lets the object change threads
+            // without anything on this side still reaching it.
+            bool aliased;
+            bool sent;
         } var;
 
         struct {
@@ -62,12 +74,33 @@ typedef struct Symbol {
             // codegen reserves carries a C function pointer instead of a chunk.
             bool is_extern;
 
+            // Declared 'extern pure': the host vouches that the body has no
+            // effects, cannot fail, and answers equal arguments equally. Codegen
+            // may then make such a call earlier, fewer times, or not at all.
+            bool is_pure;
+
+            // Set on a builtin method the compiler answers with an instruction
+            // of its own. Such a symbol has no body in either table, so its
+            // func_index stays SYMBOL_FUNC_NO_BODY and nothing may call it.
+            Intrinsic intrinsic;
+
             // What the host binds a body to. Only an extern carries these: a
             // symbol is otherwise found by the name it is stored under, and
             // nothing needs to ask a symbol what it is called.
             String *name;
             String *module;
         } func;
+
+        // 'extern channel inbox: *Event;'. Not a value a script can hold: only
+        // 'send' and 'receive' name one, and the host attaches the queue behind
+        // it to each VM by the name and module it was declared under.
+        struct {
+            // The owning pointer type a message travels as.
+            Type *element;
+
+            String *name;
+            String *module;
+        } channel;
     };
 } Symbol;
 
@@ -11,6 +11,12 @@ _Static_assert(sizeof(float) == 4, "gab float must be 4 bytes");
 
 Type *type_create(Arena *arena, TypeKind kind, String *name) {
     Type *type = arena_alloc(arena, sizeof(Type));
+    type_init(type, kind, name);
+
+    return type;
+}
+
+void type_init(Type *type, TypeKind kind, String *name) {
     type->kind = kind;
     type->name = name;
     type->size = 0;
@@ -20,8 +26,6 @@ Type *type_create(Arena *arena, TypeKind kind, String *name) {
     type->pointee = NULL;
     type->methods = NULL;
     type->is_ref = false;
-
-    return type;
 }
 
 Type *type_struct_create(Arena *arena, String *name, size_t max_fields) {
@@ -89,6 +93,8 @@ bool type_field_offset(const Type *type, const String *name, size_t *out_offset)
 
 bool type_is_pointer(const Type *type) { return type && type->kind == TYPE_POINTER; }
 
+bool type_is_task(const Type *type) { return type && type->kind == TYPE_TASK; }
+
 // Sized for a handful: most struct types declare no methods at all, and the map
 // grows if one proves popular.
 #define METHOD_MAP_INITIAL_CAPACITY 4
@@ -19,6 +19,10 @@ typedef enum {
     TYPE_STRING,
     TYPE_STRUCT,
     TYPE_POINTER,
+
+    // The handle 'spawn' gives back, which 'join' turns into the call's result.
+    // Structural like a pointer, and interned on what the call returns.
+    TYPE_TASK,
     TYPE_UNKNOWN,
     TYPE_ERROR,
 } TypeKind;
@@ -64,7 +68,8 @@ struct Type {
     TypeField *fields;
     size_t field_count;
 
-    // What a TYPE_POINTER points at; NULL for every other kind.
+    // What a TYPE_POINTER points at, and what a TYPE_TASK's call returns --
+    // NULL for a call that returns nothing. NULL for every other kind.
     Type *pointee;
 
     // Whether this pointer borrows rather than owns. A 'ref T' is a distinct
@@ -79,12 +84,16 @@ struct Type {
 };
 
 Type *type_create(Arena *arena, TypeKind kind, String *name);
+
+// As type_create, for a Type whose memory the caller allocated.
+void type_init(Type *type, TypeKind kind, String *name);
 Type *type_struct_create(Arena *arena, String *name, size_t max_fields);
 
 void type_add_field(Type *type, String *name, Type *field_type);
 void type_layout_compute(Type *type);
 
 bool type_is_pointer(const Type *type);
+bool type_is_task(const Type *type);
 
 bool type_field_offset(const Type *type, const String *name, size_t *out_offset);
 const TypeField *type_find_field(const Type *type, const String *name);
@@ -6,6 +6,7 @@
 #include "type.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 static Type *register_builtin(TypeRegistry *registry, TypeKind kind, const char *name, size_t size,
@@ -36,23 +37,73 @@ TypeRegistry *type_registry_create(Arena *arena, StringPool *strings) {
     TypeRegistry *registry = arena_alloc(arena, sizeof(TypeRegistry));
     registry->pointers = pointer_map_create_alloc(arena_allocator(arena), TYPE_REGISTRY_INITIAL_CAPACITY);
     registry->ref_pointers = pointer_map_create_alloc(arena_allocator(arena), TYPE_REGISTRY_INITIAL_CAPACITY);
+    registry->tasks = pointer_map_create_alloc(arena_allocator(arena), TYPE_REGISTRY_INITIAL_CAPACITY);
     registry->arena = arena;
     registry->strings = strings;
+    registry->lock = NULL;
+    registry->reclaimable = false;
     type_registry_register_builtins(registry);
 
     return registry;
 }
 
+// Every value is a pointer or task type this registry allocated.
+static void type_registry_free_values(PointerMap *map) {
+    for (size_t i = 0; i < map->capacity; i++) {
+        for (PointerMapEntry *entry = map->buckets[i]; entry; entry = entry->next) {
+            free(entry->value);
+        }
+    }
+}
+
+// Called before anything is interned, so the arena maps it drops are empty and
+// their memory merely goes unused until the arena is.
+void type_registry_make_reclaimable(TypeRegistry *registry) {
+    registry->pointers = pointer_map_create(TYPE_REGISTRY_INITIAL_CAPACITY);
+    registry->ref_pointers = pointer_map_create(TYPE_REGISTRY_INITIAL_CAPACITY);
+    registry->tasks = pointer_map_create(TYPE_REGISTRY_INITIAL_CAPACITY);
+    registry->reclaimable = true;
+}
+
 void type_registry_destroy(TypeRegistry *registry) {
+    if (!registry->reclaimable) {
+        return;
+    }
+
+    type_registry_free_values(registry->pointers);
+    type_registry_free_values(registry->ref_pointers);
+    type_registry_free_values(registry->tasks);
+
     pointer_map_destroy(registry->pointers);
     pointer_map_destroy(registry->ref_pointers);
+    pointer_map_destroy(registry->tasks);
+}
+
+// A pointer or task type, allocated on its own if the registry is reclaimable.
+// See TypeRegistry.
+static Type *type_registry_structural(TypeRegistry *registry, TypeKind kind) {
+    if (!registry->reclaimable) {
+        return type_create(registry->arena, kind, NULL);
+    }
+
+    Type *type = malloc(sizeof(Type));
+
+    // As an arena does: no caller can carry on without the type.
+    if (!type) {
+        fprintf(stderr, "gab: out of memory interning a type\n");
+        abort();
+    }
+
+    type_init(type, kind, NULL);
+
+    return type;
 }
 
 Type *type_registry_pointer_to(TypeRegistry *registry, Type *pointee) {
     return type_registry_pointer_to_kind(registry, pointee, false);
 }
 
-Type *type_registry_pointer_to_kind(TypeRegistry *registry, Type *pointee, bool is_ref) {
+static Type *type_registry_intern_pointer(TypeRegistry *registry, Type *pointee, bool is_ref) {
     // Two maps rather than a composite key: 'ref T' and '*T' are different
     // types, and the whole type system compares by pointer identity, so they
     // must never collide in one table.
@@ -65,7 +116,7 @@ Type *type_registry_pointer_to_kind(TypeRegistry *registry, Type *pointee, bool
 
     // No name: a pointer type is structural, so its printable form is derived
     // from the pointee when a diagnostic asks. See Type::name.
-    Type *type = type_create(registry->arena, TYPE_POINTER, NULL);
+    Type *type = type_registry_structural(registry, TYPE_POINTER);
 
     // Always a raw address to the payload, so a stack pointer and a heap one
     // are byte-identical; only the resolver knows which is which. A 'ref T' is
@@ -80,6 +131,121 @@ Type *type_registry_pointer_to_kind(TypeRegistry *registry, Type *pointee, bool
     return type;
 }
 
+Type *type_registry_pointer_to_kind(TypeRegistry *registry, Type *pointee, bool is_ref) {
+    if (!registry->lock) {
+        return type_registry_intern_pointer(registry, pointee, is_ref);
+    }
+
+    pthread_mutex_lock(registry->lock);
+    Type *type = type_registry_intern_pointer(registry, pointee, is_ref);
+    pthread_mutex_unlock(registry->lock);
+
+    return type;
+}
+
+static Type *type_registry_intern_task(TypeRegistry *registry, Type *result) {
+    Type **existing = pointer_map_lookup(registry->tasks, result);
+    if (existing) {
+        return *existing;
+    }
+
+    Type *type = type_registry_structural(registry, TYPE_TASK);
+
+    // The address of the task, which the pool runs and 'join' frees: held in a
+    // slot pair like a '*T', and owned by that slot the same way.
+    type->size = sizeof(void *);
+    type->alignment = _Alignof(void *);
+    type->pointee = result;
+
+    pointer_map_insert(registry->tasks, result, type);
+
+    return type;
+}
+
+Type *type_registry_task_of(TypeRegistry *registry, Type *result) {
+    if (!registry->lock) {
+        return type_registry_intern_task(registry, result);
+    }
+
+    pthread_mutex_lock(registry->lock);
+    Type *type = type_registry_intern_task(registry, result);
+    pthread_mutex_unlock(registry->lock);
+
+    return type;
+}
+
+// What a structural type is built on: the struct or builtin its pointees end
+// at, or NULL for the task of a call that returns nothing.
+static const Type *type_registry_base(const Type *type) {
+    while (type && (type->kind == TYPE_POINTER || type->kind == TYPE_TASK)) {
+        type = type->pointee;
+    }
+
+    return type;
+}
+
+typedef struct {
+    Type **data;
+    size_t size;
+    size_t capacity;
+} DoomedTypes;
+
+// Unlinks every entry built on a doomed type, keeping its value to free once
+// every map is done: '**T' is keyed on '*T', which may be a value unlinked
+// from another map first, and its base is found through it.
+static void type_registry_forget_in(PointerMap *map, bool (*doomed)(const Type *base, void *ctx), void *ctx,
+                                    DoomedTypes *freed) {
+    for (size_t i = 0; i < map->capacity; i++) {
+        PointerMapEntry *entry = map->buckets[i];
+
+        while (entry) {
+            PointerMapEntry *next = entry->next;
+            const Type *base = type_registry_base(entry->key);
+
+            if (base && doomed(base, ctx)) {
+                if (freed->size == freed->capacity) {
+                    freed->capacity = freed->capacity ? freed->capacity * 2 : 16;
+                    freed->data = realloc(freed->data, freed->capacity * sizeof(Type *));
+
+                    if (!freed->data) {
+                        fprintf(stderr, "gab: out of memory forgetting types\n");
+                        abort();
+                    }
+                }
+
+                freed->data[freed->size++] = entry->value;
+                pointer_map_delete(map, entry->key);
+            }
+
+            entry = next;
+        }
+    }
+}
+
+void type_registry_forget(TypeRegistry *registry, bool (*doomed)(const Type *base, void *ctx), void *ctx) {
+    assert(registry->reclaimable && "only a reclaimable registry gives memory back");
+
+    DoomedTypes freed = {0};
+
+    if (registry->lock) {
+        pthread_mutex_lock(registry->lock);
+    }
+
+    type_registry_forget_in(registry->pointers, doomed, ctx, &freed);
+    type_registry_forget_in(registry->ref_pointers, doomed, ctx, &freed);
+    type_registry_forget_in(registry->tasks, doomed, ctx, &freed);
+
+    if (registry->lock) {
+        pthread_mutex_unlock(registry->lock);
+    }
+
+    for (size_t i = 0; i < freed.size; i++) {
+        free(freed.data[i]);
+    }
+
+    free(freed.data);
+}
+
 Type *type_registry_error_type(TypeRegistry *registry) { return registry->builtins.error_type; }
 
 Type *type_registry_get_builtin(TypeRegistry *registry, TypeKind kind) {
@@ -6,6 +6,7 @@
 #include "type.h"
 #include "util/hash_map.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 
 #define TYPE_REGISTRY_INITIAL_CAPACITY 8
@@ -43,6 +44,12 @@ typedef struct {
 // pointer type, because the type system compares types by pointer identity: a
 // second 'int' or a second '*Player' would silently break every comparison.
 //
+// Everything comes from the registry's arena, unless it is made reclaimable:
+// then a pointer or task type, and the maps interning it, are allocated on
+// their own, since one lives only as long as what it is built on, and that may
+// be a struct of a module gab_module_free reclaims. Only the VM's registry is;
+// one made for a compile alone goes with its arena.
+//
 // Which type names are visible where is a scoping question, so the name map
 // belongs to Scope, which already owns the parent chain that answers it.
 typedef struct TypeRegistry {
@@ -55,11 +62,25 @@ typedef struct TypeRegistry {
     // Borrowing 'ref T' types, interned apart from the owning ones so that
     // pointer-identity comparison keeps telling them apart.
     PointerMap *ref_pointers;
+
+    // Task handles, interned on the result type by the same map shape: a
+    // 'task T' is as structural as a '*T'.
+    PointerMap *tasks;
     TypeBuiltins builtins;
+
+    // As StringPool::lock: set only while units compile concurrently, when two
+    // of them may intern the same '*T' at once and must still get one Type.
+    pthread_mutex_t *lock;
+
+    bool reclaimable;
 } TypeRegistry;
 
 TypeRegistry *type_registry_create(Arena *arena, StringPool *strings);
 
+// Before anything has been interned. See TypeRegistry.
+void type_registry_make_reclaimable(TypeRegistry *registry);
+
+// Frees what a reclaimable registry allocated on its own; nothing otherwise.
 void type_registry_destroy(TypeRegistry *registry);
 
 Type *type_registry_get_builtin(TypeRegistry *registry, TypeKind type);
@@ -73,4 +94,15 @@ Type *type_registry_pointer_to(TypeRegistry *registry, Type *pointee);
 // flavours. A 'ref T' does not own its pointee; the two are distinct types.
 Type *type_registry_pointer_to_kind(TypeRegistry *registry, Type *pointee, bool is_ref);
 
+// The interned handle of a task whose call returns 'result', which is NULL for
+// one that returns nothing.
+Type *type_registry_task_of(TypeRegistry *registry, Type *result);
+
+// Drops every pointer and task type built on a type 'doomed' accepts -- '*T',
+// 'ref T', '**T', 'task *T' -- for a T about to be freed. Left interned, they
+// would be handed out again to whatever next allocates a Type where T was.
+// 'doomed' is asked about the struct or builtin at the bottom of each. Only on
+// a reclaimable registry.
+void type_registry_forget(TypeRegistry *registry, bool (*doomed)(const Type *base, void *ctx), void *ctx);
+
 #endif
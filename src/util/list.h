@@ -83,6 +83,29 @@
         return removed;                                                                                      \
     }                                                                                                        \
                                                                                                              \
+    /* Gives back the capacity past the size, which _grow doubles into: for a   */                           \
+    /* list that is done growing, or will not for a long while.                 */                           \
+    static inline void Alias##_shrink(Name *list) {                                                          \
+        if (list->capacity == list->size) {                                                                  \
+            return;                                                                                          \
+        }                                                                                                    \
+                                                                                                             \
+        if (list->size == 0) {                                                                               \
+            free(list->data);                                                                                \
+            list->data = NULL;                                                                               \
+            list->capacity = 0;                                                                              \
+            return;                                                                                          \
+        }                                                                                                    \
+                                                                                                             \
+        /* A failed shrink leaves the list as it was, which is still a list. */                              \
+        ItemType *data = realloc(list->data, list->size * sizeof(ItemType));                                 \
+                                                                                                             \
+        if (data) {                                                                                          \
+            list->data = data;                                                                               \
+            list->capacity = list->size;                                                                     \
+        }                                                                                                    \
+    }                                                                                                        \
+                                                                                                             \
     static inline void Alias##_free(Name *list) {                                                            \
         for (size_t i = 0; i < list->size; i++) {                                                            \
             Alias##_item_free(list->data[i]);                                                                \
@@ -14,25 +14,12 @@ unsigned int args_type_slots(const Type *type) {
     return (unsigned int)((type->size + VM_SLOT_SIZE - 1) / VM_SLOT_SIZE);
 }
 
-uint8_t *args_address(Args *args, int index, const Type **out_type) {
+uint8_t *args_address(Args *args, int index) {
     assert(args && "a C body was called without a frame");
-
-    const Symbol *symbol = args->symbol;
-
-    assert(index >= 0 && (size_t)index < symbol->func.param_count &&
+    assert(index >= 0 && (size_t)index < args->symbol->func.param_count &&
            "a C body read a parameter its declaration does not have");
 
-    unsigned int slot = 1;
-
-    for (int i = 0; i < index; i++) {
-        slot += args_type_slots(symbol->func.params[i]);
-    }
-
-    if (out_type) {
-        *out_type = symbol->func.params[index];
-    }
-
-    return args->vm->stack + args->base + (size_t)slot * VM_SLOT_SIZE;
+    return args->vm->stack + args->base + args->param_offsets[index];
 }
 
 uint8_t *args_return_address(Args *args) {
@@ -45,11 +32,16 @@ uint8_t *args_return_address(Args *args) {
 // slot carries no tag, so reading an int as a float reinterprets the bytes
 // rather than converting them -- which is why the declaration is what says
 // whether a read is the right one.
+//
+// The check is an assert and nothing more, so a release build reads the slot
+// without ever touching the declaration: the offset table already answers
+// where, and what the slot holds was settled when the host's declaration and
+// body were written to agree.
 static uint8_t *args_address_of_kind(Args *args, int index, TypeKind kind) {
-    const Type *type = NULL;
-    uint8_t *at = args_address(args, index, &type);
+    uint8_t *at = args_address(args, index);
 
-    assert(type && type->kind == kind && "a C body read a parameter as a type it was not declared");
+    assert(args->symbol->func.params[index]->kind == kind &&
+           "a C body read a parameter as a type it was not declared");
     (void)kind;
 
     return at;
@@ -91,11 +83,11 @@ void *args_pointer(Args *args, int index) {
 }
 
 void args_struct(Args *args, int index, void *out, size_t size) {
-    const Type *type = NULL;
-    const uint8_t *at = args_address(args, index, &type);
+    const uint8_t *at = args_address(args, index);
 
     assert(out && "a C body read a struct argument into nothing");
-    assert(type && type->size == size && "a struct argument was read at a size its type does not have");
+    assert(args->symbol->func.params[index]->size == size &&
+           "a struct argument was read at a size its type does not have");
     (void)size;
 
     memcpy(out, at, size);
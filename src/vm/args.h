@@ -22,10 +22,9 @@
 // travel as data.
 
 // Where a parameter's slots begin, counting from the frame's slot 0 -- which
-// holds the return value, exactly as it does for a script callee. A multi-slot
-// parameter occupies consecutive slots, so each index is found by walking the
-// widths ahead of it rather than by indexing a table.
-uint8_t *args_address(Args *args, int index, const Type **out_type);
+// holds the return value, exactly as it does for a script callee. One load from
+// the prototype's offset table, however many parameters precede this one.
+uint8_t *args_address(Args *args, int index);
 
 // The frame's slot 0, which is where a callee leaves its result.
 uint8_t *args_return_address(Args *args);
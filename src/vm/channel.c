@@ -0,0 +1,83 @@
+#include "vm/channel.h"
+
+#include "allocator.h"
+#include "object.h"
+
+#include <stdlib.h>
+
+Channel *channel_create(const Type *type) {
+    Channel *channel = malloc(sizeof(Channel));
+    ChannelNode *stub = malloc(sizeof(ChannelNode));
+
+    if (!channel || !stub) {
+        free(channel);
+        free(stub);
+        return NULL;
+    }
+
+    atomic_init(&stub->next, NULL);
+    stub->object = NULL;
+
+    channel->type = type;
+    atomic_init(&channel->head, stub);
+    channel->tail = stub;
+    atomic_flag_clear(&channel->receiving);
+
+    return channel;
+}
+
+void channel_destroy(Channel *channel) {
+    if (!channel) {
+        return;
+    }
+
+    void *object;
+
+    while ((object = channel_receive(channel))) {
+        gab_object_free(DEFAULT_ALLOCATOR, object);
+    }
+
+    free(channel->tail);
+    free(channel);
+}
+
+bool channel_send(Channel *channel, void *object) {
+    ChannelNode *node = malloc(sizeof(ChannelNode));
+
+    if (!node) {
+        return false;
+    }
+
+    atomic_init(&node->next, NULL);
+    node->object = object;
+
+    // The exchange orders this send among the others; linking the previous
+    // node to it is what makes it visible, and the release there publishes the
+    // object's contents along with it.
+    ChannelNode *previous = atomic_exchange_explicit(&channel->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+
+    return true;
+}
+
+void *channel_receive(Channel *channel) {
+    while (atomic_flag_test_and_set_explicit(&channel->receiving, memory_order_acquire)) {
+    }
+
+    ChannelNode *tail = channel->tail;
+    ChannelNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    void *object = NULL;
+
+    // The node after the tail carries the message, and becomes the new tail
+    // once taken; the old one, whose message went before, is done with.
+    if (next) {
+        object = next->object;
+        next->object = NULL;
+        channel->tail = next;
+        free(tail);
+    }
+
+    atomic_flag_clear_explicit(&channel->receiving, memory_order_release);
+
+    return object;
+}
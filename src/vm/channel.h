@@ -0,0 +1,62 @@
+#ifndef GAB_CHANNEL_H
+#define GAB_CHANNEL_H
+
+#include "type.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+    A channel carries owned objects from whoever sends to whoever receives,
+    across threads, without copying them: what travels is the object's address,
+    and with it the ownership. The sender's slot is cleared as the message goes,
+    so exactly one side owns the object at any moment, as it always is.
+
+    The queue is Vyukov's multi-producer single-consumer one: a send is one
+    atomic exchange and a store, and never waits on another sender or on a
+    receiver. Receives are serialized among themselves by a flag, since the
+    consumer's end is a plain pointer only one thread may move -- the common
+    case, a shard draining its own inbox, never finds the flag taken.
+
+    A message is a small node of its own rather than a field in the object's
+    header, so an object that is never sent costs nothing for the ability.
+*/
+
+typedef struct ChannelNode {
+    struct ChannelNode *_Atomic next;
+    void *object;
+} ChannelNode;
+
+// The host's name for it, as gab.h declares it opaque.
+typedef struct GabChannel {
+    // The struct every message is an object of. Checked on each host send, and
+    // against a script's declaration when the channel is attached, which is
+    // what lets a receiver free what it was handed by its header.
+    const Type *type;
+
+    // Producers swap themselves in here; the consumer reads from 'tail'. The
+    // node at 'tail' is always one already taken, or the first stub, so the
+    // queue is never without one.
+    ChannelNode *_Atomic head;
+    ChannelNode *tail;
+
+    atomic_flag receiving;
+} Channel;
+
+// NULL when memory ran out.
+Channel *channel_create(const Type *type);
+
+// Frees the channel and every object still queued in it.
+void channel_destroy(Channel *channel);
+
+// Queues an object the caller owned, which the channel owns from here on.
+// False, leaving the object the caller's, when the message could not be
+// allocated.
+bool channel_send(Channel *channel, void *object);
+
+// The oldest object queued, which the caller now owns, or NULL when there is
+// none. Never waits: a send still between its two steps is not seen until it
+// has finished them.
+void *channel_receive(Channel *channel);
+
+#endif
@@ -2,13 +2,80 @@
 
 #include "vm/vm.h"
 
+#include <string.h>
+
 Chunk *chunk_create() {
     Chunk *chunk = malloc(sizeof(Chunk));
     chunk->instructions = instruction_list_create();
     chunk->const_pool = constpool_create(VM_MAX_CONSTANTS);
+    chunk->borrowed = false;
     return chunk;
 }
 
+Chunk *chunk_borrow(const Instruction *instructions, size_t instruction_count, const Constant *constants,
+                    size_t constant_count) {
+    Chunk *chunk = malloc(sizeof(Chunk));
+    ConstantPool *pool = malloc(sizeof(ConstantPool));
+
+    // Full, so nothing tries to grow either into memory that is not theirs.
+    *pool = (ConstantPool){
+        .constants = (Constant *)constants,
+        .count = constant_count,
+        .capacity = constant_count,
+        .max_capacity = constant_count,
+    };
+
+    chunk->const_pool = pool;
+    chunk->instructions = (InstructionList){
+        .data = (Instruction *)instructions,
+        .size = instruction_count,
+        .capacity = instruction_count,
+    };
+    chunk->borrowed = true;
+
+    return chunk;
+}
+
+size_t chunk_footprint(const Chunk *chunk) {
+    return chunk->instructions.size * sizeof(Instruction) + chunk->const_pool->count * sizeof(Constant);
+}
+
+// Both are four bytes wide, so the constants land aligned after any number of
+// instructions.
+void chunk_move_into(Chunk *chunk, void *memory) {
+    Instruction *instructions = memory;
+    Constant *constants = (Constant *)(instructions + chunk->instructions.size);
+    ConstantPool *pool = chunk->const_pool;
+
+    memcpy(instructions, chunk->instructions.data, chunk->instructions.size * sizeof(Instruction));
+
+    if (pool->count) {
+        memcpy(constants, pool->constants, pool->count * sizeof(Constant));
+    }
+
+    // One already borrowed leaves its lender to free what it lent.
+    if (!chunk->borrowed) {
+        instruction_list_free(&chunk->instructions);
+        free(pool->constants);
+    }
+
+    chunk->instructions = (InstructionList){
+        .data = instructions,
+        .size = chunk->instructions.size,
+        .capacity = chunk->instructions.size,
+    };
+
+    // Full, as a borrowed pool is.
+    *pool = (ConstantPool){
+        .constants = constants,
+        .count = pool->count,
+        .capacity = pool->count,
+        .max_capacity = pool->count,
+    };
+
+    chunk->borrowed = true;
+}
+
 size_t chunk_add_instruction(Chunk *chunk, Instruction instruction) {
     instruction_list_add(&chunk->instructions, instruction);
 
@@ -20,8 +87,12 @@ void chunk_patch_instruction(Chunk *chunk, size_t index, Instruction instruction
 }
 
 void chunk_free(Chunk *chunk) {
-    constpool_free(chunk->const_pool);
-    instruction_list_free(&chunk->instructions);
+    if (chunk->borrowed) {
+        free(chunk->const_pool);
+    } else {
+        constpool_free(chunk->const_pool);
+        instruction_list_free(&chunk->instructions);
+    }
 
     free(chunk);
 }
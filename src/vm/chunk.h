@@ -4,6 +4,8 @@
 #include "util/list.h"
 #include "vm/constant_pool.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint32_t Instruction;
@@ -14,9 +16,29 @@ GAB_LIST(InstructionList, instruction_list, Instruction)
 typedef struct {
     ConstantPool *const_pool;
     InstructionList instructions;
+
+    // Whether the instructions and constants are memory the chunk only points
+    // at -- a mapped VM image, the code its unit was packed into as it linked,
+    // or the region gab_vm_compact moved it to -- rather than its own. Such a
+    // chunk is run and never written.
+    bool borrowed;
 } Chunk;
 
 Chunk *chunk_create();
+
+// A chunk over instructions and constants that live elsewhere and outlive it,
+// which freeing it leaves alone.
+Chunk *chunk_borrow(const Instruction *instructions, size_t instruction_count, const Constant *constants,
+                    size_t constant_count);
+// How many bytes chunk_move_into copies the chunk's code and constants into.
+size_t chunk_footprint(const Chunk *chunk);
+
+// Copies the chunk's instructions and then its constants to 'memory' and frees
+// its own, if they were, leaving it borrowed from there as chunk_borrow's are:
+// for code that is done growing, moved somewhere it can be packed with other
+// chunks'.
+void chunk_move_into(Chunk *chunk, void *memory);
+
 size_t chunk_add_instruction(Chunk *chunk, Instruction instruction);
 void chunk_patch_instruction(Chunk *chunk, size_t index, Instruction instruction);
 void chunk_free(Chunk *chunk);
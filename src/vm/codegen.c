@@ -10,6 +10,7 @@
 #include "vm/opcode.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Where a variable or parameter lives in the frame being generated. Keyed by
 // Symbol * because a Symbol is what a name resolved to, but held here rather
@@ -71,6 +72,31 @@ typedef struct LoopContext {
     unsigned int depth;
 } LoopContext;
 
+// A call to an 'extern pure' function on constant arguments, made once where
+// the function is entered rather than each place it is written. Every call equal
+// to it then reads the one result: the declaration promised that nothing tells
+// the difference.
+typedef struct {
+    // The first call of its kind, standing for every call equal to it.
+    const ASTExpr *call;
+
+    // How many times the body spells it, and whether any of them is in a loop.
+    // One call outside a loop is left where it is: moving it would save nothing,
+    // and a call under a branch would run where it otherwise might not.
+    unsigned int uses;
+    bool in_loop;
+
+    // The slot holding the result, or VM_INVALID_REGISTER until it is emitted.
+    unsigned int reg;
+} PureCall;
+
+#define pure_call_list_item_free(item) ((void)(item))
+GAB_LIST(PureCallList, pure_call_list, PureCall)
+
+// Each hoisted result keeps its slots for the whole body, so only so many are
+// worth the frame they take.
+#define CODEGEN_MAX_HOISTED_CALLS 8
+
 typedef struct {
     Chunk *chunk;
     unsigned int next_reg;
@@ -122,6 +148,10 @@ typedef struct {
     // from NULL: the resolver has already refused a jump that would leave one.
     LoopContext *loop;
 
+    // Pure calls this body made at its entry. Per function body, like the slots
+    // they landed in.
+    PureCallList pure_calls;
+
     Diagnostics *diagnostics;
     bool failed;
 } CodegenState;
@@ -150,6 +180,7 @@ typedef enum {
 // Statements, in the order codegen_stmt dispatches them.
 static void codegen_stmt(CodegenState *state, ASTStmt *ast);
 static void codegen_return_stmt(CodegenState *state, ASTReturnStmt *ast);
+static void codegen_yield_stmt(CodegenState *state, ASTYieldStmt *ast);
 static void codegen_var_decl_stmt(CodegenState *state, ASTVarDecl *ast);
 static bool codegen_expr_into(CodegenState *state, ASTExpr *value, unsigned int dest);
 static void codegen_assign_stmt(CodegenState *state, ASTAssignStmt *ast);
@@ -158,18 +189,34 @@ static void codegen_block_stmt(CodegenState *state, ASTBlockStmt *ast);
 static bool stmt_may_assign(const ASTStmt *stmt, const Symbol *symbol);
 static bool for_is_countable(const ASTForStmt *ast, const Symbol **counter, const Symbol **bound);
 static void codegen_for_stmt(CodegenState *state, ASTForStmt *ast);
+static void codegen_parallel_for_stmt(CodegenState *state, ASTForStmt *ast);
 static void codegen_jump_stmt(CodegenState *state, ASTStmt *ast);
 static void codegen_if_stmt(CodegenState *state, ASTIfStmt *ast);
+static void codegen_send_stmt(CodegenState *state, ASTStmt *stmt);
+static void codegen_receive_stmt(CodegenState *state, ASTStmt *stmt);
+static size_t codegen_channel_index(CodegenState *state, const Symbol *channel);
+static void codegen_emit_channel_op(CodegenState *state, OpCode op, unsigned int rd, const Symbol *channel);
 static void codegen_reserve_proto(CodegenState *state, ASTFuncDecl *ast);
 static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt);
+static void codegen_func_body(CodegenState *state, ASTStmt *stmt, FuncPrototype *out);
+static void codegen_deferred_proto(CodegenState *state, ASTStmt *stmt, FuncPrototype *out);
+static bool pure_call_is_hoistable(const ASTExpr *node);
+static bool pure_call_equals(const ASTExpr *a, const ASTExpr *b);
+static void pure_calls_collect_expr(PureCallList *calls, const ASTExpr *node, bool in_loop);
+static void pure_calls_collect_stmt(PureCallList *calls, const ASTStmt *stmt, bool in_loop);
+static void codegen_hoist_pure_calls(CodegenState *state, const ASTStmt *body);
+static const PureCall *codegen_find_hoisted_call(const CodegenState *state, const ASTExpr *node);
 
 // Expressions, in the order codegen_expr dispatches them.
 static unsigned int codegen_expr(CodegenState *state, ASTExpr *ast);
 static Constant value_from_literal(Literal lit);
 static unsigned int codegen_literal_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_variable_expr(CodegenState *state, ASTExpr *node);
-static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symbol *callee, Span span);
+static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symbol *callee, bool spawn,
+                              Span span);
 static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node);
+static unsigned int codegen_call_block(CodegenState *state, ASTExpr *node, bool spawn);
+static unsigned int codegen_intrinsic_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_field_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_addr_of_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_deref_expr(CodegenState *state, ASTExpr *node);
@@ -177,6 +224,8 @@ static unsigned int codegen_neg_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_not_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_cast_expr(CodegenState *state, ASTExpr *node);
 static unsigned int codegen_new_expr(CodegenState *state, ASTExpr *node);
+static unsigned int codegen_spawn_expr(CodegenState *state, ASTExpr *node);
+static unsigned int codegen_join_expr(CodegenState *state, ASTExpr *node);
 
 // Field and pointer access, against a struct in registers or through a pointer.
 static FieldTarget codegen_resolve_field_target(CodegenState *state, ASTExpr *node, bool auto_deref);
@@ -255,7 +304,7 @@ static OpCode field_opcode_for(size_t size, bool load, bool indirect, bool *ok);
 
 // ---- Generating a script ----
 
-Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Diagnostics *diagnostics) {
+static Unit *codegen_unit_create(Arena *arena) {
     Unit *unit = calloc(1, sizeof(Unit));
 
     if (!unit) {
@@ -266,14 +315,27 @@ Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Dia
     unit->extern_protos = extern_proto_list_create();
     unit->types = type_list_create();
     unit->strings = string_list_create();
+    unit->channels = channel_list_create();
     unit->proto_relocations = relocation_list_create();
     unit->extern_relocations = relocation_list_create();
     unit->type_relocations = relocation_list_create();
     unit->string_relocations = relocation_list_create();
+    unit->channel_relocations = relocation_list_create();
+    unit->call_sites = call_site_list_create();
     unit->bindings = proto_binding_list_create();
     unit->externs = extern_request_list_create();
     unit->arena = arena;
 
+    return unit;
+}
+
+Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Diagnostics *diagnostics) {
+    Unit *unit = codegen_unit_create(arena);
+
+    if (!unit) {
+        return NULL;
+    }
+
     CodegenState state = {
         .chunk = chunk_create(),
         .next_reg = 0,
@@ -287,6 +349,7 @@ Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Dia
         .temporaries = owned_list_create(),
         .depth = 0,
         .frame_refs = frame_ref_list_create(),
+        .pure_calls = pure_call_list_create(),
         .diagnostics = diagnostics,
         .failed = false,
     };
@@ -311,6 +374,7 @@ Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Dia
     slot_map_destroy(state.slots);
     owned_list_free(&state.owned);
     owned_list_free(&state.temporaries);
+    pure_call_list_free(&state.pure_calls);
     proto_map_destroy(state.local_protos);
 
     if (state.failed) {
@@ -327,6 +391,38 @@ Unit *codegen_generate(ASTScript *script, Arena *arena, StringPool *strings, Dia
     return unit;
 }
 
+Unit *codegen_generate_deferred(ASTStmt *func_decl, Arena *arena, StringPool *strings,
+                               Diagnostics *diagnostics) {
+    Unit *unit = codegen_unit_create(arena);
+
+    if (!unit) {
+        return NULL;
+    }
+
+    // No pre-pass: a function cannot be declared inside another, and every
+    // function the body could call was stamped with its index when its unit
+    // linked.
+    CodegenState state = {
+        .unit = unit,
+        .arena = arena,
+        .strings = strings,
+        .local_protos = proto_map_create(SLOT_MAP_INITIAL_CAPACITY),
+        .diagnostics = diagnostics,
+        .failed = false,
+    };
+
+    codegen_func_body(&state, func_decl, &unit->top_level);
+
+    proto_map_destroy(state.local_protos);
+
+    if (state.failed) {
+        unit_free(unit);
+        return NULL;
+    }
+
+    return unit;
+}
+
 // ---- Statements ----
 
 // Frees every unbound owned value the statement produced. Emitted at the end of
@@ -359,6 +455,10 @@ static void codegen_stmt(CodegenState *state, ASTStmt *ast) {
         codegen_return_stmt(state, &ast->ret);
         break;
     }
+    case STMT_YIELD: {
+        codegen_yield_stmt(state, &ast->yield);
+        break;
+    }
     case STMT_VAR_DECL: {
         codegen_var_decl_stmt(state, &ast->var_decl);
         break;
@@ -393,6 +493,19 @@ static void codegen_stmt(CodegenState *state, ASTStmt *ast) {
     case STMT_STRUCT_DECL:
         // Types are resolved at compile time and emit no code.
         break;
+    case STMT_CHANNEL_DECL:
+        // Emits no code either, but is registered whether or not anything
+        // here uses it, so a host can attach to every channel a unit declares.
+        if (ast->channel_decl.symbol) {
+            codegen_channel_index(state, ast->channel_decl.symbol);
+        }
+        break;
+    case STMT_SEND:
+        codegen_send_stmt(state, ast);
+        break;
+    case STMT_RECEIVE:
+        codegen_receive_stmt(state, ast);
+        break;
     }
 
     codegen_release_temporaries(state);
@@ -442,6 +555,31 @@ static void codegen_return_stmt(CodegenState *state, ASTReturnStmt *ast) {
     chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_RETURN_N, 0, reg, slots));
 }
 
+// A yield leaves the frame exactly as it is, so unlike a return it releases
+// nothing: every local, owned or not, is still there when the coroutine is
+// resumed at the next instruction. The slot count is zero for a bare 'yield;'.
+static void codegen_yield_stmt(CodegenState *state, ASTYieldStmt *ast) {
+    if (!ast->value) {
+        chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_YIELD, 0, 0, 0));
+        return;
+    }
+
+    unsigned int reg = codegen_expr(state, ast->value);
+    unsigned int slots = type_slot_count(ast->value->type);
+
+    if (slots > VM_MAX_RETURN_SLOTS) {
+        if (!state->failed) {
+            diag_error(state->diagnostics, GAB_ERR_CODEGEN, ast->value->span,
+                       "struct is too large to yield by value");
+        }
+
+        state->failed = true;
+        return;
+    }
+
+    chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_YIELD, 0, reg, slots));
+}
+
 static void codegen_var_decl_stmt(CodegenState *state, ASTVarDecl *ast) {
     Span span = ast->initializer ? ast->initializer->span : (Span){0};
 
@@ -748,11 +886,17 @@ static bool stmt_may_assign(const ASTStmt *stmt, const Symbol *symbol) {
     case STMT_FOR:
         return stmt_may_assign(stmt->forstmt.init, symbol) || stmt_may_assign(stmt->forstmt.post, symbol) ||
                stmt_may_assign(stmt->forstmt.body, symbol);
+    case STMT_RECEIVE:
+        return stmt_may_assign(stmt->receive.then_block, symbol) ||
+               stmt_may_assign(stmt->receive.else_block, symbol);
     case STMT_EXPR:
     case STMT_FUNC_DECL:
     case STMT_STRUCT_DECL:
     case STMT_JUMP:
     case STMT_RETURN:
+    case STMT_YIELD:
+    case STMT_CHANNEL_DECL:
+    case STMT_SEND:
         return false;
     }
 
@@ -824,6 +968,11 @@ static bool for_is_countable(const ASTForStmt *ast, const Symbol **counter, cons
 }
 
 static void codegen_for_stmt(CodegenState *state, ASTForStmt *ast) {
+    if (ast->parallel) {
+        codegen_parallel_for_stmt(state, ast);
+        return;
+    }
+
     // The initializer's own scope, holding it for the whole loop: it is
     // declared once, outlives every iteration, and dies when the loop does.
     unsigned int saved = state->next_reg;
@@ -946,6 +1095,98 @@ static void codegen_for_stmt(CodegenState *state, ASTForStmt *ast) {
     codegen_release_registers(state, saved);
 }
 
+// A 'parallel for' is the frame running its own loop in chunks, each on a copy
+// of the frame:
+//
+//     init                          counter = a
+//     limit = n                     read once, here
+//     OP_PARALLEL_FOR counter, limit, refs_from
+//     OP_JMP end                    where this frame goes on
+//   body:
+//     ...
+//     step and test                 against the chunk's own limit
+//     OP_PARALLEL_END               a chunk's run ends here
+//   end:
+//
+// The frame itself never enters the body. OP_PARALLEL_FOR hands every chunk
+// the body's first instruction and waits for all of them, and each chunk
+// loops from there over its slice until OP_PARALLEL_END. The resolver has
+// already refused everything that would leave the body any other way.
+static void codegen_parallel_for_stmt(CodegenState *state, ASTForStmt *ast) {
+    unsigned int saved = state->next_reg;
+    unsigned int enclosing_depth = state->depth++;
+
+    codegen_stmt(state, ast->init);
+
+    unsigned int counter_reg = codegen_slot_of(state, ast->init->var_decl.symbol);
+
+    // Not the bound's own variable, which the body may not change anyway, but
+    // a register each chunk overwrites with the end of its slice.
+    unsigned int limit_reg = codegen_alloc_register(state, ast->condition->span);
+    unsigned int bound_saved = state->next_reg;
+    unsigned int bound = codegen_expr(state, ast->condition->bin_op.right);
+
+    chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_MOVE, limit_reg, bound, 0));
+    codegen_release_registers(state, bound_saved);
+
+    // Everything below this register is the frame's as the loop found it;
+    // everything from it up is the body's, per chunk.
+    chunk_add_instruction(state->chunk,
+                          VM_ENCODE_R(OP_PARALLEL_FOR, counter_reg, limit_reg, state->next_reg));
+
+    CodegenLabel end_label = codegen_create_label(state);
+
+    LoopContext *enclosing_loop = state->loop;
+    LoopContext loop = {
+        .breaks = codegen_label_list_create(),
+        .continues = codegen_label_list_create(),
+        .depth = state->depth,
+    };
+    state->loop = &loop;
+
+    size_t body_start = state->chunk->instructions.size;
+
+    codegen_stmt(state, ast->body);
+
+    for (size_t i = 0; i < loop.continues.size; i++) {
+        codegen_patch_jump(state, loop.continues.data[i], OP_JMP, 0);
+    }
+
+    assert(loop.breaks.size == 0 && "'break' out of a 'parallel for' reached codegen");
+
+    ptrdiff_t back = (ptrdiff_t)body_start - (ptrdiff_t)(state->chunk->instructions.size + 1);
+
+    if (back >= -VM_MAX_LOOP_OFFSET) {
+        chunk_add_instruction(state->chunk,
+                              VM_ENCODE_R(OP_FOR_LOOP, counter_reg, limit_reg, (unsigned int)back));
+    } else {
+        unsigned int test_saved = state->next_reg;
+        unsigned int test = codegen_alloc_register(state, ast->condition->span);
+
+        chunk_add_instruction(state->chunk, VM_ENCODE_RK(OP_ADDI, counter_reg, counter_reg, 1, 1));
+        chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_CMP_LTI, test, counter_reg, limit_reg));
+
+        CodegenLabel done_label = codegen_create_label(state);
+        codegen_emit_loop(state, body_start);
+        codegen_patch_jump(state, done_label, OP_JMP_IF_FALSE, test);
+
+        codegen_release_registers(state, test_saved);
+    }
+
+    chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_PARALLEL_END, 0, 0, 0));
+
+    codegen_patch_jump(state, end_label, OP_JMP, 0);
+
+    state->loop = enclosing_loop;
+    codegen_label_list_free(&loop.breaks);
+    codegen_label_list_free(&loop.continues);
+
+    codegen_release_owned(state, enclosing_depth, VM_INVALID_REGISTER);
+
+    state->depth = enclosing_depth;
+    codegen_release_registers(state, saved);
+}
+
 static void codegen_jump_stmt(CodegenState *state, ASTStmt *ast) {
     assert(state->loop && "'break' outside a loop reached codegen");
 
@@ -983,6 +1224,101 @@ static void codegen_if_stmt(CodegenState *state, ASTIfStmt *ast) {
     codegen_patch_jump(state, end, OP_JMP, 0);
 }
 
+// Where the unit numbered a channel, registering it the first time. Numbered
+// within the unit, as a type is, and reconciled with the program's at link.
+static size_t codegen_channel_index(CodegenState *state, const Symbol *channel) {
+    for (size_t i = 0; i < state->unit->channels.size; i++) {
+        if (state->unit->channels.data[i] == channel) {
+            return i;
+        }
+    }
+
+    channel_list_add(&state->unit->channels, channel);
+
+    return state->unit->channels.size - 1;
+}
+
+static void codegen_emit_channel_op(CodegenState *state, OpCode op, unsigned int rd, const Symbol *channel) {
+    size_t index = codegen_channel_index(state, channel);
+    size_t offset = chunk_add_instruction(state->chunk, VM_ENCODE_I(op, rd, (unsigned int)index));
+
+    relocation_list_add(&state->unit->channel_relocations,
+                        (Relocation){.chunk = state->chunk, .offset = offset});
+}
+
+// 'send inbox, e;'. The object leaves with the message and OP_SEND clears the
+// slot it left from, so whatever would have released it -- the block's close,
+// the statement's end, an unwind -- finds NULL there instead.
+static void codegen_send_stmt(CodegenState *state, ASTStmt *stmt) {
+    ASTSendStmt *ast = &stmt->send;
+    unsigned int reg = codegen_expr(state, ast->value);
+
+    if (expr_yields_owned(ast->value)) {
+        // Nobody's until the send takes it, and released at the statement's end
+        // like any unbound object if the send never does.
+        owned_list_add(&state->temporaries,
+                       (OwnedSlot){.slot = reg, .depth = state->depth, .type = ast->value->type});
+        codegen_record_frame_ref(state, reg);
+    } else if (!codegen_slot_is_owned(state, reg)) {
+        // The resolver knows the variable was never copied, but only here is it
+        // known whether it took over an object or borrowed one to begin with.
+        if (!state->failed) {
+            diag_error(state->diagnostics, GAB_ERR_CODEGEN, ast->value->span,
+                       "cannot send a borrowed value; only the variable that owns an object can send it");
+        }
+
+        state->failed = true;
+        return;
+    }
+
+    codegen_emit_channel_op(state, OP_SEND, reg, ast->symbol);
+}
+
+// 'receive e from inbox { ... } else { ... }'. OP_RECEIVE skips the jump after
+// it when there was a message, and falls into it when there was none:
+//
+//       OP_RECEIVE e, inbox
+//       OP_JMP     empty
+//       <first block, e owned>
+//       OP_JMP     end
+//   empty:
+//       <second block>
+//   end:
+static void codegen_receive_stmt(CodegenState *state, ASTStmt *stmt) {
+    ASTReceiveStmt *ast = &stmt->receive;
+
+    // 'e' is declared a block out from the first block's own statements, as
+    // the resolver scoped it, and is released as that block closes.
+    unsigned int saved = state->next_reg;
+    unsigned int enclosing_depth = state->depth++;
+
+    unsigned int slot = codegen_alloc_slots(state, VM_POINTER_SLOTS, VM_POINTER_SLOTS, stmt->span);
+    codegen_set_slot(state, ast->symbol, slot);
+
+    codegen_emit_channel_op(state, OP_RECEIVE, slot, ast->channel_symbol);
+    CodegenLabel empty = codegen_create_label(state);
+
+    codegen_own_slot(state, slot, ast->symbol->var.type);
+    codegen_block_stmt(state, &ast->then_block->block);
+    codegen_release_owned(state, enclosing_depth, VM_INVALID_REGISTER);
+
+    state->depth = enclosing_depth;
+    codegen_release_registers(state, saved);
+
+    if (!ast->else_block) {
+        codegen_patch_jump(state, empty, OP_JMP, 0);
+        return;
+    }
+
+    CodegenLabel end = codegen_create_label(state);
+
+    codegen_patch_jump(state, empty, OP_JMP, 0);
+
+    codegen_stmt(state, ast->else_block);
+
+    codegen_patch_jump(state, end, OP_JMP, 0);
+}
+
 // Claims the index a function's call will encode, without generating anything.
 // Reserving it before any body is generated is what lets a body call a function
 // whose own body has not been reached yet — the recursion case, and now the
@@ -1043,7 +1379,31 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
     // binds to is a question only a VM can answer, so the unit records the ask
     // and linking either answers all of them or installs nothing.
     if (ast->symbol->func.is_extern) {
-        state->unit->extern_protos.data[func_index] = (ExternProto){.symbol = ast->symbol};
+        const Symbol *symbol = ast->symbol;
+
+        // Laid out as a script callee's parameters are, from slot 1 up. A body
+        // reads them through this table instead of re-deriving the layout.
+        uint16_t *param_offsets =
+            arena_alloc(state->arena, (symbol->func.param_count + 1) * sizeof(uint16_t));
+        unsigned int slot = 1;
+
+        for (size_t i = 0; i < symbol->func.param_count && slot <= VM_MAX_FRAME_SLOTS; i++) {
+            param_offsets[i] = (uint16_t)(slot * VM_SLOT_SIZE);
+            slot += type_slot_count(symbol->func.params[i]);
+        }
+
+        // The same bound a script body's parameters meet: a caller could not
+        // lay out the arguments, and an offset past it would not fit the table.
+        if (slot > VM_MAX_FRAME_SLOTS) {
+            diag_error(state->diagnostics, GAB_ERR_CODEGEN, stmt->span,
+                       "function signature is too large for a frame");
+
+            state->failed = true;
+            return;
+        }
+
+        state->unit->extern_protos.data[func_index] =
+            (ExternProto){.symbol = symbol, .param_offsets = param_offsets};
 
         extern_request_list_add(
             &state->unit->externs,
@@ -1052,6 +1412,61 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
         return;
     }
 
+    if (ast->deferred) {
+        codegen_deferred_proto(state, stmt, state->unit->prototypes.data[func_index]);
+        return;
+    }
+
+    codegen_func_body(state, stmt, state->unit->prototypes.data[func_index]);
+}
+
+// A function the unit's loading skipped the body of: everything a caller needs
+// to lay out its arguments and read its result, which the signature alone
+// decides, and where to find the body once something calls it.
+static void codegen_deferred_proto(CodegenState *state, ASTStmt *stmt, FuncPrototype *out) {
+    ASTFuncDecl *ast = &stmt->func_decl;
+    const Symbol *symbol = ast->symbol;
+
+    // Counted as codegen_func_body places them, receiver included: it is
+    // parameter zero of the symbol.
+    unsigned int param_slots = 0;
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        param_slots += type_slot_count(symbol->func.params[i]);
+    }
+
+    if (1 + param_slots > VM_MAX_FRAME_SLOTS) {
+        diag_error(state->diagnostics, GAB_ERR_CODEGEN, stmt->span,
+                   "function signature is too large for a frame");
+
+        state->failed = true;
+        return;
+    }
+
+    DeferredBody *deferred = arena_alloc(state->arena, sizeof(DeferredBody));
+    *deferred = (DeferredBody){
+        .symbol = ast->symbol,
+        .offset = ast->source_offset,
+        .line = stmt->span.line,
+        .column = stmt->span.column,
+    };
+
+    *out = (FuncPrototype){
+        .arity = (int)symbol->func.param_count,
+        .param_slots = (int)param_slots,
+        .return_slots = (int)type_slot_count(symbol->func.return_type),
+        .returns_owned = type_is_pointer(symbol->func.return_type) && !symbol->func.return_type->is_ref,
+        .refs = frame_ref_list_create(),
+        .deferred = deferred,
+    };
+
+    state->unit->deferred_count++;
+}
+
+// Generates a script function's body into 'out', in a frame of its own.
+static void codegen_func_body(CodegenState *state, ASTStmt *stmt, FuncPrototype *out) {
+    ASTFuncDecl *ast = &stmt->func_decl;
+
     Chunk *func_chunk = chunk_create();
 
     unsigned int func_next_reg = 1;
@@ -1068,6 +1483,7 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
         .temporaries = owned_list_create(),
         .depth = 0,
         .frame_refs = frame_ref_list_create(),
+        .pure_calls = pure_call_list_create(),
         .diagnostics = state->diagnostics,
         .failed = false,
     };
@@ -1105,6 +1521,7 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
         frame_ref_list_free(&func_state.frame_refs);
         owned_list_free(&func_state.owned);
         owned_list_free(&func_state.temporaries);
+        pure_call_list_free(&func_state.pure_calls);
         slot_map_destroy(func_state.slots);
 
         return;
@@ -1113,6 +1530,8 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
     func_state.next_reg = func_next_reg;
     func_state.max_reg = func_next_reg;
 
+    codegen_hoist_pure_calls(&func_state, ast->body);
+
     codegen_stmt(&func_state, ast->body);
 
     state->failed = state->failed || func_state.failed;
@@ -1125,19 +1544,236 @@ static void codegen_func_decl_stmt(CodegenState *state, ASTStmt *stmt) {
         chunk_add_instruction(func_chunk, VM_ENCODE_R(OP_RETURN, 0, 0, 0));
     }
 
-    *state->unit->prototypes.data[func_index] = (FuncPrototype){
+    *out = (FuncPrototype){
         .chunk = func_chunk,
         // The receiver is parameter zero, so it counts.
         .arity = ast->params.size + (ast->receiver ? 1 : 0),
         .max_registers = func_state.max_reg,
+        .param_slots = (int)func_next_reg - 1,
+        .return_slots = (int)type_slot_count(ast->symbol->func.return_type),
+        .returns_owned =
+            type_is_pointer(ast->symbol->func.return_type) && !ast->symbol->func.return_type->is_ref,
         .refs = func_state.frame_refs,
     };
 
     owned_list_free(&func_state.owned);
     owned_list_free(&func_state.temporaries);
+    pure_call_list_free(&func_state.pure_calls);
     slot_map_destroy(func_state.slots);
 }
 
+// ---- Pure calls ----
+
+// A call that may be made once at entry in place of where it is written: to an
+// 'extern pure' function, on literals only, so the arguments are the same at
+// entry as anywhere later. A result to own is excluded, since one call cannot
+// hand the same object to several owners.
+static bool pure_call_is_hoistable(const ASTExpr *node) {
+    if (node->kind != EXPR_CALL || node->call.intrinsic != INTRINSIC_NONE || !node->symbol) {
+        return false;
+    }
+
+    if (!node->symbol->func.is_extern || !node->symbol->func.is_pure) {
+        return false;
+    }
+
+    if (!node->type || type_is_owned(node->type)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < node->call.args.size; i++) {
+        if (node->call.args.data[i]->kind != EXPR_LITERAL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Whether two hoistable calls are the same call: one callee, equal literals. A
+// float is compared by its bits, so '0.0' and '-0.0' stay apart; a string by
+// identity, since the lexer interns every literal.
+static bool pure_call_equals(const ASTExpr *a, const ASTExpr *b) {
+    if (a->symbol != b->symbol || a->call.args.size != b->call.args.size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->call.args.size; i++) {
+        const Literal *x = &a->call.args.data[i]->lit;
+        const Literal *y = &b->call.args.data[i]->lit;
+
+        if (x->kind != y->kind) {
+            return false;
+        }
+
+        bool same = x->kind == TYPE_STRING  ? x->as_string == y->as_string
+                    : x->kind == TYPE_FLOAT ? memcmp(&x->as_float, &y->as_float, sizeof(float)) == 0
+                                            : x->as_int == y->as_int;
+
+        if (!same) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void pure_calls_collect_expr(PureCallList *calls, const ASTExpr *node, bool in_loop) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->kind) {
+    case EXPR_LITERAL:
+    case EXPR_VARIABLE:
+    case EXPR_NEW:
+        return;
+    case EXPR_BIN_OP:
+        pure_calls_collect_expr(calls, node->bin_op.left, in_loop);
+        pure_calls_collect_expr(calls, node->bin_op.right, in_loop);
+        return;
+    case EXPR_FIELD:
+        pure_calls_collect_expr(calls, node->field.target, in_loop);
+        return;
+    case EXPR_ADDR_OF:
+    case EXPR_DEREF:
+    case EXPR_NEG:
+    case EXPR_NOT:
+    case EXPR_SPAWN:
+    case EXPR_JOIN:
+        pure_calls_collect_expr(calls, node->unary.target, in_loop);
+        return;
+    case EXPR_CAST:
+        pure_calls_collect_expr(calls, node->cast.operand, in_loop);
+        return;
+    case EXPR_CALL:
+        break;
+    }
+
+    for (size_t i = 0; i < node->call.args.size; i++) {
+        pure_calls_collect_expr(calls, node->call.args.data[i], in_loop);
+    }
+
+    if (!pure_call_is_hoistable(node)) {
+        return;
+    }
+
+    for (size_t i = 0; i < calls->size; i++) {
+        PureCall *seen = &calls->data[i];
+
+        if (pure_call_equals(seen->call, node)) {
+            seen->uses++;
+            seen->in_loop = seen->in_loop || in_loop;
+            return;
+        }
+    }
+
+    pure_call_list_add(calls,
+                       (PureCall){.call = node, .uses = 1, .in_loop = in_loop, .reg = VM_INVALID_REGISTER});
+}
+
+// A nested function is not entered: it has a frame, and an entry, of its own.
+static void pure_calls_collect_stmt(PureCallList *calls, const ASTStmt *stmt, bool in_loop) {
+    if (!stmt) {
+        return;
+    }
+
+    switch (stmt->kind) {
+    case STMT_EXPR:
+        pure_calls_collect_expr(calls, stmt->expr.value, in_loop);
+        return;
+    case STMT_VAR_DECL:
+        pure_calls_collect_expr(calls, stmt->var_decl.initializer, in_loop);
+        return;
+    case STMT_ASSIGN:
+        pure_calls_collect_expr(calls, stmt->assign.target, in_loop);
+        pure_calls_collect_expr(calls, stmt->assign.value, in_loop);
+        return;
+    case STMT_COMPOUND_ASSIGN:
+        pure_calls_collect_expr(calls, stmt->compound_assign.target, in_loop);
+        pure_calls_collect_expr(calls, stmt->compound_assign.value, in_loop);
+        return;
+    case STMT_BLOCK:
+        for (size_t i = 0; i < stmt->block.list.size; i++) {
+            pure_calls_collect_stmt(calls, stmt->block.list.data[i], in_loop);
+        }
+        return;
+    case STMT_IF:
+        pure_calls_collect_expr(calls, stmt->ifstmt.condition, in_loop);
+        pure_calls_collect_stmt(calls, stmt->ifstmt.then_block, in_loop);
+        pure_calls_collect_stmt(calls, stmt->ifstmt.else_block, in_loop);
+        return;
+    case STMT_FOR:
+        // The initializer runs once; everything else runs per iteration.
+        pure_calls_collect_stmt(calls, stmt->forstmt.init, in_loop);
+        pure_calls_collect_expr(calls, stmt->forstmt.condition, true);
+        pure_calls_collect_stmt(calls, stmt->forstmt.post, true);
+        pure_calls_collect_stmt(calls, stmt->forstmt.body, true);
+        return;
+    case STMT_RETURN:
+        pure_calls_collect_expr(calls, stmt->ret.result, in_loop);
+        return;
+    case STMT_YIELD:
+        pure_calls_collect_expr(calls, stmt->yield.value, in_loop);
+        return;
+    case STMT_SEND:
+        pure_calls_collect_expr(calls, stmt->send.value, in_loop);
+        return;
+    case STMT_RECEIVE:
+        pure_calls_collect_stmt(calls, stmt->receive.then_block, in_loop);
+        pure_calls_collect_stmt(calls, stmt->receive.else_block, in_loop);
+        return;
+    case STMT_FUNC_DECL:
+    case STMT_STRUCT_DECL:
+    case STMT_JUMP:
+    case STMT_CHANNEL_DECL:
+        return;
+    }
+}
+
+// Makes each pure call worth moving at the top of the body, before any local is
+// allocated, so its result sits below every slot the body will reclaim. A call
+// repeated, or made in a loop, then costs one host call per entry instead of
+// one per evaluation.
+//
+// Arguments that are variables are left alone. Proving one unchanged between
+// entry and the call is a question of every store in between, and the cases the
+// host tables are written for pass constants.
+static void codegen_hoist_pure_calls(CodegenState *state, const ASTStmt *body) {
+    PureCallList found = pure_call_list_create();
+    pure_calls_collect_stmt(&found, body, false);
+
+    for (size_t i = 0; i < found.size && state->pure_calls.size < CODEGEN_MAX_HOISTED_CALLS; i++) {
+        PureCall call = found.data[i];
+
+        if (call.uses < 2 && !call.in_loop) {
+            continue;
+        }
+
+        // Generated as any call is. The entry is not listed yet, so this cannot
+        // find itself; its arguments are literals, so nothing else is hoisted
+        // inside it. Its argument block is reclaimed and its result is kept.
+        call.reg = codegen_call_expr(state, (ASTExpr *)call.call);
+
+        pure_call_list_add(&state->pure_calls, call);
+    }
+
+    pure_call_list_free(&found);
+}
+
+// The slot already holding this call's result, if the entry made it.
+static const PureCall *codegen_find_hoisted_call(const CodegenState *state, const ASTExpr *node) {
+    for (size_t i = 0; i < state->pure_calls.size; i++) {
+        const PureCall *call = &state->pure_calls.data[i];
+
+        if (pure_call_equals(call->call, node)) {
+            return call;
+        }
+    }
+
+    return NULL;
+}
+
 // ---- Expressions ----
 
 static unsigned int codegen_expr(CodegenState *state, ASTExpr *ast) {
@@ -1164,6 +1800,10 @@ static unsigned int codegen_expr(CodegenState *state, ASTExpr *ast) {
         return codegen_cast_expr(state, ast);
     case EXPR_NEW:
         return codegen_new_expr(state, ast);
+    case EXPR_SPAWN:
+        return codegen_spawn_expr(state, ast);
+    case EXPR_JOIN:
+        return codegen_join_expr(state, ast);
     }
 
     assert(0 && "unknown expression kind");
@@ -1248,7 +1888,12 @@ static unsigned int codegen_variable_expr(CodegenState *state, ASTExpr *node) {
 // module it ever loaded. No argument count is encoded: the callee's frame is
 // based at dest, so the arguments written above dest already are its parameters,
 // and its size comes from the prototype.
-static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symbol *callee, Span span) {
+//
+// A spawn is the same instruction shape over the same block, as OP_SPAWN: it
+// takes the arguments from where a callee would find them and leaves a task
+// handle at dest instead of a result.
+static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symbol *callee, bool spawn,
+                              Span span) {
     // A function this unit declared is numbered by the unit and rebased at link;
     // one an earlier unit declared already has its final index and must be left
     // alone. Which it is, is which of the two knows the answer.
@@ -1266,6 +1911,8 @@ static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symb
 
     bool is_extern = callee->func.is_extern;
 
+    assert(!(spawn && is_extern) && "the resolver refuses to spawn an extern");
+
     // Only an absolute index can be bounds-checked here. A unit-local one is
     // checked at link, where the base it will be given is known.
     if (!local && index > (is_extern ? VM_MAX_EXTERN_PROTOS : VM_MAX_PROTOTYPES)) {
@@ -1278,11 +1925,15 @@ static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symb
     }
 
     size_t offset = chunk_add_instruction(
-        state->chunk, VM_ENCODE_I(is_extern ? OP_CALL_EXTERN : OP_CALL, dest, (unsigned int)index));
+        state->chunk,
+        VM_ENCODE_I(spawn ? OP_SPAWN : is_extern ? OP_CALL_EXTERN : OP_CALL, dest, (unsigned int)index));
 
     if (local) {
         relocation_list_add(is_extern ? &state->unit->extern_relocations : &state->unit->proto_relocations,
                             (Relocation){.chunk = state->chunk, .offset = offset});
+    } else {
+        call_site_list_add(&state->unit->call_sites,
+                           (CallSite){.chunk = state->chunk, .offset = offset, .callee = callee});
     }
 }
 
@@ -1290,6 +1941,27 @@ static void codegen_emit_call(CodegenState *state, unsigned int dest, const Symb
 // where the callee's frame expects them: its r0 is the return slot and its
 // parameters are r1..arity.
 static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node) {
+    if (node->call.intrinsic != INTRINSIC_NONE) {
+        return codegen_intrinsic_expr(state, node);
+    }
+
+    // Made once at entry, so this is a read of the slot it left its result in,
+    // exactly as a variable is.
+    if (state->pure_calls.size > 0 && pure_call_is_hoistable(node)) {
+        const PureCall *hoisted = codegen_find_hoisted_call(state, node);
+
+        if (hoisted) {
+            return hoisted->reg;
+        }
+    }
+
+    return codegen_call_block(state, node, false);
+}
+
+// The argument block and the instruction over it, for a call or for a spawn of
+// one. A spawn keeps only the two slots of its handle, which is what lands at
+// dest in place of a result.
+static unsigned int codegen_call_block(CodegenState *state, ASTExpr *node, bool spawn) {
     size_t arg_count = node->call.args.size;
 
     // dest and the argument slots must be contiguous, so they are reserved
@@ -1300,7 +1972,7 @@ static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node) {
         arg_slots += type_slot_count(node->call.args.data[i]->type);
     }
 
-    unsigned int return_slots = type_slot_count(node->type);
+    unsigned int return_slots = spawn ? VM_POINTER_SLOTS : type_slot_count(node->type);
 
     // The callee's frame is based at dest, so its parameters overlap the
     // argument block. A struct return larger than that block still needs room
@@ -1312,7 +1984,7 @@ static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node) {
 
     // dest and the argument slots must be contiguous, so the whole block is
     // reserved before evaluating anything.
-    unsigned int dest = codegen_alloc_slots(state, reserved, 1, node->span);
+    unsigned int dest = codegen_alloc_slots(state, reserved, spawn ? VM_POINTER_SLOTS : 1, node->span);
 
     // Only the result slots outlive the call; everything above them is the
     // argument block and is released once the call is emitted.
@@ -1350,7 +2022,7 @@ static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node) {
         offset += slots;
     }
 
-    codegen_emit_call(state, dest, node->symbol, node->span);
+    codegen_emit_call(state, dest, node->symbol, spawn, node->span);
 
     // After the call, so the callee still has its arguments, and before the
     // registers are reclaimed, so the slots still hold what was put in them.
@@ -1363,6 +2035,87 @@ static unsigned int codegen_call_expr(CodegenState *state, ASTExpr *node) {
     return dest;
 }
 
+// A call the resolver tagged as an intrinsic: its operands are evaluated where
+// they land, with no argument block, and one instruction computes the result.
+// Nothing is pushed and nothing is borrowed past the instruction, so none of
+// the call path's layout applies.
+static unsigned int codegen_intrinsic_expr(CodegenState *state, ASTExpr *node) {
+    ASTExprList *args = &node->call.args;
+    bool is_float = node->type->kind == TYPE_FLOAT;
+
+    switch (node->call.intrinsic) {
+    case INTRINSIC_LEN:
+    case INTRINSIC_SQRT:
+    case INTRINSIC_FLOOR:
+    case INTRINSIC_CEIL:
+    case INTRINSIC_ABS: {
+        OpCode op = OP_STR_LEN;
+
+        switch (node->call.intrinsic) {
+        case INTRINSIC_SQRT:
+            op = OP_SQRTF;
+            break;
+        case INTRINSIC_FLOOR:
+            op = OP_FLOORF;
+            break;
+        case INTRINSIC_CEIL:
+            op = OP_CEILF;
+            break;
+        case INTRINSIC_ABS:
+            op = is_float ? OP_ABSF : OP_ABSI;
+            break;
+        default:
+            break;
+        }
+
+        unsigned int operand = codegen_expr(state, args->data[0]);
+        unsigned int rd = codegen_alloc_register(state, node->span);
+
+        chunk_add_instruction(state->chunk, VM_ENCODE_R(op, rd, operand, 0));
+
+        return rd;
+    }
+    case INTRINSIC_MIN:
+    case INTRINSIC_MAX:
+    case INTRINSIC_CLAMP: {
+        // 'clamp(x, lo, hi)' is 'min(max(x, lo), hi)', computed in one
+        // register. A range given backwards answers hi, as the nesting says.
+        OpCode max_op = is_float ? OP_MAXF : OP_MAXI;
+        OpCode min_op = is_float ? OP_MINF : OP_MINI;
+
+        unsigned int value = codegen_expr(state, args->data[0]);
+
+        for (size_t i = 1; i < args->size; i++) {
+            bool is_max = node->call.intrinsic == INTRINSIC_MAX ||
+                          (node->call.intrinsic == INTRINSIC_CLAMP && i == 1);
+
+            // An int bound small enough rides in the instruction, as it does
+            // for arithmetic: 'min(n, 10)' needs no load of the 10. The float
+            // forms read a register, having no constant-pool variant.
+            unsigned int bound = 0;
+            unsigned int k = !is_float && expr_is_immediate_operand(args->data[i], &bound) ? 1 : 0;
+
+            if (!k) {
+                bound = codegen_expr(state, args->data[i]);
+            }
+
+            unsigned int rd = i == 1 ? codegen_alloc_register(state, node->span) : value;
+
+            chunk_add_instruction(state->chunk, VM_ENCODE_RK(is_max ? max_op : min_op, rd, value, bound, k));
+
+            value = rd;
+        }
+
+        return value;
+    }
+    case INTRINSIC_NONE:
+        break;
+    }
+
+    assert(0 && "not an intrinsic");
+    abort();
+}
+
 static unsigned int codegen_field_expr(CodegenState *state, ASTExpr *node) {
     FieldTarget target = codegen_resolve_field_target(state, node, true);
 
@@ -1589,6 +2342,45 @@ static unsigned int codegen_new_expr(CodegenState *state, ASTExpr *node) {
     return rd;
 }
 
+// 'spawn f(x)': f's argument block, laid out as for a call, handed to a task
+// rather than to a frame. The handle is owned by whatever takes it, and
+// releasing one unjoined is what cancels or waits for the task.
+static unsigned int codegen_spawn_expr(CodegenState *state, ASTExpr *node) {
+    return codegen_call_block(state, node->unary.target, true);
+}
+
+// 'join t': waits for the task in t's slot and copies its result out. The slot
+// is cleared by the join itself, so the release codegen emits where t goes out
+// of scope finds nothing left to do.
+static unsigned int codegen_join_expr(CodegenState *state, ASTExpr *node) {
+    unsigned int task = codegen_expr(state, node->unary.target);
+
+    // A task whose call returns nothing still joins, with nowhere to put a
+    // result: zero slots, at a destination nothing reads.
+    if (!node->type) {
+        chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_JOIN, 0, task, 0));
+        return 0;
+    }
+
+    unsigned int slots = type_slot_count(node->type);
+
+    if (slots > VM_MAX_RETURN_SLOTS) {
+        if (!state->failed) {
+            diag_error(state->diagnostics, GAB_ERR_CODEGEN, node->span,
+                       "struct is too large to join by value");
+        }
+
+        state->failed = true;
+        return 0;
+    }
+
+    unsigned int rd = codegen_alloc_slots(state, slots, type_align_slots(node->type), node->span);
+
+    chunk_add_instruction(state->chunk, VM_ENCODE_R(OP_JOIN, rd, task, slots));
+
+    return rd;
+}
+
 // ---- Field and pointer access ----
 
 // Walks a field chain down to whatever the outermost struct lives in,
@@ -2059,15 +2851,18 @@ static void codegen_emit_loop(CodegenState *state, size_t target) {
 
 // ---- Reference ownership ----
 
-static bool type_is_owned(const Type *type) { return type_is_pointer(type); }
+// A task handle is owned as a '*T' is: exactly one slot holds it, and that
+// slot going out of scope is what ends the task's claim on anything.
+static bool type_is_owned(const Type *type) { return type_is_pointer(type) || type_is_task(type); }
 
 // Whether an expression hands its caller a reference to own, or merely lends
 // one it keeps. 'new' and a call returning '*T' produce a fresh reference the
-// receiver is responsible for; reading a variable or a field does not, since
-// the variable or the object still holds it.
+// receiver is responsible for, as do a 'spawn' and a 'join' of a task that
+// returns one; reading a variable or a field does not, since the variable or
+// the object still holds it.
 //
-// Derived from the expression rather than recorded on it: the two producing
-// forms are exactly these, and a flag on every node would have to be kept in
+// Derived from the expression rather than recorded on it: the producing forms
+// are exactly these, and a flag on every node would have to be kept in
 // step with them for no extra information.
 static bool expr_yields_owned(const ASTExpr *expr) {
     if (!expr || !type_is_owned(expr->type)) {
@@ -2077,6 +2872,8 @@ static bool expr_yields_owned(const ASTExpr *expr) {
     switch (expr->kind) {
     case EXPR_NEW:
     case EXPR_CALL:
+    case EXPR_SPAWN:
+    case EXPR_JOIN:
         return true;
     default:
         return false;
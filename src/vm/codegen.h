@@ -21,4 +21,11 @@
 // as it runs.
 Unit *codegen_generate(ASTScript *ast, Arena *arena, StringPool *strings, Diagnostics *diagnostics);
 
+// Generates the body of a function whose unit deferred it, from its
+// declaration parsed back and resolved, as a unit of its own: the body is the
+// unit's top level, and whatever it allocates or interns is linked as any
+// unit's would be. See DeferredBody.
+Unit *codegen_generate_deferred(ASTStmt *func_decl, Arena *arena, StringPool *strings,
+                               Diagnostics *diagnostics);
+
 #endif
@@ -0,0 +1,506 @@
+#include "vm/image.h"
+
+#include "compile.h"
+#include "symbol_table.h"
+#include "vm/chunk.h"
+#include "vm/link.h"
+#include "vm/opcode.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Written as the writing machine holds it, and read back the same way only by
+// a machine that holds it the same way.
+#define IMAGE_BYTE_ORDER 0x01020304u
+
+// Every record is 32-bit words, so each lands aligned wherever the writer puts
+// it on a 4-byte boundary, and the mapping's page alignment does the rest.
+
+// Bytes at an offset, with a NUL after them that 'length' does not count, so a
+// unit's source can be lexed where it lies.
+typedef struct {
+    uint32_t at;
+    uint32_t length;
+} ImageText;
+
+// An array of records at an offset.
+typedef struct {
+    uint32_t count;
+    uint32_t at;
+} ImageTable;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t pointer_size;
+    uint32_t byte_order;
+    uint32_t size;
+
+    ImageTable units;      // ImageUnit
+    ImageTable prototypes; // ImageProto
+    ImageTable types;      // ImageName: the struct's module and its name there
+    ImageTable strings;    // ImageText
+    ImageTable channels;   // ImageName: the module declaring it and its name
+} ImageHeader;
+
+typedef struct {
+    ImageText name;
+    ImageText source;
+} ImageUnit;
+
+typedef struct {
+    ImageText module;
+    ImageText name;
+} ImageName;
+
+typedef struct {
+    uint32_t max_registers;
+    ImageTable refs;         // uint32_t slots
+    ImageTable instructions; // Instruction
+    ImageTable constants;    // Constant
+} ImageProto;
+
+// ---- Writing ----
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} ImageBuffer;
+
+// Appends 'count' bytes at the next 4-byte boundary and returns where they
+// went. Zeroed when 'bytes' is NULL, for a table filled in afterwards.
+static uint32_t image_put(ImageBuffer *out, const void *bytes, size_t count) {
+    size_t at = (out->size + 3) & ~(size_t)3;
+
+    if (out->failed || at + count > UINT32_MAX) {
+        out->failed = true;
+        return 0;
+    }
+
+    if (at + count > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+
+        while (capacity < at + count) {
+            capacity *= 2;
+        }
+
+        uint8_t *data = realloc(out->data, capacity);
+
+        if (!data) {
+            out->failed = true;
+            return 0;
+        }
+
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    memset(out->data + out->size, 0, at - out->size);
+
+    if (bytes) {
+        memcpy(out->data + at, bytes, count);
+    } else {
+        memset(out->data + at, 0, count);
+    }
+
+    out->size = at + count;
+
+    return (uint32_t)at;
+}
+
+static ImageText image_put_text(ImageBuffer *out, const char *text, size_t length) {
+    uint32_t at = image_put(out, text, length);
+    image_put(out, "", 1);
+
+    return (ImageText){.at = at, .length = (uint32_t)length};
+}
+
+static ImageTable image_put_table(ImageBuffer *out, size_t count, size_t record_size) {
+    return (ImageTable){.count = (uint32_t)count, .at = image_put(out, NULL, count * record_size)};
+}
+
+// Records are written by offset, never through a pointer kept across a put:
+// the buffer moves as it grows.
+static void image_set(ImageBuffer *out, ImageTable table, size_t index, const void *record, size_t size) {
+    if (!out->failed) {
+        memcpy(out->data + table.at + index * size, record, size);
+    }
+}
+
+static ImageName image_put_name(ImageBuffer *out, const String *module, const String *name) {
+    return (ImageName){
+        .module = image_put_text(out, module->data, module->length),
+        .name = image_put_text(out, name->data, name->length),
+    };
+}
+
+static void image_put_proto(ImageBuffer *out, ImageTable table, size_t index, const FuncPrototype *proto) {
+    const Chunk *chunk = proto->chunk;
+    ImageProto record = {.max_registers = (uint32_t)proto->max_registers};
+
+    record.refs = image_put_table(out, proto->refs.size, sizeof(uint32_t));
+    for (size_t i = 0; i < proto->refs.size; i++) {
+        uint32_t slot = proto->refs.data[i].slot;
+        image_set(out, record.refs, i, &slot, sizeof(slot));
+    }
+
+    record.instructions = (ImageTable){
+        .count = (uint32_t)chunk->instructions.size,
+        .at = image_put(out, chunk->instructions.data, chunk->instructions.size * sizeof(Instruction)),
+    };
+
+    record.constants = (ImageTable){
+        .count = (uint32_t)chunk->const_pool->count,
+        .at = image_put(out, chunk->const_pool->constants, chunk->const_pool->count * sizeof(Constant)),
+    };
+
+    image_set(out, table, index, &record, sizeof(record));
+}
+
+bool image_write(VM *vm, const char *path, Diagnostics *diagnostics) {
+    const Program *program = &vm->program;
+    const LoadedUnitList *units = &vm->env.loaded_units;
+
+    // Declaring the units again would number the tables densely, and a freed
+    // module left them with holes and later units in them.
+    if (vm->env.modules_freed) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "a VM a module was freed from cannot be written as an image");
+        return false;
+    }
+
+    // An image declares every unit again from its source.
+    for (size_t i = 0; i < units->size; i++) {
+        if (!units->data[i].source) {
+            diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                       "unit '%s' was loaded without its source kept; see gab_keep_sources",
+                       units->data[i].name);
+            return false;
+        }
+    }
+
+    ImageBuffer out = {0};
+    uint32_t header_at = image_put(&out, NULL, sizeof(ImageHeader));
+
+    ImageHeader header = {
+        .magic = IMAGE_MAGIC,
+        .version = IMAGE_VERSION,
+        .slot_size = VM_SLOT_SIZE,
+        .pointer_size = (uint32_t)sizeof(void *),
+        .byte_order = IMAGE_BYTE_ORDER,
+        .units = image_put_table(&out, units->size, sizeof(ImageUnit)),
+        .prototypes = image_put_table(&out, program->prototypes.size, sizeof(ImageProto)),
+        .types = image_put_table(&out, program->heap_types.size, sizeof(ImageName)),
+        .strings = image_put_table(&out, program->strings.size, sizeof(ImageText)),
+        .channels = image_put_table(&out, program->channels.size, sizeof(ImageName)),
+    };
+
+    for (size_t i = 0; i < units->size; i++) {
+        const LoadedUnit *unit = &units->data[i];
+        ImageUnit record = {
+            .name = image_put_text(&out, unit->name, strlen(unit->name)),
+            .source = image_put_text(&out, unit->source, unit->source_length),
+        };
+
+        image_set(&out, header.units, i, &record, sizeof(record));
+    }
+
+    for (size_t i = 0; i < program->prototypes.size; i++) {
+        image_put_proto(&out, header.prototypes, i, program->prototypes.data[i]);
+    }
+
+    for (size_t i = 0; i < program->heap_types.size; i++) {
+        const Type *type = program->heap_types.data[i];
+        String *module = environment_type_module(&vm->env, type);
+
+        if (!module) {
+            out.failed = true;
+            break;
+        }
+
+        ImageName record = image_put_name(&out, module, type->name);
+        image_set(&out, header.types, i, &record, sizeof(record));
+    }
+
+    for (size_t i = 0; i < program->strings.size; i++) {
+        const String *text = program->strings.data[i];
+        ImageText record = image_put_text(&out, text->data, text->length);
+
+        image_set(&out, header.strings, i, &record, sizeof(record));
+    }
+
+    for (size_t i = 0; i < program->channels.size; i++) {
+        const Symbol *channel = program->channels.data[i];
+        ImageName record = image_put_name(&out, channel->channel.module, channel->channel.name);
+
+        image_set(&out, header.channels, i, &record, sizeof(record));
+    }
+
+    header.size = (uint32_t)out.size;
+    image_set(&out, (ImageTable){.at = header_at}, 0, &header, sizeof(header));
+
+    if (out.failed) {
+        free(out.data);
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "the VM image could not be built");
+        return false;
+    }
+
+    FILE *file = fopen(path, "wb");
+    bool ok = file && fwrite(out.data, 1, out.size, file) == out.size;
+
+    if (file && fclose(file) != 0) {
+        ok = false;
+    }
+
+    free(out.data);
+
+    if (!ok) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "could not write the VM image to '%s'", path);
+    }
+
+    return ok;
+}
+
+// ---- Restoring ----
+
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+} ImageMap;
+
+// Whether a table of 'record_size'-byte records lies within the image, on the
+// alignment its records need to be read where they lie.
+static bool image_table_ok(const ImageMap *map, ImageTable table, size_t record_size) {
+    return table.at % 4 == 0 && table.at <= map->size &&
+           table.count <= (map->size - table.at) / (record_size ? record_size : 1);
+}
+
+static const void *image_record(const ImageMap *map, ImageTable table, size_t index, size_t record_size) {
+    return map->base + table.at + index * record_size;
+}
+
+// The text, NUL included, or NULL if it does not lie within the image.
+static const char *image_text(const ImageMap *map, ImageText text) {
+    if (text.at >= map->size || text.length >= map->size - text.at || map->base[text.at + text.length]) {
+        return NULL;
+    }
+
+    return (const char *)map->base + text.at;
+}
+
+static String *image_string(VM *vm, const ImageMap *map, ImageText text) {
+    const char *data = image_text(map, text);
+
+    return data ? string_from_ref(&vm->env.strings, (StringRef){.data = data, .length = text.length}) : NULL;
+}
+
+// The scope of a module the image names, if the units declared it.
+static Scope *image_module(VM *vm, const ImageMap *map, ImageText name) {
+    String *module = image_string(vm, map, name);
+    Scope **scope = module ? module_scope_map_lookup(vm->env.module_scopes, module) : NULL;
+
+    return scope ? *scope : NULL;
+}
+
+static bool image_fill_proto(const ImageMap *map, const ImageProto *record, FuncPrototype *proto) {
+    if (!proto->deferred || !image_table_ok(map, record->refs, sizeof(uint32_t)) ||
+        !image_table_ok(map, record->instructions, sizeof(Instruction)) ||
+        !image_table_ok(map, record->constants, sizeof(Constant)) ||
+        record->constants.count > VM_MAX_CONSTANTS) {
+        return false;
+    }
+
+    const uint32_t *slots = image_record(map, record->refs, 0, sizeof(uint32_t));
+
+    for (size_t i = 0; i < record->refs.count; i++) {
+        frame_ref_list_add(&proto->refs, (FrameRef){.slot = slots[i]});
+    }
+
+    // Run where it lies: the mapping is never written, so the pages stay the
+    // ones every process restored from this file shares.
+    const Instruction *code = image_record(map, record->instructions, 0, sizeof(Instruction));
+    const Constant *constants = image_record(map, record->constants, 0, sizeof(Constant));
+
+    proto->chunk = chunk_borrow(code, record->instructions.count, constants, record->constants.count);
+    proto->max_registers = (int)record->max_registers;
+    proto->deferred = NULL;
+
+    return true;
+}
+
+// The tables the bytecode indexes, in the image's order, in place of the ones
+// the units' top levels left: those are never run again, and the order is
+// what every operand in the image was compiled against.
+static bool image_restore_tables(VM *vm, const ImageMap *map, const ImageHeader *header) {
+    TypeList types = type_list_create();
+    StringList strings = string_list_create();
+    ChannelList channels = channel_list_create();
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < header->types.count; i++) {
+        const ImageName *name = image_record(map, header->types, i, sizeof(ImageName));
+        Scope *scope = image_module(vm, map, name->module);
+        String *type_name = image_string(vm, map, name->name);
+        const Type *type = scope && type_name ? scope_type_lookup(scope, type_name) : NULL;
+
+        ok = type && type->kind == TYPE_STRUCT;
+
+        if (ok) {
+            type_list_add(&types, type);
+        }
+    }
+
+    for (size_t i = 0; ok && i < header->strings.count; i++) {
+        String *text = image_string(vm, map, *(const ImageText *)image_record(map, header->strings, i,
+                                                                             sizeof(ImageText)));
+
+        ok = text != NULL;
+
+        if (ok) {
+            string_list_add(&strings, text);
+        }
+    }
+
+    for (size_t i = 0; ok && i < header->channels.count; i++) {
+        const ImageName *name = image_record(map, header->channels, i, sizeof(ImageName));
+        Scope *scope = image_module(vm, map, name->module);
+        String *channel_name = image_string(vm, map, name->name);
+        const Symbol *channel = scope && channel_name ? scope_symbol_lookup(scope, channel_name) : NULL;
+
+        ok = channel && channel->kind == SYMBOL_CHANNEL;
+
+        if (ok) {
+            channel_list_add(&channels, channel);
+        }
+    }
+
+    if (!ok) {
+        type_list_free(&types);
+        string_list_free(&strings);
+        channel_list_free(&channels);
+        return false;
+    }
+
+    type_list_free(&vm->program.heap_types);
+    string_list_free(&vm->program.strings);
+    channel_list_free(&vm->program.channels);
+
+    vm->program.heap_types = types;
+    vm->program.strings = strings;
+    vm->program.channels = channels;
+
+    return true;
+}
+
+// Maps the file read-only, into the environment so it goes with the VM.
+static bool image_map(VM *vm, const char *path, ImageMap *map) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    void *base = MAP_FAILED;
+
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ImageHeader)) {
+        base = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    // The mapping holds the file open itself.
+    close(fd);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    vm->env.mapped_image = base;
+    vm->env.mapped_size = (size_t)info.st_size;
+
+    *map = (ImageMap){.base = base, .size = (size_t)info.st_size};
+
+    return true;
+}
+
+bool image_restore(VM *vm, const char *path, Diagnostics *diagnostics) {
+    if (vm->env.loaded_units.size > 0 || vm->env.mapped_image) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "a VM image restores only into a VM that has loaded nothing");
+        return false;
+    }
+
+    ImageMap map;
+
+    if (!image_map(vm, path, &map)) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "could not map the VM image '%s'", path);
+        return false;
+    }
+
+    const ImageHeader *header = (const ImageHeader *)map.base;
+
+    if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION ||
+        header->slot_size != VM_SLOT_SIZE || header->pointer_size != sizeof(void *) ||
+        header->byte_order != IMAGE_BYTE_ORDER || header->size != map.size ||
+        !image_table_ok(&map, header->units, sizeof(ImageUnit)) ||
+        !image_table_ok(&map, header->prototypes, sizeof(ImageProto)) ||
+        !image_table_ok(&map, header->types, sizeof(ImageName)) ||
+        !image_table_ok(&map, header->strings, sizeof(ImageText)) ||
+        !image_table_ok(&map, header->channels, sizeof(ImageName))) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "'%s' is not a VM image this build of gab can map", path);
+        return false;
+    }
+
+    // Declared again in the order they first linked, so every function and
+    // every extern lands at the index the image's bytecode calls it by.
+    for (size_t i = 0; i < header->units.count; i++) {
+        const ImageUnit *unit = image_record(&map, header->units, i, sizeof(ImageUnit));
+        const char *name = image_text(&map, unit->name);
+        const char *source = image_text(&map, unit->source);
+
+        if (!name || !source) {
+            diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "the VM image '%s' is damaged", path);
+            return false;
+        }
+
+        // Its errors carry its own name rather than the image's.
+        diagnostics->module = name;
+
+        FuncPrototype top_level = {0};
+
+        if (!compile_unit_stubs(vm, source, &top_level, diagnostics)) {
+            return false;
+        }
+
+        func_proto_free(&top_level);
+    }
+
+    bool ok = vm->program.prototypes.size == header->prototypes.count;
+
+    for (size_t i = 0; ok && i < header->prototypes.count; i++) {
+        const ImageProto *record = image_record(&map, header->prototypes, i, sizeof(ImageProto));
+
+        ok = image_fill_proto(&map, record, vm->program.prototypes.data[i]);
+
+        if (ok) {
+            vm->program.deferred_pending--;
+        }
+    }
+
+    if (!ok || !image_restore_tables(vm, &map, header)) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "the VM image '%s' does not fit what its units declare here", path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef GAB_IMAGE_H
+#define GAB_IMAGE_H
+
+#include "diagnostics.h"
+#include "vm/vm.h"
+
+#include <stdbool.h>
+
+/*
+    A VM's loaded state as a file one process writes and any number map: every
+    unit the VM loaded, in the order it linked them, and the program those
+    units made -- each function's bytecode, and the tables an instruction
+    indexes.
+
+    Nothing in the file is a pointer. Where the program holds a Type *, a
+    String * or a channel's Symbol *, the file holds a name, and where one
+    record refers to another it gives its offset from the start of the file,
+    so the file means the same wherever it is mapped. The bytecode is the one
+    thing not named: its operands are indices into the program's tables, which
+    a restore rebuilds in the same order, so the instructions are run where
+    they lie in the mapping. Every process restored from one image shares the
+    same physical pages of it.
+
+    The declarations are made again from each unit's source, kept in the image,
+    with every body jumped over: declaring is what gives the names and types
+    the bytecode was compiled against to the VM restoring it, and a VM's
+    symbols and types are too entangled with its arenas to map. The externs the
+    units declare are bound again as a load binds them, so a host registers
+    them before restoring, as it would before loading.
+
+    Written in the byte order, slot size and pointer size of the machine that
+    wrote it, which are in its header; a restore anywhere else is refused.
+*/
+
+#define IMAGE_MAGIC 0x49424147u // "GABI"
+#define IMAGE_VERSION 1u
+
+// Writes what 'vm' has loaded to 'path'. Every deferred body must have been
+// compiled. False, with a diagnostic, if the file could not be written or a
+// module was freed from the VM.
+bool image_write(VM *vm, const char *path, Diagnostics *diagnostics);
+
+// Maps 'path' and restores from it into 'vm', which must have loaded nothing.
+// The mapping lives until the VM is freed. False, with a diagnostic, if the
+// file is not an image this build can map or a unit in it does not declare; a
+// VM that failed part way through is only fit to be freed.
+bool image_restore(VM *vm, const char *path, Diagnostics *diagnostics);
+
+#endif
@@ -1,10 +1,14 @@
 #include "vm/interp.h"
 
+#include "compile.h"
 #include "object.h"
+#include "symbol_table.h"
 #include "type.h"
+#include "vm/channel.h"
 #include "vm/chunk.h"
 #include "vm/constant_pool.h"
 #include "vm/opcode.h"
+#include "vm/task.h"
 #include "vm/vm.h"
 #include "vm/vm_dispatch.h"
 
@@ -13,6 +17,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Registers sit at base + r * VM_SLOT_SIZE, so the stack must hold every
@@ -64,20 +69,24 @@ static void vm_clear_pointer(VM *vm, size_t reg) {
 // A slot listed on the prototype either owns a live object or holds NULL,
 // because freeing one clears it. That is what makes walking the list safe
 // despite sibling blocks reusing slots. A 'ref T' slot is never listed.
-static void vm_release_frame_refs(VM *vm, const CallFrame *frame) {
+static void vm_release_frame_refs(uint8_t *stack, const CallFrame *frame) {
     const FrameRefList *refs = &frame->proto->refs;
 
     for (size_t i = 0; i < refs->size; i++) {
         FrameRef ref = refs->data[i];
 
+        if (ref.slot < frame->refs_from) {
+            continue;
+        }
+
         void *object;
-        memcpy(&object, vm->stack + frame->base + ref.slot * VM_SLOT_SIZE, sizeof(object));
+        memcpy(&object, stack + frame->base + ref.slot * VM_SLOT_SIZE, sizeof(object));
 
         if (!object) {
             continue;
         }
 
-        memcpy(vm->stack + frame->base + ref.slot * VM_SLOT_SIZE, &(void *){NULL}, sizeof(object));
+        memcpy(stack + frame->base + ref.slot * VM_SLOT_SIZE, &(void *){NULL}, sizeof(object));
 
         gab_object_free(DEFAULT_ALLOCATOR, object);
     }
@@ -87,8 +96,8 @@ static void vm_release_frame_refs(VM *vm, const CallFrame *frame) {
 // ordinary releases are jumped past by the failure, so without this a run that
 // fails leaks everything that was live when it did.
 static void vm_unwind(VM *vm) {
-    while (vm->frame_count > 0) {
-        vm_release_frame_refs(vm, &vm->frames[vm->frame_count - 1]);
+    while (vm->frame_count > vm->frame_floor) {
+        vm_release_frame_refs(vm->stack, &vm->frames[vm->frame_count - 1]);
         vm_pop_frame(vm);
     }
 }
@@ -162,6 +171,23 @@ int32_t vm_divi(int32_t a, int32_t b) { return a / b; }
 
 int32_t vm_modi(int32_t a, int32_t b) { return a % b; }
 
+static int32_t vm_mini(int32_t a, int32_t b) { return a < b ? a : b; }
+
+static int32_t vm_maxi(int32_t a, int32_t b) { return a > b ? a : b; }
+
+// A one-operand float intrinsic: rd becomes func of r1.
+static void vm_unaryf(VM *vm, Instruction instruction, float (*func)(float)) {
+    vm_write_f32(vm, VM_DECODE_R_RD(instruction), func(vm_read_f32(vm, VM_DECODE_R_R1(instruction))));
+}
+
+// As vm_arithmeticf, but over values, so libm's own functions serve directly.
+static void vm_binaryf(VM *vm, Instruction instruction, float (*func)(float, float)) {
+    float a = vm_read_f32(vm, VM_DECODE_R_R1(instruction));
+    float b = vm_read_f32(vm, VM_DECODE_R_R2(instruction));
+
+    vm_write_f32(vm, VM_DECODE_R_RD(instruction), func(a, b));
+}
+
 // Truncates a float to an int, clamping whatever does not fit to the nearest
 // end of the range.
 //
@@ -326,6 +352,142 @@ void vm_fail(VM *vm, VmRunStatus status, const char *message) {
     snprintf(vm->error.message, sizeof(vm->error.message), "%s", message);
 }
 
+// Compiles a body a lazy load deferred, about to run for the first time, or
+// fails the run with why it cannot be. Only the VM the program belongs to
+// compiles: a context shares the prototype with threads that may be running
+// it, which is why every body is compiled before a context can exist. One
+// that failed then still fails here, with the same error, on any of them.
+static bool vm_compile_body(VM *vm, const FuncPrototype *proto) {
+    const Diagnostic *failure = proto->deferred->failure;
+
+    if (!failure && vm->owner) {
+        vm_fail(vm, VM_RUN_ERR_COMPILE, "a function's deferred body cannot be compiled by a context");
+        return false;
+    }
+
+    // Const only as the interpreter sees it: the program's prototypes are its
+    // own, and this is the one write a run makes to one.
+    if (!failure) {
+        failure = compile_deferred(vm, (FuncPrototype *)proto);
+    }
+
+    if (failure) {
+        char message[sizeof(vm->error.message)];
+        snprintf(message, sizeof(message), "line %d: %s", failure->span.line, failure->message);
+
+        vm_fail(vm, VM_RUN_ERR_COMPILE, message);
+        return false;
+    }
+
+    return true;
+}
+
+// Compiles whatever a lazy load left deferred, before the task pool's threads
+// could reach any of it. A body that fails is left for whichever thread calls
+// it to report.
+static void vm_settle_bodies(VM *vm) {
+    if (!vm->owner && vm->program.deferred_pending > 0) {
+        compile_deferred_all(vm);
+    }
+}
+
+// The channel OP_SEND or OP_RECEIVE names, or NULL having failed the run:
+// the host attaches channels to a VM after loading, and may not have.
+static Channel *vm_channel_for(VM *vm, size_t index) {
+    Channel *channel = vm_channel(vm, index);
+
+    if (!channel) {
+        char message[sizeof(vm->error.message)];
+        snprintf(message, sizeof(message), "channel '%s' is not attached",
+                 vm->image->channels.data[index]->channel.name->data);
+
+        vm_fail(vm, VM_RUN_ERR_CHANNEL, message);
+    }
+
+    return channel;
+}
+
+static int32_t native_i32(const uint8_t *at) {
+    int32_t value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static float native_f32(const uint8_t *at) {
+    float value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static void *native_ptr(const uint8_t *at) {
+    void *value;
+    memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+// Calls a host function registered with a native signature: each argument is
+// loaded from its slot as the C type the shape names, and the result stored
+// back into slot 0. link_check has already held the shape against the
+// declaration, so no read here needs a type check.
+//
+// Such a body has no GabArgs to fail through, so it cannot stop the run.
+static void vm_call_native(VM *vm, const ExternProto *proto, size_t base) {
+    uint8_t *frame = vm->stack + base;
+    const uint16_t *at = proto->param_offsets;
+
+    switch (proto->shape) {
+    case EXTERN_SHAPE_I_I: {
+        int32_t result = ((int32_t (*)(int32_t))proto->native)(native_i32(frame + at[0]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_II_I: {
+        int32_t result = ((int32_t (*)(int32_t, int32_t))proto->native)(native_i32(frame + at[0]),
+                                                                        native_i32(frame + at[1]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_F_F: {
+        float result = ((float (*)(float))proto->native)(native_f32(frame + at[0]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_FF_F: {
+        float result =
+            ((float (*)(float, float))proto->native)(native_f32(frame + at[0]), native_f32(frame + at[1]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_P_V:
+        ((void (*)(void *))proto->native)(native_ptr(frame + at[0]));
+        break;
+    case EXTERN_SHAPE_P_I: {
+        int32_t result = ((int32_t (*)(void *))proto->native)(native_ptr(frame + at[0]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_P_F: {
+        float result = ((float (*)(void *))proto->native)(native_ptr(frame + at[0]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_P_P: {
+        void *result = ((void *(*)(void *))proto->native)(native_ptr(frame + at[0]));
+        memcpy(frame, &result, sizeof(result));
+        break;
+    }
+    case EXTERN_SHAPE_PI_V:
+        ((void (*)(void *, int32_t))proto->native)(native_ptr(frame + at[0]), native_i32(frame + at[1]));
+        break;
+    case EXTERN_SHAPE_PF_V:
+        ((void (*)(void *, float))proto->native)(native_ptr(frame + at[0]), native_f32(frame + at[1]));
+        break;
+    case EXTERN_SHAPE_ARGS:
+        assert(0 && "a GabArgs body has no native shape");
+        break;
+    }
+}
+
 // Runs a C body against the frame at 'base'. Returns false when the run must
 // unwind, which is the body having reported a failure.
 //
@@ -337,10 +499,27 @@ void vm_fail(VM *vm, VmRunStatus status, const char *message) {
 // nothing for a frame to track — and a C function that cannot be interpreted
 // has no instruction pointer to return to.
 bool vm_call_extern(VM *vm, const ExternProto *proto, size_t base) {
-    Args args = {.vm = vm, .symbol = proto->symbol, .base = base};
+    if (proto->shape != EXTERN_SHAPE_ARGS) {
+        vm_call_native(vm, proto, base);
+        return true;
+    }
+
+    Args args = {.vm = vm, .symbol = proto->symbol, .base = base, .param_offsets = proto->param_offsets};
+
+    // A body may call back into a script, which builds its frame above this
+    // block; see VM::running_extern. A native body has no way to, so only this
+    // path records it.
+    const ExternProto *outer = vm->running_extern;
+    size_t outer_base = vm->running_extern_base;
+
+    vm->running_extern = proto;
+    vm->running_extern_base = base;
 
     proto->body(&args);
 
+    vm->running_extern = outer;
+    vm->running_extern_base = outer_base;
+
     return vm->error.status == VM_RUN_OK;
 }
 
@@ -404,7 +583,7 @@ static void vm_run_loop(VM *vm) {
                 unsigned int rd = VM_DECODE_I_RD(instruction);
                 size_t string_index = VM_DECODE_I_KX(instruction);
 
-                const String *text = vm->program.strings.data[string_index];
+                const String *text = vm->image->strings.data[string_index];
 
                 // Borrowed, not copied: the characters are interned and outlive
                 // every frame, so the header names them where they already are.
@@ -541,6 +720,55 @@ static void vm_run_loop(VM *vm) {
                 vm_write_i32(vm, rd, vm_ftoi(vm_read_f32(vm, r1)));
                 VM_NEXT();
             }
+            VM_CASE(OP_STR_LEN) {
+                GabStringValue value;
+                memcpy(&value, vm_reg_at(vm, VM_DECODE_R_R1(instruction)), sizeof(value));
+
+                vm_write_i32(vm, VM_DECODE_R_RD(instruction), value.length);
+                VM_NEXT();
+            }
+            VM_CASE(OP_SQRTF) {
+                vm_unaryf(vm, instruction, sqrtf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_ABSF) {
+                vm_unaryf(vm, instruction, fabsf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_FLOORF) {
+                vm_unaryf(vm, instruction, floorf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_CEILF) {
+                vm_unaryf(vm, instruction, ceilf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_MINF) {
+                vm_binaryf(vm, instruction, fminf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_MAXF) {
+                vm_binaryf(vm, instruction, fmaxf);
+                VM_NEXT();
+            }
+            VM_CASE(OP_ABSI) {
+                int32_t value = vm_read_i32(vm, VM_DECODE_R_R1(instruction));
+
+                // On the unsigned width, so INT32_MIN wraps to itself rather
+                // than overflowing -- the answer negation already gives it.
+                uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+                vm_write_i32(vm, VM_DECODE_R_RD(instruction), (int32_t)magnitude);
+                VM_NEXT();
+            }
+            VM_CASE(OP_MINI) {
+                vm_arithmetici(vm, instruction, vm_mini);
+                VM_NEXT();
+            }
+            VM_CASE(OP_MAXI) {
+                vm_arithmetici(vm, instruction, vm_maxi);
+                VM_NEXT();
+            }
             VM_CASE(OP_MODI) {
                 if (!vm_check_divisor(vm, instruction, "took the remainder of a division by zero",
                                       "took the remainder of the most negative int and -1")) {
@@ -578,7 +806,7 @@ static void vm_run_loop(VM *vm) {
                 unsigned int rd = VM_DECODE_I_RD(instruction);
                 size_t type_index = VM_DECODE_I_KX(instruction);
 
-                const Type *type = vm->program.heap_types.data[type_index];
+                const Type *type = vm->image->heap_types.data[type_index];
 
                 // The one place a heap object is created, so a host-supplied
                 // allocator would replace this single call.
@@ -620,13 +848,21 @@ static void vm_run_loop(VM *vm) {
                 unsigned int dest = VM_DECODE_I_RD(instruction);
                 size_t proto_index = VM_DECODE_I_KX(instruction);
 
-                const FuncPrototype *proto = vm->program.prototypes.data[proto_index];
+                const FuncPrototype *proto = vm->image->prototypes.data[proto_index];
 
                 // The callee's r0 is its return slot and its parameters are
                 // r1..arity, so basing it at dest lines its parameters up with the
                 // arguments the caller already placed above dest.
                 size_t base = frame->base + dest * VM_SLOT_SIZE;
 
+                // A single test of a field the push reads anyway, so an eager
+                // load pays nothing it can measure for the lazy one's sake.
+                if (!proto->chunk && !vm_compile_body(vm, proto)) {
+                    vm_unwind(vm);
+
+                    VM_NEXT();
+                }
+
                 if (!vm_push_frame(vm, proto, base, vm->instruction_pointer + 1, dest)) {
                     // Unwinding here is what makes the failure safe; the reason is
                     // left on the VM because the loop has no caller to return to.
@@ -643,7 +879,7 @@ static void vm_run_loop(VM *vm) {
                 unsigned int dest = VM_DECODE_I_RD(instruction);
                 size_t extern_index = VM_DECODE_I_KX(instruction);
 
-                const ExternProto *proto = &vm->program.extern_protos.data[extern_index];
+                const ExternProto *proto = &vm->image->extern_protos.data[extern_index];
 
                 if (!vm_call_extern(vm, proto, frame->base + dest * VM_SLOT_SIZE)) {
                     vm_unwind(vm);
@@ -665,7 +901,7 @@ static void vm_run_loop(VM *vm) {
                 size_t frame_base = frame->base;
                 vm_pop_frame(vm);
 
-                if (vm->frame_count == 0) {
+                if (vm->frame_count == vm->frame_floor) {
                     // The last frame returning ends this run, and its result stays
                     // at its own r0 so the caller can read it. That is stack slot 0
                     // for frame zero, and the call block's base for a host call —
@@ -678,6 +914,175 @@ static void vm_run_loop(VM *vm) {
                 memcpy(vm_reg_at(vm, dest), result, slots * VM_SLOT_SIZE);
                 VM_RETRY();
             }
+            VM_CASE(OP_YIELD) {
+                if (!vm->in_coroutine) {
+                    vm_fail(vm, VM_RUN_ERR_YIELD, "'yield' outside a coroutine");
+                    vm_unwind(vm);
+
+                    VM_NEXT();
+                }
+
+                size_t r1 = VM_DECODE_R_R1(instruction);
+                size_t slots = VM_DECODE_R_R2(instruction);
+
+                // The value goes where the coroutine's result will: the r0 of
+                // its bottom frame, which is what the host reads after either.
+                // Staged through a buffer because a yield from that same frame
+                // may name a register the copy would overlap.
+                uint8_t value[VM_MAX_RETURN_SLOTS * VM_SLOT_SIZE];
+                memcpy(value, vm_reg_at(vm, r1), slots * VM_SLOT_SIZE);
+                memcpy(vm->stack + vm->frames[vm->frame_floor].base, value, slots * VM_SLOT_SIZE);
+
+                // Every frame stays pushed. The loop is left directly, since
+                // running off the end would pop them, and resuming starts
+                // from the instruction after this one.
+                vm->instruction_pointer += 1;
+                vm->suspended = true;
+
+                goto vm_done;
+            }
+            VM_CASE(OP_SPAWN) {
+                unsigned int dest = VM_DECODE_I_RD(instruction);
+                size_t proto_index = VM_DECODE_I_KX(instruction);
+
+                const FuncPrototype *proto = vm->image->prototypes.data[proto_index];
+
+                vm_settle_bodies(vm);
+
+                // The arguments are where OP_CALL would have based the callee's
+                // parameters; the task copies them, so the block is free again
+                // once this returns.
+                void *task = task_spawn(vm, proto, vm->registers + (dest + 1) * VM_SLOT_SIZE);
+
+                if (!task) {
+                    vm_fail(vm, VM_RUN_ERR_OUT_OF_MEMORY, "out of memory");
+                    vm_unwind(vm);
+
+                    VM_NEXT();
+                }
+
+                memcpy(vm->registers + dest * VM_SLOT_SIZE, &task, sizeof(task));
+                VM_NEXT();
+            }
+            VM_CASE(OP_JOIN) {
+                size_t rd = VM_DECODE_R_RD(instruction);
+                size_t r1 = VM_DECODE_R_R1(instruction);
+                size_t slots = VM_DECODE_R_R2(instruction);
+
+                void *task;
+                memcpy(&task, vm->registers + r1 * VM_SLOT_SIZE, sizeof(task));
+
+                // The resolver only lets a task variable be joined, but a join
+                // in a loop body can still reach the same variable twice.
+                if (!task) {
+                    vm_fail(vm, VM_RUN_ERR_TASK, "this task was already joined");
+                    vm_unwind(vm);
+
+                    VM_NEXT();
+                }
+
+                // Cleared before the join, which may run the task right here:
+                // an unwind inside it must not find the handle and release it
+                // a second time.
+                vm_clear_pointer(vm, r1);
+
+                // Staged, because an inline run moves the registers to its own
+                // frame and back, and the result belongs in this frame's.
+                uint8_t result[VM_MAX_RETURN_SLOTS * VM_SLOT_SIZE];
+
+                if (!task_join(vm, task, result, slots)) {
+                    vm_unwind(vm);
+
+                    VM_NEXT();
+                }
+
+                memcpy(vm->registers + rd * VM_SLOT_SIZE, result, slots * VM_SLOT_SIZE);
+                VM_NEXT();
+            }
+            VM_CASE(OP_PARALLEL_FOR) {
+                int32_t start = vm_read_i32(vm, VM_DECODE_R_RD(instruction));
+                int32_t end = vm_read_i32(vm, VM_DECODE_R_R1(instruction));
+
+                // The chunks enter past the jump that follows, which is where
+                // this frame goes next, whether there was anything to run or
+                // not.
+                if (start < end) {
+                    vm_settle_bodies(vm);
+
+                    TaskLoop loop = {
+                        .proto = frame->proto,
+                        .registers = vm->registers,
+                        .entry = vm->instruction_pointer + 2,
+                        .counter = VM_DECODE_R_RD(instruction),
+                        .limit = VM_DECODE_R_R1(instruction),
+                        .refs_from = VM_DECODE_R_R2(instruction),
+                        .start = start,
+                        .end = end,
+                    };
+
+                    if (!task_parallel_for(vm, &loop)) {
+                        vm_unwind(vm);
+                    }
+                }
+
+                VM_NEXT();
+            }
+            VM_CASE(OP_PARALLEL_END) {
+                // The chunk's frame is the run's only one, so popping it ends
+                // the run, as the last return of any other would.
+                vm_pop_frame(vm);
+                VM_RETRY();
+            }
+            VM_CASE(OP_SEND) {
+                size_t rd = VM_DECODE_I_RD(instruction);
+                Channel *channel = vm_channel_for(vm, VM_DECODE_I_KX(instruction));
+
+                if (!channel) {
+                    vm_unwind(vm);
+                    VM_NEXT();
+                }
+
+                uint8_t *object = vm_read_ptr(vm, rd);
+
+                // The resolver keeps a sent variable from being named again,
+                // but a slot that never owned anything is NULL, and NULL is not
+                // a message anyone could free.
+                if (!object) {
+                    vm_fail(vm, VM_RUN_ERR_CHANNEL, "nothing to send");
+                    vm_unwind(vm);
+                    VM_NEXT();
+                }
+
+                if (!channel_send(channel, object)) {
+                    vm_fail(vm, VM_RUN_ERR_OUT_OF_MEMORY, "out of memory");
+                    vm_unwind(vm);
+                    VM_NEXT();
+                }
+
+                // Cleared, so the release at the end of its block, and an
+                // unwind, find nothing to free: the object is the receiver's.
+                vm_write_ptr(vm, rd, NULL);
+                VM_NEXT();
+            }
+            VM_CASE(OP_RECEIVE) {
+                size_t rd = VM_DECODE_I_RD(instruction);
+                Channel *channel = vm_channel_for(vm, VM_DECODE_I_KX(instruction));
+
+                if (!channel) {
+                    vm_unwind(vm);
+                    VM_NEXT();
+                }
+
+                uint8_t *object = channel_receive(channel);
+
+                vm_write_ptr(vm, rd, object);
+
+                if (object) {
+                    vm->instruction_pointer += 1;
+                }
+
+                VM_NEXT();
+            }
             VM_CASE(OP_LOAD_FIELD_1) {
                 vm_load_field(vm, instruction, 1);
                 VM_NEXT();
@@ -799,7 +1204,7 @@ static void vm_run_loop(VM *vm) {
             }
 
             // Not an instruction, so nothing encodes it, and the 7-bit opcode
-            // field cannot produce it for 53 opcodes. Listed because -Wswitch
+            // field cannot produce it for 72 opcodes. Listed because -Wswitch
             // counts every enum member.
             VM_CASE_UNREACHABLE(OP__COUNT)
         }
@@ -807,28 +1212,273 @@ static void vm_run_loop(VM *vm) {
 
     VM_EXIT()
 
+    // A yield left on purpose, with the coroutine's frames still wanted.
+    if (vm->suspended) {
+        return;
+    }
+
     // Top-level code has no trailing return, so the loop usually ends by
     // running off the end of the chunk rather than through OP_RETURN.
-    while (vm->frame_count > 0) {
+    while (vm->frame_count > vm->frame_floor) {
         vm_pop_frame(vm);
     }
 }
 
+// What a run hands back to the one it is nested in, when it was started from
+// inside an extern: the frames below its floor are the outer run's, and so are
+// the registers and instruction pointer its loop resumes with once the extern
+// returns. A run the host started saves the same three and restores them
+// unused, which costs less than telling the two apart.
+typedef struct {
+    size_t floor;
+    uint8_t *registers;
+    ptrdiff_t instruction_pointer;
+    bool in_coroutine;
+} VmOuterRun;
+
+static VmOuterRun vm_enter_run(VM *vm) {
+    VmOuterRun outer = {
+        .floor = vm->frame_floor,
+        .registers = vm->registers,
+        .instruction_pointer = vm->instruction_pointer,
+        .in_coroutine = vm->in_coroutine,
+    };
+
+    // Not a coroutine until interp_resume says so: a plain call made from
+    // inside one is not itself something a 'yield' may suspend.
+    vm->in_coroutine = false;
+
+    // The new run's frames go above every frame already pushed, and its loop
+    // stops when they are gone rather than at an empty stack.
+    vm->frame_floor = vm->frame_count;
+
+    return outer;
+}
+
+static void vm_leave_run(VM *vm, VmOuterRun outer) {
+    vm->frame_floor = outer.floor;
+    vm->registers = outer.registers;
+    vm->instruction_pointer = outer.instruction_pointer;
+    vm->in_coroutine = outer.in_coroutine;
+}
+
 VmRunStatus interp_run_frame(VM *vm, const FuncPrototype *proto, size_t base, unsigned int dest) {
     // A run reports only its own outcome, so whatever the last one left behind
     // is cleared before this one starts.
     vm->error = (VmError){.status = VM_RUN_OK};
 
-    if (!vm_push_frame(vm, proto, base, 0, dest)) {
+    if (!proto->chunk && !vm_compile_body(vm, proto)) {
+        return vm->error.status;
+    }
+
+    VmOuterRun outer = vm_enter_run(vm);
+
+    if (vm_push_frame(vm, proto, base, 0, dest)) {
+        vm_run_loop(vm);
+    } else {
+        vm_fail(vm, VM_RUN_ERR_STACK_OVERFLOW, "out of stack space");
+    }
+
+    vm_leave_run(vm, outer);
+
+    return vm->error.status;
+}
+
+VmRunStatus interp_run_chunk(VM *vm, const FuncPrototype *proto, size_t base, ptrdiff_t entry,
+                             unsigned int refs_from) {
+    vm->error = (VmError){.status = VM_RUN_OK};
+
+    VmOuterRun outer = vm_enter_run(vm);
+
+    if (vm_push_frame(vm, proto, base, 0, 0)) {
+        vm->frames[vm->frame_count - 1].refs_from = refs_from;
+        vm->instruction_pointer = entry;
+
+        vm_run_loop(vm);
+    } else {
         vm_fail(vm, VM_RUN_ERR_STACK_OVERFLOW, "out of stack space");
+    }
+
+    vm_leave_run(vm, outer);
+
+    return vm->error.status;
+}
+
+VmRunStatus interp_run_batch(VM *vm, const FuncPrototype *proto, size_t base, const InterpBatch *batch,
+                             size_t *out_done) {
+    vm->error = (VmError){.status = VM_RUN_OK};
+
+    size_t done = 0;
+
+    if (!proto->chunk && !vm_compile_body(vm, proto)) {
+        *out_done = done;
+        return vm->error.status;
+    }
+
+    // Every item runs on the same frame at the same base, so whether it fits is
+    // the same answer each time and is asked once.
+    if (vm->frame_count == VM_MAX_CALL_DEPTH ||
+        !vm_reserve_stack(vm, base / VM_SLOT_SIZE + proto->max_registers)) {
+        vm_fail(vm, VM_RUN_ERR_STACK_OVERFLOW, "out of stack space");
+        *out_done = done;
+        return vm->error.status;
+    }
+
+    VmOuterRun outer = vm_enter_run(vm);
+    uint8_t *params = vm->stack + base + VM_SLOT_SIZE;
+
+    for (; done < batch->count; done++) {
+        uint8_t *item = batch->items + done * batch->stride;
+
+        if (batch->by_pointer) {
+            memcpy(params, &item, sizeof(item));
+        } else {
+            memcpy(params, item, batch->arg_bytes);
+        }
+
+        // What vm_push_frame would do, less the checks already made above. The
+        // run ends when this frame pops, which leaves the count at the floor
+        // again for the next item.
+        vm->frames[vm->frame_floor] = (CallFrame){.proto = proto, .return_ip = 0, .base = base, .dest = 0};
+        vm->frame_count = vm->frame_floor + 1;
+        vm->registers = vm->stack + base;
+        vm->instruction_pointer = 0;
+
+        vm_run_loop(vm);
+
+        if (vm->error.status != VM_RUN_OK) {
+            break;
+        }
+
+        if (batch->results) {
+            memcpy(batch->results + done * batch->result_stride, vm->stack + base, batch->result_size);
+        }
+    }
+
+    vm_leave_run(vm, outer);
+
+    *out_done = done;
+
+    return vm->error.status;
+}
+
+void interp_coroutine_init(VmCoroutine *co, const FuncPrototype *proto, uint8_t *stack,
+                           size_t stack_capacity) {
+    *co = (VmCoroutine){
+        .proto = proto,
+        .stack = stack,
+        .stack_capacity = stack_capacity,
+    };
+}
+
+VmRunStatus interp_resume(VM *vm, VmCoroutine *co) {
+    vm->error = (VmError){.status = VM_RUN_OK};
+
+    // Checked before anything is swapped, so a refusal leaves both the VM and
+    // the coroutine as they were.
+    if (vm->frame_count + (co->started ? co->frame_count : 1) > VM_MAX_CALL_DEPTH) {
+        vm_fail(vm, VM_RUN_ERR_CALL_DEPTH, "call depth exceeded");
         return vm->error.status;
     }
 
-    vm_run_loop(vm);
+    if (!co->started && !co->proto->chunk && !vm_compile_body(vm, co->proto)) {
+        return vm->error.status;
+    }
+
+    VmOuterRun outer = vm_enter_run(vm);
+
+    uint8_t *outer_stack = vm->stack;
+    size_t outer_capacity = vm->stack_capacity;
+
+    vm->stack = co->stack;
+    vm->stack_capacity = co->stack_capacity;
+    vm->in_coroutine = true;
+    vm->suspended = false;
+
+    co->running = true;
+
+    if (!co->started) {
+        co->started = true;
+
+        if (!vm_push_frame(vm, co->proto, 0, 0, 0)) {
+            vm_fail(vm, VM_RUN_ERR_STACK_OVERFLOW, "out of stack space");
+        }
+    } else {
+        // Put back exactly where they were relative to the floor. Each frame's
+        // base is an offset into the coroutine's stack, which is the stack
+        // again now, so nothing in them needs rebasing.
+        memcpy(&vm->frames[vm->frame_floor], co->frames, co->frame_count * sizeof(CallFrame));
+        vm->frame_count = vm->frame_floor + co->frame_count;
+
+        vm->registers = vm->stack + vm->frames[vm->frame_count - 1].base;
+        vm->instruction_pointer = co->instruction_pointer;
+    }
+
+    if (vm->error.status == VM_RUN_OK) {
+        vm_run_loop(vm);
+    }
+
+    if (vm->suspended) {
+        size_t count = vm->frame_count - vm->frame_floor;
+
+        if (count > co->frame_capacity) {
+            size_t capacity = co->frame_capacity ? co->frame_capacity * 2 : 4;
+            while (capacity < count) {
+                capacity *= 2;
+            }
+
+            CallFrame *frames = realloc(co->frames, capacity * sizeof(CallFrame));
+
+            // Without somewhere to keep the frames the coroutine cannot be
+            // continued, so it fails as a run would, releasing what they own.
+            if (!frames) {
+                vm->suspended = false;
+                vm_fail(vm, VM_RUN_ERR_OUT_OF_MEMORY, "out of memory suspending a coroutine");
+                vm_unwind(vm);
+            } else {
+                co->frames = frames;
+                co->frame_capacity = capacity;
+            }
+        }
+
+        if (vm->suspended) {
+            memcpy(co->frames, &vm->frames[vm->frame_floor], count * sizeof(CallFrame));
+            co->frame_count = count;
+            co->instruction_pointer = vm->instruction_pointer;
+
+            vm->frame_count = vm->frame_floor;
+        }
+    }
+
+    if (!vm->suspended) {
+        co->frame_count = 0;
+        co->done = true;
+    }
+
+    co->running = false;
+
+    vm->suspended = false;
+    vm->stack = outer_stack;
+    vm->stack_capacity = outer_capacity;
+
+    vm_leave_run(vm, outer);
 
     return vm->error.status;
 }
 
+void interp_coroutine_discard(VmCoroutine *co) {
+    // Innermost first, as an unwind would release them.
+    for (size_t i = co->frame_count; i > 0; i--) {
+        vm_release_frame_refs(co->stack, &co->frames[i - 1]);
+    }
+
+    free(co->frames);
+
+    co->frames = NULL;
+    co->frame_count = 0;
+    co->frame_capacity = 0;
+}
+
 VmRunStatus interp_run_extern(VM *vm, const ExternProto *proto, size_t base) {
     vm->error = (VmError){.status = VM_RUN_OK};
 
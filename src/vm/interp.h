@@ -4,7 +4,9 @@
 #include "vm/link.h"
 #include "vm/vm.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Runs a unit's top level as frame zero, leaving its result in slot 0. Returns
 // why the run stopped; vm->error carries the same status plus a message.
@@ -15,8 +17,81 @@ VmRunStatus interp_run_top_level(VM *vm, const FuncPrototype *top_level);
 // left at the frame's own r0, which is the slot at base. The embedding API
 // calls in through this; base is a byte offset into the stack, and the caller
 // must already have placed the arguments in the parameter slots above it.
+//
+// Started from inside an extern, the run nests in the one that called it: it
+// pushes above the frames already there, stops once its own have popped, and
+// leaves the outer loop's registers and instruction pointer as it found them.
 VmRunStatus interp_run_frame(VM *vm, const FuncPrototype *proto, size_t base, unsigned int dest);
 
+// Runs one chunk of a 'parallel for': a frame of 'proto' whose registers the
+// caller has already copied to 'base', entered at the body's first
+// instruction and left at the OP_PARALLEL_END after it. An unwind releases only
+// the slots from 'refs_from' up, which are the body's own.
+VmRunStatus interp_run_chunk(VM *vm, const FuncPrototype *proto, size_t base, ptrdiff_t entry,
+                             unsigned int refs_from);
+
+// One function run over an array of host items, each one's result optionally
+// written to a second array. An item is either copied into the parameter slots
+// ('arg_bytes' of it) or, when 'by_pointer' is set, passed as its own address.
+typedef struct {
+    uint8_t *items;
+    size_t stride;
+    size_t count;
+    size_t arg_bytes;
+    bool by_pointer;
+
+    uint8_t *results;
+    size_t result_stride;
+    size_t result_size;
+} InterpBatch;
+
+// Runs 'proto' once per item on a frame based at 'base', checking the frame's
+// reservation once rather than per item. Stops at the first failure; 'out_done'
+// receives how many items ran to completion, which is the failing item's index
+// when the status is not VM_RUN_OK.
+VmRunStatus interp_run_batch(VM *vm, const FuncPrototype *proto, size_t base, const InterpBatch *batch,
+                             size_t *out_done);
+
+// A function run that can stop part way and be continued: its own stack, and
+// while suspended, the frames that were on the VM's when it yielded. The stack
+// never moves, so a borrow of one of its locals survives the suspension; the
+// frames are only ever copied, so their array grows as deep as a yield found
+// them.
+//
+// A coroutine runs on the VM's frame array while resumed, above whatever frames
+// are already there, and on its own stack in place of the VM's.
+typedef struct {
+    const FuncPrototype *proto;
+
+    uint8_t *stack;
+    size_t stack_capacity;
+
+    CallFrame *frames;
+    size_t frame_count;
+    size_t frame_capacity;
+
+    ptrdiff_t instruction_pointer;
+
+    bool started;
+    bool running;
+    bool done;
+} VmCoroutine;
+
+// Sets up a coroutine over 'proto' whose stack is 'stack', reserved by the
+// caller. The arguments are the caller's to write at slot 1 before the first
+// resume, as for any frame.
+void interp_coroutine_init(VmCoroutine *co, const FuncPrototype *proto, uint8_t *stack,
+                           size_t stack_capacity);
+
+// Runs the coroutine until it yields, returns or fails. Either of the first two
+// leaves its value at the stack's slot 0; returning or failing also marks it
+// done, and a failure has unwound its frames.
+VmRunStatus interp_resume(VM *vm, VmCoroutine *co);
+
+// Releases what a coroutine's suspended frames still own, for one abandoned
+// before it finished, and the frame array. The stack is the caller's.
+void interp_coroutine_discard(VmCoroutine *co);
+
 // Runs an extern's host body against the block at 'base', for a host calling
 // one directly. No frame is pushed and no bytecode runs: an extern has none,
 // and its arguments are already laid out where a callee's would be.
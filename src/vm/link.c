@@ -9,16 +9,20 @@
 #include "vm/opcode.h"
 #include "vm/vm.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Frees what a prototype allocated. The prototype itself is arena-owned and is
 // reclaimed with the VM.
 //
 // A cleared chunk means there is nothing to free, which is how a unit hands its
 // top level to the caller: compile_unit clears the chunk it gave away, so
-// unit_free walks the same prototype and drops none of it.
+// unit_free walks the same prototype and drops none of it. NULL is a slot a
+// freed module left, with nothing in it at all.
 void func_proto_free(FuncPrototype *proto) {
-    if (!proto->chunk) {
+    if (!proto || !proto->chunk) {
         return;
     }
 
@@ -40,12 +44,16 @@ void unit_free(Unit *unit) {
     extern_proto_list_free(&unit->extern_protos);
     type_list_free(&unit->types);
     string_list_free(&unit->strings);
+    channel_list_free(&unit->channels);
     relocation_list_free(&unit->proto_relocations);
     relocation_list_free(&unit->extern_relocations);
     relocation_list_free(&unit->type_relocations);
     relocation_list_free(&unit->string_relocations);
+    relocation_list_free(&unit->channel_relocations);
+    call_site_list_free(&unit->call_sites);
     proto_binding_list_free(&unit->bindings);
     extern_request_list_free(&unit->externs);
+    free(unit->code);
 
     free(unit);
 }
@@ -79,18 +87,73 @@ static void remap_indices(const RelocationList *relocations, const size_t *index
 
 // The host body bound to a name, or NULL if none is. Both are interned, so
 // identity is the comparison.
-static GabExternFn find_extern(const Program *program, const Symbol *symbol) {
+static const ExternBinding *find_extern(const Program *program, const Symbol *symbol) {
     for (size_t i = 0; i < program->extern_bindings.size; i++) {
         const ExternBinding *binding = &program->extern_bindings.data[i];
 
         if (binding->name == symbol->func.name && binding->module == symbol->func.module) {
-            return binding->fn;
+            return binding;
         }
     }
 
     return NULL;
 }
 
+// What each native shape takes and returns, spelled as its name is: one letter
+// per parameter, then the result. Indexed by ExternShape.
+static const struct {
+    const char *params;
+    char result;
+} extern_shapes[] = {
+    [EXTERN_SHAPE_ARGS] = {"", 'v'}, [EXTERN_SHAPE_I_I] = {"i", 'i'},   [EXTERN_SHAPE_II_I] = {"ii", 'i'},
+    [EXTERN_SHAPE_F_F] = {"f", 'f'}, [EXTERN_SHAPE_FF_F] = {"ff", 'f'}, [EXTERN_SHAPE_P_V] = {"p", 'v'},
+    [EXTERN_SHAPE_P_I] = {"p", 'i'}, [EXTERN_SHAPE_P_F] = {"p", 'f'},   [EXTERN_SHAPE_P_P] = {"p", 'p'},
+    [EXTERN_SHAPE_PI_V] = {"pi", 'v'}, [EXTERN_SHAPE_PF_V] = {"pf", 'v'},
+};
+
+// Whether a declared type is what one letter of a shape stands for. 'v' is
+// only ever a result, and matches a function declaring none.
+static bool extern_shape_accepts(char letter, const Type *type, bool is_result) {
+    switch (letter) {
+    case 'i':
+        return type && type->kind == TYPE_INT;
+    case 'f':
+        return type && type->kind == TYPE_FLOAT;
+    case 'p':
+        // A parameter only borrows, and a '*T' result is the one pointer that
+        // hands its object over.
+        return type && type->kind == TYPE_POINTER && (is_result || type->is_ref);
+    case 'v':
+        return type == NULL;
+    default:
+        return false;
+    }
+}
+
+// Whether a native body's C signature is the one the script declared. A
+// GabArgs body reads whatever it was declared with, so it always agrees; a
+// native one is handed raw values, and a mismatch here would be an int read
+// as a float at every call with nothing left to catch it.
+static bool extern_shape_matches(ExternShape shape, const Symbol *symbol) {
+    if (shape == EXTERN_SHAPE_ARGS) {
+        return true;
+    }
+
+    const char *params = extern_shapes[shape].params;
+
+    if (strlen(params) != symbol->func.param_count) {
+        return false;
+    }
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        if (!extern_shape_accepts(params[i], symbol->func.params[i], false)) {
+            return false;
+        }
+    }
+
+    return extern_shape_accepts(extern_shapes[shape].result, symbol->func.return_type, true);
+}
+
 // Whether this unit could be installed: the indices fit their operand fields
 // once rebased, and every extern names a host body that exists.
 //
@@ -138,53 +201,260 @@ bool link_check(Program *program, Unit *unit, Diagnostics *diagnostics) {
         }
     }
 
+    if (program->channels.size + unit->channels.size > VM_MAX_CHANNELS) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "too many channels in one program");
+        return false;
+    }
+
+    if (unit->channels.size && !unit->channel_map) {
+        unit->channel_map = arena_alloc(unit->arena, unit->channels.size * sizeof(size_t));
+
+        if (!unit->channel_map) {
+            return false;
+        }
+    }
+
     for (size_t i = 0; i < unit->externs.size; i++) {
         const ExternRequest *request = &unit->externs.data[i];
-        GabExternFn body = find_extern(program, request->symbol);
+        const ExternBinding *binding = find_extern(program, request->symbol);
 
-        if (!body) {
+        if (!binding) {
             diag_error(diagnostics, GAB_ERR_CODEGEN, request->span,
                        "extern function '%s' was never registered", request->symbol->func.name->data);
             return false;
         }
 
-        unit->extern_protos.data[request->local_index].body = body;
+        if (!extern_shape_matches(binding->shape, request->symbol)) {
+            diag_error(diagnostics, GAB_ERR_CODEGEN, request->span,
+                       "extern function '%s' was registered with a C signature its declaration does not have",
+                       request->symbol->func.name->data);
+            return false;
+        }
+
+        ExternProto *proto = &unit->extern_protos.data[request->local_index];
+
+        proto->body = binding->fn;
+        proto->native = binding->native;
+        proto->shape = binding->shape;
     }
 
     return true;
 }
 
+// Where a unit's prototypes start: the first run of slots a freed module left
+// that holds them all, or else the end of the table. Together, because every
+// call a unit makes to its own functions is rebased by the one base.
+static size_t link_proto_base(const Program *program, size_t count) {
+    size_t run = 0;
+
+    for (size_t i = 0; count > 0 && i < program->prototypes.size; i++) {
+        run = program->prototypes.data[i] ? 0 : run + 1;
+
+        if (run == count) {
+            return i + 1 - count;
+        }
+    }
+
+    return program->prototypes.size;
+}
+
+// As link_proto_base, for the extern table, whose empty slots name no symbol.
+static size_t link_extern_base(const Program *program, size_t count) {
+    size_t run = 0;
+
+    for (size_t i = 0; count > 0 && i < program->extern_protos.size; i++) {
+        run = program->extern_protos.data[i].symbol ? 0 : run + 1;
+
+        if (run == count) {
+            return i + 1 - count;
+        }
+    }
+
+    return program->extern_protos.size;
+}
+
+#define proto_index_list_item_free(item) ((void)(item))
+GAB_LIST(ProtoIndexList, proto_index_list, size_t)
+
+// The position among 'count' prototypes from 'base' that a call names, or
+// 'count' if the instruction calls none of them.
+static size_t link_callee(Instruction instruction, size_t count, size_t base) {
+    if (VM_DECODE_OPCODE(instruction) != OP_CALL) {
+        return count;
+    }
+
+    size_t index = VM_DECODE_I_KX(instruction);
+
+    return index >= base && index - base < count ? index - base : count;
+}
+
+void link_call_order(FuncPrototype *const *prototypes, size_t count, size_t base, size_t *order) {
+    bool *called = calloc(count, sizeof(bool));
+    bool *placed = calloc(count, sizeof(bool));
+    size_t next = 0;
+
+    // Declaration order, for want of the room to find a better one.
+    if (!called || !placed) {
+        for (size_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+
+        free(called);
+        free(placed);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const Chunk *chunk = prototypes[i] ? prototypes[i]->chunk : NULL;
+
+        for (size_t j = 0; chunk && j < chunk->instructions.size; j++) {
+            size_t callee = link_callee(chunk->instructions.data[j], count, base);
+
+            if (callee != count && callee != i) {
+                called[callee] = true;
+            }
+        }
+    }
+
+    // On a stack of its own rather than the C one, which a long enough chain
+    // of calls would run off the end of.
+    ProtoIndexList pending = proto_index_list_create();
+
+    // Those nothing here calls first: they are where runs begin. Then those
+    // left, which only a cycle reaches.
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t root = 0; root < count; root++) {
+            if (placed[root] || (pass == 0 && called[root])) {
+                continue;
+            }
+
+            proto_index_list_add(&pending, root);
+
+            while (pending.size > 0) {
+                size_t at = pending.data[--pending.size];
+
+                if (placed[at]) {
+                    continue;
+                }
+
+                placed[at] = true;
+                order[next++] = at;
+
+                // Pushed last to first, so the first call made is the next
+                // placed.
+                const Chunk *chunk = prototypes[at] ? prototypes[at]->chunk : NULL;
+
+                for (size_t j = chunk ? chunk->instructions.size : 0; j > 0; j--) {
+                    size_t callee = link_callee(chunk->instructions.data[j - 1], count, base);
+
+                    if (callee != count && !placed[callee]) {
+                        proto_index_list_add(&pending, callee);
+                    }
+                }
+            }
+        }
+    }
+
+    proto_index_list_free(&pending);
+    free(called);
+    free(placed);
+}
+
+// Moves the code and constants of every body the unit compiled into one
+// allocation, in call order, in place of the two each chunk made for itself:
+// a call then lands near where it was made, rather than anywhere on the heap.
+// The operands are final by now, since the chunks are not written again.
+//
+// Left as they are if the room cannot be had, which costs locality and
+// nothing else.
+static void link_pack_code(Unit *unit, size_t proto_base) {
+    size_t count = unit->prototypes.size;
+    size_t size = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const Chunk *chunk = unit->prototypes.data[i]->chunk;
+
+        // A deferred body has no chunk yet, and a restored one is in the image.
+        if (chunk && !chunk->borrowed) {
+            size += chunk_footprint(chunk);
+        }
+    }
+
+    size_t *order = size ? malloc(count * sizeof(size_t)) : NULL;
+    uint8_t *code = order ? malloc(size) : NULL;
+
+    if (!code) {
+        free(order);
+        return;
+    }
+
+    link_call_order(unit->prototypes.data, count, proto_base, order);
+
+    uint8_t *at = code;
+
+    for (size_t i = 0; i < count; i++) {
+        Chunk *chunk = unit->prototypes.data[order[i]]->chunk;
+
+        if (chunk && !chunk->borrowed) {
+            size_t footprint = chunk_footprint(chunk);
+
+            chunk_move_into(chunk, at);
+            at += footprint;
+        }
+    }
+
+    free(order);
+    unit->code = code;
+}
+
 // Installs a unit the caller has already checked with link_check.
 //
 // Nothing here can fail, which is the point: by the time anything is appended,
 // every question that could have refused the unit has been asked.
 void link_install(Program *program, Unit *unit) {
-    size_t proto_base = program->prototypes.size;
-    size_t extern_base = program->extern_protos.size;
+    size_t proto_base = link_proto_base(program, unit->prototypes.size);
+    size_t extern_base = link_extern_base(program, unit->extern_protos.size);
 
     for (size_t i = 0; i < unit->prototypes.size; i++) {
-        func_proto_list_add(&program->prototypes, unit->prototypes.data[i]);
+        if (proto_base + i < program->prototypes.size) {
+            program->prototypes.data[proto_base + i] = unit->prototypes.data[i];
+        } else {
+            func_proto_list_add(&program->prototypes, unit->prototypes.data[i]);
+        }
     }
 
     for (size_t i = 0; i < unit->extern_protos.size; i++) {
-        extern_proto_list_add(&program->extern_protos, unit->extern_protos.data[i]);
+        if (extern_base + i < program->extern_protos.size) {
+            program->extern_protos.data[extern_base + i] = unit->extern_protos.data[i];
+        } else {
+            extern_proto_list_add(&program->extern_protos, unit->extern_protos.data[i]);
+        }
     }
 
     // Interned against what the program already holds, so a type two units both
     // allocate is registered once. A prototype cannot be shared this way --
     // each declaration is a distinct function -- which is why only types are
-    // looked up rather than appended outright.
+    // looked up rather than appended outright. One that is new takes the first
+    // slot a freed module left, as a literal and a channel do below.
     for (size_t i = 0; i < unit->types.size; i++) {
         size_t found = program->heap_types.size;
+        size_t empty = program->heap_types.size;
 
         for (size_t j = 0; j < program->heap_types.size; j++) {
             if (program->heap_types.data[j] == unit->types.data[i]) {
                 found = j;
                 break;
             }
+
+            if (!program->heap_types.data[j] && empty == program->heap_types.size) {
+                empty = j;
+            }
         }
 
-        if (found == program->heap_types.size) {
+        if (found == program->heap_types.size && empty < program->heap_types.size) {
+            program->heap_types.data[empty] = unit->types.data[i];
+            found = empty;
+        } else if (found == program->heap_types.size) {
             type_list_add(&program->heap_types, unit->types.data[i]);
         }
 
@@ -195,25 +465,65 @@ void link_install(Program *program, Unit *unit) {
     // literal two units share is registered once.
     for (size_t i = 0; i < unit->strings.size; i++) {
         size_t found = program->strings.size;
+        size_t empty = program->strings.size;
 
         for (size_t j = 0; j < program->strings.size; j++) {
             if (program->strings.data[j] == unit->strings.data[i]) {
                 found = j;
                 break;
             }
+
+            if (!program->strings.data[j] && empty == program->strings.size) {
+                empty = j;
+            }
         }
 
-        if (found == program->strings.size) {
+        if (found == program->strings.size && empty < program->strings.size) {
+            program->strings.data[empty] = unit->strings.data[i];
+            found = empty;
+        } else if (found == program->strings.size) {
             string_list_add(&program->strings, unit->strings.data[i]);
         }
 
         unit->string_map[i] = found;
     }
 
+    // By declaration, so a channel a later unit of the module sends on is the
+    // one the first unit declared, not a second of the same name.
+    for (size_t i = 0; i < unit->channels.size; i++) {
+        size_t found = program->channels.size;
+        size_t empty = program->channels.size;
+
+        for (size_t j = 0; j < program->channels.size; j++) {
+            if (program->channels.data[j] == unit->channels.data[i]) {
+                found = j;
+                break;
+            }
+
+            if (!program->channels.data[j] && empty == program->channels.size) {
+                empty = j;
+            }
+        }
+
+        if (found == program->channels.size && empty < program->channels.size) {
+            program->channels.data[empty] = unit->channels.data[i];
+            found = empty;
+        } else if (found == program->channels.size) {
+            channel_list_add(&program->channels, unit->channels.data[i]);
+        }
+
+        unit->channel_map[i] = found;
+    }
+
+    program->deferred_pending += unit->deferred_count;
+
     relocate(&unit->proto_relocations, proto_base);
     relocate(&unit->extern_relocations, extern_base);
     remap_indices(&unit->type_relocations, unit->type_map);
     remap_indices(&unit->string_relocations, unit->string_map);
+    remap_indices(&unit->channel_relocations, unit->channel_map);
+
+    link_pack_code(unit, proto_base);
 
     // Last, because a symbol stamped with an index is a symbol a later compile
     // will call through: nothing may carry one until the function it names is
@@ -8,7 +8,9 @@
 #include "util/list.h"
 #include "vm/chunk.h"
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct Symbol;
 
@@ -35,6 +37,35 @@ typedef void (*GabExternFn)(GabArgs *args);
 // accessors a host reaches it through are the checked tier over the VM's own.
 typedef struct GabArgs Args;
 
+// A host body taking its arguments as native C values rather than a GabArgs.
+// Held type-erased and cast back to its real type by the one switch that calls
+// it, which the shape below selects; a function pointer may round-trip through
+// any other function pointer type, so nothing is lost on the way.
+typedef void (*GabNativeFn)(void);
+
+// Which C signature a host body has. EXTERN_SHAPE_ARGS is the GabExternFn every
+// extern can use; the rest are the scalar leaf shapes common enough to call
+// directly, named by their parameters and then their result: 'i' is an int32_t,
+// 'f' a float, 'p' a pointer, and 'v' no result.
+//
+// A fixed list rather than a general descriptor because each one is a call the
+// compiler has to be able to emit: calling a C function whose signature is only
+// known at runtime needs an FFI layer, and the point of these is to cost less
+// than the accessors do.
+typedef enum {
+    EXTERN_SHAPE_ARGS,
+    EXTERN_SHAPE_I_I,
+    EXTERN_SHAPE_II_I,
+    EXTERN_SHAPE_F_F,
+    EXTERN_SHAPE_FF_F,
+    EXTERN_SHAPE_P_V,
+    EXTERN_SHAPE_P_I,
+    EXTERN_SHAPE_P_F,
+    EXTERN_SHAPE_P_P,
+    EXTERN_SHAPE_PI_V,
+    EXTERN_SHAPE_PF_V,
+} ExternShape;
+
 // A function whose body is C rather than bytecode: a host extern, and a
 // builtin type's method, which the VM registers the same way.
 //
@@ -46,15 +77,54 @@ typedef struct GabArgs Args;
 typedef struct {
     GabExternFn body;
 
+    // Set instead of 'body' for a host function registered with a native
+    // signature, which 'shape' names. Checked against the declaration at link,
+    // so by the time a call reaches it the slots hold what the C types say.
+    GabNativeFn native;
+    ExternShape shape;
+
     // The declaration the body was written against, which is what turns a
     // parameter index into a slot and says how wide the return value is.
-    // Points into the environment's arena, so it outlives every compile.
+    // Points into its module's arena, so it outlives every compile.
     const struct Symbol *symbol;
+
+    // Byte offset of each parameter from the frame's slot 0, in declaration
+    // order. Fixed by the declaration, so it is worked out once when codegen
+    // reserves the prototype rather than on every read: a body reading all ten
+    // of its arguments would otherwise walk the widths ahead of each, which is
+    // quadratic in the parameter count on every call.
+    //
+    // A frame is at most VM_MAX_FRAME_SLOTS wide, so every offset fits 16 bits.
+    // Lives in the module's arena alongside the symbol.
+    const uint16_t *param_offsets;
 } ExternProto;
 
 #define extern_proto_list_item_free(item) ((void)(item))
 GAB_LIST(ExternProtoList, extern_proto_list, ExternProto)
 
+// What a lazy load keeps of a body it did not compile, so that the body can be
+// compiled the first time something reaches it. See compile_deferred.
+//
+// The unit is the compiler's business -- the source, the module scope and the
+// imports a body resolves against -- and opaque here.
+typedef struct DeferredUnit DeferredUnit;
+
+typedef struct {
+    const DeferredUnit *unit;
+    struct Symbol *symbol;
+
+    // Where the declaration starts in the unit's source: the 'func' keyword,
+    // so the body is parsed back with its signature and its parameters' names.
+    size_t offset;
+    int line;
+    int column;
+
+    // The first error compiling it met, or NULL. Kept once set: a body that
+    // failed fails the same way every time it is reached, rather than once per
+    // call and at the cost of a compile each.
+    const Diagnostic *failure;
+} DeferredBody;
+
 // One function compiled to bytecode. A unit's top level is one of these too,
 // with an arity of zero: it runs as frame zero, so the interpreter has a single
 // path and OP_RETURN means the same thing everywhere.
@@ -66,6 +136,14 @@ typedef struct {
     int arity;
     int max_registers;
 
+    // How wide the parameters are, in slots from slot 1, and the result from
+    // slot 0; and whether the result is an object the caller comes to own. A
+    // frame never needs these, since its callee's block is already in place.
+    // A task does: it carries the block from the spawning frame to its own.
+    int param_slots;
+    int return_slots;
+    bool returns_owned;
+
     // Every slot this function ever owns a reference in. Walked only on an
     // abnormal unwind, where the ordinary releases are skipped — so it costs
     // nothing on the path that matters, and the alternative is leaking whatever
@@ -76,14 +154,19 @@ typedef struct {
     // a slot when it releases it: a slot listed here either holds a live
     // reference or holds NULL, and NULL is what both release paths tolerate.
     FrameRefList refs;
+
+    // Set on a function whose body a lazy load skipped, for as long as it goes
+    // uncompiled: 'chunk' is NULL, and so is every field above it but the
+    // signature's. Everything that starts a frame checks 'chunk' first.
+    DeferredBody *deferred;
 } FuncPrototype;
 
 void func_proto_free(FuncPrototype *proto);
 
 // Prototypes are held by pointer, not by value: a frame addresses its prototype
 // for as long as it runs, and this list grows whenever a unit loads. Each
-// prototype comes from the environment's arena, so the list frees what a prototype owns
-// and not the prototype itself.
+// prototype comes from its module's arena, so the list frees what a prototype
+// owns and not the prototype itself.
 #define func_proto_list_item_free(item) func_proto_free(item)
 GAB_LIST(FuncProtoList, func_proto_list, FuncPrototype *)
 
@@ -97,6 +180,11 @@ GAB_LIST(TypeList, type_list, const Type *)
 #define string_list_item_free(item) ((void)(item))
 GAB_LIST(StringList, string_list, String *)
 
+// The channels 'send' and 'receive' name, by the declaration each came from.
+// A symbol outlives every compile, so the list borrows them.
+#define channel_list_item_free(item) ((void)(item))
+GAB_LIST(ChannelList, channel_list, const struct Symbol *)
+
 // One operand a unit must rewrite once linking tells it where its indices
 // landed. A unit numbers what it declares from zero, so an operand it encoded
 // means nothing until the unit's base is added to it.
@@ -111,6 +199,19 @@ typedef struct {
 #define relocation_list_item_free(item) ((void)(item))
 GAB_LIST(RelocationList, relocation_list, Relocation)
 
+// A call to a function an earlier unit declared, whose operand is already the
+// callee's index in the program: linking leaves it alone. Recorded for a unit
+// cache, which names the callee instead, since the VM loading the cache may
+// have numbered it differently. See unit_cache.h.
+typedef struct {
+    Chunk *chunk;
+    size_t offset;
+    const struct Symbol *callee;
+} CallSite;
+
+#define call_site_list_item_free(item) ((void)(item))
+GAB_LIST(CallSiteList, call_site_list, CallSite)
+
 // A function this unit declared, and the symbol to stamp with its index once
 // linking makes that index absolute. Stamping at link rather than during
 // codegen is what keeps a compile that fails from leaving a symbol pointing at
@@ -154,23 +255,36 @@ typedef struct {
     ExternProtoList extern_protos;
     TypeList types;
     StringList strings;
+    ChannelList channels;
 
     RelocationList proto_relocations;
     RelocationList extern_relocations;
     RelocationList type_relocations;
     RelocationList string_relocations;
+    RelocationList channel_relocations;
+    CallSiteList call_sites;
 
     ProtoBindingList bindings;
     ExternRequestList externs;
 
+    // How many of the prototypes have their body deferred. See DeferredBody.
+    size_t deferred_count;
+
     // The arena the unit allocates from, held so that anything the link needs
     // can be allocated after codegen has finished.
     Arena *arena;
 
+    // The one allocation link_install moved the code and constants of every
+    // body the unit compiled into, or NULL if it compiled none. malloc'd, and
+    // the chunks borrow from it, so whoever keeps the unit's module takes it
+    // and frees it with the module.
+    void *code;
+
     // Where each of the unit's types landed in the program's list, filled in by the
     // link check so that installing has nothing left that can fail.
     size_t *type_map;
     size_t *string_map;
+    size_t *channel_map;
 } Unit;
 
 void unit_free(Unit *unit);
@@ -184,10 +298,14 @@ GAB_LIST(TopLevelList, top_level_list, FuncPrototype)
 // A host body bound to a name, waiting for a script to declare it 'extern'.
 // Registrations outlive every load, so one made before any unit loads is still
 // there for the last of them.
+//
+// Either 'fn' or 'native' is set, as 'shape' says. See ExternShape.
 typedef struct {
     String *module;
     String *name;
     GabExternFn fn;
+    GabNativeFn native;
+    ExternShape shape;
 } ExternBinding;
 
 #define extern_binding_list_item_free(item) ((void)(item))
@@ -200,6 +318,11 @@ GAB_LIST(ExternBindingList, extern_binding_list, ExternBinding)
 //
 // Allocated out of Environment::arena, so a Program never outlives the
 // Environment that compiled it.
+//
+// A module gab_module_free reclaimed leaves its slots empty rather than
+// renumbering the rest, since every other unit's bytecode names what it uses
+// by index: NULL in a table of pointers, and a zeroed ExternProto. A later
+// unit's link fills them again before it grows a table.
 typedef struct {
     // Function prototypes are program-wide because a prototype index is baked
     // into OP_CALL operands. Top-level variables are not here: they are
@@ -225,12 +348,23 @@ typedef struct {
     // names its type.
     StringList strings;
 
+    // The channels OP_SEND and OP_RECEIVE name, indexed from the instruction.
+    // What is attached to each is a VM's own business, so this holds only the
+    // declaration a host attaches by.
+    ChannelList channels;
+
     // Every loaded unit's top level. See TopLevelList.
     TopLevelList top_levels;
 
     // Host bodies bound by name, resolved against a unit's 'extern'
     // declarations as it loads. See ExternBinding.
     ExternBindingList extern_bindings;
+
+    // How many prototypes are still waiting for a deferred body to compile,
+    // failed ones not counted. Zero unless a unit loaded lazily, which is
+    // what lets the paths that must see every body compiled -- a context, a
+    // task pool -- ask once and move on.
+    size_t deferred_pending;
 } Program;
 
 // Whether this unit could be installed. Reports through the diagnostics sink if
@@ -242,4 +376,12 @@ bool link_check(Program *program, Unit *unit, Diagnostics *diagnostics);
 // Installs a unit that link_check has accepted. Cannot fail.
 void link_install(Program *program, Unit *unit);
 
+// Orders 'count' prototypes by call affinity into 'order', a permutation of
+// their positions: depth first from each one no other of them calls, in
+// declaration order, so that a function is followed by what it calls first.
+// 'base' is the index OP_CALL names the first of them by; a call to anything
+// outside them is no edge. Code laid out in this order keeps a call and the
+// callee it lands in close, where a cache line or a page holds both.
+void link_call_order(FuncPrototype *const *prototypes, size_t count, size_t base, size_t *order);
+
 #endif
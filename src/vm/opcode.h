@@ -42,6 +42,31 @@ typedef enum {
     // fit to the nearest end of the int range, so every operand has an answer.
     OP_ITOF,
     OP_FTOI,
+
+    // Intrinsics: calls the resolver recognised and codegen answers with one
+    // instruction instead of a call, so a 'sqrt' in a hot loop is a dispatch
+    // rather than an Args block and a trip through a host function pointer.
+    //
+    // OP_STR_LEN writes the count from the string header at r1 into rd. The
+    // float forms read r1 and write rd, and OP_MINF / OP_MAXF read r2 as well;
+    // they follow fminf and fmaxf, so a NaN operand yields the other one.
+    //
+    // The int forms take their right operand as the arithmetic does, register
+    // or immediate by the k bit. OP_ABSI wraps the most negative int to itself,
+    // as negation already does, rather than overflowing.
+    //
+    // There is no clamp: it is a max and then a min into the same register, and
+    // a fourth operand would not fit an R-type instruction.
+    OP_STR_LEN,
+    OP_SQRTF,
+    OP_ABSF,
+    OP_FLOORF,
+    OP_CEILF,
+    OP_MINF,
+    OP_MAXF,
+    OP_ABSI,
+    OP_MINI,
+    OP_MAXI,
     OP_CMP_LTI,
     OP_CMP_GTI,
     OP_CMP_EQI,
@@ -114,6 +139,42 @@ typedef enum {
     OP_RETURN,
     OP_RETURN_N,
 
+    // Suspends the coroutine running this frame, leaving r2 slots from r1 where
+    // a return would leave its result; r2 is zero for a bare 'yield'. The
+    // frames stay as they are, and the next resume continues after this.
+    OP_YIELD,
+
+    // 'spawn': I-type like OP_CALL, over the same argument block above rd.
+    // Hands prototypes[kx] and a copy of its arguments to the VM's task pool,
+    // and leaves the task's handle in rd's slot pair.
+    OP_SPAWN,
+
+    // 'join': waits for the task whose handle is in r1, clears that slot, and
+    // copies r2 slots of its result into rd. A task that failed fails the join.
+    OP_JOIN,
+
+    // 'parallel for': runs iterations rd..r1 of the loop whose body follows,
+    // split into chunks across the task pool, and falls through to the jump
+    // past that body. Each chunk runs on a copy of this frame's registers,
+    // with rd and r1 set to its own range; r2 is the first slot the body owns,
+    // below which an unwinding chunk releases nothing, since those slots are
+    // this frame's.
+    OP_PARALLEL_FOR,
+
+    // The end of a 'parallel for' body, reached only by a chunk: it returns
+    // from the chunk's frame with nothing to hand back.
+    OP_PARALLEL_END,
+
+    // 'send': hands the object in rd's slot pair to channels[kx] and clears
+    // the slot, which owns nothing from then on. I-type: a channel index is
+    // not a register.
+    OP_SEND,
+
+    // 'receive': moves the oldest object in channels[kx] into rd's slot pair
+    // and skips the instruction after, the jump to the code run when the
+    // channel is empty -- which it falls through to if it is.
+    OP_RECEIVE,
+
     // Field access is byte-granular: sub-word fields share a slot, so a
     // slot-wide store would clobber a field's neighbours. The width is a
     // compile-time constant, so it selects the opcode rather than costing
@@ -266,6 +327,7 @@ typedef enum {
 // A type index rides in OP_NEW's 17-bit I-type field, for the same reason.
 #define VM_MAX_HEAP_TYPES VM_MAX_CONSTANTS
 #define VM_MAX_STRINGS VM_MAX_CONSTANTS
+#define VM_MAX_CHANNELS VM_MAX_CONSTANTS
 
 // A string value is an address and a count. The count is padded out to the
 // address's alignment, which is what makes the script's layout the C one -- so it
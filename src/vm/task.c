@@ -0,0 +1,653 @@
+#include "vm/task.h"
+
+#include "allocator.h"
+#include "object.h"
+#include "slot.h"
+#include "type.h"
+#include "vm/interp.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// More threads than this is more deques to search than cores to gain from.
+#define TASK_MAX_WORKERS 64
+
+#define TASK_DEQUE_INITIAL_CAPACITY 64
+
+// Chunks per worker for a 'parallel for'. More than one, so a worker that
+// finishes early takes another rather than idling while one runs long.
+#define TASK_CHUNKS_PER_WORKER 4
+
+typedef enum {
+    // On a deque, not yet claimed. Whoever moves it out of this state -- a
+    // worker, a joiner, a discard -- is the only one that decides its fate.
+    TASK_QUEUED,
+    TASK_RUNNING,
+    // Finished, failed, or cancelled before it started.
+    TASK_DONE,
+} TaskState;
+
+typedef struct {
+    const FuncPrototype *proto;
+
+    // Where the run starts in proto's code: -1 for a call from its first
+    // instruction, otherwise a chunk of a 'parallel for' entered at its body,
+    // whose unwind releases only the slots from 'refs_from' up.
+    ptrdiff_t entry;
+    unsigned int refs_from;
+
+    // The VM whose channels the run sends and receives on: the one that
+    // spawned it, or whichever that one was itself borrowing them from. It
+    // outlives the task, which is joined before the spawning run returns.
+    const VM *channels;
+
+    // The VM whose VM::live_tasks counts this task until it is joined or
+    // discarded, or NULL for a chunk of a 'parallel for', which its loop
+    // waits for before anything else can run.
+    VM *owner;
+
+    // One for the handle and one for each deque entry, since a task a joiner
+    // took back is still on a deque until some worker finds it there.
+    atomic_int refs;
+    atomic_int state;
+
+    // How the run ended, for the joiner to report. Written before TASK_DONE
+    // and read after it, both under 'lock'.
+    VmError error;
+
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+
+    // The call block: arguments from slot 1 going in, the result at slot 0
+    // coming out. Sized for whichever is larger, and kept at 8-byte alignment
+    // so a pointer result sits as it would in a frame. A chunk's block is the
+    // whole frame of the loop, and nothing comes back out of it.
+    size_t block_slots;
+    uint64_t block[];
+} VmTask;
+
+// What a task handle's header names. Its only job is its kind: the payload is
+// a VmTask, not a struct with fields to walk.
+static const Type TASK_OBJECT_TYPE = {.kind = TYPE_TASK};
+
+typedef struct TaskWorker {
+    TaskPool *pool;
+    VM *vm;
+    pthread_t thread;
+
+    // A ring of tasks: the owner pushes and pops at the bottom, others steal
+    // from the top. Guarded by a lock rather than built lock-free, as a task
+    // is a whole call and an uncontended lock is not what it waits on.
+    pthread_mutex_t lock;
+    VmTask **ring;
+    size_t top;
+    size_t count;
+    size_t capacity;
+} TaskWorker;
+
+struct TaskPool {
+    TaskWorker *workers;
+    size_t worker_count;
+
+    // Where the next spawn from outside the pool goes.
+    atomic_size_t next;
+
+    // Entries across every deque, and what an idle worker sleeps on until
+    // there are some.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    size_t pending;
+    bool stopping;
+};
+
+// The worker this thread is, for a spawn from inside a task. NULL on every
+// thread the pool did not start.
+static _Thread_local TaskWorker *current_worker = NULL;
+
+// One pool per owning VM, made by whichever spawn comes first.
+static pthread_mutex_t pool_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static VmTask *task_of(void *handle) { return handle; }
+
+static void task_release(VmTask *task) {
+    if (atomic_fetch_sub(&task->refs, 1) != 1) {
+        return;
+    }
+
+    pthread_mutex_destroy(&task->lock);
+    pthread_cond_destroy(&task->done);
+
+    free(gab_object_of(task));
+}
+
+// Runs a task this thread has claimed, on vm, and publishes how it ended. The
+// frame goes above anything vm is running, so a joiner running it inline
+// keeps the frame that joined.
+static void task_run(VM *vm, VmTask *task) {
+    size_t base = vm_call_base(vm);
+    uint8_t *block = (uint8_t *)task->block;
+
+    // The run reports through vm->error, which an inline one shares with the
+    // run that joined. That one is mid-instruction and has not failed, so its
+    // error is put back as it was.
+    VmError outer = vm->error;
+    const VM *outer_channels = vm->channels_from;
+
+    vm->channels_from = task->channels;
+
+    VmRunStatus status;
+
+    if (base / VM_SLOT_SIZE + task->block_slots > vm->stack_capacity) {
+        // A call block is always smaller than the frame the push checks, but
+        // a chunk's is the frame, and it is copied before there is one.
+        vm_fail(vm, VM_RUN_ERR_STACK_OVERFLOW, "out of stack space");
+        status = vm->error.status;
+    } else {
+        memcpy(vm->stack + base, block, task->block_slots * VM_SLOT_SIZE);
+
+        status = task->entry < 0 ? interp_run_frame(vm, task->proto, base, 0)
+                                 : interp_run_chunk(vm, task->proto, base, task->entry, task->refs_from);
+    }
+
+    VmError error = vm->error;
+    vm->error = outer;
+    vm->channels_from = outer_channels;
+
+    if (status == VM_RUN_OK && task->entry < 0) {
+        memcpy(block, vm->stack + base, (size_t)task->proto->return_slots * VM_SLOT_SIZE);
+    }
+
+    pthread_mutex_lock(&task->lock);
+    task->error = error;
+    atomic_store(&task->state, TASK_DONE);
+    pthread_cond_broadcast(&task->done);
+    pthread_mutex_unlock(&task->lock);
+}
+
+static void task_wait(VmTask *task) {
+    pthread_mutex_lock(&task->lock);
+
+    while (atomic_load(&task->state) != TASK_DONE) {
+        pthread_cond_wait(&task->done, &task->lock);
+    }
+
+    pthread_mutex_unlock(&task->lock);
+}
+
+// Takes the task off the queue for this thread. False when a worker, joiner or
+// discard got there first.
+static bool task_claim(VmTask *task, TaskState to) {
+    int expected = TASK_QUEUED;
+
+    return atomic_compare_exchange_strong(&task->state, &expected, to);
+}
+
+// ---- Deques ----
+
+static bool deque_push(TaskWorker *worker, VmTask *task) {
+    pthread_mutex_lock(&worker->lock);
+
+    if (worker->count == worker->capacity) {
+        size_t capacity = worker->capacity ? worker->capacity * 2 : TASK_DEQUE_INITIAL_CAPACITY;
+        VmTask **ring = malloc(capacity * sizeof(VmTask *));
+
+        if (!ring) {
+            pthread_mutex_unlock(&worker->lock);
+            return false;
+        }
+
+        // Unwrapped on the way over, so the copy starts at index 0.
+        for (size_t i = 0; i < worker->count; i++) {
+            ring[i] = worker->ring[(worker->top + i) % worker->capacity];
+        }
+
+        free(worker->ring);
+        worker->ring = ring;
+        worker->top = 0;
+        worker->capacity = capacity;
+    }
+
+    worker->ring[(worker->top + worker->count) % worker->capacity] = task;
+    worker->count++;
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return true;
+}
+
+// The newest entry, for the deque's own worker: what it spawned last is what
+// its caches still hold.
+static VmTask *deque_pop(TaskWorker *worker) {
+    pthread_mutex_lock(&worker->lock);
+
+    VmTask *task = NULL;
+
+    if (worker->count > 0) {
+        worker->count--;
+        task = worker->ring[(worker->top + worker->count) % worker->capacity];
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return task;
+}
+
+// The oldest entry, for any other worker: the one its owner would reach last.
+static VmTask *deque_steal(TaskWorker *worker) {
+    pthread_mutex_lock(&worker->lock);
+
+    VmTask *task = NULL;
+
+    if (worker->count > 0) {
+        task = worker->ring[worker->top];
+        worker->top = (worker->top + 1) % worker->capacity;
+        worker->count--;
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return task;
+}
+
+// ---- The pool ----
+
+static VmTask *worker_find(TaskWorker *worker) {
+    TaskPool *pool = worker->pool;
+
+    VmTask *task = deque_pop(worker);
+
+    size_t self = (size_t)(worker - pool->workers);
+
+    for (size_t i = 1; !task && i < pool->worker_count; i++) {
+        task = deque_steal(&pool->workers[(self + i) % pool->worker_count]);
+    }
+
+    if (task) {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return task;
+}
+
+static void *worker_main(void *arg) {
+    TaskWorker *worker = arg;
+    TaskPool *pool = worker->pool;
+
+    current_worker = worker;
+
+    for (;;) {
+        VmTask *task = worker_find(worker);
+
+        if (!task) {
+            pthread_mutex_lock(&pool->lock);
+
+            while (pool->pending == 0 && !pool->stopping) {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+
+            bool stopping = pool->stopping && pool->pending == 0;
+            pthread_mutex_unlock(&pool->lock);
+
+            if (stopping) {
+                return NULL;
+            }
+
+            continue;
+        }
+
+        // An entry whose task a joiner already took back, or a discard
+        // cancelled, is only a reference to drop.
+        if (task_claim(task, TASK_RUNNING)) {
+            task_run(worker->vm, task);
+        }
+
+        task_release(task);
+    }
+}
+
+void task_pool_destroy(TaskPool *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        TaskWorker *worker = &pool->workers[i];
+
+        // Stopping drained every deque, so nothing is left to release.
+        assert(worker->count == 0);
+
+        free(worker->ring);
+        pthread_mutex_destroy(&worker->lock);
+        vm_free(worker->vm);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+
+    free(pool->workers);
+    free(pool);
+}
+
+static TaskPool *task_pool_create(VM *owner) {
+    TaskPool *pool = calloc(1, sizeof(TaskPool));
+
+    if (!pool) {
+        return NULL;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t count = cores < 1 ? 1 : cores > TASK_MAX_WORKERS ? TASK_MAX_WORKERS : (size_t)cores;
+
+    pool->workers = calloc(count, sizeof(TaskWorker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    if (!pool->workers) {
+        task_pool_destroy(pool);
+        return NULL;
+    }
+
+    // Every worker exists before any thread starts, as a thread steals from
+    // all of them.
+    for (size_t i = 0; i < count; i++) {
+        TaskWorker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->vm = vm_create_worker(owner);
+
+        if (!worker->vm || !worker->vm->stack) {
+            if (worker->vm) {
+                vm_free(worker->vm);
+            }
+
+            pthread_mutex_destroy(&worker->lock);
+            break;
+        }
+
+        pool->worker_count++;
+    }
+
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            // The workers that did start are joined by the destroy; the rest
+            // never ran and only have their contexts to free.
+            for (size_t j = i; j < pool->worker_count; j++) {
+                pthread_mutex_destroy(&pool->workers[j].lock);
+                vm_free(pool->workers[j].vm);
+            }
+
+            pool->worker_count = i;
+            break;
+        }
+    }
+
+    if (pool->worker_count == 0) {
+        task_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+// The pool of the VM that owns vm's program, started on first use. NULL when
+// it cannot be, and every join then runs its task itself.
+static TaskPool *task_pool_of(VM *vm) {
+    VM *owner = vm->owner ? vm->owner : vm;
+
+    TaskPool *pool = atomic_load(&owner->tasks);
+
+    if (pool) {
+        return pool;
+    }
+
+    pthread_mutex_lock(&pool_create_lock);
+
+    pool = atomic_load(&owner->tasks);
+
+    if (!pool) {
+        pool = task_pool_create(owner);
+        atomic_store(&owner->tasks, pool);
+    }
+
+    pthread_mutex_unlock(&pool_create_lock);
+
+    return pool;
+}
+
+// ---- Tasks ----
+
+// A task with a zeroed block of 'block_slots' slots, queued but on no deque,
+// that runs with the channels 'vm' does.
+static VmTask *task_create(const VM *vm, const FuncPrototype *proto, size_t block_slots) {
+    size_t block_bytes =
+        (block_slots * VM_SLOT_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+
+    ObjectHeader *header = malloc(sizeof(ObjectHeader) + sizeof(VmTask) + block_bytes);
+
+    if (!header) {
+        return NULL;
+    }
+
+    header->type = &TASK_OBJECT_TYPE;
+
+    VmTask *task = (VmTask *)(header + 1);
+
+    task->proto = proto;
+    task->entry = -1;
+    task->refs_from = 0;
+    task->channels = vm->channels_from ? vm->channels_from : vm;
+    task->owner = NULL;
+    atomic_init(&task->refs, 1);
+    atomic_init(&task->state, TASK_QUEUED);
+    task->error = (VmError){.status = VM_RUN_OK};
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->done, NULL);
+    task->block_slots = block_slots;
+
+    memset(task->block, 0, block_bytes);
+
+    return task;
+}
+
+// Puts the task on a deque of 'pool'. One that cannot be is left where it is,
+// for whoever waits on it to run, as is every task when there is no pool.
+static void task_submit(TaskPool *pool, VmTask *task) {
+    if (!pool) {
+        return;
+    }
+
+    TaskWorker *worker = current_worker && current_worker->pool == pool
+                             ? current_worker
+                             : &pool->workers[atomic_fetch_add(&pool->next, 1) % pool->worker_count];
+
+    // The entry's reference, and its place in the count, are taken before it
+    // is visible, since a worker may pop it the moment it is.
+    atomic_fetch_add(&task->refs, 1);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    bool pushed = deque_push(worker, task);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pushed) {
+        pthread_cond_signal(&pool->wake);
+    } else {
+        pool->pending--;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!pushed) {
+        atomic_fetch_sub(&task->refs, 1);
+    }
+}
+
+// Runs the task here if nobody has started it, and otherwise waits for
+// whoever did.
+static void task_finish(VM *vm, VmTask *task) {
+    if (task_claim(task, TASK_RUNNING)) {
+        task_run(vm, task);
+    } else {
+        task_wait(task);
+    }
+}
+
+void *task_spawn(VM *vm, const FuncPrototype *proto, const uint8_t *args) {
+    size_t param_slots = (size_t)proto->param_slots;
+    size_t return_slots = (size_t)proto->return_slots;
+    size_t block_slots = 1 + param_slots > return_slots ? 1 + param_slots : return_slots;
+
+    VmTask *task = task_create(vm, proto, block_slots);
+
+    if (!task) {
+        return NULL;
+    }
+
+    memcpy((uint8_t *)task->block + VM_SLOT_SIZE, args, param_slots * VM_SLOT_SIZE);
+
+    task->owner = vm->owner ? vm->owner : vm;
+    atomic_fetch_add(&task->owner->live_tasks, 1);
+
+    task_submit(task_pool_of(vm), task);
+
+    return task;
+}
+
+bool task_join(VM *vm, void *handle, uint8_t *out, size_t slots) {
+    VmTask *task = task_of(handle);
+
+    task_finish(vm, task);
+
+    bool ok = task->error.status == VM_RUN_OK;
+
+    if (ok) {
+        memcpy(out, task->block, slots * VM_SLOT_SIZE);
+    } else {
+        char message[sizeof(task->error.message) + 32];
+        snprintf(message, sizeof(message), "task failed: %s", task->error.message);
+
+        vm_fail(vm, VM_RUN_ERR_TASK, message);
+    }
+
+    atomic_fetch_sub(&task->owner->live_tasks, 1);
+    task_release(task);
+
+    return ok;
+}
+
+void task_discard(void *handle) {
+    VmTask *task = task_of(handle);
+
+    // Not started: cancelled where it sits, and the worker that finds it
+    // there only drops its reference.
+    if (!task_claim(task, TASK_DONE)) {
+        task_wait(task);
+
+        // A result nobody joined is still the task's to give up, and an owned
+        // one would otherwise leak.
+        if (task->error.status == VM_RUN_OK && task->proto->returns_owned) {
+            void *object;
+            memcpy(&object, task->block, sizeof(object));
+
+            gab_object_free(DEFAULT_ALLOCATOR, object);
+        }
+    }
+
+    atomic_fetch_sub(&task->owner->live_tasks, 1);
+    task_release(task);
+}
+
+bool task_parallel_for(VM *vm, const TaskLoop *loop) {
+    TaskPool *pool = task_pool_of(vm);
+
+    int64_t total = (int64_t)loop->end - loop->start;
+    size_t chunks = pool ? pool->worker_count * TASK_CHUNKS_PER_WORKER : 1;
+
+    if ((int64_t)chunks > total) {
+        chunks = (size_t)total;
+    }
+
+    VmTask **tasks = malloc(chunks * sizeof(VmTask *));
+
+    if (!tasks) {
+        vm_fail(vm, VM_RUN_ERR_OUT_OF_MEMORY, "out of memory");
+        return false;
+    }
+
+    size_t frame_slots = (size_t)loop->proto->max_registers;
+    size_t created = 0;
+
+    for (; created < chunks; created++) {
+        VmTask *task = task_create(vm, loop->proto, frame_slots);
+
+        if (!task) {
+            break;
+        }
+
+        int32_t lo = (int32_t)(loop->start + total * (int64_t)created / (int64_t)chunks);
+        int32_t hi = (int32_t)(loop->start + total * (int64_t)(created + 1) / (int64_t)chunks);
+
+        // Every chunk starts from the frame as the loop found it, with its own
+        // slice of the range in the counter and the bound. The slots from
+        // 'refs_from' up are the body's and start empty, so an unwind in the
+        // chunk never mistakes something the frame left there for its own.
+        uint8_t *block = (uint8_t *)task->block;
+        memcpy(block, loop->registers, (size_t)loop->refs_from * VM_SLOT_SIZE);
+        memcpy(block + (size_t)loop->counter * VM_SLOT_SIZE, &lo, sizeof(lo));
+        memcpy(block + (size_t)loop->limit * VM_SLOT_SIZE, &hi, sizeof(hi));
+
+        task->entry = loop->entry;
+        task->refs_from = loop->refs_from;
+
+        task_submit(pool, task);
+        tasks[created] = task;
+    }
+
+    // Every chunk that was made is finished before the loop is, failed or
+    // not, since each reads through pointers the frame still owns.
+    VmError error = {.status = VM_RUN_OK};
+
+    for (size_t i = 0; i < created; i++) {
+        task_finish(vm, tasks[i]);
+
+        if (error.status == VM_RUN_OK && tasks[i]->error.status != VM_RUN_OK) {
+            error = tasks[i]->error;
+        }
+
+        task_release(tasks[i]);
+    }
+
+    free(tasks);
+
+    if (error.status == VM_RUN_OK && created < chunks) {
+        error.status = VM_RUN_ERR_OUT_OF_MEMORY;
+        snprintf(error.message, sizeof(error.message), "out of memory");
+    }
+
+    if (error.status != VM_RUN_OK) {
+        vm_fail(vm, error.status, error.message);
+        return false;
+    }
+
+    return true;
+}
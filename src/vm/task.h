@@ -0,0 +1,76 @@
+#ifndef GAB_TASK_H
+#define GAB_TASK_H
+
+#include "vm/link.h"
+#include "vm/vm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    A task is one script call run on another thread: 'let t = spawn f(x);'
+    starts it, 'join t' waits for it and hands back what f returned.
+
+    Tasks run on a pool of threads, one per core, each with a context of the VM
+    to run on and a deque of tasks. A spawn pushes onto the deque of the thread
+    doing the spawning when that is one of the pool's, so a task that spawns
+    more keeps them close; from any other thread it goes to the deques in turn.
+    An idle thread takes from the bottom of its own deque first and then from
+    the top of the others', so work spreads without anything handing it out.
+
+    A join never waits on a task that has not started: it takes the task back
+    and runs it on its own stack, as if it had been a call. That is what keeps
+    a pool of N threads from deadlocking on tasks that join tasks, and what
+    lets a VM whose pool could not be started run every task anyway.
+
+    In the script, a task handle is owned as a '*T' is, and released where its
+    variable goes out of scope. The handle is an object whose header names a
+    Type of kind TYPE_TASK, so every path that frees an owned slot -- a scope's
+    release, an unwind after a failure, an abandoned coroutine -- reaches
+    task_discard through gab_object_free without knowing what it held.
+*/
+
+typedef struct TaskPool TaskPool;
+
+// A 'parallel for' as its OP_PARALLEL_FOR found it: the frame running it, the
+// body's first instruction, and the range left to count through.
+typedef struct {
+    const FuncPrototype *proto;
+    const uint8_t *registers;
+    ptrdiff_t entry;
+
+    // Registers of the counter and the bound, which each chunk gets its own
+    // slice in, and the first one the body allocates.
+    unsigned int counter;
+    unsigned int limit;
+    unsigned int refs_from;
+
+    int32_t start;
+    int32_t end;
+} TaskLoop;
+
+// Starts 'proto' on the pool of vm's owner with a copy of its arguments,
+// which are proto->param_slots slots at 'args'. Returns the handle the
+// script's slot holds, or NULL when the task could not be allocated.
+void *task_spawn(VM *vm, const FuncPrototype *proto, const uint8_t *args);
+
+// Waits for the task, running it on vm when it has not started, and copies
+// 'slots' slots of its result to 'out'. Answers false, with the reason
+// recorded on vm, when the task failed. Either way the handle is gone.
+bool task_join(VM *vm, void *handle, uint8_t *out, size_t slots);
+
+// Splits the loop's range into chunks, runs each on a copy of the frame on the
+// pool, and waits for all of them. Answers false, with the first failure
+// recorded on vm, when any chunk failed.
+bool task_parallel_for(VM *vm, const TaskLoop *loop);
+
+// Releases a handle that was never joined: a task that has not started never
+// will, and one that has is waited for and its result dropped.
+void task_discard(void *handle);
+
+// Stops the pool's threads and frees their contexts. Every task has been
+// joined or discarded by then. NULL-tolerant, as most VMs never spawn.
+void task_pool_destroy(TaskPool *pool);
+
+#endif
@@ -0,0 +1,918 @@
+#include "vm/unit_cache.h"
+
+#include "symbol_table.h"
+#include "type.h"
+#include "vm/opcode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// What one operand of a cached body stands for. Written as a byte, so the
+// numbering is part of the format: append, never renumber.
+typedef enum {
+    CACHE_RELOC_PROTO,
+    CACHE_RELOC_EXTERN,
+    CACHE_RELOC_STRING,
+    CACHE_RELOC_TYPE,
+    CACHE_RELOC_CHANNEL,
+    CACHE_RELOC_CALL,
+} CacheRelocKind;
+
+// ---- Writing ----
+
+static void cache_put_bytes(UnitCacheBuffer *out, const void *bytes, size_t count) {
+    if (out->failed) {
+        return;
+    }
+
+    if (out->size + count > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 256;
+
+        while (capacity < out->size + count) {
+            capacity *= 2;
+        }
+
+        uint8_t *data = realloc(out->data, capacity);
+
+        if (!data) {
+            out->failed = true;
+            return;
+        }
+
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    memcpy(out->data + out->size, bytes, count);
+    out->size += count;
+}
+
+static void cache_put_u8(UnitCacheBuffer *out, uint8_t value) { cache_put_bytes(out, &value, 1); }
+
+static void cache_put_u32(UnitCacheBuffer *out, uint32_t value) {
+    uint8_t bytes[4];
+
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    cache_put_bytes(out, bytes, sizeof(bytes));
+}
+
+static void cache_put_u64(UnitCacheBuffer *out, uint64_t value) {
+    cache_put_u32(out, (uint32_t)value);
+    cache_put_u32(out, (uint32_t)(value >> 32));
+}
+
+static void cache_put_string(UnitCacheBuffer *out, const String *text) {
+    cache_put_u32(out, (uint32_t)text->length);
+    cache_put_bytes(out, text->data, text->length);
+}
+
+// Overwrites a count written before what it counts was known.
+static void cache_patch_u32(UnitCacheBuffer *out, size_t at, uint32_t value) {
+    if (out->failed) {
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        out->data[at + i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// ---- Reading ----
+
+// Every read checks it stays within the cache, and a reader that ran off the
+// end answers zero from then on: the caller looks at 'failed' once, after a
+// whole record, rather than after every field of it.
+typedef struct {
+    const uint8_t *at;
+    const uint8_t *end;
+    bool failed;
+} CacheReader;
+
+static const uint8_t *cache_take(CacheReader *reader, size_t count) {
+    if (reader->failed || (size_t)(reader->end - reader->at) < count) {
+        reader->failed = true;
+        return NULL;
+    }
+
+    const uint8_t *bytes = reader->at;
+    reader->at += count;
+
+    return bytes;
+}
+
+static uint8_t cache_get_u8(CacheReader *reader) {
+    const uint8_t *bytes = cache_take(reader, 1);
+
+    return bytes ? bytes[0] : 0;
+}
+
+static uint32_t cache_get_u32(CacheReader *reader) {
+    const uint8_t *bytes = cache_take(reader, 4);
+
+    if (!bytes) {
+        return 0;
+    }
+
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static uint64_t cache_get_u64(CacheReader *reader) {
+    uint64_t low = cache_get_u32(reader);
+
+    return low | (uint64_t)cache_get_u32(reader) << 32;
+}
+
+static StringRef cache_get_string(CacheReader *reader) {
+    uint32_t length = cache_get_u32(reader);
+    const uint8_t *bytes = cache_take(reader, length);
+
+    return bytes ? (StringRef){.data = (const char *)bytes, .length = length} : (StringRef){0};
+}
+
+// A count of records at least 'record_size' bytes each. One the rest of the
+// cache could not hold is refused before anything is allocated for it.
+static size_t cache_get_count(CacheReader *reader, size_t record_size) {
+    size_t count = cache_get_u32(reader);
+
+    if (count > (size_t)(reader->end - reader->at) / record_size) {
+        reader->failed = true;
+        return 0;
+    }
+
+    return count;
+}
+
+// ---- Hashing ----
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+static uint64_t fnv_bytes(uint64_t hash, const void *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        hash ^= ((const uint8_t *)bytes)[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// By value rather than by bytes, so the hash is the same on either byte order.
+static uint64_t fnv_u64(uint64_t hash, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        hash ^= (uint8_t)(value >> (8 * i));
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static uint64_t fnv_string(uint64_t hash, const String *text) {
+    hash = fnv_u64(hash, text->length);
+
+    return fnv_bytes(hash, text->data, text->length);
+}
+
+uint64_t unit_cache_hash_source(const char *source) {
+    return fnv_bytes(FNV_OFFSET, source, strlen(source));
+}
+
+// A type as a signature or a field mentions it: what it is called and how
+// much of a frame it takes. A struct's layout is its own module's to hash,
+// which is why a cache depends on every module whose structs it can reach.
+static uint64_t fingerprint_type(uint64_t hash, const Type *type) {
+    if (!type) {
+        return fnv_u64(hash, UINT64_MAX);
+    }
+
+    hash = fnv_u64(hash, type->kind);
+
+    switch (type->kind) {
+    case TYPE_POINTER:
+        return fingerprint_type(fnv_u64(hash, type->is_ref), type->pointee);
+    case TYPE_TASK:
+        return fingerprint_type(hash, type->pointee);
+    default:
+        hash = type->name ? fnv_string(hash, type->name) : hash;
+        return fnv_u64(hash, type->size);
+    }
+}
+
+static uint64_t fingerprint_symbol(const String *name, const Symbol *symbol) {
+    uint64_t hash = fnv_u64(fnv_string(FNV_OFFSET, name), symbol->kind);
+
+    switch (symbol->kind) {
+    case SYMBOL_VAR:
+        return fingerprint_type(hash, symbol->var.type);
+    case SYMBOL_FUNC:
+        hash = fingerprint_type(hash, symbol->func.return_type);
+        hash = fnv_u64(hash, symbol->func.param_count);
+
+        for (size_t i = 0; i < symbol->func.param_count; i++) {
+            hash = fingerprint_type(hash, symbol->func.params[i]);
+        }
+
+        hash = fnv_u64(hash, symbol->func.is_extern);
+        return fnv_u64(hash, symbol->func.is_pure);
+    case SYMBOL_CHANNEL:
+        return fingerprint_type(hash, symbol->channel.element);
+    }
+
+    return hash;
+}
+
+static uint64_t fingerprint_declared_type(const String *name, const Type *type) {
+    uint64_t hash = fingerprint_type(fnv_string(FNV_OFFSET, name), type);
+    hash = fnv_u64(hash, type->alignment);
+    hash = fnv_u64(hash, type->field_count);
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        hash = fnv_string(hash, type->fields[i].name);
+        hash = fnv_u64(hash, type->fields[i].offset);
+        hash = fingerprint_type(hash, type->fields[i].type);
+    }
+
+    // Summed like the module's own entries: a map's order is its capacity's.
+    uint64_t methods = 0;
+
+    if (type->methods) {
+        for (size_t i = 0; i < type->methods->capacity; i++) {
+            for (MethodMapEntry *entry = type->methods->buckets[i]; entry; entry = entry->next) {
+                methods += fingerprint_symbol(entry->key, entry->value);
+            }
+        }
+    }
+
+    return fnv_u64(hash, methods);
+}
+
+uint64_t unit_cache_fingerprint(const Scope *scope) {
+    if (!scope) {
+        return 0;
+    }
+
+    uint64_t fingerprint = 0;
+
+    for (size_t i = 0; i < scope->symbol_table->capacity; i++) {
+        for (SymbolTableEntry *entry = scope->symbol_table->buckets[i]; entry; entry = entry->next) {
+            fingerprint += fingerprint_symbol(entry->key, entry->value);
+        }
+    }
+
+    for (size_t i = 0; i < scope->types->capacity; i++) {
+        for (TypeMapEntry *entry = scope->types->buckets[i]; entry; entry = entry->next) {
+            fingerprint += fingerprint_declared_type(entry->key, entry->value.type);
+        }
+    }
+
+    return fingerprint;
+}
+
+// ---- Naming what a body refers to ----
+
+static bool cache_list_has(const StringList *list, const String *name) {
+    for (size_t i = 0; i < list->size; i++) {
+        if (list->data[i] == name) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void cache_depend_on_type(const Environment *env, StringList *modules, const Type *type) {
+    while (type && (type->kind == TYPE_POINTER || type->kind == TYPE_TASK)) {
+        type = type->pointee;
+    }
+
+    if (!type || type->kind != TYPE_STRUCT) {
+        return;
+    }
+
+    String *module = environment_type_module(env, type);
+
+    if (module && !cache_list_has(modules, module)) {
+        string_list_add(modules, module);
+    }
+}
+
+static void cache_depend_on_symbol(const Environment *env, StringList *modules, const Symbol *symbol) {
+    switch (symbol->kind) {
+    case SYMBOL_VAR:
+        cache_depend_on_type(env, modules, symbol->var.type);
+        break;
+    case SYMBOL_FUNC:
+        cache_depend_on_type(env, modules, symbol->func.return_type);
+
+        for (size_t i = 0; i < symbol->func.param_count; i++) {
+            cache_depend_on_type(env, modules, symbol->func.params[i]);
+        }
+        break;
+    case SYMBOL_CHANNEL:
+        cache_depend_on_type(env, modules, symbol->channel.element);
+        break;
+    }
+}
+
+// Adds every module a struct this scope's declarations mention was declared
+// in: a body can reach a field of any of them without importing its module.
+static void cache_depend_on_scope(const Environment *env, StringList *modules, const Scope *scope) {
+    for (size_t i = 0; i < scope->symbol_table->capacity; i++) {
+        for (SymbolTableEntry *entry = scope->symbol_table->buckets[i]; entry; entry = entry->next) {
+            cache_depend_on_symbol(env, modules, entry->value);
+        }
+    }
+
+    for (size_t i = 0; i < scope->types->capacity; i++) {
+        for (TypeMapEntry *entry = scope->types->buckets[i]; entry; entry = entry->next) {
+            const Type *type = entry->value.type;
+
+            for (size_t f = 0; f < type->field_count; f++) {
+                cache_depend_on_type(env, modules, type->fields[f].type);
+            }
+
+            if (!type->methods) {
+                continue;
+            }
+
+            for (size_t m = 0; m < type->methods->capacity; m++) {
+                for (MethodMapEntry *method = type->methods->buckets[m]; method; method = method->next) {
+                    cache_depend_on_symbol(env, modules, method->value);
+                }
+            }
+        }
+    }
+}
+
+// A struct OP_NEW allocates, as the module that declared it and its name
+// there. The unit's own are in the staging scope, under the unit's module.
+static String *cache_name_type(const Environment *env, const Scope *staging, String *module_name,
+                               const Type *type) {
+    TypeBinding *own = type_map_lookup(staging->types, type->name);
+
+    if (own && own->type == type) {
+        return module_name;
+    }
+
+    return environment_type_module(env, type);
+}
+
+// A function an earlier unit declared, as the module it was declared in and
+// its name there -- with the struct it is a method of, if it is one, since a
+// method has no name of its own in its module.
+typedef struct {
+    String *module;
+    String *receiver;
+    String *name;
+} CalleeName;
+
+static bool cache_name_callee(const Environment *env, const Symbol *callee, CalleeName *out) {
+    for (size_t i = 0; i < env->module_scopes->capacity; i++) {
+        for (ModuleScopeMapEntry *module = env->module_scopes->buckets[i]; module; module = module->next) {
+            const Scope *scope = module->value;
+
+            for (size_t s = 0; s < scope->symbol_table->capacity; s++) {
+                for (SymbolTableEntry *entry = scope->symbol_table->buckets[s]; entry; entry = entry->next) {
+                    if (entry->value == callee) {
+                        *out = (CalleeName){.module = module->key, .name = entry->key};
+                        return true;
+                    }
+                }
+            }
+
+            for (size_t t = 0; t < scope->types->capacity; t++) {
+                for (TypeMapEntry *entry = scope->types->buckets[t]; entry; entry = entry->next) {
+                    MethodMap *methods = entry->value.type->methods;
+
+                    for (size_t m = 0; methods && m < methods->capacity; m++) {
+                        for (MethodMapEntry *method = methods->buckets[m]; method; method = method->next) {
+                            if (method->value == callee) {
+                                *out = (CalleeName){
+                                    .module = module->key,
+                                    .receiver = entry->key,
+                                    .name = method->key,
+                                };
+                                return true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// ---- Writing a unit ----
+
+static size_t cache_operand(const Chunk *chunk, size_t offset) {
+    return VM_DECODE_I_KX(chunk->instructions.data[offset]);
+}
+
+static size_t cache_begin_count(UnitCacheBuffer *out) {
+    size_t at = out->size;
+    cache_put_u32(out, 0);
+
+    return at;
+}
+
+// The kind and offset of each relocation in one list that falls in 'chunk'.
+static uint32_t cache_put_plain_relocations(UnitCacheBuffer *out, const RelocationList *relocations,
+                                            const Chunk *chunk, CacheRelocKind kind) {
+    uint32_t count = 0;
+
+    for (size_t i = 0; i < relocations->size; i++) {
+        if (relocations->data[i].chunk == chunk) {
+            cache_put_u8(out, (uint8_t)kind);
+            cache_put_u32(out, (uint32_t)relocations->data[i].offset);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static bool cache_put_body(Environment *env, const Unit *unit, const Scope *staging, String *module_name,
+                           const FuncPrototype *proto, UnitCacheBuffer *out) {
+    const Chunk *chunk = proto->chunk;
+
+    cache_put_u32(out, (uint32_t)proto->max_registers);
+
+    cache_put_u32(out, (uint32_t)proto->refs.size);
+    for (size_t i = 0; i < proto->refs.size; i++) {
+        cache_put_u32(out, proto->refs.data[i].slot);
+    }
+
+    cache_put_u32(out, (uint32_t)chunk->instructions.size);
+    for (size_t i = 0; i < chunk->instructions.size; i++) {
+        cache_put_u32(out, chunk->instructions.data[i]);
+    }
+
+    // Raw, as the pool holds them: an int and a float are the same 32 bits to
+    // the pool, and the instruction loading one already knows which it is.
+    cache_put_u32(out, (uint32_t)chunk->const_pool->count);
+    for (size_t i = 0; i < chunk->const_pool->count; i++) {
+        uint32_t bits;
+        memcpy(&bits, &chunk->const_pool->constants[i], sizeof(bits));
+        cache_put_u32(out, bits);
+    }
+
+    size_t count_at = cache_begin_count(out);
+    uint32_t count = 0;
+
+    count += cache_put_plain_relocations(out, &unit->proto_relocations, chunk, CACHE_RELOC_PROTO);
+    count += cache_put_plain_relocations(out, &unit->extern_relocations, chunk, CACHE_RELOC_EXTERN);
+
+    for (size_t i = 0; i < unit->string_relocations.size; i++) {
+        const Relocation *reloc = &unit->string_relocations.data[i];
+
+        if (reloc->chunk == chunk) {
+            cache_put_u8(out, CACHE_RELOC_STRING);
+            cache_put_u32(out, (uint32_t)reloc->offset);
+            cache_put_string(out, unit->strings.data[cache_operand(chunk, reloc->offset)]);
+            count++;
+        }
+    }
+
+    for (size_t i = 0; i < unit->type_relocations.size; i++) {
+        const Relocation *reloc = &unit->type_relocations.data[i];
+
+        if (reloc->chunk != chunk) {
+            continue;
+        }
+
+        const Type *type = unit->types.data[cache_operand(chunk, reloc->offset)];
+        String *module = cache_name_type(env, staging, module_name, type);
+
+        if (!module) {
+            return false;
+        }
+
+        cache_put_u8(out, CACHE_RELOC_TYPE);
+        cache_put_u32(out, (uint32_t)reloc->offset);
+        cache_put_string(out, module);
+        cache_put_string(out, type->name);
+        count++;
+    }
+
+    for (size_t i = 0; i < unit->channel_relocations.size; i++) {
+        const Relocation *reloc = &unit->channel_relocations.data[i];
+
+        if (reloc->chunk == chunk) {
+            const Symbol *channel = unit->channels.data[cache_operand(chunk, reloc->offset)];
+
+            cache_put_u8(out, CACHE_RELOC_CHANNEL);
+            cache_put_u32(out, (uint32_t)reloc->offset);
+            cache_put_string(out, channel->channel.module);
+            cache_put_string(out, channel->channel.name);
+            count++;
+        }
+    }
+
+    for (size_t i = 0; i < unit->call_sites.size; i++) {
+        const CallSite *site = &unit->call_sites.data[i];
+        CalleeName name;
+
+        if (site->chunk != chunk) {
+            continue;
+        }
+
+        if (!cache_name_callee(env, site->callee, &name)) {
+            return false;
+        }
+
+        cache_put_u8(out, CACHE_RELOC_CALL);
+        cache_put_u32(out, (uint32_t)site->offset);
+        cache_put_u8(out, name.receiver != NULL);
+        cache_put_string(out, name.module);
+
+        if (name.receiver) {
+            cache_put_string(out, name.receiver);
+        }
+
+        cache_put_string(out, name.name);
+        count++;
+    }
+
+    cache_patch_u32(out, count_at, count);
+
+    return true;
+}
+
+bool unit_cache_write(Environment *env, const Unit *unit, const Scope *staging, const Scope *target,
+                      String *module_name, const StringList *imported, const ParserBodySpanList *spans,
+                      uint64_t source_hash, UnitCacheBuffer *out) {
+    *out = (UnitCacheBuffer){0};
+
+    cache_put_u32(out, UNIT_CACHE_MAGIC);
+    cache_put_u32(out, UNIT_CACHE_VERSION);
+    cache_put_u32(out, VM_SLOT_SIZE);
+    cache_put_u32(out, (uint32_t)sizeof(void *));
+    cache_put_u64(out, source_hash);
+
+    // The unit's own module first, then what it imports, then every module a
+    // struct any of those mention came from, until nothing new turns up.
+    StringList modules = string_list_create();
+    string_list_add(&modules, module_name);
+
+    for (size_t i = 0; i < imported->size; i++) {
+        if (!cache_list_has(&modules, imported->data[i])) {
+            string_list_add(&modules, imported->data[i]);
+        }
+    }
+
+    cache_depend_on_scope(env, &modules, staging);
+
+    for (size_t i = 0; i < modules.size; i++) {
+        Scope **scope = module_scope_map_lookup(env->module_scopes, modules.data[i]);
+
+        if (scope) {
+            cache_depend_on_scope(env, &modules, *scope);
+        }
+    }
+
+    cache_put_u32(out, (uint32_t)modules.size);
+
+    for (size_t i = 0; i < modules.size; i++) {
+        Scope **scope = module_scope_map_lookup(env->module_scopes, modules.data[i]);
+
+        cache_put_string(out, modules.data[i]);
+        cache_put_u64(out, unit_cache_fingerprint(i == 0 ? target : scope ? *scope : NULL));
+    }
+
+    string_list_free(&modules);
+
+    cache_put_u32(out, (uint32_t)spans->size);
+
+    for (size_t i = 0; i < spans->size; i++) {
+        cache_put_u64(out, spans->data[i].start);
+        cache_put_u64(out, spans->data[i].resume);
+        cache_put_u32(out, (uint32_t)spans->data[i].line);
+        cache_put_u32(out, (uint32_t)spans->data[i].column);
+    }
+
+    cache_put_u32(out, (uint32_t)unit->prototypes.size);
+
+    for (size_t i = 0; i < unit->prototypes.size && !out->failed; i++) {
+        if (!cache_put_body(env, unit, staging, module_name, unit->prototypes.data[i], out)) {
+            out->failed = true;
+        }
+    }
+
+    if (out->failed) {
+        free(out->data);
+        *out = (UnitCacheBuffer){0};
+        return false;
+    }
+
+    return true;
+}
+
+// ---- Reading a unit ----
+
+#define CACHE_SPAN_SIZE (8 + 8 + 4 + 4)
+
+bool unit_cache_open(UnitCache *cache, Arena *arena, const void *data, size_t size, uint64_t source_hash,
+                     Diagnostics *diagnostics) {
+    CacheReader reader = {.at = data, .end = (const uint8_t *)data + size};
+
+    uint32_t magic = cache_get_u32(&reader);
+    uint32_t version = cache_get_u32(&reader);
+    uint32_t slot_size = cache_get_u32(&reader);
+    uint32_t pointer_size = cache_get_u32(&reader);
+
+    if (reader.failed || magic != UNIT_CACHE_MAGIC || version != UNIT_CACHE_VERSION ||
+        slot_size != VM_SLOT_SIZE || pointer_size != sizeof(void *)) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "not a unit cache this build of gab can load");
+        return false;
+    }
+
+    *cache = (UnitCache){.data = data, .size = size, .source_hash = cache_get_u64(&reader)};
+
+    if (!reader.failed && cache->source_hash != source_hash) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "the unit cache is stale: it was compiled from other source");
+        return false;
+    }
+
+    // Stepped over here and read when they are checked, against the modules
+    // as they are when the unit has parsed.
+    cache->module_count = cache_get_count(&reader, 4 + 8);
+    cache->modules = reader.at;
+
+    for (size_t i = 0; i < cache->module_count; i++) {
+        cache_get_string(&reader);
+        cache_get_u64(&reader);
+    }
+
+    cache->body_count = cache_get_count(&reader, CACHE_SPAN_SIZE);
+    cache->spans = arena_alloc(arena, (cache->body_count + 1) * sizeof(ParserBodySpan));
+
+    for (size_t i = 0; i < cache->body_count; i++) {
+        cache->spans[i] = (ParserBodySpan){
+            .start = (size_t)cache_get_u64(&reader),
+            .resume = (size_t)cache_get_u64(&reader),
+            .line = (int)cache_get_u32(&reader),
+            .column = (int)cache_get_u32(&reader),
+        };
+    }
+
+    cache->bodies = reader.at;
+
+    if (reader.failed) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0}, "the unit cache is truncated");
+        return false;
+    }
+
+    return true;
+}
+
+bool unit_cache_current(const UnitCache *cache, Environment *env, const Scope *target,
+                        Diagnostics *diagnostics) {
+    CacheReader reader = {.at = cache->modules, .end = cache->data + cache->size};
+
+    for (size_t i = 0; i < cache->module_count; i++) {
+        String *name = string_from_ref(&env->strings, cache_get_string(&reader));
+        uint64_t fingerprint = cache_get_u64(&reader);
+
+        Scope **scope = module_scope_map_lookup(env->module_scopes, name);
+
+        if (unit_cache_fingerprint(i == 0 ? target : scope ? *scope : NULL) != fingerprint) {
+            diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                       "the unit cache is stale: module '%s' has changed since it was written", name->data);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Where a cached body names a module, the scope to look it up in: the unit's
+// own module through the staging scope, so what the unit itself declared is
+// found as well as what earlier units did.
+static Scope *cache_module_scope(Environment *env, Scope *staging, String *module_name, StringRef name) {
+    String *module = string_from_ref(&env->strings, name);
+
+    if (module == module_name) {
+        return staging;
+    }
+
+    Scope **scope = module_scope_map_lookup(env->module_scopes, module);
+
+    return scope ? *scope : NULL;
+}
+
+// Where the unit numbers a literal, a type or a channel, appending it the
+// first time: as codegen numbers them, so the link reconciles them the same.
+static size_t cache_string_index(Unit *unit, String *text) {
+    for (size_t i = 0; i < unit->strings.size; i++) {
+        if (unit->strings.data[i] == text) {
+            return i;
+        }
+    }
+
+    string_list_add(&unit->strings, text);
+
+    return unit->strings.size - 1;
+}
+
+static size_t cache_type_index(Unit *unit, const Type *type) {
+    for (size_t i = 0; i < unit->types.size; i++) {
+        if (unit->types.data[i] == type) {
+            return i;
+        }
+    }
+
+    type_list_add(&unit->types, type);
+
+    return unit->types.size - 1;
+}
+
+static size_t cache_channel_index(Unit *unit, const Symbol *channel) {
+    for (size_t i = 0; i < unit->channels.size; i++) {
+        if (unit->channels.data[i] == channel) {
+            return i;
+        }
+    }
+
+    channel_list_add(&unit->channels, channel);
+
+    return unit->channels.size - 1;
+}
+
+static void cache_set_operand(Chunk *chunk, size_t offset, size_t value) {
+    Instruction instruction = instruction_list_get(&chunk->instructions, offset);
+
+    chunk_patch_instruction(chunk, offset,
+                            VM_ENCODE_I(VM_DECODE_OPCODE(instruction), VM_DECODE_I_RD(instruction),
+                                        (unsigned int)value));
+}
+
+// Reads one relocation and applies it to 'chunk'. False for one that names
+// what this VM does not have, or does not fit the unit it is filling.
+static bool cache_read_relocation(CacheReader *reader, Environment *env, Unit *unit, Scope *staging,
+                                  String *module_name, Chunk *chunk) {
+    CacheRelocKind kind = cache_get_u8(reader);
+    size_t offset = cache_get_u32(reader);
+
+    if (reader->failed || offset >= chunk->instructions.size) {
+        return false;
+    }
+
+    Relocation reloc = {.chunk = chunk, .offset = offset};
+    size_t operand = cache_operand(chunk, offset);
+
+    switch (kind) {
+    case CACHE_RELOC_PROTO:
+        relocation_list_add(&unit->proto_relocations, reloc);
+        return operand < unit->prototypes.size;
+    case CACHE_RELOC_EXTERN:
+        relocation_list_add(&unit->extern_relocations, reloc);
+        return operand < unit->extern_protos.size;
+    case CACHE_RELOC_STRING: {
+        String *text = string_from_ref(&env->strings, cache_get_string(reader));
+
+        cache_set_operand(chunk, offset, cache_string_index(unit, text));
+        relocation_list_add(&unit->string_relocations, reloc);
+        return !reader->failed;
+    }
+    case CACHE_RELOC_TYPE: {
+        Scope *scope = cache_module_scope(env, staging, module_name, cache_get_string(reader));
+        String *name = string_from_ref(&env->strings, cache_get_string(reader));
+        const Type *type = scope ? scope_type_lookup(scope, name) : NULL;
+
+        if (reader->failed || !type || type->kind != TYPE_STRUCT) {
+            return false;
+        }
+
+        cache_set_operand(chunk, offset, cache_type_index(unit, type));
+        relocation_list_add(&unit->type_relocations, reloc);
+        return true;
+    }
+    case CACHE_RELOC_CHANNEL: {
+        Scope *scope = cache_module_scope(env, staging, module_name, cache_get_string(reader));
+        String *name = string_from_ref(&env->strings, cache_get_string(reader));
+        const Symbol *channel = scope ? scope_symbol_lookup(scope, name) : NULL;
+
+        if (reader->failed || !channel || channel->kind != SYMBOL_CHANNEL) {
+            return false;
+        }
+
+        cache_set_operand(chunk, offset, cache_channel_index(unit, channel));
+        relocation_list_add(&unit->channel_relocations, reloc);
+        return true;
+    }
+    case CACHE_RELOC_CALL: {
+        bool is_method = cache_get_u8(reader);
+        Scope *scope = cache_module_scope(env, staging, module_name, cache_get_string(reader));
+        const Symbol *callee = NULL;
+
+        if (is_method) {
+            String *receiver_name = string_from_ref(&env->strings, cache_get_string(reader));
+            String *name = string_from_ref(&env->strings, cache_get_string(reader));
+            const Type *receiver = scope ? scope_type_lookup(scope, receiver_name) : NULL;
+
+            callee = receiver ? type_find_method(receiver, name) : NULL;
+        } else {
+            String *name = string_from_ref(&env->strings, cache_get_string(reader));
+
+            callee = scope ? scope_symbol_lookup(scope, name) : NULL;
+        }
+
+        if (reader->failed || !callee || callee->kind != SYMBOL_FUNC) {
+            return false;
+        }
+
+        // Already absolute, as codegen would have left it: this VM's index.
+        OpCode op = VM_DECODE_OPCODE(instruction_list_get(&chunk->instructions, offset));
+        bool is_extern = op == OP_CALL_EXTERN;
+        size_t index = callee->func.func_index;
+
+        if (callee->func.is_extern != is_extern || index == SYMBOL_FUNC_NO_BODY ||
+            index > (is_extern ? VM_MAX_EXTERN_PROTOS : VM_MAX_PROTOTYPES)) {
+            return false;
+        }
+
+        cache_set_operand(chunk, offset, index);
+        return true;
+    }
+    }
+
+    return false;
+}
+
+static bool cache_read_body(CacheReader *reader, Environment *env, Unit *unit, Scope *staging,
+                            String *module_name, FuncPrototype *out) {
+    out->max_registers = (int)cache_get_u32(reader);
+
+    size_t ref_count = cache_get_count(reader, 4);
+    for (size_t i = 0; i < ref_count; i++) {
+        frame_ref_list_add(&out->refs, (FrameRef){.slot = cache_get_u32(reader)});
+    }
+
+    size_t instruction_count = cache_get_count(reader, 4);
+    for (size_t i = 0; i < instruction_count; i++) {
+        chunk_add_instruction(out->chunk, cache_get_u32(reader));
+    }
+
+    size_t constant_count = cache_get_count(reader, 4);
+    if (constant_count > out->chunk->const_pool->max_capacity) {
+        return false;
+    }
+
+    for (size_t i = 0; i < constant_count; i++) {
+        uint32_t bits = cache_get_u32(reader);
+        Constant constant;
+
+        memcpy(&constant, &bits, sizeof(constant));
+        constpool_add(out->chunk->const_pool, constant);
+    }
+
+    size_t reloc_count = cache_get_count(reader, 1 + 4);
+    for (size_t i = 0; i < reloc_count; i++) {
+        if (!cache_read_relocation(reader, env, unit, staging, module_name, out->chunk)) {
+            return false;
+        }
+    }
+
+    return !reader->failed;
+}
+
+bool unit_cache_fill(const UnitCache *cache, Environment *env, Unit *unit, Scope *staging,
+                     String *module_name, Diagnostics *diagnostics) {
+    CacheReader reader = {.at = cache->bodies, .end = cache->data + cache->size};
+    size_t count = cache_get_u32(&reader);
+
+    // Every body was jumped over by its span, so every prototype is a stub,
+    // in the order the cache wrote them.
+    bool fits = count == unit->prototypes.size && count == unit->deferred_count;
+
+    for (size_t i = 0; fits && i < count; i++) {
+        FuncPrototype *proto = unit->prototypes.data[i];
+        FuncPrototype body = {.chunk = chunk_create(), .refs = frame_ref_list_create()};
+
+        if (!proto->deferred || !cache_read_body(&reader, env, unit, staging, module_name, &body)) {
+            func_proto_free(&body);
+            fits = false;
+            break;
+        }
+
+        frame_ref_list_free(&proto->refs);
+        proto->chunk = body.chunk;
+        proto->max_registers = body.max_registers;
+        proto->refs = body.refs;
+        proto->deferred = NULL;
+
+        unit->deferred_count--;
+    }
+
+    if (!fits) {
+        diag_error(diagnostics, GAB_ERR_CODEGEN, (Span){0},
+                   "the unit cache does not fit this unit, or names what this VM has not loaded");
+    }
+
+    return fits;
+}
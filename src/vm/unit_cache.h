@@ -0,0 +1,106 @@
+#ifndef GAB_UNIT_CACHE_H
+#define GAB_UNIT_CACHE_H
+
+#include "arena.h"
+#include "diagnostics.h"
+#include "parser.h"
+#include "scope.h"
+#include "vm/link.h"
+#include "vm/vm.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    A unit's function bodies, compiled, in a form that outlives the VM that
+    compiled them: what a later process loads instead of lexing, parsing,
+    resolving and generating each body again.
+
+    Only the bodies are cached. The declarations are read from the source
+    each time -- with every body jumped over by the span the cache recorded,
+    so nothing of a body is lexed -- because declaring is what makes a unit's
+    names and types exist in this VM, and a declaration is cheap next to the
+    body it declares. A body's bytecode then fills the stub a lazy load would
+    have left for it (see DeferredBody), and the unit links as any other.
+
+    Nothing a body names by index is stored as one. A call to a function this
+    unit declares, or to one of its externs, is numbered within the unit as
+    codegen numbered it, and the load numbers the unit the same way; anything
+    else -- a string, a type, a channel, a function another unit declared --
+    is stored by what it is, and looked up in the loading VM.
+
+    A cache is rejected, never used, when it was compiled from other source,
+    or against another layout of any module it reads: the module it fills, as
+    it stood before the unit, and every module it imports. It is trusted as
+    far as that goes: the bytecode in it is run as the compiler's own would be.
+
+    Every integer is little-endian, whatever the machine.
+*/
+
+#define UNIT_CACHE_MAGIC 0x43424147u // "GABC"
+#define UNIT_CACHE_VERSION 1u
+
+// The bytes of a cache being written. 'data' is malloc'd and the caller's.
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} UnitCacheBuffer;
+
+// A cache as read back: its header checked and its spans laid out for the
+// parser, its bodies still bytes until unit_cache_fill reads them.
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+
+    uint64_t source_hash;
+
+    // The modules the unit's bytecode depends on the layout of, each with the
+    // fingerprint it had then. The first is the module the unit fills.
+    size_t module_count;
+    const uint8_t *modules;
+
+    ParserBodySpan *spans;
+    size_t body_count;
+    const uint8_t *bodies;
+} UnitCache;
+
+// What a cache is keyed on: a hash of the unit's source text.
+uint64_t unit_cache_hash_source(const char *source);
+
+// A hash of what a module declares, as the bytecode compiled against it can
+// see: every name, every signature, every struct's layout and methods. Equal
+// for equal declarations whichever order they were made in, and 0 for a
+// module that does not exist or declares nothing.
+uint64_t unit_cache_fingerprint(const Scope *scope);
+
+// Writes a unit codegen has just produced, before it links: every body in the
+// order of its prototypes, and the spans and fingerprints a load checks
+// against. 'staging' is the scope the unit declared into and 'target' the
+// module it fills; 'imported' the modules it imports. False only if out of
+// memory.
+bool unit_cache_write(Environment *env, const Unit *unit, const Scope *staging, const Scope *target,
+                      String *module_name, const StringList *imported, const ParserBodySpanList *spans,
+                      uint64_t source_hash, UnitCacheBuffer *out);
+
+// Reads a cache's header and spans, which are allocated from 'arena'. False,
+// with a diagnostic, for bytes that are not a cache this build can load, or
+// for a cache of other source.
+bool unit_cache_open(UnitCache *cache, Arena *arena, const void *data, size_t size, uint64_t source_hash,
+                     Diagnostics *diagnostics);
+
+// Whether every module the cache depends on is laid out as it was when the
+// cache was written. 'target' is the module the unit fills, which may be new.
+bool unit_cache_current(const UnitCache *cache, Environment *env, const Scope *target,
+                        Diagnostics *diagnostics);
+
+// Gives every deferred prototype of a unit just generated from the cached
+// spans the body the cache holds for it, leaving the unit as codegen would
+// have left it compiling the bodies itself. False, with a diagnostic, if the
+// cache names something this VM does not have or does not fit the unit.
+bool unit_cache_fill(const UnitCache *cache, Environment *env, Unit *unit, Scope *staging,
+                     String *module_name, Diagnostics *diagnostics);
+
+#endif
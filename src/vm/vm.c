@@ -13,6 +13,7 @@
 #include "vm/codegen.h"
 #include "vm/constant_pool.h"
 #include "vm/opcode.h"
+#include "vm/task.h"
 #include "vm/vm_dispatch.h"
 
 #include <assert.h>
@@ -23,16 +24,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #define ARENA_BLOCK_SIZE 2048
 
-// The stack never moves, so it is sized for the worst case up front: every
-// frame to the call-depth limit addressing every register it can name. That is
-// a few hundred kilobytes, and it is what makes '&local' sound — an address
-// into a buffer realloc could move would dangle, and untagged slots give the
-// VM no way to find live pointers and rebase them.
-#define VM_STACK_SIZE (VM_MAX_CALL_DEPTH * VM_MAX_REGISTERS)
-
 // The base must hold an 8-byte value at its natural alignment. malloc already
 // guarantees at least alignof(max_align_t), which covers this on every platform
 // with an 8-byte scalar type; the assertion fails the build anywhere it would not.
@@ -50,9 +45,22 @@ static void environment_init(Environment *env) {
     string_pool_init(&env->strings, env->arena);
 
     scope_init(&env->global_scope, env->arena, &env->strings, NULL);
-    env->module_scopes = module_scope_map_create_alloc(arena_allocator(env->arena), 8);
+    type_registry_make_reclaimable(env->global_scope.type_registry);
+
+    // On malloc, so that freeing a module gives its entries back.
+    env->module_scopes = module_scope_map_create(8);
+    env->modules = module_map_create(8);
 
     env->module_imports = module_import_list_create();
+    env->loaded_units = loaded_unit_list_create();
+    env->mapped_image = NULL;
+    env->mapped_size = 0;
+    env->code_regions = code_region_list_create();
+    env->modules_freed = false;
+    env->defer_bodies = false;
+    env->keep_sources = false;
+
+    pthread_mutex_init(&env->intern_lock, NULL);
 }
 
 static void environment_free(Environment *env) {
@@ -65,25 +73,55 @@ static void environment_free(Environment *env) {
     // arena holding the string payloads is destroyed.
     string_pool_free(&env->strings);
 
+    // The pointer types it interned point at structs in the arenas below, but
+    // are freed without being read.
+    type_registry_destroy(env->global_scope.type_registry);
+
+    for (size_t i = 0; i < env->modules->capacity; i++) {
+        for (ModuleMapEntry *entry = env->modules->buckets[i]; entry; entry = entry->next) {
+            arena_list_free(&entry->value->arenas);
+            source_mapping_list_free(&entry->value->sources);
+            code_list_free(&entry->value->code);
+            free(entry->value);
+        }
+    }
+
+    module_map_destroy(env->modules);
+
     arena_destroy(env->arena);
     arena_destroy(env->compile_arena);
+
+    loaded_unit_list_free(&env->loaded_units);
+
+    // Last: the program's chunks ran from it, and the sources the units were
+    // declared from are in it.
+    if (env->mapped_image) {
+        munmap(env->mapped_image, env->mapped_size);
+    }
+
+    code_region_list_free(&env->code_regions);
+
+    pthread_mutex_destroy(&env->intern_lock);
 }
 
 static void program_init(Program *program) {
     program->prototypes = func_proto_list_create();
     program->heap_types = type_list_create();
     program->strings = string_list_create();
+    program->channels = channel_list_create();
     program->top_levels = top_level_list_create();
     program->extern_bindings = extern_binding_list_create();
     program->extern_protos = extern_proto_list_create();
+    program->deferred_pending = 0;
 }
 
 // Frees only what the program allocated for itself. The prototypes and types it
-// indexes come from the environment's arena and go with it.
+// indexes come from their modules' arenas and go with them.
 static void program_free(Program *program) {
     func_proto_list_free(&program->prototypes);
     type_list_free(&program->heap_types);
     string_list_free(&program->strings);
+    channel_list_free(&program->channels);
     extern_binding_list_free(&program->extern_bindings);
     extern_proto_list_free(&program->extern_protos);
 
@@ -91,53 +129,66 @@ static void program_free(Program *program) {
     top_level_list_free(&program->top_levels);
 }
 
-// 's.len()'. Reads the count the receiver's header already carries.
-static void string_len(Args *args) { args_return_int(args, args_string(args, 0).length); }
-
-// The methods a builtin type answers, registered as an extern is: a Symbol in
-// the type's method map, and an entry in the table OP_CALL_EXTERN indexes. The
-// body is a GabExternFn because that is what a C body is here, whether the host
-// wrote it or the VM did.
-//
-// Registered rather than known to the compiler, so that adding one is an entry
-// here instead of a case in the resolver and another in codegen. It costs a
-// call where an instruction would do; nothing yet makes that worth a second
-// mechanism.
+// The methods a builtin type answers: a Symbol in the type's method map, found
+// by the same lookup a struct's methods are, so a call on one is checked like
+// any other method call.
 //
-// These land at the bottom of the extern table, before any unit loads. That
-// costs a unit's own externs nothing: the two tables are numbered apart, so a
-// script function's index is unaffected by how many builtins exist.
-static void register_builtin_method(VM *vm, Type *receiver, const char *name, GabExternFn body,
+// Each names the instruction that answers it rather than a body. A builtin
+// method is a question about a value the VM already lays out -- a string's
+// length is in its header -- and routing it through OP_CALL_EXTERN spent an
+// Args block and an indirect call to read one slot. The symbol therefore has
+// no entry in either table, and codegen emits the instruction wherever the
+// resolver tagged the call with it.
+static void register_builtin_method(VM *vm, Type *receiver, const char *name, Intrinsic intrinsic,
                                     Type *return_type) {
     Arena *arena = vm->env.arena;
 
     Symbol *symbol = arena_alloc(arena, sizeof(Symbol));
-    symbol->kind = SYMBOL_FUNC;
-    symbol->func.return_type = return_type;
-    symbol->func.param_count = 1;
-    symbol->func.params = arena_alloc(arena, sizeof(Type *));
-    symbol->func.is_extern = true;
-    symbol->func.name = string_from_cstr(&vm->env.strings, name);
-    symbol->func.module = NULL;
+    *symbol = (Symbol){
+        .kind = SYMBOL_FUNC,
+        .func =
+            {
+                .return_type = return_type,
+                .param_count = 1,
+                .params = arena_alloc(arena, sizeof(Type *)),
+                .func_index = SYMBOL_FUNC_NO_BODY,
+                .intrinsic = intrinsic,
+                .name = string_from_cstr(&vm->env.strings, name),
+            },
+    };
 
     // The receiver is parameter zero, by value: a string is a header that
     // copies, and a method that only reads it wants no indirection.
     symbol->func.params[0] = receiver;
 
-    symbol->func.func_index = vm->program.extern_protos.size;
-
-    extern_proto_list_add(&vm->program.extern_protos, (ExternProto){.body = body, .symbol = symbol});
-
-    type_add_method(arena, receiver, string_from_cstr(&vm->env.strings, name), symbol);
+    type_add_method(arena, receiver, symbol->func.name, symbol);
 }
 
 static void register_builtin_methods(VM *vm) {
     TypeRegistry *registry = vm->env.global_scope.type_registry;
 
-    register_builtin_method(vm, registry->builtins.string_type, "len", string_len,
+    register_builtin_method(vm, registry->builtins.string_type, "len", INTRINSIC_LEN,
                             registry->builtins.int_type);
 }
 
+// The execution state a VM and a context each have their own of.
+static void vm_init_machine(VM *vm) {
+    vm->stack_capacity = VM_STACK_SIZE;
+    vm->stack = calloc(vm->stack_capacity, VM_SLOT_SIZE);
+    vm->registers = vm->stack;
+    vm->frame_count = 0;
+    vm->frame_floor = 0;
+    vm->running_extern = NULL;
+    vm->running_extern_base = 0;
+    vm->in_coroutine = false;
+    vm->suspended = false;
+    vm->instruction_pointer = 0;
+    vm->error = (VmError){.status = VM_RUN_OK};
+    vm->channels = NULL;
+    vm->channel_capacity = 0;
+    vm->channels_from = NULL;
+}
+
 VM *vm_create() {
     VM *vm = malloc(sizeof(VM));
 
@@ -146,26 +197,149 @@ VM *vm_create() {
 
     vm->func_handles = func_handle_list_create();
 
-    vm->stack_capacity = VM_STACK_SIZE;
-    vm->stack = calloc(vm->stack_capacity, VM_SLOT_SIZE);
-    vm->registers = vm->stack;
-    vm->frame_count = 0;
-    vm->instruction_pointer = 0;
-    vm->error = (VmError){.status = VM_RUN_OK};
+    vm->image = &vm->program;
+    vm->owner = NULL;
+    vm->context_count = 0;
+    vm->live_coroutines = 0;
+    vm->pending_load = NULL;
+    vm->tasks = NULL;
+    atomic_init(&vm->live_tasks, 0);
+    vm->is_worker = false;
+
+    vm_init_machine(vm);
 
-    // After the program exists: a method's entry goes in its table.
     register_builtin_methods(vm);
 
     return vm;
 }
 
+// A context, counted by its owner or not. See VM::is_worker.
+static VM *vm_create_shared(VM *owner, bool is_worker) {
+    VM *vm = malloc(sizeof(VM));
+
+    if (!vm) {
+        return NULL;
+    }
+
+    // Nothing compiles into a context, so there is no environment or program
+    // to set up -- zeroed, so a stray read of either finds empty tables rather
+    // than garbage.
+    memset(&vm->env, 0, sizeof(vm->env));
+    memset(&vm->program, 0, sizeof(vm->program));
+
+    vm->func_handles = func_handle_list_create();
+
+    vm->image = &owner->program;
+    vm->owner = owner;
+    vm->context_count = 0;
+    vm->live_coroutines = 0;
+    vm->pending_load = NULL;
+    vm->tasks = NULL;
+    atomic_init(&vm->live_tasks, 0);
+    vm->is_worker = is_worker;
+
+    if (!is_worker) {
+        owner->context_count++;
+    }
+
+    vm_init_machine(vm);
+
+    return vm;
+}
+
+VM *vm_create_context(VM *owner) { return vm_create_shared(owner, false); }
+
+VM *vm_create_worker(VM *owner) { return vm_create_shared(owner, true); }
+
+bool vm_call_nested(const VM *vm) { return vm->frame_count > 0 || vm->running_extern; }
+
+size_t vm_call_base(const VM *vm) {
+    if (!vm_call_nested(vm)) {
+        // The call block goes above anything a module run left in frame zero, so
+        // a host call never overwrites top-level state it might want to read
+        // after.
+        return (vm->stack_capacity / 2) * VM_SLOT_SIZE;
+    }
+
+    // Nested: above the topmost frame's registers, which hold the block of an
+    // extern that frame called, and above the running extern's own block for
+    // when the host called that extern directly and there is no frame.
+    size_t top = 0;
+
+    if (vm->frame_count > 0) {
+        const CallFrame *frame = &vm->frames[vm->frame_count - 1];
+        top = frame->base + frame->proto->max_registers * VM_SLOT_SIZE;
+    }
+
+    const ExternProto *proto = vm->running_extern;
+
+    if (proto) {
+        const Symbol *symbol = proto->symbol;
+        size_t end = VM_SLOT_SIZE * args_type_slots(symbol->func.return_type);
+
+        if (symbol->func.param_count > 0) {
+            size_t last = symbol->func.param_count - 1;
+            size_t params_end =
+                proto->param_offsets[last] + VM_SLOT_SIZE * args_type_slots(symbol->func.params[last]);
+
+            end = params_end > end ? params_end : end;
+        }
+
+        top = vm->running_extern_base + end > top ? vm->running_extern_base + end : top;
+    }
+
+    // Kept on an 8-byte boundary, as every frame base is, so a pointer
+    // parameter sits at its natural alignment.
+    return (top + 7) & ~(size_t)7;
+}
+
+uint8_t *vm_stack_map(size_t slots) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    // Where the system overcommits anyway this only says so; where it does not,
+    // it keeps a deep reservation from being charged up front.
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+
+    void *stack = mmap(NULL, slots * VM_SLOT_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+    return stack == MAP_FAILED ? NULL : stack;
+}
+
+void vm_stack_unmap(uint8_t *stack, size_t slots) {
+    if (stack) {
+        munmap(stack, slots * VM_SLOT_SIZE);
+    }
+}
+
 void vm_free(VM *vm) {
     // The handles themselves are gab.c's to free, and gab_vm_free has done so
     // by now; this releases only the array that tracked them.
     func_handle_list_free(&vm->func_handles);
 
+    // The channels themselves are the host's, attached rather than given.
+    free(vm->channels);
+
+    if (vm->owner) {
+        if (!vm->is_worker) {
+            assert(vm->owner->context_count > 0 && "a context is counted by its owner");
+            vm->owner->context_count--;
+        }
+
+        free(vm->stack);
+        free(vm);
+        return;
+    }
+
+    assert(vm->context_count == 0 && "every context is freed before the VM it shares");
+    assert(!vm->pending_load && "a pending load is abandoned before the VM it compiles against");
+
+    // Its threads run on contexts of this VM, so they stop before it goes.
+    task_pool_destroy(vm->tasks);
+
     // Program before environment: what a prototype allocated is freed here,
-    // and the prototype itself lives in the environment's arena.
+    // and the prototype itself lives in its module's arena.
     program_free(&vm->program);
     environment_free(&vm->env);
 
@@ -173,6 +347,130 @@ void vm_free(VM *vm) {
     free(vm);
 }
 
+// Whether 'ptr' is in memory already mapped read-only: a restored image, or
+// a region an earlier compaction filled. Compared as integers, as arena_owns
+// does.
+static bool vm_code_read_only(const Environment *env, const void *ptr) {
+    uintptr_t address = (uintptr_t)ptr;
+    uintptr_t image = (uintptr_t)env->mapped_image;
+
+    if (env->mapped_image && address >= image && address < image + env->mapped_size) {
+        return true;
+    }
+
+    for (size_t i = 0; i < env->code_regions.size; i++) {
+        uintptr_t start = (uintptr_t)env->code_regions.data[i].data;
+
+        if (address >= start && address < start + env->code_regions.data[i].size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// The chunks a compaction moves: every one a prototype owns, and every one
+// borrowed from the code a unit was packed into as it linked. One a restored
+// image or an earlier compaction lent is where it belongs already, and a body
+// still deferred has none.
+static bool vm_compact_moves(const VM *vm, const FuncPrototype *proto) {
+    return proto && proto->chunk &&
+           (!proto->chunk->borrowed || !vm_code_read_only(&vm->env, proto->chunk->instructions.data));
+}
+
+// What each unit was packed into as it linked, once nothing borrows from it.
+static void vm_compact_free_unit_code(VM *vm) {
+    for (size_t i = 0; i < vm->env.modules->capacity; i++) {
+        for (ModuleMapEntry *entry = vm->env.modules->buckets[i]; entry; entry = entry->next) {
+            code_list_free(&entry->value->code);
+            entry->value->code = code_list_create();
+        }
+    }
+}
+
+// Anonymous pages rather than one more allocation, so that they can be made
+// read-only once filled: a stray write into code is then a fault at the write
+// and not a wrong answer later. A region that cannot be had leaves every
+// chunk where it is, which is only a compaction not done.
+//
+// Laid out by call affinity across the whole program, where a link could only
+// order the unit it linked. See link_call_order.
+static void vm_compact_chunks(VM *vm) {
+    FuncProtoList *prototypes = &vm->program.prototypes;
+    size_t size = 0;
+
+    for (size_t i = 0; i < prototypes->size; i++) {
+        if (vm_compact_moves(vm, prototypes->data[i])) {
+            size += chunk_footprint(prototypes->data[i]->chunk);
+        }
+    }
+
+    // Nothing borrows from a unit's packed code any more: every body in it
+    // has been reloaded since.
+    if (size == 0) {
+        vm_compact_free_unit_code(vm);
+        return;
+    }
+
+    size_t *order = malloc(prototypes->size * sizeof(size_t));
+    void *data = order ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                       : MAP_FAILED;
+
+    if (data == MAP_FAILED) {
+        free(order);
+        return;
+    }
+
+    link_call_order(prototypes->data, prototypes->size, 0, order);
+
+    uint8_t *next = data;
+
+    for (size_t i = 0; i < prototypes->size; i++) {
+        FuncPrototype *proto = prototypes->data[order[i]];
+
+        if (vm_compact_moves(vm, proto)) {
+            size_t footprint = chunk_footprint(proto->chunk);
+
+            chunk_move_into(proto->chunk, next);
+            next += footprint;
+        }
+    }
+
+    free(order);
+
+    mprotect(data, size, PROT_READ);
+    code_region_list_add(&vm->env.code_regions, (CodeRegion){.data = data, .size = size});
+
+    vm_compact_free_unit_code(vm);
+}
+
+void vm_compact(VM *vm) {
+    assert(!vm->owner && vm->context_count == 0 && vm->live_coroutines == 0 && !vm_call_nested(vm) &&
+           "a compaction moves the code a frame could be running");
+
+    Program *program = &vm->program;
+
+    // Each ran once, as its unit loaded, and nothing can reach one again.
+    top_level_list_free(&program->top_levels);
+    program->top_levels = top_level_list_create();
+
+    vm_compact_chunks(vm);
+
+    for (size_t i = 0; i < program->prototypes.size; i++) {
+        if (program->prototypes.data[i]) {
+            frame_ref_list_shrink(&program->prototypes.data[i]->refs);
+        }
+    }
+
+    func_proto_list_shrink(&program->prototypes);
+    extern_proto_list_shrink(&program->extern_protos);
+    type_list_shrink(&program->heap_types);
+    string_list_shrink(&program->strings);
+    channel_list_shrink(&program->channels);
+    extern_binding_list_shrink(&program->extern_bindings);
+    code_region_list_shrink(&vm->env.code_regions);
+}
+
 // The scope a module's declarations live in, created on first mention. A
 // module accumulates across compiles, so a second unit naming the same module
 // gets the scope the first one filled rather than a fresh one.
@@ -187,10 +485,110 @@ Scope *environment_module_scope(Environment *env, String *name) {
         return *existing;
     }
 
-    Scope *scope = arena_alloc(env->arena, sizeof(Scope));
-    scope_init_module(scope, env->arena, &env->strings, &env->global_scope);
+    Arena *arena = arena_create(ARENA_BLOCK_SIZE);
+
+    Scope *scope = arena_alloc(arena, sizeof(Scope));
+    scope_init_module(scope, arena, &env->strings, &env->global_scope);
 
     module_scope_map_insert(env->module_scopes, name, scope);
+    environment_module_adopt(env, name, arena);
 
     return scope;
 }
+
+Module *environment_module(const Environment *env, String *name) {
+    Module **module = module_map_lookup(env->modules, name);
+
+    return module ? *module : NULL;
+}
+
+void environment_module_adopt(Environment *env, String *name, Arena *arena) {
+    Module *module = environment_module(env, name);
+
+    if (!module) {
+        module = malloc(sizeof(Module));
+
+        if (!module) {
+            fprintf(stderr, "gab: out of memory recording a module\n");
+            abort();
+        }
+
+        *module = (Module){
+            .arenas = arena_list_create(),
+            .sources = source_mapping_list_create(),
+            .code = code_list_create(),
+        };
+        module_map_insert(env->modules, name, module);
+    }
+
+    arena_list_add(&module->arenas, arena);
+}
+
+bool environment_module_owns(const Environment *env, String *name, const void *ptr) {
+    const Module *module = environment_module(env, name);
+
+    for (size_t i = 0; module && i < module->arenas.size; i++) {
+        if (arena_owns(module->arenas.data[i], ptr)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void environment_module_adopt_source(Environment *env, String *name, SourceMapping mapping) {
+    source_mapping_list_add(&environment_module(env, name)->sources, mapping);
+}
+
+void environment_module_adopt_code(Environment *env, String *name, void *code) {
+    code_list_add(&environment_module(env, name)->code, code);
+}
+
+void environment_module_drop(Environment *env, String *name) {
+    Module *module = environment_module(env, name);
+
+    module_scope_map_delete(env->module_scopes, name);
+    module_map_delete(env->modules, name);
+
+    arena_list_free(&module->arenas);
+    source_mapping_list_free(&module->sources);
+    code_list_free(&module->code);
+    free(module);
+}
+
+void code_region_free(CodeRegion region) { munmap(region.data, region.size); }
+
+// An empty file maps nothing, and has nothing to unmap.
+void source_mapping_free(SourceMapping mapping) {
+    if (mapping.data) {
+        munmap(mapping.data, mapping.size);
+    }
+}
+
+// By name first, which is one lookup per module: a module declares a type
+// under one name, so only the module holding this Type under its own name can
+// be the one that declared it.
+String *environment_type_module(const Environment *env, const Type *type) {
+    if (type->kind != TYPE_STRUCT) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < env->module_scopes->capacity; i++) {
+        for (ModuleScopeMapEntry *entry = env->module_scopes->buckets[i]; entry; entry = entry->next) {
+            TypeBinding *binding = type_map_lookup(entry->value->types, type->name);
+
+            if (binding && binding->type == type) {
+                return entry->key;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void environment_share_interning(Environment *env, bool shared) {
+    pthread_mutex_t *lock = shared ? &env->intern_lock : NULL;
+
+    env->strings.lock = lock;
+    env->global_scope.type_registry->lock = lock;
+}
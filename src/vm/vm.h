@@ -11,11 +11,23 @@
 #include "vm/link.h"
 #include "vm/opcode.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
 #define VM_MAX_CALL_DEPTH 256
 
+// The stack never moves, so it is sized for the worst case up front: every
+// frame to the call-depth limit addressing every register it can name. That is
+// a few hundred kilobytes, and it is what makes '&local' sound — an address
+// into a buffer realloc could move would dangle, and untagged slots give the
+// VM no way to find live pointers and rebase them. A coroutine's stack is as
+// large for the same reason, but reserved rather than allocated; see
+// vm_stack_map.
+#define VM_STACK_SIZE (VM_MAX_CALL_DEPTH * VM_MAX_REGISTERS)
+
 typedef struct {
     const FuncPrototype *proto;
 
@@ -24,6 +36,11 @@ typedef struct {
     // Byte offset into the stack, not a slot index.
     size_t base;
     unsigned int dest;
+
+    // The lowest slot an unwind releases. Zero but for a 'parallel for'
+    // chunk, whose registers below this are a copy of another frame's and
+    // own nothing.
+    unsigned int refs_from;
 } CallFrame;
 
 // Every GabFunc this VM has handed out. A handle points into the VM's arena, so
@@ -51,6 +68,83 @@ GAB_LIST(ModuleImportList, module_import_list, ModuleImport)
 
 // StringList comes from link.h, which the program's literal table also uses.
 
+// Arenas a compile allocated what it declared from. Kept whole rather than
+// merged into another: a hash map built in one holds the arena as its
+// allocator, and grows from it again when a later unit declares into the same
+// module.
+#define arena_list_item_free(item) arena_destroy(item)
+GAB_LIST(ArenaList, arena_list, Arena *)
+
+// A source file mapped read-only, which a unit loaded from it is lexed from
+// and keeps as its source rather than a copy. See gab_load_file.
+typedef struct {
+    void *data;
+    size_t size;
+} SourceMapping;
+
+void source_mapping_free(SourceMapping mapping);
+
+#define source_mapping_list_item_free(item) source_mapping_free(item)
+GAB_LIST(SourceMappingList, source_mapping_list, SourceMapping)
+
+// Where vm_compact packed the code and constants of the chunks it found, each
+// region mapped read-only once filled. Kept until the VM goes: a chunk in one
+// may be freed with its module or replaced by a reload, but the region is
+// shared with the rest and is not.
+typedef struct {
+    void *data;
+    size_t size;
+} CodeRegion;
+
+void code_region_free(CodeRegion region);
+
+#define code_region_list_item_free(item) code_region_free(item)
+GAB_LIST(CodeRegionList, code_region_list, CodeRegion)
+
+// The allocations link_install packed each unit's code into, which the
+// unit's chunks borrow. See Unit::code.
+#define code_list_item_free(item) free(item)
+GAB_LIST(CodeList, code_list, void *)
+
+// What one module's lifetime is made of: every arena something it declared
+// came from, the files its units were read from, the code its units compiled
+// to, and the owner of the strings only it has asked for. Freed whole by gab_module_free, and by nothing else
+// before the VM goes.
+//
+// The first arena is the module's own, which its scope and the scope's maps
+// are allocated from; after it, the arena of each compile that linked into
+// the module, adopted as the compile finished.
+typedef struct {
+    ArenaList arenas;
+    SourceMappingList sources;
+    CodeList code;
+    StringOwner strings;
+} Module;
+
+#define module_map_hash(key) (size_t)key
+#define module_map_key_equals(key, other) key == other
+#define module_map_key_dup(key) key
+#define module_map_entry_free(key, value)
+
+GAB_HASH_MAP(ModuleMap, module_map, String *, Module *)
+
+// A unit as it linked: the name its diagnostics carried and its source, kept
+// where its declarations are, for as long. In the order the units linked, which
+// is the order a VM image declares them again in. See image.h.
+//
+// The source is 'source_length' bytes and need not be terminated: a unit
+// loaded from a file keeps the file's mapping. NULL for a unit that linked
+// without Environment::keep_sources and had no copy of its own to keep.
+typedef struct {
+    String *module;
+    const char *name;
+    const char *source;
+    size_t source_length;
+} LoadedUnit;
+
+#define loaded_unit_list_item_free(item) ((void)(item))
+GAB_LIST(LoadedUnitList, loaded_unit_list, LoadedUnit)
+
 // Why a run stopped. A run that completed normally leaves VM_RUN_OK; anything
 // else means the interpreter unwound early, and the frames are already gone.
 typedef enum {
@@ -64,6 +158,22 @@ typedef enum {
     // An 'extern' function reported failure, or none was ever bound to the
     // prototype a call named.
     VM_RUN_ERR_EXTERN,
+
+    // A 'yield' ran in a function called as an ordinary call rather than
+    // resumed as a coroutine, so there was nothing to suspend.
+    VM_RUN_ERR_YIELD,
+
+    // A joined task failed, which the join reports with the task's own reason;
+    // or a task was joined a second time.
+    VM_RUN_ERR_TASK,
+
+    // A 'send' or 'receive' named a channel the host never attached to the
+    // VM running it.
+    VM_RUN_ERR_CHANNEL,
+
+    // A call reached a function whose deferred body does not compile, which a
+    // lazy load only finds out then. See Environment::defer_bodies.
+    VM_RUN_ERR_COMPILE,
 } VmRunStatus;
 
 // The interpreter's failure channel. A run cannot report through a return value
@@ -82,21 +192,22 @@ typedef struct {
 
 // Arenas are named for what owns them, and the rule that follows from that is
 // the whole lifetime model: allocate from the arena of the thing that will own
-// the result. A Type published into the registry is owned by the VM; an AST
-// node is owned by the compile that built it.
+// the result. A builtin Type is owned by the VM; an AST node is owned by the
+// compile that built it.
 //
-// A third, module-scoped lifetime belongs between these two — long enough to
-// outlive a compile, short enough to be freed by gab_module_free. It does not
-// exist yet because every compile shares one global scope and type registry,
-// so a module's types are reachable from the next module and freeing them
-// would dangle. It becomes real alongside per-module scopes.
+// A module's lifetime sits between these two -- long enough to outlive a
+// compile, short enough to be freed by gab_module_free. What a module
+// declares, its types, symbols and prototypes, is owned by it and allocated
+// from its arenas; see Module. Another module reaches those only by importing
+// it, so one that nothing imports can be freed without leaving a dangling
+// pointer behind in any other.
 //
 // The compile-time world a unit resolves against: every name that exists, the
 // scopes they live in, and which module may see which. A run never reads any of
 // it -- what a run needs, codegen has already turned into an index.
 typedef struct {
-    // Lives until vm_free: interned strings, global symbols, and every Type.
-    // Also backs the prototypes in Program, which is why neither outlives this.
+    // Lives until vm_free: the builtins, and the strings interned outside a
+    // module's compile.
     Arena *arena;
 
     // Reset at the start of every compile: the AST, diagnostics, and the scopes
@@ -112,27 +223,120 @@ typedef struct {
     // anywhere and the type registry is shared.
     Scope global_scope;
 
-    // One scope per declared module name, created on first use and living as
-    // long as the VM. A module accumulates across compiles: a second unit
-    // naming the same module compiles against the scope the first one filled.
+    // One scope per declared module name, created on first use and living
+    // until the module is freed. A module accumulates across compiles: a
+    // second unit naming the same module compiles against the scope the first
+    // one filled.
     ModuleScopeMap *module_scopes;
 
+    // What each of those modules' lifetime is made of, by the same name. See
+    // Module.
+    ModuleMap *modules;
+
     // Which module imports which. See ModuleImport.
     ModuleImportList module_imports;
+
+    // Every unit that has linked. See LoadedUnit.
+    LoadedUnitList loaded_units;
+
+    // The VM image this environment was restored from, mapped read-only: the
+    // bytecode of every function it held is run from here rather than copied,
+    // so processes restored from one image share its pages. NULL for a VM
+    // that was not. See image.h.
+    void *mapped_image;
+    size_t mapped_size;
+
+    // Every region vm_compact has packed chunks into. See CodeRegion.
+    CodeRegionList code_regions;
+
+    // Whether a module has been freed. Its slots in the program's tables are
+    // emptied and may be filled again by later units, so the tables no longer
+    // follow the order the remaining units linked in, which a VM image needs.
+    bool modules_freed;
+
+    // Whether a unit loaded from now on has its function bodies parsed,
+    // resolved and compiled only when first reached. See DeferredBody.
+    bool defer_bodies;
+
+    // Whether a unit linked from now on keeps a copy of its source, which a
+    // snapshot writes and a reload compares against. See LoadedUnit.
+    bool keep_sources;
+
+    // What the string pool and the type registry take while a batch of units
+    // compiles on several threads. One lock for both, since both allocate from
+    // 'arena'. See environment_share_interning.
+    pthread_mutex_t intern_lock;
 } Environment;
 
 // The machine: a stack, a frame array, and where in the bytecode it is. Holds
-// the Environment and Program by value for now, because one arena backs all
-// three and vm_free is the single lifetime -- but the interpreter reads only
-// 'program', so what it takes to run is already separable from what it took to
-// compile.
+// the Environment and Program by value, because one arena backs all three and
+// vm_free is the single lifetime -- but the interpreter reads only 'image', so
+// what it takes to run is separable from what it took to compile.
+//
+// A context is that separation made real: a VM of its own stack, frames and
+// error whose image is another VM's program, so N threads run one compiled
+// program on N contexts without compiling it N times. Its own env and program
+// are empty and never read.
 typedef struct VM {
     Environment env;
     Program program;
 
+    // The program a run indexes into: &program for a VM, the owner's for a
+    // context. Never written through once a load has installed into it.
+    const Program *image;
+
+    // The VM a context was made from, or NULL for a VM itself.
+    struct VM *owner;
+
+    // How many contexts share this VM's program. A load grows the program's
+    // tables, which may move them under a run on another thread, so loading is
+    // refused while any context exists.
+    size_t context_count;
+
+    // How many coroutines made from this VM have begun a call that has not
+    // ended. Each holds frames that name a prototype and an offset into its
+    // chunk, so a reload, which replaces chunks, waits until there are none.
+    size_t live_coroutines;
+
+    // A unit compiling on another thread, begun by gab_load_async and not yet
+    // finished, or NULL. Nothing else loads while there is one: its compile
+    // reads the environment as it stood when the load began, and only stays a
+    // consistent snapshot for as long as nothing writes to it.
+    struct CompileAsync *pending_load;
+
+    // The threads 'spawn' runs tasks on, started by the first spawn and shared
+    // by every context of this VM. NULL until then, and always on a context,
+    // which spawns into its owner's. See task.h.
+    struct TaskPool *_Atomic tasks;
+
+    // How many tasks spawned on this VM or any of its contexts have not yet
+    // been joined or discarded. Always the owner's, and atomic, as a task
+    // spawning another counts here from a worker's thread. A run that spawns
+    // joins before it returns, but a coroutine can yield in between, handing
+    // the host back a VM whose tables and channels a worker is still reading;
+    // loading and attaching wait until there are none.
+    atomic_size_t live_tasks;
+
+    // A context the task pool made to run tasks on. Not counted in the
+    // owner's context_count: a worker only runs while a task is live, and
+    // VM::live_tasks already keeps loads out for that long.
+    bool is_worker;
+
     // The handles this VM has handed out. See FuncHandleList.
     FuncHandleList func_handles;
 
+    // What the host attached to each of the program's channels, by the index
+    // OP_SEND and OP_RECEIVE carry, for runs on this VM. NULL where nothing
+    // is. Each VM and context has its own, so a shard's 'inbox' is its own
+    // queue though every shard runs the same program.
+    struct GabChannel **channels;
+    size_t channel_capacity;
+
+    // Whose channels a run here uses: NULL for this VM's own. Set by the task
+    // pool while one of its workers runs a task, which sends and receives on
+    // the channels of the VM that spawned it.
+    const struct VM *channels_from;
+
     // The stack is byte-addressed and 8-byte aligned at the base, so a value
     // wider than a slot can sit at its natural alignment. Capacity is still
     // counted in slots; a slot is VM_SLOT_SIZE bytes.
@@ -145,6 +349,25 @@ typedef struct VM {
     CallFrame frames[VM_MAX_CALL_DEPTH];
     size_t frame_count;
 
+    // The frame count the running loop stops at. Zero for a run the host
+    // started; for one started by an extern calling back into a script, the
+    // count when it began, so the loop returns into the extern and an unwind
+    // leaves the frames it is nested in alone.
+    size_t frame_floor;
+
+    // The extern body running right now, and its block's byte offset, or NULL.
+    // A call made from inside it builds its frame above both this block and the
+    // topmost frame -- a host calling an extern directly has no frame to be
+    // above, only the block.
+    const ExternProto *running_extern;
+    size_t running_extern_base;
+
+    // Whether the running loop was started by resuming a coroutine, which is
+    // the only run a 'yield' may suspend; and whether the last loop to stop
+    // stopped there, leaving its frames pushed rather than unwound.
+    bool in_coroutine;
+    bool suspended;
+
     // Signed, because a jump offset is: an index that went negative wraps to a
     // huge unsigned value, which reads as 'past the end' and would end the run
     // quietly instead of tripping a bound.
@@ -168,6 +391,9 @@ struct GabArgs {
     // Byte offset of the frame's slot 0, which is where the return value goes;
     // the arguments follow it, laid out exactly as a script callee's would be.
     size_t base;
+
+    // Where each parameter sits past base. See ExternProto::param_offsets.
+    const uint16_t *param_offsets;
 };
 
 // Where register r of the current frame begins, and where slot i of the stack
@@ -217,11 +443,88 @@ static inline void vm_write_ptr(VM *vm, size_t r, uint8_t *address) {
     memcpy(vm_reg_at(vm, r), &address, sizeof(address));
 }
 
+// The channel a run on this VM sends to or receives from as 'index', or NULL
+// when none is attached there.
+static inline struct GabChannel *vm_channel(const VM *vm, size_t index) {
+    const VM *source = vm->channels_from ? vm->channels_from : vm;
+
+    return index < source->channel_capacity ? source->channels[index] : NULL;
+}
+
 VM *vm_create();
+
+// A context over 'owner''s program, with a stack and frames of its own. Freed
+// with vm_free like a VM, before its owner is.
+VM *vm_create_context(VM *owner);
+
+// A context for one of the task pool's threads, which the owner does not count
+// and the pool frees with vm_free.
+VM *vm_create_worker(VM *owner);
+
+// Whether a run is in progress on this VM, which for a host means it is inside
+// an extern that run called.
+bool vm_call_nested(const VM *vm);
+
+// Where a call made from outside the bytecode -- by the host, or for a task --
+// bases its frame, in bytes into the stack: above everything a run in progress
+// is using, or at the middle of the stack when none is.
+size_t vm_call_base(const VM *vm);
+
+// A stack for a coroutine: 'slots' of address space, committed by the system
+// only as the coroutine's frames first touch it, so thousands of shallow
+// coroutines cost a page or two each rather than the whole reservation.
+// Zeroed, as every stack is. NULL when the space could not be reserved.
+uint8_t *vm_stack_map(size_t slots);
+void vm_stack_unmap(uint8_t *stack, size_t slots);
+
 void vm_free(VM *vm);
 
-// The scope holding a module's declarations, created on first mention and
-// living as long as the VM. NULL names the default module.
+// Gives back what loading left behind and running never needs again: every
+// unit's top level, which ran once, and the slack doubling left in each of the
+// program's tables. The code and constants of every chunk are moved into one
+// region, mapped read-only and ordered by call affinity across the program,
+// in place of the allocation each unit was packed into as it linked.
+//
+// Everything keeps its index and every prototype its chunk, so handles, the
+// bytecode that names them, and later loads are none the wiser. Only for a VM
+// nothing is running on, and no context or coroutine is sharing: a frame
+// points into the code it runs.
+void vm_compact(VM *vm);
+
+// The scope holding a module's declarations, created on first mention, with
+// the module's own arena, and living until the module is freed.
 Scope *environment_module_scope(Environment *env, String *name);
 
+// The module of that name, or NULL.
+Module *environment_module(const Environment *env, String *name);
+
+// Hands the arena a compile declared into the module from to the module, whose
+// lifetime it then has. Records the module if the compile is what created it.
+void environment_module_adopt(Environment *env, String *name, Arena *arena);
+
+// Whether 'ptr' was allocated from one of the module's arenas.
+bool environment_module_owns(const Environment *env, String *name, const void *ptr);
+
+// Hands a file a unit of the module was loaded from to the module, which
+// unmaps it when it goes.
+void environment_module_adopt_source(Environment *env, String *name, SourceMapping mapping);
+
+// Hands the code a unit of the module was packed into to the module, which
+// frees it when it goes.
+void environment_module_adopt_code(Environment *env, String *name, void *code);
+
+// Forgets the module and destroys its arenas and mappings. Whatever else
+// pointed into them must already be gone.
+void environment_module_drop(Environment *env, String *name);
+
+// The module that declared a struct, by its name there. NULL for a type no
+// module has, which is a builtin or one a compile is still staging.
+String *environment_type_module(const Environment *env, const Type *type);
+
+// Makes interning safe to call from several threads at once, or single-
+// threaded and lock-free again. Everything else a compile writes is the
+// compile's own, so this is the whole of what sharing the environment takes --
+// provided nothing but interning touches 'arena' while it is shared.
+void environment_share_interning(Environment *env, bool shared);
+
 #endif
@@ -68,13 +68,13 @@
         }                                                                                                    \
     } while (0)
 
-// Reads the instruction the pointer names, leaving the loop once it has run
-// past the frame's code. The pointer is signed, so a jump that went too far
+// Reads the instruction the pointer names, leaving the loop once its own frames
+// are gone or it has run past the frame's code. The pointer is signed, so a jump that went too far
 // back reads as negative here rather than as a huge index that would pass for
 // a normal end of function.
 #define VM_FETCH()                                                                                           \
     do {                                                                                                     \
-        if (vm->frame_count == 0 || vm->instruction_pointer < 0 ||                                           \
+        if (vm->frame_count == vm->frame_floor || vm->instruction_pointer < 0 ||                             \
             vm->instruction_pointer >= (ptrdiff_t)code_size) {                                               \
             goto vm_done;                                                                                    \
         }                                                                                                    \
@@ -167,6 +167,16 @@
         [OP_MODI] = &&OP_MODI_label,                                                                         \
         [OP_ITOF] = &&OP_ITOF_label,                                                                         \
         [OP_FTOI] = &&OP_FTOI_label,                                                                         \
+        [OP_STR_LEN] = &&OP_STR_LEN_label,                                                                   \
+        [OP_SQRTF] = &&OP_SQRTF_label,                                                                       \
+        [OP_ABSF] = &&OP_ABSF_label,                                                                         \
+        [OP_FLOORF] = &&OP_FLOORF_label,                                                                     \
+        [OP_CEILF] = &&OP_CEILF_label,                                                                       \
+        [OP_MINF] = &&OP_MINF_label,                                                                         \
+        [OP_MAXF] = &&OP_MAXF_label,                                                                         \
+        [OP_ABSI] = &&OP_ABSI_label,                                                                         \
+        [OP_MINI] = &&OP_MINI_label,                                                                         \
+        [OP_MAXI] = &&OP_MAXI_label,                                                                         \
         [OP_CMP_LTI] = &&OP_CMP_LTI_label,                                                                   \
         [OP_CMP_GTI] = &&OP_CMP_GTI_label,                                                                   \
         [OP_CMP_EQI] = &&OP_CMP_EQI_label,                                                                   \
@@ -198,6 +208,13 @@
         [OP_RELEASE] = &&OP_RELEASE_label,                                                                   \
         [OP_RETURN] = &&OP_RETURN_label,                                                                     \
         [OP_RETURN_N] = &&OP_RETURN_N_label,                                                                 \
+        [OP_YIELD] = &&OP_YIELD_label,                                                                       \
+        [OP_SPAWN] = &&OP_SPAWN_label,                                                                       \
+        [OP_JOIN] = &&OP_JOIN_label,                                                                         \
+        [OP_PARALLEL_FOR] = &&OP_PARALLEL_FOR_label,                                                         \
+        [OP_PARALLEL_END] = &&OP_PARALLEL_END_label,                                                         \
+        [OP_SEND] = &&OP_SEND_label,                                                                         \
+        [OP_RECEIVE] = &&OP_RECEIVE_label,                                                                   \
         [OP_LOAD_FIELD_1] = &&OP_LOAD_FIELD_1_label,                                                         \
         [OP_LOAD_FIELD_2] = &&OP_LOAD_FIELD_2_label,                                                         \
         [OP_LOAD_FIELD_4] = &&OP_LOAD_FIELD_4_label,                                                         \
@@ -112,12 +112,43 @@ static void test_reset_hands_back_the_same_space() {
     arena_destroy(arena);
 }
 
+// A rewind gives back only what came after the mark, across however many
+// blocks that spilled into, and keeps them for what comes next.
+static void test_rewind_keeps_what_came_before_the_mark() {
+    Arena *arena = arena_create(TEST_BLOCK_SIZE);
+
+    int *kept = arena_alloc(arena, sizeof(int));
+    *kept = 42;
+
+    ArenaMark mark = arena_mark(arena);
+    void *first = arena_alloc(arena, 16);
+
+    for (int i = 0; i < 8; i++) {
+        arena_alloc(arena, 32);
+    }
+
+    size_t blocks = block_count(arena);
+    arena_rewind(arena, mark);
+
+    assert(*kept == 42);
+    assert(arena_alloc(arena, 16) == first);
+
+    for (int i = 0; i < 8; i++) {
+        arena_alloc(arena, 32);
+    }
+
+    assert(block_count(arena) == blocks);
+
+    arena_destroy(arena);
+}
+
 int main(void) {
     test_allocations_are_aligned();
     test_allocation_larger_than_a_block();
     test_reset_reuses_blocks_instead_of_leaking_them();
     test_reset_then_allocate_larger_than_the_recycled_block();
     test_reset_hands_back_the_same_space();
+    test_rewind_keeps_what_came_before_the_mark();
 
     printf("All arena tests passed\n");
     return 0;
@@ -0,0 +1,174 @@
+// Calling a script through the header gab-bindgen generated from it. The header
+// is written at build time from bindgen/game.gab, so this file compiling at all
+// is the layout claim: every _Static_assert in it held against this compiler.
+#include "game_bindings.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *read_script(void) {
+    FILE *file = fopen(GAB_BINDGEN_SCRIPT, "rb");
+    assert(file);
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *source = malloc((size_t)length + 1);
+    assert(fread(source, 1, (size_t)length, file) == (size_t)length);
+    source[length] = '\0';
+
+    fclose(file);
+
+    return source;
+}
+
+static void roll(GabArgs *args) { gab_return_int(args, gab_arg_get_int(args, 0) - 1); }
+
+static GabVM *load_game(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "game", "roll", roll, &err));
+
+    char *source = read_script();
+    assert(gab_load(vm, "game.gab", source, &err));
+    free(source);
+
+    return vm;
+}
+
+// Each wrapper takes its parameters as C types and hands back the result the
+// same way: a borrow written through, a struct by value, bools widened into
+// the frame and narrowed back out.
+static void test_the_wrappers_call_the_script(void) {
+    GabVM *vm = load_game();
+
+    GabError err;
+    game_Bindings game;
+    assert(game_bind(&game, vm, &err));
+
+    Player player = {.health = 100, .alive = true, .stats = {.armor = 3, .speed = 1.5f}, .target = NULL};
+
+    int32_t health = 0;
+    assert(game_damage(&game, &player, 10, &health, &err) == GAB_OK);
+    assert(health == 93);
+    assert(player.health == 93);
+
+    float speed = 0.0f;
+    assert(game_speed_of(&game, &player, 0.25f, &speed, &err) == GAB_OK);
+    assert(speed == 1.75f);
+
+    bool either = true;
+    assert(game_either(&game, false, false, &either, &err) == GAB_OK);
+    assert(!either);
+    assert(game_either(&game, false, true, &either, &err) == GAB_OK);
+    assert(either);
+
+    // No arguments at all, and an extern underneath.
+    int32_t dice = 0;
+    assert(game_dice(&game, &dice, &err) == GAB_OK);
+    assert(dice == 6);
+
+    gab_vm_free(vm);
+}
+
+// The header only knows the script it was generated from. A VM that loaded an
+// edited one is refused at bind, naming what changed, before any wrapper runs.
+static void test_binding_refuses_a_changed_script(void) {
+    GabError err;
+
+    GabVM *vm = gab_vm_new();
+    assert(gab_load(vm, "<m>",
+                    "module game;\n"
+                    "struct Stats { armor: int, speed: float }\n"
+                    "struct Player { health: int, alive: bool, stats: Stats, target: *Player }\n"
+                    "func damage(p: ref Player, amount: float): int { return 0; }\n",
+                    &err));
+
+    game_Bindings game;
+    assert(!game_bind(&game, vm, &err));
+    assert(strstr(err.message, "damage"));
+
+    gab_vm_free(vm);
+
+    // A field moved is a layout the asserts compiled against no longer hold.
+    vm = gab_vm_new();
+    assert(gab_load(vm, "<m>",
+                    "module game;\n"
+                    "struct Stats { speed: float, armor: int }\n",
+                    &err));
+
+    assert(!game_bind(&game, vm, &err));
+    assert(strstr(err.message, "Stats"));
+
+    gab_vm_free(vm);
+}
+
+// The checked lookup is public, and spells a signature as a script writes one.
+static void test_a_signature_is_spelled_as_declared(void) {
+    GabVM *vm = load_game();
+
+    GabError err;
+    GabFunc *fn = gab_lookup(vm, "game", "damage", &err);
+
+    char signature[64];
+    assert(gab_func_signature(fn, signature, sizeof(signature)) == strlen("func(ref Player, int): int"));
+    assert(strcmp(signature, "func(ref Player, int): int") == 0);
+
+    // Truncated like snprintf, still reporting the whole length.
+    char short_buffer[8];
+    assert(gab_func_signature(fn, short_buffer, sizeof(short_buffer)) == strlen(signature));
+    assert(strcmp(short_buffer, "func(re") == 0);
+
+    assert(gab_lookup_typed(vm, "game", "damage", "func(ref Player, int): int", &err));
+    assert(!gab_lookup_typed(vm, "game", "damage", "func(ref Player, int)", &err));
+
+    gab_vm_free(vm);
+}
+
+// A signature has no bound on its length: eight borrows of a long-named struct
+// spell one past any buffer a lookup might have kept on its stack.
+static void test_a_long_signature_binds(void) {
+    static const char *const STRUCT = "AStructWhoseNameGoesOnForQuiteSomeTimeIndeed";
+
+    char source[1024];
+    char signature[512];
+    int at = snprintf(source, sizeof(source), "module wide;\nstruct %s { v: int }\nfunc sum(", STRUCT);
+    int spelled = snprintf(signature, sizeof(signature), "func(");
+
+    for (int i = 0; i < 8; i++) {
+        at += snprintf(source + at, sizeof(source) - (size_t)at, "%sp%d: ref %s", i ? ", " : "", i, STRUCT);
+        spelled += snprintf(signature + spelled, sizeof(signature) - (size_t)spelled, "%sref %s",
+                            i ? ", " : "", STRUCT);
+    }
+
+    snprintf(source + at, sizeof(source) - (size_t)at, "): int { return p0.v; }\n");
+    snprintf(signature + spelled, sizeof(signature) - (size_t)spelled, "): int");
+    assert(strlen(signature) > 256);
+
+    GabVM *vm = gab_vm_new();
+    GabError err;
+    assert(gab_load(vm, "wide.gab", source, &err));
+
+    assert(gab_lookup_typed(vm, "wide", "sum", signature, &err));
+
+    signature[strlen(signature) - 3] = '\0';
+    assert(!gab_lookup_typed(vm, "wide", "sum", signature, &err));
+    assert(strstr(err.message, "is declared as func("));
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_the_wrappers_call_the_script();
+    test_binding_refuses_a_changed_script();
+    test_a_signature_is_spelled_as_declared();
+    test_a_long_signature_binds();
+
+    printf("bindgen_test: all tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+// Channels: owned objects handed between scripts, hosts and threads without
+// copying. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const ORDER_SOURCE = "module t;\n"
+                                        "struct Order { id: int, qty: int }\n"
+                                        "struct Other { id: int }\n"
+                                        "extern channel outbox: *Order;\n"
+                                        "extern channel inbox: *Order;\n"
+                                        "func place(id: int): int {\n"
+                                        "    let o: *Order = new Order;\n"
+                                        "    o.id = id;\n"
+                                        "    o.qty = id * 2;\n"
+                                        "    send outbox, o;\n"
+                                        "    return id;\n"
+                                        "}\n"
+                                        "func place_many(from: int, to: int): int {\n"
+                                        "    for let i: int = from; i < to; i += 1 { place(i); }\n"
+                                        "    return to - from;\n"
+                                        "}\n"
+                                        "func fan_out(n: int): int {\n"
+                                        "    let a = spawn place_many(0, n);\n"
+                                        "    let b = spawn place_many(n, 2 * n);\n"
+                                        "    let c = spawn place_many(2 * n, 3 * n);\n"
+                                        "    let d = spawn place_many(3 * n, 4 * n);\n"
+                                        "    return join a + join b + join c + join d;\n"
+                                        "}\n"
+                                        "func drain(): int {\n"
+                                        "    let total: int = 0;\n"
+                                        "    let more: bool = true;\n"
+                                        "    for more {\n"
+                                        "        receive o from inbox { total += o.qty; } else { more = false; }\n"
+                                        "    }\n"
+                                        "    return total;\n"
+                                        "}\n"
+                                        "func forward(): int {\n"
+                                        "    let moved: int = 0;\n"
+                                        "    let more: bool = true;\n"
+                                        "    for more {\n"
+                                        "        receive o from inbox { o.qty += 1; send outbox, o; moved += 1; } else { more = false; }\n"
+                                        "    }\n"
+                                        "    return moved;\n"
+                                        "}\n";
+
+// Every function here takes its int arguments first; 'args' holds as many as
+// the function has.
+static GabStatus call_ints(GabVM *vm, const char *name, const int32_t *args, int32_t *out, GabError *err) {
+    GabFunc *fn = gab_lookup(vm, "t", name, err);
+    GabCall *call = gab_call_init(fn, err);
+    assert(call);
+
+    for (int i = 0; i < gab_func_arity(fn); i++) {
+        assert(gab_arg_int(call, i, args[i]));
+    }
+
+    GabStatus status = gab_call(vm, call, out, err);
+
+    gab_call_free(call);
+
+    return status;
+}
+
+static GabChannel *attached(GabVM *vm, const char *name) {
+    GabError err;
+    GabChannel *channel = gab_channel_new(gab_find_type(vm, "t", "Order"), &err);
+    assert(channel);
+    assert(gab_channel_attach(vm, "t", name, channel, &err));
+
+    return channel;
+}
+
+static int32_t field(GabVM *vm, void *object, const char *name) {
+    size_t offset = 0;
+    assert(gab_field_offset(gab_find_type(vm, "t", "Order"), name, &offset));
+
+    int32_t value;
+    memcpy(&value, (char *)object + offset, sizeof(value));
+
+    return value;
+}
+
+static void set_field(GabVM *vm, void *object, const char *name, int32_t value) {
+    size_t offset = 0;
+    assert(gab_field_offset(gab_find_type(vm, "t", "Order"), name, &offset));
+
+    memcpy((char *)object + offset, &value, sizeof(value));
+}
+
+// What a script sends, the host receives -- the same object, in order -- and
+// what the host sends, a script receives.
+static void test_objects_cross_between_script_and_host(void) {
+    GabVM *vm = test_load_vm(ORDER_SOURCE);
+    GabChannel *outbox = attached(vm, "outbox");
+    GabChannel *inbox = attached(vm, "inbox");
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(gab_channel_receive(outbox) == NULL);
+
+    for (int32_t i = 1; i <= 3; i++) {
+        assert(test_call_int(vm, "t", "place", i, &out, &err) == GAB_OK && out == i);
+    }
+
+    for (int32_t i = 1; i <= 3; i++) {
+        void *order = gab_channel_receive(outbox);
+        assert(order);
+        assert(field(vm, order, "id") == i && field(vm, order, "qty") == 2 * i);
+
+        gab_free(vm, order);
+    }
+
+    assert(gab_channel_receive(outbox) == NULL);
+
+    // Nothing to receive runs the other block, and owns nothing.
+    assert(call_ints(vm, "drain", NULL, &out, &err) == GAB_OK && out == 0);
+
+    const GabType *order_type = gab_find_type(vm, "t", "Order");
+
+    for (int32_t i = 0; i < 10; i++) {
+        void *order = gab_new(vm, order_type);
+        set_field(vm, order, "qty", i);
+        assert(gab_channel_send(inbox, order));
+    }
+
+    assert(call_ints(vm, "drain", NULL, &out, &err) == GAB_OK && out == 45);
+
+    // A script that receives may send what it received on: the object moves
+    // from one channel to the other and is never copied.
+    void *sent[4];
+
+    for (int32_t i = 0; i < 4; i++) {
+        sent[i] = gab_new(vm, order_type);
+        set_field(vm, sent[i], "qty", i * 10);
+        assert(gab_channel_send(inbox, sent[i]));
+    }
+
+    assert(call_ints(vm, "forward", NULL, &out, &err) == GAB_OK && out == 4);
+
+    for (int32_t i = 0; i < 4; i++) {
+        void *order = gab_channel_receive(outbox);
+        assert(order == sent[i]);
+        assert(field(vm, order, "qty") == i * 10 + 1);
+
+        gab_free(vm, order);
+    }
+
+    // Only an object of the channel's own type is taken.
+    void *other = gab_new(vm, gab_find_type(vm, "t", "Other"));
+    assert(!gab_channel_send(inbox, other));
+    assert(!gab_channel_send(inbox, NULL));
+    gab_free(vm, other);
+
+    // What is still queued is freed with the channel.
+    for (int32_t i = 0; i < 5; i++) {
+        assert(test_call_int(vm, "t", "place", i, &out, &err) == GAB_OK);
+    }
+
+    gab_channel_free(outbox);
+    gab_channel_free(inbox);
+    gab_vm_free(vm);
+}
+
+// Tasks spawned by a run send on the channels of the VM that spawned them.
+static void test_spawned_tasks_send(void) {
+    GabVM *vm = test_load_vm(ORDER_SOURCE);
+    GabChannel *outbox = attached(vm, "outbox");
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "fan_out", 250, &out, &err) == GAB_OK && out == 1000);
+
+    static bool seen[1000];
+    size_t received = 0;
+    void *order;
+
+    while ((order = gab_channel_receive(outbox))) {
+        int32_t id = field(vm, order, "id");
+        assert(id >= 0 && id < 1000 && !seen[id]);
+        seen[id] = true;
+        received++;
+
+        gab_free(vm, order);
+    }
+
+    assert(received == 1000);
+
+    gab_channel_free(outbox);
+    gab_vm_free(vm);
+}
+
+typedef struct {
+    GabVM *context;
+    int32_t count;
+    int32_t result;
+} Worker;
+
+static void *produce(void *arg) {
+    Worker *worker = arg;
+
+    GabError err;
+    int32_t range[] = {0, worker->count};
+    GabStatus status = call_ints(worker->context, "place_many", range, &worker->result, &err);
+    assert(status == GAB_OK);
+    (void)status;
+
+    return NULL;
+}
+
+static void *consume(void *arg) {
+    Worker *worker = arg;
+
+    GabError err;
+    GabCall *drain = gab_call_init(gab_lookup(worker->context, "t", "drain", &err), &err);
+    assert(drain);
+
+    // Receives never wait, so the consumer polls until it has seen as much as
+    // was sent.
+    int32_t expected = 2 * (worker->count - 1) * worker->count / 2;
+    int32_t total = 0;
+
+    while (total < expected) {
+        int32_t out = 0;
+        assert(gab_call(worker->context, drain, &out, &err) == GAB_OK);
+        total += out;
+    }
+
+    gab_call_free(drain);
+    worker->result = total;
+
+    return NULL;
+}
+
+// Two contexts of one VM, on two threads: one's outbox is the other's inbox.
+static void test_contexts_hand_objects_across_threads(void) {
+    GabVM *vm = test_load_vm(ORDER_SOURCE);
+
+    GabError err;
+    GabChannel *channel = gab_channel_new(gab_find_type(vm, "t", "Order"), &err);
+    assert(channel);
+
+    GabVM *producer_context = gab_context_new(vm, &err);
+    GabVM *consumer_context = gab_context_new(vm, &err);
+    assert(producer_context && consumer_context);
+
+    assert(gab_channel_attach(producer_context, "t", "outbox", channel, &err));
+    assert(gab_channel_attach(consumer_context, "t", "inbox", channel, &err));
+
+    Worker producer = {.context = producer_context, .count = 5000};
+    Worker consumer = {.context = consumer_context, .count = 5000};
+
+    pthread_t threads[2];
+    assert(pthread_create(&threads[0], NULL, consume, &consumer) == 0);
+    assert(pthread_create(&threads[1], NULL, produce, &producer) == 0);
+
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+
+    assert(producer.result == 5000);
+    assert(consumer.result == 4999 * 5000);
+    assert(gab_channel_receive(channel) == NULL);
+
+    gab_channel_free(channel);
+    gab_vm_free(producer_context);
+    gab_vm_free(consumer_context);
+    gab_vm_free(vm);
+}
+
+// A run that reaches a channel nobody attached fails there, and what it was
+// about to send is released rather than lost.
+static void test_an_unattached_channel_fails_the_run(void) {
+    GabVM *vm = test_load_vm(ORDER_SOURCE);
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "place", 1, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "not attached"));
+
+    // Attaching to a context gives the VM nothing.
+    GabVM *context = gab_context_new(vm, &err);
+    GabChannel *outbox = attached(context, "outbox");
+
+    assert(test_call_int(context, "t", "place", 2, &out, &err) == GAB_OK);
+    assert(test_call_int(vm, "t", "place", 2, &out, &err) == GAB_ERR_RUNTIME);
+
+    gab_free(vm, gab_channel_receive(outbox));
+
+    // Attaching is checked against the declaration.
+    GabChannel *wrong = gab_channel_new(gab_find_type(vm, "t", "Other"), &err);
+    assert(wrong);
+    assert(!gab_channel_attach(vm, "t", "outbox", wrong, &err));
+    assert(!gab_channel_attach(vm, "t", "place", outbox, &err));
+    assert(!gab_channel_attach(vm, "t", "missing", outbox, &err));
+    assert(!gab_channel_new(gab_find_type(vm, "t", "int"), &err));
+
+    gab_channel_free(outbox);
+    gab_channel_free(wrong);
+    gab_vm_free(context);
+    gab_vm_free(vm);
+}
+
+// What may be sent is settled when the script is loaded.
+static void test_sends_are_checked(void) {
+    static const char *const BAD[] = {
+        // A sent variable names nothing from there on.
+        "module t;\nstruct Order { id: int }\nextern channel c: *Order;\n"
+        "func f(): int { let o: *Order = new Order; send c, o; return o.id; }\n",
+        // Nor can what it was copied into be kept.
+        "module t;\nstruct Order { id: int }\nstruct Holder { o: ref Order }\nextern channel c: *Order;\n"
+        "func f(h: ref Holder) { let o: *Order = new Order; h.o = o; send c, o; }\n",
+        // An object of another type.
+        "module t;\nstruct Order { id: int }\nstruct Other { id: int }\nextern channel c: *Order;\n"
+        "func f() { let o: *Other = new Other; send c, o; }\n",
+        // A variable of an outer block, which a loop could send twice.
+        "module t;\nstruct Order { id: int }\nextern channel c: *Order;\n"
+        "func f(n: int) { let o: *Order = new Order; for let i: int = 0; i < n; i += 1 { send c, o; } }\n",
+        // A borrowed one, which was never the sender's to give.
+        "module t;\nstruct Order { id: int }\nextern channel c: *Order;\n"
+        "func f(o: ref Order) { send c, o; }\n",
+        // A channel is not a value.
+        "module t;\nstruct Order { id: int }\nextern channel c: *Order;\n"
+        "func f() { let d = c; }\n",
+        // Only an owned struct object travels.
+        "module t;\nextern channel c: int;\n",
+        // Nor is anything but a channel sent to.
+        "module t;\nstruct Order { id: int }\nfunc f() { let x: int = 1; let o: *Order = new Order; send x, o; }\n",
+    };
+
+    for (size_t i = 0; i < sizeof(BAD) / sizeof(BAD[0]); i++) {
+        GabVM *vm = gab_vm_new();
+
+        GabError err;
+        if (gab_load(vm, "<bad>", BAD[i], &err)) {
+            fprintf(stderr, "loaded: %s\n", BAD[i]);
+            assert(false);
+        }
+        assert(err.line > 0);
+
+        gab_vm_free(vm);
+    }
+}
+
+int main(void) {
+    test_objects_cross_between_script_and_host();
+    test_spawned_tasks_send();
+    test_contexts_hand_objects_across_threads();
+    test_an_unattached_channel_fails_the_run();
+    test_sends_are_checked();
+
+    printf("channel_test: all tests passed\n");
+
+    return 0;
+}
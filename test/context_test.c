@@ -0,0 +1,256 @@
+// Contexts: one compiled program, run from several stacks at once. Written
+// against gab.h alone, plus the threads a host would bring.
+#include "gab.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WORKERS 4
+#define CALLS_PER_WORKER 2000
+
+static const char *const WORK_SOURCE = "module work;\n"
+                                       "struct Tally { calls: int, sum: int }\n"
+                                       "func sum_to(n: int): int {\n"
+                                       "    let total: int = 0;\n"
+                                       "    for let i: int = 0; i < n; i = i + 1 { total = total + i; }\n"
+                                       "    return total;\n"
+                                       "}\n"
+                                       "func work(seed: int, tally: ref Tally): int {\n"
+                                       "    tally.calls = tally.calls + 1;\n"
+                                       "    tally.sum = tally.sum + seed;\n"
+                                       "    return seed * sum_to(100);\n"
+                                       "}\n";
+
+typedef struct {
+    int32_t calls;
+    int32_t sum;
+} Tally;
+
+typedef struct {
+    GabVM *context;
+    GabFunc *work;
+    const GabType *tally_type;
+    int32_t first_seed;
+
+    Tally tally;
+    int failures;
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *worker = arg;
+
+    GabError err;
+    GabCall *call = gab_call_init(worker->work, &err);
+    assert(call);
+
+    assert(gab_arg_pointer(call, 1, &worker->tally, worker->tally_type));
+
+    for (int32_t i = 0; i < CALLS_PER_WORKER; i++) {
+        int32_t seed = worker->first_seed + i;
+        assert(gab_arg_int(call, 0, seed));
+
+        int32_t out = 0;
+        if (gab_call(worker->context, call, &out, &err) != GAB_OK || out != seed * 4950) {
+            worker->failures++;
+        }
+    }
+
+    gab_call_free(call);
+
+    return NULL;
+}
+
+// Every worker calls the same function on its own context at the same time,
+// and each sees only its own arguments, locals and results.
+static void test_contexts_run_one_program_on_many_threads(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "work.gab", WORK_SOURCE, &err));
+
+    // Looked up once, on the VM, before any thread starts.
+    GabFunc *work = gab_lookup(vm, "work", "work", &err);
+    const GabType *tally_type = gab_find_type(vm, "work", "Tally");
+    assert(work && tally_type);
+
+    Worker workers[WORKERS];
+    pthread_t threads[WORKERS];
+
+    for (int i = 0; i < WORKERS; i++) {
+        workers[i] = (Worker){
+            .context = gab_context_new(vm, &err),
+            .work = work,
+            .tally_type = tally_type,
+            .first_seed = i * 10,
+        };
+        assert(workers[i].context);
+    }
+
+    for (int i = 0; i < WORKERS; i++) {
+        assert(pthread_create(&threads[i], NULL, run_worker, &workers[i]) == 0);
+    }
+
+    for (int i = 0; i < WORKERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    for (int i = 0; i < WORKERS; i++) {
+        assert(workers[i].failures == 0);
+        assert(workers[i].tally.calls == CALLS_PER_WORKER);
+
+        int32_t first = workers[i].first_seed;
+        int32_t last = first + CALLS_PER_WORKER - 1;
+        assert(workers[i].tally.sum == (first + last) * CALLS_PER_WORKER / 2);
+
+        gab_vm_free(workers[i].context);
+    }
+
+    gab_vm_free(vm);
+}
+
+static GabFunc *each_callback = NULL;
+
+// Calls back on whichever GabVM is running it, which on a context is the
+// context: the callback's frame goes on that stack, not the VM's.
+static void each(GabArgs *args) {
+    GabVM *running = gab_args_vm(args);
+
+    GabError err;
+    GabCall *call = gab_call_init(each_callback, &err);
+
+    int32_t total = 0;
+    for (int32_t i = 0; i < gab_arg_get_int(args, 0); i++) {
+        assert(gab_arg_int(call, 0, i));
+
+        int32_t out = 0;
+        assert(gab_call(running, call, &out, &err) == GAB_OK);
+        total += out;
+    }
+
+    gab_call_free(call);
+    gab_return_int(args, total);
+}
+
+static void test_an_extern_calls_back_on_its_context(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "cb", "each", each, &err));
+    assert(gab_load(vm, "<cb>",
+                    "module cb;\n"
+                    "extern func each(n: int): int;\n"
+                    "func double(i: int): int { return i * 2; }\n"
+                    "func run(n: int): int { let keep: int = n; return each(n) + keep; }\n",
+                    &err));
+
+    each_callback = gab_lookup(vm, "cb", "double", &err);
+
+    GabVM *context = gab_context_new(vm, &err);
+    assert(context);
+
+    // Looked up through the context, which answers from the VM's names.
+    GabFunc *run = gab_lookup(context, "cb", "run", &err);
+    assert(run);
+
+    GabCall *call = gab_call_init(run, &err);
+    assert(gab_arg_int(call, 0, 4));
+
+    int32_t out = 0;
+    assert(gab_call(context, call, &out, &err) == GAB_OK);
+    assert(out == (0 + 2 + 4 + 6) + 4);
+
+    gab_call_free(call);
+    gab_vm_free(context);
+    gab_vm_free(vm);
+}
+
+// The shared program does not change under a context: a load waits until the
+// last one is gone, and a context never loads or binds at all.
+static void test_loading_waits_for_every_context(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "work.gab", WORK_SOURCE, &err));
+
+    GabVM *context = gab_context_new(vm, &err);
+    GabVM *nested = gab_context_new(context, &err);
+    assert(context && nested);
+
+    assert(!gab_load(vm, "<more>", "module more;\n", &err));
+    assert(strstr(err.message, "context"));
+
+    assert(!gab_load(context, "<more>", "module more;\n", &err));
+    assert(!gab_extern(context, "more", "each", each, &err));
+
+    // A context made from a context shares the VM's program all the same.
+    Tally tally = {0};
+    GabCall *call = gab_call_init(gab_lookup(nested, "work", "work", &err), &err);
+    assert(gab_arg_int(call, 0, 2));
+    assert(gab_arg_pointer(call, 1, &tally, gab_find_type(nested, "work", "Tally")));
+
+    int32_t out = 0;
+    assert(gab_call(nested, call, &out, &err) == GAB_OK);
+    assert(out == 9900 && tally.calls == 1);
+
+    gab_call_free(call);
+
+    gab_vm_free(nested);
+    assert(!gab_load(vm, "<more>", "module more;\n", &err));
+
+    gab_vm_free(context);
+    assert(gab_load(vm, "<more>", "module more;\n", &err));
+
+    gab_vm_free(vm);
+}
+
+// Sessions cloned from a loaded template: each one calls straight away, keeps
+// its own state, and is gone without touching the template.
+static void test_a_clone_needs_no_load(void) {
+    GabVM *template_vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(template_vm, "work.gab", WORK_SOURCE, &err));
+
+    GabFunc *work = gab_lookup(template_vm, "work", "work", &err);
+    const GabType *tally_type = gab_find_type(template_vm, "work", "Tally");
+
+    for (int32_t session = 0; session < 64; session++) {
+        GabVM *clone = gab_vm_clone(template_vm, &err);
+        assert(clone);
+
+        Tally tally = {0};
+        GabCall *call = gab_call_init(work, &err);
+        assert(gab_arg_int(call, 0, session));
+        assert(gab_arg_pointer(call, 1, &tally, tally_type));
+
+        int32_t out = 0;
+        assert(gab_call(clone, call, &out, &err) == GAB_OK);
+        assert(out == session * 4950);
+        assert(tally.calls == 1 && tally.sum == session);
+
+        gab_call_free(call);
+        gab_vm_free(clone);
+    }
+
+    // Every clone gone, the template loads again.
+    assert(gab_load(template_vm, "<more>", "module more;\n", &err));
+
+    assert(!gab_vm_clone(NULL, &err));
+    assert(strstr(err.message, "gab_vm_clone"));
+
+    gab_vm_free(template_vm);
+}
+
+int main(void) {
+    test_contexts_run_one_program_on_many_threads();
+    test_an_extern_calls_back_on_its_context();
+    test_loading_waits_for_every_context();
+    test_a_clone_needs_no_load();
+
+    printf("context_test: all tests passed\n");
+
+    return 0;
+}
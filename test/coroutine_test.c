@@ -0,0 +1,240 @@
+// Coroutines: a call that yields to the host and is resumed from where it
+// stopped. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static GabCoroutine *start(GabVM *vm, const char *name, int32_t arg) {
+    GabError err;
+    GabCall *call = gab_call_init(gab_lookup(vm, "co", name, &err), &err);
+    assert(call);
+    assert(gab_arg_int(call, 0, arg));
+
+    GabCoroutine *co = gab_coroutine_new(vm, call, &err);
+    assert(co);
+
+    // The coroutine copied its arguments, so the call is not needed after.
+    gab_call_free(call);
+
+    return co;
+}
+
+// Each resume runs to the next yield and hands its value back; the loop's
+// locals are where the last resume left them.
+static void test_a_coroutine_yields_each_value(void) {
+    GabVM *vm = test_load_vm("module co;\n"
+                             "func count(n: int): int {\n"
+                             "    let total: int = 0;\n"
+                             "    for let i: int = 0; i < n; i = i + 1 {\n"
+                             "        total = total + i;\n"
+                             "        yield i;\n"
+                             "    }\n"
+                             "    return total;\n"
+                             "}\n");
+
+    GabCoroutine *co = start(vm, "count", 4);
+    GabError err;
+
+    for (int32_t i = 0; i < 4; i++) {
+        int32_t out = -1;
+        assert(gab_resume(co, &out, &err) == GAB_OK);
+        assert(out == i);
+        assert(!gab_coroutine_done(co));
+    }
+
+    int32_t out = -1;
+    assert(gab_resume(co, &out, &err) == GAB_OK);
+    assert(out == 0 + 1 + 2 + 3);
+    assert(gab_coroutine_done(co));
+
+    assert(gab_resume(co, &out, &err) == GAB_ERR_ARG);
+    assert(strstr(err.message, "finished"));
+
+    gab_coroutine_free(co);
+    gab_vm_free(vm);
+}
+
+// A yield suspends every frame of the call, not only the one it is written in,
+// and a borrow of a local in a lower frame still reaches it after the resume.
+static void test_a_yield_suspends_the_whole_call(void) {
+    GabVM *vm = test_load_vm("module co;\n"
+                             "func step(total: ref int, by: int): int {\n"
+                             "    *total = *total + by;\n"
+                             "    yield *total;\n"
+                             "    *total = *total + by;\n"
+                             "    return *total;\n"
+                             "}\n"
+                             "func run(by: int): int {\n"
+                             "    let total: int = 0;\n"
+                             "    let first: int = step(&total, by);\n"
+                             "    yield first * 100;\n"
+                             "    return total;\n"
+                             "}\n");
+
+    GabCoroutine *co = start(vm, "run", 3);
+    GabError err;
+
+    int32_t out = 0;
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 3);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 600);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 6);
+    assert(gab_coroutine_done(co));
+
+    gab_coroutine_free(co);
+    gab_vm_free(vm);
+}
+
+// Many coroutines over one VM take turns, each with its own stack, and plain
+// calls run between their resumes as if none were suspended.
+static void test_coroutines_interleave(void) {
+    GabVM *vm = test_load_vm("module co;\n"
+                             "func square(x: int): int { return x * x; }\n"
+                             "func squares(from: int): int {\n"
+                             "    for let i: int = from; i < from + 3; i = i + 1 { yield square(i); }\n"
+                             "    return -1;\n"
+                             "}\n");
+
+    enum { COUNT = 32 };
+    GabCoroutine *cos[COUNT];
+
+    for (int32_t c = 0; c < COUNT; c++) {
+        cos[c] = start(vm, "squares", c * 10);
+    }
+
+    GabError err;
+    GabCall *call = gab_call_init(gab_lookup(vm, "co", "square", &err), &err);
+
+    for (int32_t step = 0; step < 3; step++) {
+        for (int32_t c = 0; c < COUNT; c++) {
+            int32_t out = 0;
+            assert(gab_resume(cos[c], &out, &err) == GAB_OK);
+            assert(out == (c * 10 + step) * (c * 10 + step));
+
+            assert(gab_arg_int(call, 0, c));
+            assert(gab_call(vm, call, &out, &err) == GAB_OK && out == c * c);
+        }
+    }
+
+    gab_call_free(call);
+
+    // Half are left suspended; freeing them is as good as finishing them.
+    for (int32_t c = 0; c < COUNT; c++) {
+        if (c % 2 == 0) {
+            int32_t out = 0;
+            assert(gab_resume(cos[c], &out, &err) == GAB_OK && out == -1);
+            assert(gab_coroutine_done(cos[c]));
+        }
+
+        gab_coroutine_free(cos[c]);
+    }
+
+    gab_vm_free(vm);
+}
+
+// Owned objects live across a suspension, and a coroutine freed while
+// suspended releases them rather than leaking them.
+static void test_a_suspended_coroutine_releases_what_it_owns(void) {
+    GabVM *vm = test_load_vm("module co;\n"
+                             "struct Box { value: int }\n"
+                             "func hold(v: int): int {\n"
+                             "    let box: *Box = new Box;\n"
+                             "    box.value = v;\n"
+                             "    yield box.value;\n"
+                             "    box.value = box.value + 1;\n"
+                             "    yield box.value;\n"
+                             "    return box.value;\n"
+                             "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    GabCoroutine *co = start(vm, "hold", 7);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 7);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 8);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 8);
+    gab_coroutine_free(co);
+
+    co = start(vm, "hold", 1);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 1);
+    gab_coroutine_free(co);
+
+    gab_vm_free(vm);
+}
+
+// Outside a coroutine there is nothing to suspend, so a yield is a runtime
+// failure; inside one, a failure finishes it.
+static void test_a_yield_outside_a_coroutine_fails(void) {
+    GabVM *vm = test_load_vm("module co;\n"
+                             "func once(x: int): int { yield x; return x; }\n"
+                             "func divide(x: int): int { yield x; return 10 / x; }\n");
+
+    GabError err;
+    GabCall *call = gab_call_init(gab_lookup(vm, "co", "once", &err), &err);
+    assert(gab_arg_int(call, 0, 1));
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "yield"));
+    gab_call_free(call);
+
+    GabCoroutine *co = start(vm, "divide", 0);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 0);
+    assert(gab_resume(co, &out, &err) == GAB_ERR_RUNTIME);
+    assert(gab_coroutine_done(co));
+    gab_coroutine_free(co);
+
+    gab_vm_free(vm);
+}
+
+// A yield is checked as a return is: inside a function, of its return type, and
+// never handing out something the function still owns.
+static void test_a_yield_is_type_checked(void) {
+    static const char *const BAD[] = {
+        "module co;\nyield 1;\n",
+        "module co;\nfunc f(): int { yield 1.5; return 0; }\n",
+        "module co;\nfunc f(): int { yield; return 0; }\n",
+        "module co;\nstruct B { v: int }\nfunc f(): *B { let b: *B = new B; yield b; return b; }\n",
+    };
+
+    for (size_t i = 0; i < sizeof(BAD) / sizeof(BAD[0]); i++) {
+        GabVM *vm = gab_vm_new();
+
+        GabError err;
+        assert(!gab_load(vm, "<bad>", BAD[i], &err));
+        assert(err.line > 0);
+
+        gab_vm_free(vm);
+    }
+
+    GabVM *vm =
+        test_load_vm("module co;\nfunc f(n: int) { for let i: int = 0; i < n; i = i + 1 { yield; } }\n");
+
+    GabCoroutine *co = start(vm, "f", 2);
+    GabError err;
+
+    assert(gab_resume(co, NULL, &err) == GAB_OK);
+    assert(gab_resume(co, NULL, &err) == GAB_OK);
+    assert(!gab_coroutine_done(co));
+    assert(gab_resume(co, NULL, &err) == GAB_OK);
+    assert(gab_coroutine_done(co));
+
+    gab_coroutine_free(co);
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_a_coroutine_yields_each_value();
+    test_a_yield_suspends_the_whole_call();
+    test_coroutines_interleave();
+    test_a_suspended_coroutine_releases_what_it_owns();
+    test_a_yield_outside_a_coroutine_fails();
+    test_a_yield_is_type_checked();
+
+    printf("coroutine_test: all tests passed\n");
+
+    return 0;
+}
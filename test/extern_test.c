@@ -3,6 +3,7 @@
 #include "gab.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -44,7 +45,41 @@ static void boost(GabArgs *args) {
 
 static void refuse(GabArgs *args) { gab_error(args, "the host refused"); }
 
+// Reads every parameter of a wide, mixed signature, so each lands past
+// parameters of different widths: a string is four slots, a struct two.
+static void mix(GabArgs *args) {
+    Player p;
+    gab_arg_get_struct(args, 2, &p, sizeof p);
+
+    int32_t length = 0;
+    gab_arg_get_string(args, 1, &length);
+
+    float total = (float)gab_arg_get_int(args, 0) + (float)length + (float)p.health + (float)p.mana +
+                  gab_arg_get_float(args, 3) + (gab_arg_get_bool(args, 4) ? 100.0f : 0.0f) +
+                  (float)gab_arg_get_int(args, 5);
+
+    gab_return_float(args, total);
+}
+
 // The value a host computes comes back to the script that called it.
+// Plain C bodies for the typed registrations: the arguments arrive as C values
+// and the result is returned, with no GabArgs in sight.
+static int32_t native_add(int32_t a, int32_t b) { return a + b; }
+
+static float native_hypot(float a, float b) { return sqrtf(a * a + b * b); }
+
+static void native_drain(void *p, int32_t amount) { ((Player *)p)->mana -= amount; }
+
+static int32_t native_health(void *p) { return ((Player *)p)->health; }
+
+// Counts its calls, so a test can see how many a pure declaration saved.
+static int32_t lookups = 0;
+
+static void lookup(GabArgs *args) {
+    lookups++;
+    gab_return_int(args, gab_arg_get_int(args, 0) * 10);
+}
+
 static void test_an_extern_returns_to_its_caller(void) {
     GabVM *vm = gab_vm_new();
 
@@ -156,6 +191,35 @@ static void test_a_struct_crosses_by_value(void) {
     gab_vm_free(vm);
 }
 
+// Every parameter is found where the declaration put it, whatever precedes it.
+static void test_a_wide_signature_reads_every_parameter(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "test", "mix", mix, &err));
+
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "struct Player { health: int, mana: int }\n"
+                    "extern func mix(a: int, s: string, p: Player, f: float, b: bool, z: int): float;\n"
+                    "func run(): float {\n"
+                    "    let p: Player;\n"
+                    "    p.health = 20;\n"
+                    "    p.mana = 3;\n"
+                    "    return mix(1, \"four\", p, 0.5, true, 7);\n"
+                    "}\n",
+                    &err));
+
+    GabCall *call = gab_call_init(gab_lookup(vm, "test", "run", &err), &err);
+
+    float out = 0.0f;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 1.0f + 4.0f + 20.0f + 3.0f + 0.5f + 100.0f + 7.0f);
+
+    gab_call_free(call);
+    gab_vm_free(vm);
+}
+
 // A 'ref T' parameter borrows, so the host writes through it to the object the
 // caller still owns.
 static void test_a_borrow_is_written_through(void) {
@@ -187,6 +251,157 @@ static void test_a_borrow_is_written_through(void) {
     gab_vm_free(vm);
 }
 
+// A typed registration is called with native values, and the script sees no
+// difference from a GabArgs body.
+static void test_a_typed_extern_is_called_natively(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern_ii_i(vm, "test", "add", native_add, &err));
+    assert(gab_extern_ff_f(vm, "test", "hypot", native_hypot, &err));
+
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "extern func add(a: int, b: int): int;\n"
+                    "extern func hypot(a: float, b: float): float;\n"
+                    "func run(): int { return add(40, 2) + int(hypot(3.0, 4.0)); }\n",
+                    &err));
+
+    GabFunc *fn = gab_lookup(vm, "test", "run", &err);
+    GabCall *call = gab_call_init(fn, &err);
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 47);
+
+    gab_call_free(call);
+    gab_vm_free(vm);
+}
+
+// A 'ref T' arrives as the caller's pointer, read and written in place.
+static void test_a_typed_extern_takes_a_borrow(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern_pi_v(vm, "test", "drain", native_drain, &err));
+    assert(gab_extern_p_i(vm, "test", "health", native_health, &err));
+
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "struct Player { health: int, mana: int }\n"
+                    "extern func drain(p: ref Player, amount: int);\n"
+                    "extern func health(p: ref Player): int;\n"
+                    "func run(p: ref Player): int { drain(p, 3); return health(p); }\n",
+                    &err));
+
+    const GabType *type = gab_find_type(vm, "test", "Player");
+    GabFunc *fn = gab_lookup(vm, "test", "run", &err);
+    GabCall *call = gab_call_init(fn, &err);
+
+    Player p = {.health = 12, .mana = 10};
+    assert(gab_arg_pointer(call, 0, &p, type));
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 12);
+    assert(p.mana == 7);
+
+    gab_call_free(call);
+    gab_vm_free(vm);
+}
+
+// The C signature is held against the declaration: a body registered for two
+// ints cannot stand in for one taking floats, and the load names it.
+static void test_a_typed_extern_must_match_its_declaration(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern_ii_i(vm, "test", "add", native_add, &err));
+
+    assert(!gab_load(vm, "<m>",
+                     "module test;\n"
+                     "extern func add(a: float, b: float): float;\n",
+                     &err));
+
+    assert(strstr(err.message, "add"));
+    assert(err.line == 2);
+
+    // Arity is part of the signature too.
+    assert(!gab_load(vm, "<m>",
+                     "module test;\n"
+                     "extern func add(a: int): int;\n",
+                     &err));
+
+    gab_vm_free(vm);
+}
+
+// A pure extern on constant arguments is made once per entry, however many
+// times the loop around it runs and however often it is spelled.
+static void test_a_pure_extern_is_made_once_per_entry(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "test", "lookup", lookup, &err));
+
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "extern pure func lookup(key: int): int;\n"
+                    "func run(): int {\n"
+                    "    let total: int = 0;\n"
+                    "    for let i: int = 0; i < 10; i += 1 { total += lookup(3); }\n"
+                    "    return total + lookup(3) + lookup(4);\n"
+                    "}\n",
+                    &err));
+
+    GabFunc *fn = gab_lookup(vm, "test", "run", &err);
+    GabCall *call = gab_call_init(fn, &err);
+
+    lookups = 0;
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 11 * 30 + 40);
+
+    // 'lookup(3)' once at entry; 'lookup(4)' is spelled once outside any loop,
+    // so it stays where it is.
+    assert(lookups == 2);
+
+    gab_call_free(call);
+    gab_vm_free(vm);
+}
+
+// A variable argument may differ from one call to the next, so each is made
+// where it is written, pure or not. 'pure' is a keyword only after 'extern'.
+static void test_a_pure_extern_on_a_variable_is_made_each_time(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "test", "lookup", lookup, &err));
+
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "extern pure func lookup(key: int): int;\n"
+                    "func run(): int {\n"
+                    "    let pure: int = 0;\n"
+                    "    for let i: int = 0; i < 4; i += 1 { pure += lookup(i); }\n"
+                    "    return pure;\n"
+                    "}\n",
+                    &err));
+
+    GabFunc *fn = gab_lookup(vm, "test", "run", &err);
+    GabCall *call = gab_call_init(fn, &err);
+
+    lookups = 0;
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 60);
+    assert(lookups == 4);
+
+    gab_call_free(call);
+    gab_vm_free(vm);
+}
+
 // A script naming an extern nothing registered does not load, and the message
 // says which name is missing.
 static void test_an_unbound_extern_fails_the_load(void) {
@@ -260,6 +475,121 @@ static void test_a_host_may_call_an_extern_directly(void) {
     gab_vm_free(vm);
 }
 
+// A host 'for_each': calls back into the script once per index, reading its
+// own argument afresh each time so a callback that clobbered the extern's block
+// would show.
+static GabCall *each_callback = NULL;
+static GabStatus each_status = GAB_OK;
+
+static void for_each(GabArgs *args) {
+    GabVM *vm = gab_args_vm(args);
+    int32_t sum = 0;
+
+    for (int32_t i = 0; i < gab_arg_get_int(args, 0); i++) {
+        assert(gab_arg_int(each_callback, 0, i));
+
+        GabError err;
+        int32_t out = 0;
+
+        each_status = gab_call(vm, each_callback, &out, &err);
+        if (each_status != GAB_OK) {
+            gab_return_int(args, -1);
+            return;
+        }
+
+        sum += out;
+    }
+
+    gab_return_int(args, sum);
+}
+
+static void reload(GabArgs *args) {
+    GabError err;
+    gab_return_bool(args, gab_load(gab_args_vm(args), "<inner>", "module other;\n", &err));
+}
+
+// A call made from inside an extern runs on top of the script frames that
+// reached the extern and returns into it, and the run that called the extern
+// then finishes with its own locals as they were.
+static void test_an_extern_may_call_back_into_the_script(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "test", "for_each", for_each, &err));
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "extern func for_each(n: int): int;\n"
+                    "func cube(i: int): int { return i * i * i; }\n"
+                    "func visit(i: int): int { let sq: int = i * i; return sq + cube(i) - sq; }\n"
+                    "func run(k: int): int { let keep: int = k * 1000; let sum: int = for_each(4); return keep + "
+                    "sum; }\n",
+                    &err));
+
+    each_callback = gab_call_init(gab_lookup(vm, "test", "visit", &err), &err);
+
+    GabCall *call = gab_call_init(gab_lookup(vm, "test", "run", &err), &err);
+    assert(gab_arg_int(call, 0, 5));
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(each_status == GAB_OK);
+    assert(out == 5000 + 0 + 1 + 8 + 27);
+
+    // With no script frame under it at all: the host calls the extern itself.
+    GabCall *direct = gab_call_init(gab_lookup(vm, "test", "for_each", &err), &err);
+    assert(gab_arg_int(direct, 0, 3));
+
+    assert(gab_call(vm, direct, &out, &err) == GAB_OK);
+    assert(out == 0 + 1 + 8);
+
+    // And the VM is back to taking calls from the host as before.
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(out == 5036);
+
+    gab_call_free(direct);
+    gab_call_free(call);
+    gab_call_free(each_callback);
+    gab_vm_free(vm);
+}
+
+// A callback's failure is the extern's to handle. The outer run does not fail
+// unless the extern says so, and a load is refused rather than run mid-call.
+static void test_a_failed_callback_is_the_externs_to_report(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern(vm, "test", "for_each", for_each, &err));
+    assert(gab_extern(vm, "test", "reload", reload, &err));
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "extern func for_each(n: int): int;\n"
+                    "extern func reload(): bool;\n"
+                    "func spin(i: int): int { return spin(i); }\n"
+                    "func run(): int { return for_each(2) + 100; }\n"
+                    "func load(): bool { return reload(); }\n",
+                    &err));
+
+    each_callback = gab_call_init(gab_lookup(vm, "test", "spin", &err), &err);
+
+    GabCall *call = gab_call_init(gab_lookup(vm, "test", "run", &err), &err);
+
+    int32_t out = 0;
+    assert(gab_call(vm, call, &out, &err) == GAB_OK);
+    assert(each_status == GAB_ERR_RUNTIME);
+    assert(out == 99);
+
+    GabCall *load = gab_call_init(gab_lookup(vm, "test", "load", &err), &err);
+
+    bool loaded = true;
+    assert(gab_call(vm, load, &loaded, &err) == GAB_OK);
+    assert(!loaded);
+
+    gab_call_free(load);
+    gab_call_free(call);
+    gab_call_free(each_callback);
+    gab_vm_free(vm);
+}
+
 // An extern that reports an error unwinds the run rather than returning, and
 // the host sees the message it gave.
 static void test_an_extern_may_fail_the_run(void) {
@@ -433,10 +763,18 @@ int main(void) {
     test_an_extern_may_return_nothing();
     test_scalars_cross_the_boundary();
     test_a_struct_crosses_by_value();
+    test_a_wide_signature_reads_every_parameter();
     test_a_borrow_is_written_through();
+    test_a_typed_extern_is_called_natively();
+    test_a_typed_extern_takes_a_borrow();
+    test_a_typed_extern_must_match_its_declaration();
+    test_a_pure_extern_is_made_once_per_entry();
+    test_a_pure_extern_on_a_variable_is_made_each_time();
     test_an_unbound_extern_fails_the_load();
     test_an_extern_must_be_registered_before_the_load();
     test_a_host_may_call_an_extern_directly();
+    test_an_extern_may_call_back_into_the_script();
+    test_a_failed_callback_is_the_externs_to_report();
     test_an_extern_may_fail_the_run();
     test_an_extern_may_fail_without_a_message();
     test_a_long_extern_message_is_truncated();
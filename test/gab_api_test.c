@@ -252,6 +252,56 @@ static void test_struct_argument_and_return(void) {
     gab_vm_free(vm);
 }
 
+// The in-place path: the struct is written straight into the callee's frame
+// and the struct result read where it landed, with no GabCall in between.
+static void test_a_call_in_place(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "struct Player { health: int, mana: int }\n"
+                    "func hurt(p: Player, amount: int): Player {\n"
+                    "  let out: Player = p;\n"
+                    "  out.health = p.health - amount;\n"
+                    "  return out;\n"
+                    "}\n"
+                    "func nothing(x: int) {}\n",
+                    &err));
+
+    GabFunc *fn = gab_lookup(vm, "test", "hurt", &err);
+
+    // Written afresh every call: the frame that ran last time sits on top of
+    // the same bytes.
+    for (int32_t i = 0; i < 3; i++) {
+        uint8_t *args = gab_frame_args(vm, fn);
+        assert(args);
+
+        Player in = {.health = 100 + i, .mana = 30};
+        int32_t amount = 25;
+
+        memcpy(args, &in, sizeof(in));
+        memcpy(args + sizeof(in), &amount, sizeof(amount));
+
+        assert(gab_frame_call(vm, fn, &err) == GAB_OK);
+
+        const Player *out = gab_frame_result(vm, fn);
+        assert(out);
+        assert(out->health == 75 + i);
+        assert(out->mana == 30);
+    }
+
+    // Nothing returned, so nothing to point at.
+    GabFunc *nothing = gab_lookup(vm, "test", "nothing", &err);
+    int32_t x = 1;
+    memcpy(gab_frame_args(vm, nothing), &x, sizeof(x));
+
+    assert(gab_frame_call(vm, nothing, &err) == GAB_OK);
+    assert(gab_frame_result(vm, nothing) == NULL);
+
+    gab_vm_free(vm);
+}
+
 // A bad argument is GAB_ERR_ARG at the call, and the call does not happen.
 static void test_bad_arguments_are_rejected(void) {
     GabVM *vm = gab_vm_new();
@@ -300,6 +350,87 @@ static void test_bad_arguments_are_rejected(void) {
     gab_vm_free(vm);
 }
 
+// One function over a host array: a struct parameter gets each item's copy, a
+// 'ref' one writes the host's items in place, and a failure names its item and
+// leaves the ones after it untouched.
+static void test_a_batch_runs_over_an_array(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "<m>",
+                    "module test;\n"
+                    "struct Player { health: int, mana: int }\n"
+                    "func total(p: Player): int { return p.health + p.mana; }\n"
+                    "func heal(p: ref Player) { p.health = p.health + 10; }\n"
+                    "func spin(n: int): int { return spin(n); }\n"
+                    "func check(p: ref Player): int { if p.mana < 0 { return spin(0); } return p.mana; }\n",
+                    &err));
+
+    // Entities carry more than the script sees; the stride steps over the rest.
+    typedef struct {
+        Player player;
+        float position[2];
+    } Entity;
+
+    Entity entities[4];
+    for (int i = 0; i < 4; i++) {
+        entities[i] = (Entity){.player = {.health = i * 10, .mana = i}, .position = {1.0f, 2.0f}};
+    }
+
+    GabFunc *total = gab_lookup(vm, "test", "total", &err);
+
+    // Results interleaved with something else of the host's.
+    struct {
+        int32_t total;
+        int32_t tag;
+    } results[4] = {{0, -1}, {0, -1}, {0, -1}, {0, -1}};
+
+    assert(gab_call_batch(vm, total, entities, sizeof(Entity), 4, results, sizeof(results[0]), &err) ==
+           GAB_OK);
+    for (int i = 0; i < 4; i++) {
+        assert(results[i].total == i * 11);
+        assert(results[i].tag == -1);
+    }
+
+    GabFunc *heal = gab_lookup(vm, "test", "heal", &err);
+    assert(gab_call_batch(vm, heal, entities, sizeof(Entity), 4, NULL, 0, &err) == GAB_OK);
+    for (int i = 0; i < 4; i++) {
+        assert(entities[i].player.health == i * 10 + 10);
+        assert(entities[i].position[1] == 2.0f);
+    }
+
+    // Nothing to run is not an error.
+    assert(gab_call_batch(vm, heal, NULL, sizeof(Entity), 0, NULL, 0, &err) == GAB_OK);
+
+    // Refused before anything runs: a stride narrower than the item, a result
+    // asked of a function that returns none, a parameter that is no struct.
+    assert(gab_call_batch(vm, heal, entities, sizeof(int32_t), 4, NULL, 0, &err) == GAB_ERR_ARG);
+    assert(gab_call_batch(vm, heal, entities, sizeof(Entity), 4, results, sizeof(results[0]), &err) ==
+           GAB_ERR_ARG);
+    assert(gab_call_batch(vm, gab_lookup(vm, "test", "spin", &err), entities, sizeof(Entity), 4, NULL, 0,
+                          &err) == GAB_ERR_ARG);
+
+    // The third item fails; the first two have their results and the last has
+    // not been touched.
+    entities[2].player.mana = -1;
+
+    int32_t mana[4] = {-7, -7, -7, -7};
+    GabFunc *check = gab_lookup(vm, "test", "check", &err);
+
+    assert(gab_call_batch(vm, check, entities, sizeof(Entity), 4, mana, sizeof(mana[0]), &err) ==
+           GAB_ERR_RUNTIME);
+    assert(strncmp(err.message, "item 2: ", 8) == 0);
+    assert(mana[0] == 0 && mana[1] == 1);
+    assert(mana[2] == -7 && mana[3] == -7);
+
+    // And the VM still runs afterwards.
+    entities[2].player.mana = 2;
+    assert(gab_call_batch(vm, check, entities, sizeof(Entity), 4, mana, sizeof(mana[0]), &err) == GAB_OK);
+    assert(mana[3] == 3);
+
+    gab_vm_free(vm);
+}
+
 // A runtime failure reaches the caller as GAB_ERR_RUNTIME with a message, and
 // leaves the VM usable. Unbounded recursion is the only runtime failure that
 // exists today; the channel is what matters, not the particular cause.
@@ -1263,6 +1394,8 @@ int main(void) {
     test_call_with_scalar_args();
     test_call_in_a_loop();
     test_struct_argument_and_return();
+    test_a_call_in_place();
+    test_a_batch_runs_over_an_array();
     test_two_callers_stage_independently();
     test_bad_arguments_are_rejected();
 
@@ -0,0 +1,190 @@
+// VM images: one VM's loaded state written to a file and mapped by another in
+// place of loading. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *BASE = "module L;\n"
+                          "struct Point { x: int, y: int }\n"
+                          "extern func scale(x: int): int;\n"
+                          "func twice(x: int): int { return x * 2; }\n"
+                          "func (p: ref Point) sum(): int { return p.x + p.y; }\n";
+
+static const char *USER = "module L;\n"
+                          "func helper(x: int): int {\n"
+                          "    let p: *Point = new Point;\n"
+                          "    p.x = scale(x);\n"
+                          "    p.y = twice(x);\n"
+                          "    return p.sum();\n"
+                          "}\n"
+                          "func label(x: int): int {\n"
+                          "    let s: string = \"image\";\n"
+                          "    let t: string = \"image\";\n"
+                          "    if s == t { return x + 100; }\n"
+                          "    return 0;\n"
+                          "}\n";
+
+static int32_t scale(int32_t x) { return x * 10; }
+
+static GabVM *vm_with_externs(void) {
+    GabError err;
+    GabVM *vm = gab_vm_new();
+    gab_keep_sources(vm, true);
+
+    assert(gab_extern_i_i(vm, "L", "scale", scale, &err));
+
+    return vm;
+}
+
+static int32_t call_ok(GabVM *vm, const char *module, const char *name, int32_t arg) {
+    GabError err;
+    int32_t out = 0;
+
+    GabCall *call = gab_call_init(gab_lookup(vm, module, name, &err), &err);
+    assert(call);
+    assert(gab_arg_int(call, 0, arg));
+
+    GabStatus status = gab_call(vm, call, &out, &err);
+    if (status != GAB_OK) {
+        fprintf(stderr, "call failed: %s\n", err.message);
+        assert(false);
+    }
+
+    gab_call_free(call);
+
+    return out;
+}
+
+static void temp_path(char *path, size_t size) {
+    snprintf(path, size, "/tmp/gab_image_test_XXXXXX");
+
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+}
+
+// Restored into a new VM, every function runs as it did where it was loaded,
+// calls across units, externs, methods, literals and allocations included --
+// and so do two VMs mapping the one file at once.
+static void test_an_image_restores_elsewhere(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+
+    // Lazily, so the snapshot has bodies to compile first.
+    GabVM *writer = vm_with_externs();
+    gab_defer_bodies(writer, true);
+    test_load(writer, "base.gab", BASE);
+    test_load(writer, "user.gab", USER);
+
+    GabError err;
+    if (!gab_vm_snapshot(writer, path, &err)) {
+        fprintf(stderr, "snapshot failed: %s\n", err.message);
+        assert(false);
+    }
+
+    int32_t expected = call_ok(writer, "L", "helper", 3);
+    assert(expected == 30 + 6);
+
+    GabVM *first = vm_with_externs();
+    GabVM *second = vm_with_externs();
+
+    if (!gab_vm_from_image(first, path, &err)) {
+        fprintf(stderr, "restore failed: %s\n", err.message);
+        assert(false);
+    }
+    assert(gab_vm_from_image(second, path, &err));
+
+    assert(call_ok(first, "L", "helper", 3) == expected);
+    assert(call_ok(second, "L", "label", 1) == 101);
+    assert(call_ok(second, "L", "twice", 21) == 42);
+    assert(gab_find_type(first, "L", "Point"));
+
+    // The restored VM loads on top of the image as any other would.
+    test_load(first, "more.gab",
+              "module M;\nimport L;\nfunc m(x: int): int { let p: L::Point; p.x = x; return p.x + 1; }\n");
+    assert(call_ok(first, "M", "m", 4) == 5);
+    test_load(first, "again.gab", "module L;\nfunc thrice(x: int): int { return twice(x) + x; }\n");
+    assert(call_ok(first, "L", "thrice", 4) == 12);
+
+    gab_vm_free(second);
+    gab_vm_free(first);
+    gab_vm_free(writer);
+
+    remove(path);
+}
+
+// Only a VM that has loaded nothing is restored into, and only from an image.
+static void test_a_restore_is_refused(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+
+    GabVM *writer = vm_with_externs();
+    test_load(writer, "base.gab", BASE);
+
+    GabError err;
+    assert(gab_vm_snapshot(writer, path, &err));
+
+    GabVM *used = vm_with_externs();
+    test_load(used, "other.gab", "module O;\nfunc o(x: int): int { return x; }\n");
+    assert(!gab_vm_from_image(used, path, &err));
+    assert(call_ok(used, "O", "o", 1) == 1);
+
+    // Its externs are bound again, so one the host did not register fails.
+    GabVM *bare = gab_vm_new();
+    assert(!gab_vm_from_image(bare, path, &err));
+    assert(strstr(err.message, "scale"));
+
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    fputs("not an image, but long enough to hold a header of one and then some", file);
+    fclose(file);
+
+    GabVM *garbage = vm_with_externs();
+    assert(!gab_vm_from_image(garbage, path, &err));
+
+    GabVM *missing = vm_with_externs();
+    assert(!gab_vm_from_image(missing, "/nonexistent/gab.image", &err));
+
+    gab_vm_free(missing);
+    gab_vm_free(garbage);
+    gab_vm_free(bare);
+    gab_vm_free(used);
+    gab_vm_free(writer);
+
+    remove(path);
+}
+
+// An image declares its units again from their sources, which a VM keeps only
+// when asked to.
+static void test_a_snapshot_needs_the_sources_kept(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+
+    GabError err;
+    GabVM *vm = gab_vm_new();
+    assert(gab_extern_i_i(vm, "L", "scale", scale, &err));
+    test_load(vm, "base.gab", BASE);
+
+    assert(!gab_vm_snapshot(vm, path, &err));
+    assert(strstr(err.message, "base.gab"));
+
+    gab_vm_free(vm);
+
+    remove(path);
+}
+
+int main(void) {
+    test_an_image_restores_elsewhere();
+    test_a_restore_is_refused();
+    test_a_snapshot_needs_the_sources_kept();
+
+    printf("image_test: all tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Lazy loads: function bodies left uncompiled until something reaches them,
+// and compiled the first time something does. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static GabVM *lazy_vm(void) {
+    GabVM *vm = gab_vm_new();
+    gab_defer_bodies(vm, true);
+
+    return vm;
+}
+
+static int32_t call_ok(GabVM *vm, const char *module, const char *name, int32_t arg) {
+    GabError err;
+    int32_t out = 0;
+
+    GabStatus status = test_call_int(vm, module, name, arg, &out, &err);
+    if (status != GAB_OK) {
+        fprintf(stderr, "call failed: %s\n", err.message);
+        assert(false);
+    }
+
+    return out;
+}
+
+// Everything a body can do, done by bodies compiled one at a time as calls
+// reach them: calls in both directions across the unit, a method, literals
+// and the heap, and a function an earlier unit declared into the module.
+static void test_bodies_compile_when_called(void) {
+    GabVM *vm = lazy_vm();
+
+    test_load(vm, "base.gab",
+              "module L;\n"
+              "func twice(x: int): int { return x * 2; }\n");
+
+    test_load(vm, "lazy.gab",
+              "module L;\n"
+              "struct Counter { n: int }\n"
+              "func (c: ref Counter) bump(by: int): int { c.n += by; return c.n; }\n"
+              "func entry(x: int): int { return helper(x) + later(x); }\n"
+              "func helper(x: int): int {\n"
+              "    let c: *Counter = new Counter;\n"
+              "    c.bump(x);\n"
+              "    return c.bump(1);\n"
+              "}\n"
+              "func later(x: int): int {\n"
+              "    let s: string = \"{ braces } in a string\";\n"
+              "    let t: string = \"{ braces } in a string\";\n"
+              "    if s == t { return twice(x); }\n"
+              "    return 0;\n"
+              "}\n");
+
+    assert(call_ok(vm, "L", "entry", 10) == 11 + 20);
+    assert(call_ok(vm, "L", "entry", 1) == 2 + 2);
+
+    // And the checks are as eager as ever for everything but a body.
+    GabError err;
+    assert(!gab_load(vm, "sig.gab", "module S;\nfunc f(x: Missing): int { return 1; }\n", &err));
+    assert(err.line == 2);
+
+    assert(!gab_load(vm, "open.gab", "module O;\nfunc f(x: int): int { return 1;\n", &err));
+
+    assert(gab_compile_deferred(vm, &err));
+
+    gab_vm_free(vm);
+}
+
+// A body that does not compile is found only when it is reached: by a lookup,
+// which fails, or by a call, which fails the run -- the same error each time.
+static void test_a_broken_body_fails_when_reached(void) {
+    GabVM *vm = lazy_vm();
+
+    test_load(vm, "broken.gab",
+              "module B;\n"
+              "func good(x: int): int { return x + 1; }\n"
+              "func calls(x: int): int { if x > 0 { return broken(x); } return good(x); }\n"
+              "func broken(x: int): int {\n"
+              "    return x + missing;\n"
+              "}\n"
+              "func unparsed(x: int): int { return x +; }\n");
+
+    // Nothing reached it, so nothing is wrong yet.
+    assert(call_ok(vm, "B", "calls", 0) == 1);
+
+    GabError err;
+    int32_t out = 0;
+
+    for (int i = 0; i < 2; i++) {
+        assert(test_call_int(vm, "B", "calls", 1, &out, &err) == GAB_ERR_RUNTIME);
+        assert(strstr(err.message, "line 5"));
+        assert(strstr(err.message, "missing"));
+    }
+
+    assert(!gab_lookup(vm, "B", "broken", &err));
+    assert(err.line == 5 && strstr(err.message, "missing"));
+
+    // A parse the parser recovered from is as much a failure.
+    assert(!gab_lookup(vm, "B", "unparsed", &err));
+    assert(err.line == 7);
+
+    // The rest of the program is unaffected.
+    assert(call_ok(vm, "B", "good", 41) == 42);
+
+    gab_vm_free(vm);
+}
+
+// The validation pass compiles everything, reports the first failure with
+// where it is, and leaves every body that did compile runnable.
+static void test_the_validation_pass_finds_every_body(void) {
+    GabVM *vm = lazy_vm();
+
+    test_load(vm, "checked.gab",
+              "module C;\n"
+              "func fine(x: int): int { return x; }\n"
+              "func wrong(x: int): int {\n"
+              "    let y: int = true;\n"
+              "    return y;\n"
+              "}\n"
+              "func also_fine(x: int): int { return fine(x) + 1; }\n");
+
+    GabError err;
+    assert(!gab_compile_deferred(vm, &err));
+    assert(err.line == 4);
+
+    // Asked again, the answer is the same.
+    assert(!gab_compile_deferred(vm, &err));
+    assert(err.line == 4);
+
+    assert(call_ok(vm, "C", "also_fine", 1) == 2);
+
+    GabVM *eager = gab_vm_new();
+    assert(gab_compile_deferred(eager, &err));
+    gab_vm_free(eager);
+
+    gab_vm_free(vm);
+}
+
+// Only the VM's own thread compiles, so a context, a clone or a task finds
+// every body compiled before it runs any.
+static void test_shared_runs_find_bodies_compiled(void) {
+    GabVM *vm = lazy_vm();
+
+    test_load(vm, "shared.gab",
+              "module T;\n"
+              "func leaf(n: int): int { return n * 3; }\n"
+              "func fan(n: int): int {\n"
+              "    let a = spawn leaf(n);\n"
+              "    let b = spawn leaf(n + 1);\n"
+              "    return join a + join b;\n"
+              "}\n"
+              "func direct(n: int): int { return leaf(n) + 1; }\n"
+              "func bad(n: int): int { return nope; }\n"
+              "func calls_bad(n: int): int { return bad(n); }\n");
+
+    // The spawn compiles what its tasks could reach before any starts.
+    assert(call_ok(vm, "T", "fan", 1) == 3 + 6);
+
+    GabError err;
+    GabFunc *direct = gab_lookup(vm, "T", "direct", &err);
+    GabFunc *calls_bad = gab_lookup(vm, "T", "calls_bad", &err);
+    assert(direct && calls_bad);
+
+    GabVM *context = gab_context_new(vm, &err);
+    assert(context);
+
+    GabCall *call = gab_call_init(direct, &err);
+    assert(gab_arg_int(call, 0, 4));
+
+    int32_t out = 0;
+    assert(gab_call(context, call, &out, &err) == GAB_OK);
+    assert(out == 13);
+
+    gab_call_free(call);
+
+    // A body that failed to compile then fails on the context as on the VM.
+    call = gab_call_init(calls_bad, &err);
+    assert(gab_arg_int(call, 0, 4));
+    assert(gab_call(context, call, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "nope"));
+
+    gab_call_free(call);
+
+    gab_vm_free(context);
+    gab_vm_free(vm);
+}
+
+// Deferral applies to the other ways of loading as much as to gab_load.
+static void test_every_load_defers(void) {
+    GabVM *vm = lazy_vm();
+
+    GabSource units[] = {
+        {"user.gab", "module U;\nimport Lib;\nstruct Box { v: int }\n"
+                     "func g(x: int): int { let t: Lib::T; t.v = x + 1; return t.v * 10; }\n"},
+        {"lib.gab", "module Lib;\nstruct T { v: int }\n"},
+    };
+
+    GabError err;
+    assert(gab_load_many(vm, units, 2, &err));
+
+    // The unit's source is copied, so the host's may be gone by the call.
+    char source[] = "module A;\nimport U;\nfunc h(x: int): int { let b: U::Box; b.v = x; return k(b.v); }\n"
+                    "func k(x: int): int { return x * 15 + 1; }\n";
+
+    GabLoad *load = gab_load_async(vm, "async.gab", source, &err);
+    assert(load);
+    memset(source, ' ', sizeof(source) - 1);
+
+    // A body compiled while the load is still pending.
+    assert(call_ok(vm, "U", "g", 1) == 20);
+
+    assert(gab_load_finish(load, &err));
+    assert(call_ok(vm, "A", "h", 2) == 31);
+
+    assert(gab_compile_deferred(vm, &err));
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_bodies_compile_when_called();
+    test_a_broken_body_fails_when_reached();
+    test_the_validation_pass_finds_every_body();
+    test_shared_runs_find_bodies_compiled();
+    test_every_load_defers();
+
+    printf("lazy_test: all tests passed\n");
+
+    return 0;
+}
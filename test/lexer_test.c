@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <diagnostics.h>
 #include <lexer.h>
+#include <stdlib.h>
 #include <string.h>
 #include <string/string_pool.h>
 
@@ -372,6 +373,47 @@ static void test_slash_is_division() {
     assert_token(&lexer, TOKEN_EOF);
 }
 
+// A source with a length is read to that length and not a byte past it, so
+// one that ends in the middle of a buffer -- or at the end of a mapped file,
+// with nothing after it -- lexes as the same characters terminated would.
+// Copied into an allocation of exactly its size so a read past it is caught.
+static void test_a_source_with_a_length_ends_there() {
+    const char *text = "let count = 42 + 3.5; // done\nname 7";
+    size_t length = strlen(text);
+
+    char *exact = malloc(length);
+    memcpy(exact, text, length);
+
+    diagnostics_free(&diagnostics);
+    diagnostics_init(&diagnostics, arena, "<test>");
+    Lexer lexer = lexer_create_len(exact, length, arena, &strings, &diagnostics);
+
+    assert_token(&lexer, TOKEN_LET);
+    assert_identifier(&lexer, "count");
+    assert_token(&lexer, TOKEN_ASSIGN);
+    assert_token(&lexer, TOKEN_INT);
+    assert_token(&lexer, TOKEN_PLUS);
+    assert_token(&lexer, TOKEN_FLOAT);
+    assert_token(&lexer, TOKEN_SEMICOLON);
+    assert_identifier(&lexer, "name");
+
+    Token last = lexer_next(&lexer);
+    assert(last.type == TOKEN_INT && last.value.as_int == 7);
+    assert_token(&lexer, TOKEN_EOF);
+
+    // Cut short, the same buffer ends inside the identifier.
+    lexer = lexer_create_len(exact, length - 4, arena, &strings, &diagnostics);
+    Token final = {0};
+    for (Token token = lexer_next(&lexer); token.type != TOKEN_EOF; token = lexer_next(&lexer)) {
+        final = token;
+    }
+    assert(final.type == TOKEN_IDENT && final.lexeme.length == 2 && strncmp(final.lexeme.data, "na", 2) == 0);
+
+    assert(diagnostics_count(&diagnostics) == 0);
+
+    free(exact);
+}
+
 int main(void) {
     arena = arena_create(TEST_ARENA_BLOCK_SIZE);
     string_pool_init(&strings, arena);
@@ -405,6 +447,7 @@ int main(void) {
     test_an_out_of_range_integer_is_an_error();
     test_the_largest_integer_literal_lexes();
     test_slash_is_division();
+    test_a_source_with_a_length_ends_there();
 
     diagnostics_free(&diagnostics);
     string_pool_free(&strings);
@@ -0,0 +1,192 @@
+// gab_load_async: a unit compiled on a thread of its own while the VM goes on
+// running, and installed by gab_load_finish. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool finish(GabLoad *load, GabError *err) {
+    bool ok = gab_load_finish(load, err);
+
+    if (!ok) {
+        fprintf(stderr, "finish failed: %s\n", err->message);
+    }
+
+    return ok;
+}
+
+// The VM runs while the unit compiles, and loads nothing else until it is
+// installed.
+static void test_the_vm_runs_while_a_unit_compiles(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "base.gab",
+                    "module Base;\nstruct Box { v: int }\nfunc twice(x: int): int { return x * 2; }\n", &err));
+
+    // Copied by the call, so the buffer may be reused at once.
+    char source[256];
+    snprintf(source, sizeof(source),
+             "module User;\nimport Base;\n"
+             "func boxed(x: int): int { let b: Base::Box; b.v = x * 2; return b.v + 1; }\n");
+
+    GabLoad *load = gab_load_async(vm, "user.gab", source, &err);
+    assert(load);
+    memset(source, 0, sizeof(source));
+
+    // Calls go on as before.
+    for (int i = 0; i < 100; i++) {
+        assert(test_int_result(vm, "Base", "twice", i) == i * 2);
+    }
+
+    // Loads do not.
+    assert(!gab_load(vm, "late.gab", "module Late;\nfunc f(): int { return 1; }\n", &err));
+    assert(strstr(err.message, "unfinished"));
+
+    GabSource units[] = {{"late.gab", "module Late;\nfunc f(): int { return 1; }\n"}};
+    assert(!gab_load_many(vm, units, 1, &err));
+    assert(!gab_load_async(vm, "late.gab", units[0].source, &err));
+
+    while (!gab_load_ready(load)) {
+    }
+
+    assert(finish(load, &err));
+    assert(test_int_result(vm, "User", "boxed", 20) == 41);
+
+    // And once it is installed, the VM loads again.
+    assert(gab_load(vm, "later.gab", "module Later;\nfunc f(x: int): int { return x - 1; }\n", &err));
+    assert(test_int_result(vm, "Later", "f", 1) == 0);
+
+    gab_vm_free(vm);
+}
+
+// A unit naming a module the VM does not have yet declares it only once
+// installed; one naming a module the VM has adds to it, as gab_load does.
+static void test_new_and_existing_modules(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load(vm, "a.gab", "module A;\nstruct T { v: int }\nfunc one(x: int): int { return x + 1; }\n",
+                    &err));
+
+    GabLoad *fresh =
+        gab_load_async(vm, "fresh.gab",
+                       "module Fresh;\nstruct Pair { a: int, b: int }\n"
+                       "func sum(x: int): int { let p: Pair; p.a = x; p.b = 3; return p.a + p.b; }\n",
+                       &err);
+    assert(fresh);
+    assert(finish(fresh, &err));
+
+    const GabType *pair = gab_find_type(vm, "Fresh", "Pair");
+    assert(pair && gab_type_size(pair) == 8);
+    assert(test_int_result(vm, "Fresh", "sum", 4) == 7);
+
+    GabLoad *more = gab_load_async(
+        vm, "a2.gab", "module A;\nstruct U { t: T, w: int }\nfunc two(x: int): int { return one(x) + 1; }\n",
+        &err);
+    assert(more);
+    assert(finish(more, &err));
+
+    assert(test_int_result(vm, "A", "two", 10) == 12);
+    assert(gab_find_type(vm, "A", "U"));
+
+    // A later unit imports the module the async load declared.
+    assert(gab_load(vm, "b.gab",
+                    "module B;\nimport Fresh;\n"
+                    "func f(x: int): int { let p: Fresh::Pair; p.a = x; return p.a; }\n",
+                    &err));
+    assert(test_int_result(vm, "B", "f", 9) == 9);
+
+    gab_vm_free(vm);
+}
+
+// A failure is reported by the finish, and leaves nothing behind: the same
+// names load afterwards.
+static void test_a_failure_is_reported_by_the_finish(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    GabLoad *broken =
+        gab_load_async(vm, "broken.gab", "module M;\nfunc f(x: int): int { return x +; }\n", &err);
+    assert(broken);
+    assert(!gab_load_finish(broken, &err));
+    assert(err.line == 2);
+
+    GabLoad *unresolved =
+        gab_load_async(vm, "unresolved.gab", "module M;\nfunc f(x: int): int { return missing; }\n", &err);
+    assert(unresolved);
+    assert(!gab_load_finish(unresolved, &err));
+    assert(strstr(err.message, "missing"));
+
+    GabLoad *absent =
+        gab_load_async(vm, "absent.gab", "module M;\nimport Nowhere;\nfunc f(): int { return 1; }\n", &err);
+    assert(absent);
+    assert(!gab_load_finish(absent, &err));
+    assert(strstr(err.message, "Nowhere"));
+
+    // Nothing of M was declared, so the names are free.
+    assert(!gab_lookup(vm, "M", "f", &err));
+
+    GabLoad *fixed =
+        gab_load_async(vm, "fixed.gab", "module M;\nfunc f(x: int): int { return x + 1; }\n", &err);
+    assert(fixed);
+    assert(finish(fixed, &err));
+    assert(test_int_result(vm, "M", "f", 1) == 2);
+
+    assert(!gab_load_finish(NULL, &err));
+    assert(!gab_load_ready(NULL));
+
+    gab_vm_free(vm);
+}
+
+// A finish is refused for the reasons a load is, and the load stays pending
+// until one is not.
+static void test_a_refused_finish_stays_pending(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    GabLoad *load = gab_load_async(vm, "m.gab", "module M;\nfunc f(x: int): int { return x * 3; }\n", &err);
+    assert(load);
+
+    GabVM *context = gab_context_new(vm, &err);
+    assert(context);
+
+    assert(!gab_load_finish(load, &err));
+    assert(strstr(err.message, "contexts"));
+
+    // A context may not begin one either.
+    assert(!gab_load_async(context, "n.gab", "module N;\n", &err));
+
+    gab_vm_free(context);
+
+    assert(finish(load, &err));
+    assert(test_int_result(vm, "M", "f", 2) == 6);
+
+    gab_vm_free(vm);
+}
+
+// A VM freed with a load pending waits for its compile and discards it.
+static void test_a_vm_freed_while_a_unit_compiles(void) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_load_async(vm, "m.gab", "module M;\nstruct T { v: int }\nfunc f(x: int): int { return x; }\n",
+                          &err));
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_the_vm_runs_while_a_unit_compiles();
+    test_new_and_existing_modules();
+    test_a_failure_is_reported_by_the_finish();
+    test_a_refused_finish_stays_pending();
+    test_a_vm_freed_while_a_unit_compiles();
+
+    printf("load_async_test: all tests passed\n");
+
+    return 0;
+}
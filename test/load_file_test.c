@@ -0,0 +1,245 @@
+// Loading a unit from a file, lexed where the file is mapped rather than read
+// into memory first. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const char *GAME = "module Game;\n"
+                          "struct Unit { hp: int }\n"
+                          "func heal(x: int): int {\n"
+                          "    let u: *Unit = new Unit;\n"
+                          "    u.hp = x;\n"
+                          "    let s: string = \"healed\";\n"
+                          "    return u.hp + 10;\n"
+                          "}\n"
+                          "func score(x: int): int { return heal(x) * 2; }";
+
+// A file of 'source', named by the returned path, which the caller unlinks
+// and frees.
+static char *write_file(const char *source, size_t length) {
+    char *path = strdup("/tmp/gab_load_file_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+
+    assert(write(fd, source, length) == (ssize_t)length);
+    close(fd);
+
+    return path;
+}
+
+static void load_file(GabVM *vm, const char *path) {
+    GabError err;
+    if (!gab_load_file(vm, path, &err)) {
+        fprintf(stderr, "load failed: %s\n", err.message);
+        assert(false);
+    }
+}
+
+// How many of this process's mappings are of 'path'.
+static int mappings_of(const char *path) {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    assert(maps);
+
+    char line[512];
+    int count = 0;
+
+    while (fgets(line, sizeof(line), maps)) {
+        if (strstr(line, path)) {
+            count++;
+        }
+    }
+
+    fclose(maps);
+
+    return count;
+}
+
+// The unit runs as one loaded from a string does, whether its bodies are
+// compiled with it or when first reached -- from the mapping, long after the
+// load.
+static void test_a_file_loads_as_its_contents_would(bool lazy) {
+    char *path = write_file(GAME, strlen(GAME));
+
+    GabVM *vm = gab_vm_new();
+    gab_defer_bodies(vm, lazy);
+    load_file(vm, path);
+
+    assert(test_int_result(vm, "Game", "score", 5) == 30);
+    assert(gab_find_type(vm, "Game", "Unit"));
+
+    gab_vm_free(vm);
+    unlink(path);
+    free(path);
+}
+
+// A file whose last byte ends a page has nothing mapped after it, so the
+// lexer reading one byte too many would fault.
+static void test_a_file_filling_its_pages_lexes_to_the_end(void) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t length = 2 * page;
+    char *source = malloc(length);
+
+    const char *head = "module Full;\n//";
+    const char *tail = "\nfunc last(x: int): int { return x + 12345; }";
+
+    memset(source, 'x', length);
+    memcpy(source, head, strlen(head));
+    memcpy(source + length - strlen(tail), tail, strlen(tail));
+
+    char *path = write_file(source, length);
+
+    GabVM *vm = gab_vm_new();
+    load_file(vm, path);
+    assert(test_int_result(vm, "Full", "last", 1) == 12346);
+    gab_vm_free(vm);
+
+    unlink(path);
+    free(path);
+    free(source);
+}
+
+// The mapping is kept while the module is loaded, and goes with it; one that
+// failed to compile is not kept at all.
+static void test_a_mapping_lives_as_long_as_its_module(void) {
+    char *path = write_file(GAME, strlen(GAME));
+    const char *broken_source = "module Broken;\nfunc f(x: int): int { return y; }\n";
+    char *broken = write_file(broken_source, strlen(broken_source));
+
+    GabVM *vm = gab_vm_new();
+    GabError err;
+
+    load_file(vm, path);
+    assert(mappings_of(path) == 1);
+
+    assert(!gab_load_file(vm, broken, &err));
+    assert(strstr(err.message, "y") && err.line == 2);
+    assert(mappings_of(broken) == 0);
+
+    assert(gab_module_free(vm, "Game", &err));
+    assert(mappings_of(path) == 0);
+
+    // And loads again as if it never had been.
+    load_file(vm, path);
+    assert(test_int_result(vm, "Game", "score", 1) == 22);
+
+    gab_vm_free(vm);
+
+    unlink(path);
+    unlink(broken);
+    free(path);
+    free(broken);
+}
+
+// The unit is named by its path, which is what reloads it.
+static void test_a_file_unit_reloads_by_its_path(void) {
+    char *path = write_file(GAME, strlen(GAME));
+
+    GabVM *vm = gab_vm_new();
+    GabError err;
+    load_file(vm, path);
+
+    char edited[1024];
+    snprintf(edited, sizeof(edited), "%s", GAME);
+    char *ten = strstr(edited, "+ 10");
+    ten[2] = '2';
+
+    if (!gab_reload(vm, path, edited, &err)) {
+        fprintf(stderr, "reload failed: %s\n", err.message);
+        assert(false);
+    }
+
+    assert(test_int_result(vm, "Game", "score", 5) == 50);
+
+    gab_vm_free(vm);
+    unlink(path);
+    free(path);
+}
+
+static void test_what_cannot_be_loaded(void) {
+    GabVM *vm = gab_vm_new();
+    GabError err;
+
+    assert(!gab_load_file(vm, "/tmp/gab_load_file_not_there", &err));
+    assert(strstr(err.message, "could not open"));
+
+    assert(!gab_load_file(vm, NULL, &err));
+
+    // An empty file has nothing to map, and is refused as any unit naming no
+    // module is.
+    char *empty = write_file("", 0);
+    assert(!gab_load_file(vm, empty, &err));
+    assert(strstr(err.message, "must name its module"));
+
+    gab_vm_free(vm);
+    unlink(empty);
+    free(empty);
+}
+
+// A slice of a buffer loads to its length: what follows it is not the unit's.
+static void test_a_slice_loads_without_its_terminator(void) {
+    const char *source = "module Slice;\nfunc f(x: int): int { return x + 1; }garbage that does not lex $$$";
+    size_t length = strstr(source, "garbage") - source;
+
+    GabVM *vm = gab_vm_new();
+    GabError err;
+
+    assert(gab_load_len(vm, "slice.gab", source, length, &err));
+    assert(test_int_result(vm, "Slice", "f", 1) == 2);
+
+    assert(!gab_load_len(vm, "nothing.gab", NULL, 0, &err));
+    assert(strstr(err.message, "must name its module"));
+
+    gab_vm_free(vm);
+}
+
+// A float is converted by a reader that goes on into an exponent, which the
+// lexer does not take; a literal looking like one ending the buffer, right
+// before a page nothing is mapped at, must not lead it past the end.
+static void test_a_float_ending_the_buffer_reads_no_further(void) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char *pages = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(pages != MAP_FAILED);
+    assert(mprotect(pages + page, page, PROT_NONE) == 0);
+
+    const char *sources[] = {
+        "module G;\nfunc f(x: int): float { return 1.5e",
+        "module G;\nfunc f(x: int): float { return 1.5e+",
+        "module G;\nfunc f(x: int): float { return 1.5",
+    };
+
+    GabVM *vm = gab_vm_new();
+    GabError err;
+
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        size_t length = strlen(sources[i]);
+        char *source = pages + page - length;
+        memcpy(source, sources[i], length);
+
+        assert(!gab_load_len(vm, "edge.gab", source, length, &err));
+    }
+
+    gab_vm_free(vm);
+    munmap(pages, 2 * page);
+}
+
+int main(void) {
+    test_a_file_loads_as_its_contents_would(false);
+    test_a_file_loads_as_its_contents_would(true);
+    test_a_file_filling_its_pages_lexes_to_the_end();
+    test_a_mapping_lives_as_long_as_its_module();
+    test_a_file_unit_reloads_by_its_path();
+    test_what_cannot_be_loaded();
+    test_a_slice_loads_without_its_terminator();
+    test_a_float_ending_the_buffer_reads_no_further();
+
+    printf("load_file_test: all tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+// gab_load_many: a batch of units compiled on several threads at once and
+// linked in the order their imports need. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNITS 200
+
+static int32_t call_pointer(GabVM *vm, const char *module, const char *name, void *arg, const GabType *type) {
+    GabError err;
+    GabCall *call = gab_call_init(gab_lookup(vm, module, name, &err), &err);
+    assert(call);
+    assert(gab_arg_pointer(call, 0, arg, type));
+
+    int32_t out = 0;
+    GabStatus status = gab_call(vm, call, &out, &err);
+    assert(status == GAB_OK);
+    (void)status;
+
+    gab_call_free(call);
+
+    return out;
+}
+
+// Many units, each its own module, most importing a shared one -- given
+// before the module they import, so the batch has to order them itself.
+static void test_a_batch_loads_in_import_order(void) {
+    static char sources[UNITS][512];
+    static char names[UNITS][32];
+    GabSource units[UNITS + 1];
+
+    for (int i = 0; i < UNITS; i++) {
+        snprintf(names[i], sizeof(names[i]), "unit%d.gab", i);
+        snprintf(sources[i], sizeof(sources[i]),
+                 "module M%d;\n"
+                 "import Shapes;\n"
+                 "struct Local { v: int, box: Shapes::Box, next: *Shapes::Box }\n"
+                 "func f(x: int): int {\n"
+                 "    let l: *Local = new Local;\n"
+                 "    l.box.v = x;\n"
+                 "    l.v = %d;\n"
+                 "    return l.box.v + l.v;\n"
+                 "}\n"
+                 "func read(b: ref Shapes::Box): int { return b.v + %d; }\n",
+                 i, i, i);
+
+        units[i] = (GabSource){.name = names[i], .source = sources[i]};
+    }
+
+    units[UNITS] = (GabSource){.name = "shapes.gab",
+                               .source = "module Shapes;\n"
+                                         "struct Box { v: int }\n"
+                                         "func read(b: ref Box): int { return b.v; }\n"};
+
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    if (!gab_load_many(vm, units, UNITS + 1, &err)) {
+        fprintf(stderr, "load failed: %s\n", err.message);
+        assert(false);
+    }
+
+    // Every unit that named 'ref Shapes::Box' got the one type, whichever
+    // thread interned it first, so one object is an argument to all of them.
+    const GabType *box = gab_find_type(vm, "Shapes", "Box");
+    assert(box && gab_type_size(box) == 4);
+
+    int32_t *shared = gab_new(vm, box);
+    *shared = 1000;
+
+    for (int i = 0; i < UNITS; i++) {
+        char module[16];
+        snprintf(module, sizeof(module), "M%d", i);
+
+        assert(test_int_result(vm, module, "f", 1000) == 1000 + i);
+        assert(call_pointer(vm, module, "read", shared, box) == 1000 + i);
+    }
+
+    gab_free(vm, shared);
+
+    // And the VM loads as it did before.
+    assert(gab_load(vm, "after.gab",
+                    "module After;\nimport M7;\nfunc g(x: int): int { let l: M7::Local; l.v = x; return l.v + 1; }\n",
+                    &err));
+    assert(test_int_result(vm, "After", "g", 1) == 2);
+
+    gab_vm_free(vm);
+}
+
+// Units filling one module keep the batch's order, so a later one sees what
+// an earlier one declared, and a clash is still a clash.
+static void test_one_module_keeps_its_order(void) {
+    GabSource units[] = {
+        {"a1.gab", "module A;\nstruct T { v: int }\nfunc one(x: int): int { return x + 1; }\n"},
+        {"b.gab", "module B;\nimport A;\n"
+                  "func both(x: int): int { let u: A::U; u.t.v = x; u.w = x + 2; return u.t.v + u.w; }\n"},
+        {"a2.gab", "module A;\nstruct U { t: T, w: int }\nfunc two(x: int): int { return one(x) + 1; }\n"},
+    };
+
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    if (!gab_load_many(vm, units, sizeof(units) / sizeof(units[0]), &err)) {
+        fprintf(stderr, "load failed: %s\n", err.message);
+        assert(false);
+    }
+
+    assert(test_int_result(vm, "B", "both", 10) == 10 + 12);
+    assert(test_int_result(vm, "A", "two", 10) == 12);
+
+    GabSource clash[] = {
+        {"c1.gab", "module C;\nfunc f(x: int): int { return x; }\n"},
+        {"c2.gab", "module C;\nfunc f(x: int): int { return x + 1; }\n"},
+    };
+
+    assert(!gab_load_many(vm, clash, 2, &err));
+    assert(strncmp(err.message, "c2.gab: ", 8) == 0);
+    assert(err.line == 2);
+
+    // The first of them had loaded.
+    assert(test_int_result(vm, "C", "f", 5) == 5);
+
+    gab_vm_free(vm);
+}
+
+// A failure is reported against the unit that failed, the first in the
+// batch's order, and the units linked before it stay loaded.
+static void test_a_failure_names_its_unit(void) {
+    GabSource units[] = {
+        {"good.gab", "module Good;\nfunc f(x: int): int { return x * 2; }\n"},
+        {"bad.gab", "module Bad;\nfunc f(x: int): int { return x +; }\n"},
+        {"worse.gab", "module Worse;\nfunc f(x: int): int { return y; }\n"},
+    };
+
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(!gab_load_many(vm, units, 3, &err));
+    assert(strncmp(err.message, "bad.gab: ", 9) == 0);
+    assert(err.line == 2);
+
+    // Parsing failed, so nothing linked.
+    assert(!gab_lookup(vm, "Good", "f", &err));
+
+    GabSource late[] = {
+        {"good.gab", "module Good;\nstruct T { v: int }\nfunc f(x: int): int { return x * 2; }\n"},
+        {"user.gab",
+         "module User;\nimport Good;\nfunc g(x: int): int { let t: Good::T; return t.v + missing; }\n"},
+    };
+
+    assert(!gab_load_many(vm, late, 2, &err));
+    assert(strncmp(err.message, "user.gab: ", 10) == 0);
+    assert(test_int_result(vm, "Good", "f", 21) == 42);
+
+    // Modules importing each other within one batch have no order either.
+    GabSource cycle[] = {
+        {"x.gab", "module X;\nimport Y;\nfunc f(): int { return 1; }\n"},
+        {"y.gab", "module Y;\nimport X;\nfunc g(): int { return 2; }\n"},
+    };
+
+    assert(!gab_load_many(vm, cycle, 2, &err));
+    assert(strstr(err.message, "cycle"));
+
+    // An import of a module in neither the batch nor the VM.
+    GabSource absent[] = {
+        {"z.gab", "module Z;\nimport Nowhere;\nfunc f(): int { return 1; }\n"},
+    };
+
+    assert(!gab_load_many(vm, absent, 1, &err));
+    assert(strstr(err.message, "Nowhere"));
+
+    // An empty batch loads nothing, successfully.
+    assert(gab_load_many(vm, NULL, 0, &err));
+
+    gab_vm_free(vm);
+}
+
+// The top levels a batch ran, as a bit each, set by the units through 'mark'.
+static int32_t marked;
+
+static int32_t mark(int32_t bit) {
+    marked |= bit;
+    return bit;
+}
+
+// A top level that fails at run time is reported against its unit too, and
+// does not keep the units after it from running theirs.
+static void test_a_failing_top_level_names_its_unit(void) {
+    GabSource units[] = {
+        {"a.gab", "module A;\nextern func mark(bit: int): int;\nlet r: int = mark(1);\n"},
+        {"b.gab",
+         "module B;\nfunc boom(n: int): int { return boom(n); }\nlet r: int = boom(1);\n"},
+        {"c.gab", "module C;\nextern func mark(bit: int): int;\nlet r: int = mark(4);\n"},
+    };
+
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern_i_i(vm, "A", "mark", mark, &err));
+    assert(gab_extern_i_i(vm, "C", "mark", mark, &err));
+
+    marked = 0;
+    assert(!gab_load_many(vm, units, 3, &err));
+    assert(strncmp(err.message, "b.gab: ", 7) == 0);
+    assert(err.message[7] != '\0');
+    assert(marked == (1 | 4));
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_a_batch_loads_in_import_order();
+    test_one_module_keeps_its_order();
+    test_a_failure_names_its_unit();
+    test_a_failing_top_level_names_its_unit();
+
+    printf("load_many_test: all tests passed\n");
+
+    return 0;
+}
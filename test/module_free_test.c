@@ -0,0 +1,181 @@
+// Freeing a module: what it declared reclaimed, and the module loadable again
+// as if it never had been. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A game mode: a struct allocated and pointed at, a method, a literal.
+static const char *MODE = "module Mode;\n"
+                          "struct Unit { hp: int, armor: int }\n"
+                          "func (u: ref Unit) damage(by: int): int { u.hp -= by - u.armor; return u.hp; }\n"
+                          "func hit(by: int): int {\n"
+                          "    let u: *Unit = new Unit;\n"
+                          "    u.hp = 100;\n"
+                          "    u.armor = 5;\n"
+                          "    return u.damage(by);\n"
+                          "}\n"
+                          "func label(x: int): int {\n"
+                          "    let s: string = \"mode\";\n"
+                          "    let t: string = \"mode\";\n"
+                          "    if s == t { return x + 100; }\n"
+                          "    return 0;\n"
+                          "}\n";
+
+// A second unit of the same module.
+static const char *MODE_MORE = "module Mode;\n"
+                               "func twice(by: int): int { return hit(by) + hit(by); }\n";
+
+// Another mode using the same literal, which freeing the first must leave.
+static const char *OTHER = "module Other;\n"
+                           "func label(x: int): int {\n"
+                           "    let s: string = \"mode\";\n"
+                           "    if s == \"mode\" { return x + 1; }\n"
+                           "    return 0;\n"
+                           "}\n";
+
+static const char *IMPORTER = "module Rules;\n"
+                              "import Mode;\n"
+                              "func armor(x: int): int {\n"
+                              "    let u: Mode::Unit;\n"
+                              "    u.armor = x;\n"
+                              "    return u.armor * 2;\n"
+                              "}\n";
+
+static void module_free(GabVM *vm, const char *module) {
+    GabError err;
+    if (!gab_module_free(vm, module, &err)) {
+        fprintf(stderr, "free failed: %s\n", err.message);
+        assert(false);
+    }
+}
+
+static int32_t call_ok(GabVM *vm, const char *module, const char *name, int32_t arg) {
+    GabError err;
+    GabFunc *fn = gab_lookup(vm, module, name, &err);
+    assert(fn);
+
+    return test_func_int_result(vm, fn, arg);
+}
+
+// Loaded, freed and loaded again, over and over, as a server rotating modes
+// would: each round runs as the first did, types and literals included, and
+// what a round left is gone before the next. Eager and lazy alike; a lazy
+// round frees bodies it never compiled.
+static void test_a_mode_rotates(bool lazy) {
+    GabVM *vm = gab_vm_new();
+    gab_defer_bodies(vm, lazy);
+    test_load(vm, "other.gab", OTHER);
+
+    GabError err;
+
+    for (int round = 0; round < 64; round++) {
+        test_load(vm, "mode.gab", MODE);
+        test_load(vm, "more.gab", MODE_MORE);
+
+        GabFunc *hit = gab_lookup(vm, "Mode", "hit", &err);
+        assert(hit);
+        assert(test_func_int_result(vm, hit, 20) == 100 - 15);
+        assert(call_ok(vm, "Mode", "twice", 20) == 2 * (100 - 15));
+
+        if (round % 2 == 0) {
+            assert(call_ok(vm, "Mode", "label", 1) == 101);
+        }
+
+        module_free(vm, "Mode");
+
+        assert(!gab_lookup(vm, "Mode", "hit", &err));
+        assert(!gab_find_type(vm, "Mode", "Unit"));
+        assert(call_ok(vm, "Other", "label", 2) == 3);
+    }
+
+    // Every body still deferred belongs to a module that is loaded.
+    assert(gab_compile_deferred(vm, &err));
+
+    gab_vm_free(vm);
+}
+
+// Refused while another module imports it, and freed once that one is.
+static void test_an_imported_module_is_kept(void) {
+    GabVM *vm = gab_vm_new();
+    test_load(vm, "mode.gab", MODE);
+    test_load(vm, "rules.gab", IMPORTER);
+
+    GabError err;
+    assert(!gab_module_free(vm, "Mode", &err));
+    assert(strstr(err.message, "Rules"));
+    assert(call_ok(vm, "Mode", "hit", 20) == 100 - 15);
+
+    assert(!gab_module_free(vm, "Absent", &err));
+    assert(strstr(err.message, "Absent"));
+
+    module_free(vm, "Rules");
+    module_free(vm, "Mode");
+
+    // Loaded again under a new layout: nothing of the old one is left to
+    // clash with it.
+    test_load(vm, "mode.gab",
+              "module Mode;\nstruct Unit { armor: int }\nfunc make(x: int): int { let u: *Unit = new Unit; "
+              "u.armor = x; return u.armor; }\n");
+    test_load(vm, "rules.gab", IMPORTER);
+    assert(call_ok(vm, "Mode", "make", 7) == 7);
+    assert(call_ok(vm, "Rules", "armor", 4) == 8);
+
+    gab_vm_free(vm);
+}
+
+// A suspended coroutine could be in one of its bodies; and a VM a module was
+// freed from keeps no image of what it had.
+static void test_a_free_is_refused(void) {
+    GabVM *vm = gab_vm_new();
+    test_load(vm, "mode.gab",
+              "module Mode;\nfunc walk(n: int): int {\n"
+              "    for let i: int = 0; i < n; i = i + 1 { yield i; }\n"
+              "    return n;\n"
+              "}\n");
+
+    GabError err;
+    GabCall *start = gab_call_init(gab_lookup(vm, "Mode", "walk", &err), &err);
+    assert(start);
+    assert(gab_arg_int(start, 0, 1));
+
+    GabCoroutine *co = gab_coroutine_new(vm, start, &err);
+    assert(co);
+    gab_call_free(start);
+
+    int32_t out = -1;
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 0);
+    assert(!gab_module_free(vm, "Mode", &err));
+    assert(strstr(err.message, "coroutine"));
+
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 1);
+    gab_coroutine_free(co);
+    module_free(vm, "Mode");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/gab_module_free_test_XXXXXX");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    assert(!gab_vm_snapshot(vm, path, &err));
+    remove(path);
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_a_mode_rotates(false);
+    test_a_mode_rotates(true);
+    test_an_imported_module_is_kept();
+    test_a_free_is_refused();
+
+    printf("module_free_test: all tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+// 'parallel for': a counting loop whose iterations are split into chunks and
+// run on the task pool. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SLOTS 4096
+
+// Where the scripts put what each iteration computed. One slot per index, so
+// iterations never write the same one, and a count of every call to check no
+// iteration ran twice.
+static atomic_int results[SLOTS];
+static atomic_int puts_made;
+
+static int32_t put(int32_t index, int32_t value) {
+    assert(index >= 0 && index < SLOTS);
+
+    atomic_store(&results[index], value);
+    atomic_fetch_add(&puts_made, 1);
+
+    return 0;
+}
+
+static void reset(void) {
+    for (size_t i = 0; i < SLOTS; i++) {
+        atomic_store(&results[i], -1);
+    }
+
+    atomic_store(&puts_made, 0);
+}
+
+// A VM with 'put' bound, as every script here declares it, and 'source' loaded.
+static GabVM *load(const char *source) {
+    GabVM *vm = gab_vm_new();
+
+    GabError err;
+    assert(gab_extern_ii_i(vm, "t", "put", put, &err));
+    test_load(vm, "<parallel>", source);
+
+    return vm;
+}
+
+static const char *const LOOP_SOURCE = "module t;\n"
+                                       "extern func put(index: int, value: int): int;\n"
+                                       "struct Box { scale: int }\n"
+                                       "func squares(n: int): int {\n"
+                                       "    parallel for let i: int = 0; i < n; i += 1 { put(i, i * i); }\n"
+                                       "    return n;\n"
+                                       "}\n"
+                                       "func scaled(n: int): int {\n"
+                                       "    let b: *Box = new Box;\n"
+                                       "    b.scale = 3;\n"
+                                       "    let offset: int = 100;\n"
+                                       "    parallel for let i: int = 1; i < n + 1; i += 1 {\n"
+                                       "        let own: *Box = new Box;\n"
+                                       "        own.scale = b.scale * i + offset;\n"
+                                       "        if i % 2 == 0 { continue; }\n"
+                                       "        put(i, own.scale);\n"
+                                       "    }\n"
+                                       "    return b.scale;\n"
+                                       "}\n"
+                                       "func empty(n: int): int {\n"
+                                       "    parallel for let i: int = n; i < 0; i += 1 { put(i, 1); }\n"
+                                       "    return 7;\n"
+                                       "}\n"
+                                       "func grid(n: int): int {\n"
+                                       "    parallel for let row: int = 0; row < n; row += 1 {\n"
+                                       "        parallel for let col: int = 0; col < n; col += 1 { put(row * n + col, row + col); }\n"
+                                       "    }\n"
+                                       "    return n;\n"
+                                       "}\n";
+
+// Every iteration runs exactly once, whatever the chunks came to, and the
+// frame carries on after the loop as it would after any other.
+static void test_every_iteration_runs_once(void) {
+    GabVM *vm = load(LOOP_SOURCE);
+
+    GabError err;
+    int32_t out = 0;
+
+    int32_t sizes[] = {1, 2, 3, 7, 64, 1000, SLOTS};
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int32_t n = sizes[s];
+        reset();
+
+        assert(test_call_int(vm, "t", "squares", n, &out, &err) == GAB_OK && out == n);
+        assert(atomic_load(&puts_made) == n);
+
+        for (int32_t i = 0; i < n; i++) {
+            assert(atomic_load(&results[i]) == i * i);
+        }
+
+        assert(n == SLOTS || atomic_load(&results[n]) == -1);
+    }
+
+    // A range that is empty from the start runs nothing.
+    reset();
+    assert(test_call_int(vm, "t", "empty", 5, &out, &err) == GAB_OK && out == 7);
+    assert(atomic_load(&puts_made) == 0);
+
+    // A 'parallel for' inside another splits each chunk's rows again.
+    reset();
+    assert(test_call_int(vm, "t", "grid", 40, &out, &err) == GAB_OK && out == 40);
+    assert(atomic_load(&puts_made) == 40 * 40);
+
+    for (int32_t i = 0; i < 40 * 40; i++) {
+        assert(atomic_load(&results[i]) == i / 40 + i % 40);
+    }
+
+    gab_vm_free(vm);
+}
+
+// The body reads what the frame holds, through its pointers too, owns what it
+// makes itself, and may skip the rest of an iteration.
+static void test_the_body_reads_the_frame(void) {
+    GabVM *vm = load(LOOP_SOURCE);
+
+    GabError err;
+    int32_t out = 0;
+
+    reset();
+    assert(test_call_int(vm, "t", "scaled", 999, &out, &err) == GAB_OK && out == 3);
+    assert(atomic_load(&puts_made) == 500);
+
+    for (int32_t i = 1; i <= 999; i++) {
+        assert(atomic_load(&results[i]) == (i % 2 == 0 ? -1 : 3 * i + 100));
+    }
+
+    // A context runs its loops on the same pool.
+    GabVM *context = gab_context_new(vm, &err);
+    assert(context);
+
+    reset();
+    assert(test_call_int(context, "t", "squares", 2000, &out, &err) == GAB_OK && out == 2000);
+    assert(atomic_load(&puts_made) == 2000);
+
+    gab_vm_free(context);
+    gab_vm_free(vm);
+}
+
+// A body too long for the fused step still loops: the chunk's step falls back
+// to a compare and a jump.
+static void test_a_long_body_still_loops(void) {
+    char source[8192];
+    size_t used = (size_t)snprintf(source, sizeof(source),
+                                   "module t;\n"
+                                   "extern func put(index: int, value: int): int;\n"
+                                   "func long_body(n: int): int {\n"
+                                   "    parallel for let i: int = 0; i < n; i += 1 {\n"
+                                   "        let v: int = i;\n");
+
+    for (int i = 0; i < 100; i++) {
+        used += (size_t)snprintf(source + used, sizeof(source) - used, "        v = v + 1;\n");
+    }
+
+    snprintf(source + used, sizeof(source) - used,
+             "        put(i, v);\n"
+             "    }\n"
+             "    return n;\n"
+             "}\n");
+
+    GabVM *vm = load(source);
+
+    GabError err;
+    int32_t out = 0;
+
+    reset();
+    assert(test_call_int(vm, "t", "long_body", 300, &out, &err) == GAB_OK && out == 300);
+    assert(atomic_load(&puts_made) == 300);
+
+    for (int32_t i = 0; i < 300; i++) {
+        assert(atomic_load(&results[i]) == i + 100);
+    }
+
+    gab_vm_free(vm);
+}
+
+// An iteration that fails fails the loop, once every chunk has finished, and
+// the frame unwinds from there; the VM is as usable after as before.
+static void test_a_failed_iteration_fails_the_loop(void) {
+    GabVM *vm = load("module t;\n"
+                     "extern func put(index: int, value: int): int;\n"
+                     "struct Box { value: int }\n"
+                     "func divide(n: int): int {\n"
+                     "    let keep: *Box = new Box;\n"
+                     "    parallel for let i: int = 0; i < n; i += 1 {\n"
+                     "        let own: *Box = new Box;\n"
+                     "        put(i, 1000 / (i - 50));\n"
+                     "    }\n"
+                     "    return n;\n"
+                     "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    reset();
+    assert(test_call_int(vm, "t", "divide", 40, &out, &err) == GAB_OK && out == 40);
+
+    reset();
+    assert(test_call_int(vm, "t", "divide", 1000, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "zero"));
+
+    reset();
+    assert(test_call_int(vm, "t", "divide", 50, &out, &err) == GAB_OK && out == 50);
+    assert(atomic_load(&puts_made) == 50);
+
+    gab_vm_free(vm);
+}
+
+// What an iteration may touch is settled when the script is loaded.
+static void test_parallel_for_is_checked(void) {
+    static const char *const BAD[] = {
+        // Assigning a variable every iteration shares.
+        "module t;\nfunc f(n: int): int { let s: int = 0;\n"
+        "parallel for let i: int = 0; i < n; i += 1 { s += i; } return s; }\n",
+        // Nor the counter, which each chunk steps itself.
+        "module t;\nfunc f(n: int): int {\n"
+        "parallel for let i: int = 0; i < n; i += 1 { i = n; } return n; }\n",
+        // Writing through a shared pointer.
+        "module t;\nstruct Box { v: int }\nfunc f(n: int): int { let b: *Box = new Box;\n"
+        "parallel for let i: int = 0; i < n; i += 1 { b.v = i; } return n; }\n",
+        // Borrowing a shared variable.
+        "module t;\nfunc g(x: ref int) { }\nfunc f(n: int): int { let s: int = 0;\n"
+        "parallel for let i: int = 0; i < n; i += 1 { g(&s); } return n; }\n",
+        // Passing a shared pointer on.
+        "module t;\nstruct Box { v: int }\nfunc g(b: ref Box): int { return b.v; }\n"
+        "func f(n: int): int { let b: *Box = new Box;\n"
+        "parallel for let i: int = 0; i < n; i += 1 { let x: int = g(b); } return n; }\n",
+        // Leaving the body any way but the end of an iteration.
+        "module t;\nfunc f(n: int): int {\n"
+        "parallel for let i: int = 0; i < n; i += 1 { break; } return n; }\n",
+        "module t;\nfunc f(n: int): int {\n"
+        "parallel for let i: int = 0; i < n; i += 1 { return i; } return n; }\n",
+        "module t;\nfunc f(n: int): int {\n"
+        "parallel for let i: int = 0; i < n; i += 1 { yield i; } return n; }\n",
+        // Only the counting shape can be split up front.
+        "module t;\nfunc f(n: int): int {\n"
+        "parallel for let i: int = 0; i < n; i += 2 { } return n; }\n",
+        "module t;\nfunc f(n: int): int { let i: int = 0;\n"
+        "parallel for i < n { } return n; }\n",
+        // Module code is declarations only.
+        "module t;\nparallel for let i: int = 0; i < 4; i += 1 { }\n",
+        // 'parallel' marks a loop and nothing else.
+        "module t;\nfunc f(n: int): int { parallel let i: int = 0; return n; }\n",
+    };
+
+    for (size_t i = 0; i < sizeof(BAD) / sizeof(BAD[0]); i++) {
+        GabVM *vm = gab_vm_new();
+
+        GabError err;
+        if (gab_load(vm, "<bad>", BAD[i], &err)) {
+            fprintf(stderr, "loaded: %s\n", BAD[i]);
+            assert(false);
+        }
+        assert(err.line > 0);
+
+        gab_vm_free(vm);
+    }
+
+    // A 'break' from a loop inside the body leaves only that loop.
+    GabVM *vm = load("module t;\n"
+                     "extern func put(index: int, value: int): int;\n"
+                     "func f(n: int): int {\n"
+                     "    parallel for let i: int = 0; i < n; i += 1 {\n"
+                     "        let found: int = 0;\n"
+                     "        for let j: int = 0; j < n; j += 1 { if j * j >= i { found = j; break; } }\n"
+                     "        put(i, found);\n"
+                     "    }\n"
+                     "    return n;\n"
+                     "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    reset();
+    assert(test_call_int(vm, "t", "f", 100, &out, &err) == GAB_OK && out == 100);
+
+    for (int32_t i = 0; i < 100; i++) {
+        int32_t root = atomic_load(&results[i]);
+        assert(root * root >= i && (root == 0 || (root - 1) * (root - 1) < i));
+    }
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_every_iteration_runs_once();
+    test_the_body_reads_the_frame();
+    test_a_long_body_still_loops();
+    test_a_failed_iteration_fails_the_loop();
+    test_parallel_for_is_checked();
+
+    printf("parallel_test: all tests passed\n");
+
+    return 0;
+}
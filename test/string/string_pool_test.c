@@ -116,6 +116,36 @@ static void test_pointers_survive_resize() {
     test_context_free(&ctx);
 }
 
+// A failed compile takes back only the strings it was first to ask for: one
+// the pool had already, or one another owner asked for since, stays.
+static void test_withdraw_takes_back_only_an_owners_own() {
+    TestContext ctx;
+    test_context_init(&ctx);
+
+    String *before = string_from_cstr(&ctx.strings, "health");
+
+    StringOwner owner = {0};
+    StringOwner other = {0};
+
+    ctx.strings.owner = &owner;
+    assert(string_from_cstr(&ctx.strings, "health") == before);
+    string_from_cstr(&ctx.strings, "mana");
+    String *shared = string_from_cstr(&ctx.strings, "stamina");
+
+    ctx.strings.owner = &other;
+    assert(string_from_cstr(&ctx.strings, "stamina") == shared);
+
+    ctx.strings.owner = NULL;
+    string_pool_withdraw(&ctx.strings, &owner);
+
+    assert(string_from_cstr(&ctx.strings, "health") == before);
+    assert(string_from_cstr(&ctx.strings, "stamina") == shared);
+    assert(strcmp(string_from_cstr(&ctx.strings, "mana")->data, "mana") == 0);
+    assert(ctx.strings.map.size == 3);
+
+    test_context_free(&ctx);
+}
+
 int main(void) {
     test_interning_returns_same_pointer();
     test_distinct_text_differs();
@@ -123,6 +153,7 @@ int main(void) {
     test_data_is_null_terminated();
     test_pools_are_independent();
     test_pointers_survive_resize();
+    test_withdraw_takes_back_only_an_owners_own();
 
     printf("All string pool tests passed\n");
     return 0;
@@ -0,0 +1,81 @@
+#ifndef GAB_TEST_GAB_API_H
+#define GAB_TEST_GAB_API_H
+
+// Loading units and calling into them through gab.h, for the tests written
+// against the public API alone. Nearly every one of them opens by loading a
+// unit that must load and calling a function of one int, so those steps live
+// here rather than being copied, as run.h's do for the tests that reach inside
+// the VM.
+//
+// Header-only and 'static inline', matching run.h, and including nothing but
+// gab.h, so a test that includes it is still written against gab.h alone.
+
+#include "gab.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Loads a unit that must load, printing why it did not before the test fails,
+// since an assertion alone would not say.
+static inline void test_load(GabVM *vm, const char *name, const char *source) {
+    GabError err;
+
+    if (!gab_load(vm, name, source, &err)) {
+        fprintf(stderr, "load failed: %s\n", err.message);
+        assert(false);
+    }
+}
+
+// A new VM with 'source' loaded into it, which the caller frees.
+static inline GabVM *test_load_vm(const char *source) {
+    GabVM *vm = gab_vm_new();
+
+    test_load(vm, "<test>", source);
+
+    return vm;
+}
+
+// Calls a function of one int and answers how the call went, with what it
+// returned in '*out'. For the tests that expect some calls to fail.
+static inline GabStatus test_call_func_int(GabVM *vm, GabFunc *fn, int32_t arg, int32_t *out, GabError *err) {
+    GabCall *call = gab_call_init(fn, err);
+    assert(call);
+    assert(gab_arg_int(call, 0, arg));
+
+    GabStatus status = gab_call(vm, call, out, err);
+
+    gab_call_free(call);
+
+    return status;
+}
+
+// As test_call_func_int, with the function looked up by name.
+static inline GabStatus test_call_int(GabVM *vm, const char *module, const char *name, int32_t arg,
+                                      int32_t *out, GabError *err) {
+    return test_call_func_int(vm, gab_lookup(vm, module, name, err), arg, out, err);
+}
+
+// What a call of one int that must succeed returns.
+static inline int32_t test_func_int_result(GabVM *vm, GabFunc *fn, int32_t arg) {
+    GabError err;
+    int32_t out = 0;
+
+    if (test_call_func_int(vm, fn, arg, &out, &err) != GAB_OK) {
+        fprintf(stderr, "call failed: %s\n", err.message);
+        assert(false);
+    }
+
+    return out;
+}
+
+// As test_func_int_result, with the function looked up by name.
+static inline int32_t test_int_result(GabVM *vm, const char *module, const char *name, int32_t arg) {
+    GabError err;
+    GabFunc *fn = gab_lookup(vm, module, name, &err);
+    assert(fn);
+
+    return test_func_int_result(vm, fn, arg);
+}
+
+#endif
@@ -233,7 +233,8 @@ static inline void test_program_free(TestProgram *program) {
 static inline Chunk *test_top_chunk(TestProgram *program) { return program->script.chunk; }
 
 // The chunk of a declared function, by declaration order. A builtin method is
-// an extern, in its own table, so nothing precedes what a unit contributed.
+// answered by an instruction and has no prototype, so nothing precedes what a
+// unit contributed.
 static inline Chunk *test_func_chunk(TestProgram *program, size_t index) {
     assert(index < program->vm->program.prototypes.size);
 
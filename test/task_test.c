@@ -0,0 +1,267 @@
+// Tasks: 'spawn' starts a script call on the pool's threads, 'join' waits for
+// it. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Tasks that spawn tasks: each level splits in two until the work is small,
+// which puts far more tasks on the deques than there are threads to run them.
+static void test_tasks_spawn_and_join_tasks(void) {
+    GabVM *vm = test_load_vm("module t;\n"
+                             "func fib(n: int): int {\n"
+                             "    if n < 2 { return n; }\n"
+                             "    return fib(n - 1) + fib(n - 2);\n"
+                             "}\n"
+                             "func pfib(n: int): int {\n"
+                             "    if n < 12 { return fib(n); }\n"
+                             "    let a = spawn pfib(n - 1);\n"
+                             "    let b = spawn pfib(n - 2);\n"
+                             "    return join a + join b;\n"
+                             "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "pfib", 24, &out, &err) == GAB_OK);
+    assert(out == 46368);
+
+    // Below the split, no task is made at all.
+    assert(test_call_int(vm, "t", "pfib", 10, &out, &err) == GAB_OK);
+    assert(out == 55);
+
+    gab_vm_free(vm);
+}
+
+static const char *const RANGE_SOURCE = "module t;\n"
+                                        "func range_sum(from: int, to: int): int {\n"
+                                        "    let total: int = 0;\n"
+                                        "    for let i: int = from; i < to; i = i + 1 { total = total + i; }\n"
+                                        "    return total;\n"
+                                        "}\n"
+                                        "func split(n: int): int {\n"
+                                        "    let a = spawn range_sum(0, n);\n"
+                                        "    let b = spawn range_sum(n, 2 * n);\n"
+                                        "    let c = spawn range_sum(2 * n, 3 * n);\n"
+                                        "    let d = spawn range_sum(3 * n, 4 * n);\n"
+                                        "    return join a + join b + join c + join d;\n"
+                                        "}\n";
+
+// The pool belongs to the VM, and a context spawns into it as the VM does.
+static void test_a_context_shares_the_pool(void) {
+    GabVM *vm = test_load_vm(RANGE_SOURCE);
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "split", 1000, &out, &err) == GAB_OK);
+    assert(out == 3999 * 4000 / 2);
+
+    GabVM *context = gab_context_new(vm, &err);
+    assert(context);
+
+    for (int32_t n = 1; n <= 64; n++) {
+        assert(test_call_int(context, "t", "split", n, &out, &err) == GAB_OK);
+        assert(out == (4 * n - 1) * (4 * n) / 2);
+    }
+
+    gab_vm_free(context);
+    gab_vm_free(vm);
+}
+
+// A struct comes back by value and an object comes back owned by the joiner;
+// a task nobody joins is released with its variable, and takes its result
+// with it.
+static void test_results_cross_back_to_the_joiner(void) {
+    GabVM *vm = test_load_vm("module t;\n"
+                             "struct Pair { lo: int, hi: int }\n"
+                             "struct Box { value: int }\n"
+                             "func pair(x: int): Pair {\n"
+                             "    let p: Pair;\n"
+                             "    p.lo = x;\n"
+                             "    p.hi = x * 10;\n"
+                             "    return p;\n"
+                             "}\n"
+                             "func boxed(v: int): *Box {\n"
+                             "    let b: *Box = new Box;\n"
+                             "    b.value = v;\n"
+                             "    return b;\n"
+                             "}\n"
+                             "func by_value(x: int): int {\n"
+                             "    let t = spawn pair(x);\n"
+                             "    let p: Pair = join t;\n"
+                             "    return p.lo + p.hi;\n"
+                             "}\n"
+                             "func owned(v: int): int {\n"
+                             "    let t = spawn boxed(v);\n"
+                             "    let b: *Box = join t;\n"
+                             "    return b.value + 1;\n"
+                             "}\n"
+                             "func dropped(v: int): int {\n"
+                             "    let t = spawn boxed(v);\n"
+                             "    let u = spawn pair(v);\n"
+                             "    return v;\n"
+                             "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "by_value", 4, &out, &err) == GAB_OK && out == 44);
+    assert(test_call_int(vm, "t", "owned", 4, &out, &err) == GAB_OK && out == 5);
+
+    for (int32_t i = 0; i < 100; i++) {
+        assert(test_call_int(vm, "t", "dropped", i, &out, &err) == GAB_OK && out == i);
+    }
+
+    gab_vm_free(vm);
+}
+
+// A task that fails fails the join, with the task's own reason; the caller
+// unwinds from there as from any other runtime failure.
+static void test_a_failed_task_fails_its_join(void) {
+    GabVM *vm = test_load_vm("module t;\n"
+                             "struct Box { value: int }\n"
+                             "func divide(x: int): int { return 100 / x; }\n"
+                             "func run(x: int): int {\n"
+                             "    let keep: *Box = new Box;\n"
+                             "    let t = spawn divide(x);\n"
+                             "    return join t;\n"
+                             "}\n"
+                             "func twice(x: int): int {\n"
+                             "    let t = spawn divide(x);\n"
+                             "    let total: int = 0;\n"
+                             "    for let i: int = 0; i < 2; i = i + 1 { total = total + join t; }\n"
+                             "    return total;\n"
+                             "}\n");
+
+    GabError err;
+    int32_t out = 0;
+
+    assert(test_call_int(vm, "t", "run", 4, &out, &err) == GAB_OK && out == 25);
+
+    assert(test_call_int(vm, "t", "run", 0, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "task failed"));
+
+    // The VM is as usable after as before.
+    assert(test_call_int(vm, "t", "run", 5, &out, &err) == GAB_OK && out == 20);
+
+    assert(test_call_int(vm, "t", "twice", 5, &out, &err) == GAB_ERR_RUNTIME);
+    assert(strstr(err.message, "already joined"));
+
+    gab_vm_free(vm);
+}
+
+// What may cross to another thread is settled when the script is loaded.
+static void test_spawn_and_join_are_checked(void) {
+    static const char *const BAD[] = {
+        // Not bound to a variable, so nothing could join it.
+        "module t;\nfunc f(x: int): int { return x; }\nfunc g(): int { return join spawn f(1); }\n",
+        // At module level, with no caller to join for it.
+        "module t;\nfunc f(x: int): int { return x; }\nlet t = spawn f(1);\n",
+        // A borrow would be shared with the caller's frame.
+        "module t;\nfunc f(x: ref int): int { return *x; }\n"
+        "func g(): int { let v: int = 1; let t = spawn f(&v); return join t; }\n",
+        // A task is joined through its variable, never copied.
+        "module t;\nfunc f(x: int): int { return x; }\n"
+        "func g(): int { let t = spawn f(1); let u = t; return join u; }\n",
+        // Only a task can be joined.
+        "module t;\nfunc g(): int { let x: int = 1; return join x; }\n",
+        // Only a script function can be spawned.
+        "module t;\nextern func h(x: int): int;\nfunc g(): int { let t = spawn h(1); return join t; }\n",
+        // Nor anything that is not a call.
+        "module t;\nfunc g(): int { let t = spawn 1; return join t; }\n",
+    };
+
+    for (size_t i = 0; i < sizeof(BAD) / sizeof(BAD[0]); i++) {
+        GabVM *vm = gab_vm_new();
+
+        GabError err;
+        assert(!gab_load(vm, "<bad>", BAD[i], &err));
+        assert(err.line > 0);
+
+        gab_vm_free(vm);
+    }
+
+    // A task of a function that returns nothing is still joined.
+    GabVM *vm = test_load_vm("module t;\n"
+                             "func work(x: int) { let y: int = x * 2; }\n"
+                             "func run(x: int): int { let t = spawn work(x); join t; return x; }\n");
+
+    GabError err;
+    int32_t out = 0;
+    assert(test_call_int(vm, "t", "run", 3, &out, &err) == GAB_OK && out == 3);
+
+    gab_vm_free(vm);
+}
+
+// A coroutine can yield between a spawn and its join, handing the host back a
+// VM a worker is still running the task on. Nothing may grow the tables the
+// task reads until it is joined -- or discarded with the coroutine.
+static void test_nothing_loads_while_a_yielded_task_runs(void) {
+    GabVM *vm = test_load_vm("module t;\n"
+                             "func work(n: int): int {\n"
+                             "    let total: int = 0;\n"
+                             "    for let i: int = 0; i < n; i = i + 1 { total = total + i % 7; }\n"
+                             "    return total;\n"
+                             "}\n"
+                             "func later(n: int): int { let t = spawn work(n); yield 1; return join t; }\n");
+
+    GabError err;
+    int32_t expected = 0;
+    assert(test_call_int(vm, "t", "work", 100000, &expected, &err) == GAB_OK);
+
+    GabCall *call = gab_call_init(gab_lookup(vm, "t", "later", &err), &err);
+    assert(call && gab_arg_int(call, 0, 100000));
+
+    // Run through to the join: no load of any kind until then.
+    GabCoroutine *co = gab_coroutine_new(vm, call, &err);
+    assert(co);
+
+    int32_t out = 0;
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 1);
+
+    assert(!gab_load(vm, "<more>", "module m;\nfunc two(): int { return 2; }\n", &err));
+    assert(strstr(err.message, "task"));
+    assert(!gab_load_async(vm, "<more>", "module m;\nfunc two(): int { return 2; }\n", &err));
+    assert(strstr(err.message, "task"));
+
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == expected);
+    assert(gab_coroutine_done(co));
+    gab_coroutine_free(co);
+
+    // A load begun before the yield is not finished after it, and a coroutine
+    // abandoned mid-task discards the task.
+    GabLoad *pending = gab_load_async(vm, "<pending>", "module p;\nfunc one(): int { return 1; }\n", &err);
+    assert(pending);
+
+    co = gab_coroutine_new(vm, call, &err);
+    assert(co);
+    assert(gab_resume(co, &out, &err) == GAB_OK && out == 1);
+
+    assert(!gab_load_finish(pending, &err));
+    assert(strstr(err.message, "task"));
+
+    gab_coroutine_free(co);
+    gab_call_free(call);
+
+    assert(gab_load_finish(pending, &err));
+    assert(gab_load(vm, "<more>", "module m;\nfunc two(): int { return 2; }\n", &err));
+
+    gab_vm_free(vm);
+}
+
+int main(void) {
+    test_tasks_spawn_and_join_tasks();
+    test_a_context_shares_the_pool();
+    test_results_cross_back_to_the_joiner();
+    test_a_failed_task_fails_its_join();
+    test_spawn_and_join_are_checked();
+    test_nothing_loads_while_a_yielded_task_runs();
+
+    printf("task_test: all tests passed\n");
+
+    return 0;
+}
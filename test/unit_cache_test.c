@@ -0,0 +1,190 @@
+// Unit caches: a unit's bodies saved compiled by one VM and loaded by another
+// in their place. Written against gab.h alone.
+#include "gab.h"
+#include "support/gab_api.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *BASE = "module L;\n"
+                          "struct Point { x: int, y: int }\n"
+                          "func twice(x: int): int { return x * 2; }\n"
+                          "func (p: ref Point) sum(): int { return p.x + p.y; }\n";
+
+static const char *CACHED = "module L;\n"
+                            "struct Counter { n: int }\n"
+                            "func (c: ref Counter) bump(by: int): int { c.n += by; return c.n; }\n"
+                            "func entry(x: int): int {\n"
+                            "    let f: float = 2.5;\n"
+                            "    let g: float = 2.0;\n"
+                            "    if f > g { return later(x); }\n"
+                            "    return 0;\n"
+                            "}\n"
+                            "func helper(x: int): int {\n"
+                            "    let c: *Counter = new Counter;\n"
+                            "    c.bump(x);\n"
+                            "    let p: *Point = new Point;\n"
+                            "    p.x = c.bump(1);\n"
+                            "    p.y = twice(x);\n"
+                            "    return p.sum();\n"
+                            "}\n"
+                            "func later(x: int): int {\n"
+                            "    let s: string = \"{ braces } in a string\";\n"
+                            "    let t: string = \"{ braces } in a string\";\n"
+                            "    if s == t { return x + 20; }\n"
+                            "    return 0;\n"
+                            "}\n";
+
+static int32_t call_ok(GabVM *vm, const char *module, const char *name, int32_t arg) {
+    GabError err;
+    int32_t out = 0;
+
+    GabCall *call = gab_call_init(gab_lookup(vm, module, name, &err), &err);
+    assert(call);
+    assert(gab_arg_int(call, 0, arg));
+
+    GabStatus status = gab_call(vm, call, &out, &err);
+    if (status != GAB_OK) {
+        fprintf(stderr, "call failed: %s\n", err.message);
+        assert(false);
+    }
+
+    gab_call_free(call);
+
+    return out;
+}
+
+// Saved by one VM and loaded by another that loaded what it depends on: the
+// bodies run as the compiler's own did, calls into the earlier unit and its
+// methods, literals and allocations included.
+static void test_a_saved_unit_loads_elsewhere(void) {
+    GabVM *saver = gab_vm_new();
+    test_load(saver, "base.gab", BASE);
+
+    GabError err;
+    void *data = NULL;
+    size_t size = 0;
+
+    assert(gab_save_unit(saver, "cached.gab", CACHED, &data, &size, &err));
+    assert(data && size > 0);
+
+    int32_t expected = call_ok(saver, "L", "helper", 4);
+    assert(expected == (4 + 1) + 8);
+
+    // Another VM, with its prototypes numbered otherwise: an extra unit ahead
+    // of the base shifts every index the cache could have baked in.
+    GabVM *loader = gab_vm_new();
+    test_load(loader, "first.gab",
+              "module F;\nfunc one(): int { return 1; }\nfunc two(): int { return 2; }\n");
+    test_load(loader, "base.gab", BASE);
+
+    assert(gab_load_compiled(loader, "cached.gab", CACHED, data, size, &err));
+
+    assert(call_ok(loader, "L", "helper", 4) == expected);
+    assert(call_ok(loader, "L", "later", 1) == 21);
+    assert(call_ok(loader, "L", "entry", 3) == 23);
+
+    // And lazily: the cache fills every body, so nothing is left to compile.
+    GabVM *lazy = gab_vm_new();
+    gab_defer_bodies(lazy, true);
+    test_load(lazy, "base.gab", BASE);
+
+    assert(gab_load_compiled(lazy, "cached.gab", CACHED, data, size, &err));
+    assert(call_ok(lazy, "L", "helper", 4) == expected);
+    assert(gab_compile_deferred(lazy, &err));
+
+    free(data);
+
+    gab_vm_free(lazy);
+    gab_vm_free(loader);
+    gab_vm_free(saver);
+}
+
+// A cache of other source is refused before anything declares, so the source
+// then loads as usual.
+static void test_a_stale_cache_is_refused(void) {
+    GabVM *saver = gab_vm_new();
+
+    GabError err;
+    void *data = NULL;
+    size_t size = 0;
+
+    assert(gab_save_unit(saver, "s.gab", "module S;\nfunc f(x: int): int { return x + 1; }\n", &data, &size,
+                         &err));
+
+    GabVM *loader = gab_vm_new();
+    const char *edited = "module S;\nfunc f(x: int): int { return x + 2; }\n";
+
+    assert(!gab_load_compiled(loader, "s.gab", edited, data, size, &err));
+    assert(strstr(err.message, "stale"));
+
+    test_load(loader, "s.gab", edited);
+    assert(call_ok(loader, "S", "f", 1) == 3);
+
+    // Nor is anything but a cache taken for one.
+    assert(!gab_load_compiled(loader, "t.gab", "module T;\n", "not a cache", 11, &err));
+
+    unsigned char *truncated = malloc(size);
+    memcpy(truncated, data, size);
+
+    GabVM *other = gab_vm_new();
+    assert(!gab_load_compiled(other, "s.gab", "module S;\nfunc f(x: int): int { return x + 1; }\n",
+                              truncated, size - 3, &err));
+
+    free(truncated);
+    free(data);
+
+    gab_vm_free(other);
+    gab_vm_free(loader);
+    gab_vm_free(saver);
+}
+
+// Bytecode compiled against one layout of a module it imports is refused
+// against another, even from unchanged source.
+static void test_a_changed_import_is_refused(void) {
+    const char *user = "module U;\nimport Lib;\n"
+                       "func g(x: int): int { let t: Lib::T; t.v = x; return t.v * 10; }\n";
+
+    GabVM *saver = gab_vm_new();
+    test_load(saver, "lib.gab", "module Lib;\nstruct T { v: int, w: int }\n");
+
+    GabError err;
+    void *data = NULL;
+    size_t size = 0;
+
+    assert(gab_save_unit(saver, "user.gab", user, &data, &size, &err));
+
+    GabVM *same = gab_vm_new();
+    test_load(same, "lib.gab", "module Lib;\nstruct T { v: int, w: int }\n");
+    assert(gab_load_compiled(same, "user.gab", user, data, size, &err));
+    assert(call_ok(same, "U", "g", 2) == 20);
+
+    GabVM *changed = gab_vm_new();
+    test_load(changed, "lib.gab", "module Lib;\nstruct T { w: int, v: int }\n");
+
+    assert(!gab_load_compiled(changed, "user.gab", user, data, size, &err));
+    assert(strstr(err.message, "'Lib'"));
+
+    // Refused without declaring, so the source still loads.
+    test_load(changed, "user.gab", user);
+    assert(call_ok(changed, "U", "g", 2) == 20);
+
+    free(data);
+
+    gab_vm_free(changed);
+    gab_vm_free(same);
+    gab_vm_free(saver);
+}
+
+int main(void) {
+    test_a_saved_unit_loads_elsewhere();
+    test_a_stale_cache_is_refused();
+    test_a_changed_import_is_refused();
+
+    printf("unit_cache_test: all tests passed\n");
+
+    return 0;
+}
@@ -28,9 +28,41 @@ static void test_instruction_addition() {
     chunk_free(chunk);
 }
 
+// Moved out, a chunk reads the same from where it was moved to, and freeing it
+// leaves that memory alone.
+static void test_move_into() {
+    Chunk *chunk = chunk_create();
+    chunk_add_instruction(chunk, 0xDEADBEEF);
+    chunk_add_instruction(chunk, 0xCAFEBABE);
+    chunk_add_instruction(chunk, 0x12345678);
+    constpool_add(chunk->const_pool, (Constant){.as_int = 42});
+    constpool_add(chunk->const_pool, (Constant){.as_float = 2.5f});
+
+    size_t footprint = chunk_footprint(chunk);
+    assert(footprint == 3 * sizeof(Instruction) + 2 * sizeof(Constant));
+
+    uint32_t memory[5];
+    chunk_move_into(chunk, memory);
+
+    assert(chunk->borrowed);
+    assert(chunk->instructions.data == memory && chunk->instructions.size == 3);
+    assert(chunk->instructions.data[1] == 0xCAFEBABE);
+    assert(constpool_get(chunk->const_pool, 0).as_int == 42);
+    assert(constpool_get(chunk->const_pool, 1).as_float == 2.5f);
+
+    // Once borrowed, moved again without freeing what it was lent.
+    uint32_t again[5];
+    chunk_move_into(chunk, again);
+    assert(chunk->instructions.data == again && again[2] == 0x12345678);
+    assert(memory[0] == 0xDEADBEEF);
+
+    chunk_free(chunk);
+}
+
 int main() {
     test_chunk_creation();
     test_instruction_addition();
+    test_move_into();
 
     return 0;
 }
@@ -0,0 +1,137 @@
+// Intrinsics: 's.len()', 'sqrt', 'abs', 'min' and the rest. Each is a call in
+// the source and a single instruction in the chunk, so the claims here are
+// both what they compute and that no call was emitted to compute it.
+#include "support/run.h"
+#include "vm/opcode.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static void test_sqrt_floor_and_ceil() {
+    assert(test_run_float("func f(): float { let x: float = 16.0; return sqrt(x); }\n"
+                          "let r: float = f();\n") == 4.0f);
+
+    assert(test_run_float("func f(): float { let x: float = 2.5; return floor(x); }\n"
+                          "let r: float = f();\n") == 2.0f);
+
+    assert(test_run_float("func f(): float { let x: float = -2.5; return ceil(x); }\n"
+                          "let r: float = f();\n") == -2.0f);
+}
+
+// 'abs', 'min' and 'max' take either numeric type and yield the one given.
+static void test_abs_min_max_on_both_numeric_types() {
+    assert(test_run_int("func f(): int { let x: int = -7; return abs(x); }\n"
+                        "let r: int = f();\n") == 7);
+
+    assert(test_run_float("func f(): float { let x: float = -1.5; return abs(x); }\n"
+                          "let r: float = f();\n") == 1.5f);
+
+    assert(test_run_int("func f(): int { let a: int = 3; let b: int = -4; return min(a, b) + max(a, b); }\n"
+                        "let r: int = f();\n") == -1);
+
+    assert(test_run_float("func f(): float { let a: float = 0.5; let b: float = 2.0; return max(a, b) - "
+                          "min(a, b); }\n"
+                          "let r: float = f();\n") == 1.5f);
+}
+
+// The most negative int has no positive counterpart, so it wraps to itself as
+// '-x' already does rather than overflowing.
+static void test_abs_of_int_min_wraps() {
+    assert(test_run_int("func f(): int { let x: int = -2147483647 - 1; return abs(x); }\n"
+                        "let r: int = f();\n") == INT32_MIN);
+}
+
+// Inside, below and above the range. A small int bound rides in the
+// instruction, so the literal forms exercise the immediate path.
+static void test_clamp_pins_to_the_range() {
+    assert(test_run_int("func f(): int { let x: int = 5; return clamp(x, 0, 10); }\n"
+                        "let r: int = f();\n") == 5);
+    assert(test_run_int("func f(): int { let x: int = -5; return clamp(x, 0, 10); }\n"
+                        "let r: int = f();\n") == 0);
+    assert(test_run_int("func f(): int { let x: int = 50; let hi: int = 10; return clamp(x, 0, hi); }\n"
+                        "let r: int = f();\n") == 10);
+
+    assert(test_run_float("func f(): float { let x: float = 1.5; return clamp(x, 0.0, 1.0); }\n"
+                          "let r: float = f();\n") == 1.0f);
+}
+
+// Clamping reads x and never writes it: the result is a fresh register.
+static void test_clamp_leaves_its_operand_alone() {
+    assert(test_run_int("func f(): int { let x: int = 50; let y: int = clamp(x, 0, 10); return x + y; }\n"
+                        "let r: int = f();\n") == 60);
+}
+
+// The builtin method answers from the header, as it did when it was a call.
+static void test_len_counts_characters() {
+    assert(test_run_int("func f(): int { let s: string = \"hello\"; return s.len(); }\n"
+                        "let r: int = f();\n") == 5);
+}
+
+// Each intrinsic is its own instruction, and neither table is called into.
+static void test_intrinsics_emit_no_call() {
+    TestProgram program = test_compile("func f(s: string, x: float, n: int): float {\n"
+                                       "    let k: int = s.len() + abs(n) + clamp(n, 0, 9);\n"
+                                       "    return sqrt(x) + min(x, 1.0);\n"
+                                       "}\n");
+
+    Chunk *chunk = test_func_chunk(&program, 0);
+
+    assert(test_count_opcode(chunk, OP_CALL) == 0);
+    assert(test_count_opcode(chunk, OP_CALL_EXTERN) == 0);
+
+    assert(test_count_opcode(chunk, OP_STR_LEN) == 1);
+    assert(test_count_opcode(chunk, OP_ABSI) == 1);
+    assert(test_count_opcode(chunk, OP_SQRTF) == 1);
+    assert(test_count_opcode(chunk, OP_MINF) == 1);
+
+    // A max, then a min into the same register.
+    assert(test_count_opcode(chunk, OP_MAXI) == 1);
+    assert(test_count_opcode(chunk, OP_MINI) == 1);
+
+    // Both of clamp's bounds are small enough to be immediates.
+    assert(test_count_opcode(chunk, OP_LOAD_CONST) == 1);
+
+    test_program_free(&program);
+}
+
+// A declaration claims the name: an intrinsic only answers one nothing else
+// does, so a program that declared its own 'min' keeps it.
+static void test_a_declaration_shadows_an_intrinsic() {
+    assert(test_run_int("func min(a: int, b: int): int { return 42; }\n"
+                        "func f(): int { return min(1, 2); }\n"
+                        "let r: int = f();\n") == 42);
+}
+
+static void test_operands_are_checked() {
+    // The rounding family is float-only.
+    assert(!test_compiles("func f(): int { let x: int = 4; return sqrt(x); }\n"));
+
+    // Mixed operand types have no single result type.
+    assert(!test_compiles("func f(): int { let a: int = 1; let b: float = 2.0; return min(a, b); }\n"));
+
+    // Only numbers.
+    assert(!test_compiles("func f(): bool { let b: bool = true; return abs(b); }\n"));
+
+    assert(!test_compiles("func f(): int { let x: int = 1; return clamp(x, 0); }\n"));
+    assert(!test_compiles("func f(): float { let x: float = 1.0; return sqrt(x, x); }\n"));
+
+    // The result is the operand type, not a wider one.
+    assert(!test_compiles("func f(): int { let x: float = 1.0; return abs(x); }\n"));
+}
+
+int main() {
+    test_sqrt_floor_and_ceil();
+    test_abs_min_max_on_both_numeric_types();
+    test_abs_of_int_min_wraps();
+    test_clamp_pins_to_the_range();
+    test_clamp_leaves_its_operand_alone();
+    test_len_counts_characters();
+    test_intrinsics_emit_no_call();
+    test_a_declaration_shadows_an_intrinsic();
+    test_operands_are_checked();
+
+    printf("intrinsic_test: all tests passed\n");
+    return 0;
+}
@@ -242,6 +242,43 @@ static void test_a_call_reaches_a_function_from_an_earlier_unit() {
     vm_free(vm);
 }
 
+// A unit's bodies are packed into one allocation as it links, each caller
+// followed by what it calls: d and a are called by nothing here and start
+// runs of their own, in the order declared, and a's run is a, b, c.
+static void test_a_unit_is_packed_in_call_order() {
+    VM *vm = vm_create();
+
+    compile_and_run(vm, "module M;\n"
+                        "func d(): int { return 4; }\n"
+                        "func c(): int { return 3; }\n"
+                        "func b(): int { return c() + 2; }\n"
+                        "func a(): int { return b() + 1; }\n"
+                        "let r: int = a();\n");
+
+    assert(loaded_protos(vm) == 4);
+
+    const Chunk *d = loaded_proto(vm, 0)->chunk;
+    const Chunk *c = loaded_proto(vm, 1)->chunk;
+    const Chunk *b = loaded_proto(vm, 2)->chunk;
+    const Chunk *a = loaded_proto(vm, 3)->chunk;
+    const Chunk *order[] = {d, a, b, c};
+
+    for (size_t i = 0; i < 4; i++) {
+        assert(order[i]->borrowed);
+    }
+
+    for (size_t i = 1; i < 4; i++) {
+        const uint8_t *end = (const uint8_t *)order[i - 1]->instructions.data + chunk_footprint(order[i - 1]);
+        assert((const uint8_t *)order[i]->instructions.data == end);
+    }
+
+    int32_t returned;
+    memcpy(&returned, vm_slot_at(vm, 0), sizeof(returned));
+    assert(returned == 6);
+
+    vm_free(vm);
+}
+
 // A unit that cannot link leaves the VM as it was. The unit numbers its own
 // prototypes and types and hands them over only once every extern in it has
 // been bound, so a failure partway through installs none of them -- and the
@@ -501,6 +538,7 @@ int main() {
     test_function_signatures_survive_a_later_compile();
     test_prototypes_survive_a_later_compile();
     test_a_call_reaches_a_function_from_an_earlier_unit();
+    test_a_unit_is_packed_in_call_order();
     test_a_unit_that_fails_to_link_installs_nothing();
     test_checking_a_unit_installs_nothing();
     test_compile_once_run_many();
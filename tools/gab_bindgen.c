@@ -0,0 +1,599 @@
+// gab-bindgen: reads a unit and writes the C header a host calls it through.
+//
+//   gab-bindgen [-I dependency.gab]... [-o bindings.h] unit.gab
+//
+// For every struct the unit's signatures reach, the header defines the C struct
+// and _Static_asserts its size, alignment and every field offset against what
+// the script computed, so layout drift is a compile error in the host rather
+// than a corrupted frame at runtime. For every function the unit declares it
+// emits a typed wrapper that writes the arguments into the VM's frame at
+// offsets fixed here and runs it with gab_frame_call: no staging copy, no
+// gab_arg_* per argument, and no kind check in any of them.
+//
+// What the compiler cannot see is whether the VM the host binds against loaded
+// the same script. '<module>_bind' checks that, once: every struct against the
+// loaded layout and every function through gab_lookup_typed.
+//
+// A unit is only declared, never linked or run, so its externs need no body
+// here and nothing it does at the top level happens. A '-I' unit is one the
+// unit imports; it is declared first, and its structs are emitted only where
+// the unit's own signatures need them.
+#include "ast/ast.h"
+#include "ast/stmt.h"
+#include "compile.h"
+#include "diagnostics.h"
+#include "gab.h"
+#include "string/string.h"
+#include "type.h"
+#include "util/list.h"
+#include "vm/args.h"
+#include "vm/vm.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A struct the header may need, and the module gab_find_type finds it in. A
+// Type does not know its module, so it is recorded from the declaration.
+typedef struct {
+    const Type *type;
+    const String *module;
+
+    // Emission state for the by-value ordering: a struct must be complete
+    // before another holds it by value.
+    bool needed;
+    bool emitted;
+} BoundStruct;
+
+#define bound_struct_list_item_free(item) ((void)(item))
+GAB_LIST(BoundStructList, bound_struct_list, BoundStruct)
+
+typedef struct {
+    FILE *out;
+
+    // The unit's module, which prefixes every name the header defines so two
+    // modules' bindings can be included together.
+    const char *module;
+
+    BoundStructList structs;
+} Bindgen;
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *source = length >= 0 ? malloc((size_t)length + 1) : NULL;
+
+    if (source && fread(source, 1, (size_t)length, file) != (size_t)length) {
+        free(source);
+        source = NULL;
+    }
+
+    if (source) {
+        source[length] = '\0';
+    }
+
+    fclose(file);
+
+    return source;
+}
+
+// Declares one unit into the VM and records the structs it declared. The
+// script is handed back for the caller to walk, or NULL on failure after the
+// diagnostics were printed.
+static ASTScript *declare_unit(VM *vm, Bindgen *gen, const char *path, char **source_out) {
+    char *source = read_file(path);
+
+    if (!source) {
+        fprintf(stderr, "gab-bindgen: cannot read '%s'\n", path);
+        return NULL;
+    }
+
+    Diagnostics diagnostics;
+    diagnostics_init(&diagnostics, vm->env.compile_arena, path);
+
+    ASTScript *script = ast_script_create();
+
+    if (!compile_declare(vm, source, script, &diagnostics)) {
+        diagnostics_print(&diagnostics, stderr);
+        diagnostics_free(&diagnostics);
+        ast_script_destroy(script);
+        free(source);
+
+        return NULL;
+    }
+
+    diagnostics_free(&diagnostics);
+
+    const String *module = string_from_ref(&vm->env.strings, script->module_name);
+
+    for (size_t i = 0; i < script->statements.size; i++) {
+        const ASTStmt *stmt = script->statements.data[i];
+
+        if (stmt->kind == STMT_STRUCT_DECL && stmt->struct_decl.type) {
+            bound_struct_list_add(&gen->structs,
+                                  (BoundStruct){.type = stmt->struct_decl.type, .module = module});
+        }
+    }
+
+    *source_out = source;
+
+    return script;
+}
+
+static BoundStruct *find_struct(Bindgen *gen, const Type *type) {
+    for (size_t i = 0; i < gen->structs.size; i++) {
+        if (gen->structs.data[i].type == type) {
+            return &gen->structs.data[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Marks a struct, and every struct it reaches, as one the header defines.
+static void need_type(Bindgen *gen, const Type *type) {
+    while (type && type->kind == TYPE_POINTER) {
+        type = type->pointee;
+    }
+
+    if (!type || type->kind != TYPE_STRUCT) {
+        return;
+    }
+
+    BoundStruct *bound = find_struct(gen, type);
+
+    if (!bound || bound->needed) {
+        return;
+    }
+
+    bound->needed = true;
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        need_type(gen, type->fields[i].type);
+    }
+}
+
+// Whether a function is one the header wraps: a free function with a body in
+// script. An extern is the host's own, and a method is not reachable through
+// gab_lookup.
+static bool func_is_bound(const ASTStmt *stmt) {
+    return stmt->kind == STMT_FUNC_DECL && stmt->func_decl.symbol && !stmt->func_decl.receiver &&
+           !stmt->func_decl.symbol->func.is_extern;
+}
+
+// A symbol only carries its name when it is an extern, so a script function's
+// is read off its declaration.
+static void func_name(const ASTStmt *stmt, char *name, size_t size) {
+    snprintf(name, size, "%.*s", (int)stmt->func_decl.name.length, stmt->func_decl.name.data);
+}
+
+// The C spelling of a script type, as it is written before a declarator.
+static void emit_c_type(FILE *out, const Type *type) {
+    switch (type->kind) {
+    case TYPE_INT:
+        fputs("int32_t", out);
+        return;
+    case TYPE_FLOAT:
+        fputs("float", out);
+        return;
+    case TYPE_BOOL:
+        fputs("bool", out);
+        return;
+    case TYPE_STRING:
+        fputs("GabString", out);
+        return;
+    case TYPE_STRUCT:
+        fputs(type->name->data, out);
+        return;
+    case TYPE_POINTER:
+        emit_c_type(out, type->pointee);
+        fputs(" *", out);
+        return;
+    // A task cannot be spelled, so no signature or field has one.
+    case TYPE_TASK:
+    case TYPE_UNKNOWN:
+    case TYPE_ERROR:
+        break;
+    }
+
+    fputs("void", out);
+}
+
+static void emit_declarator(FILE *out, const Type *type, const char *name) {
+    emit_c_type(out, type);
+    fprintf(out, "%s%s", type->kind == TYPE_POINTER ? "" : " ", name);
+}
+
+// Defines a struct after every struct it holds by value, then asserts that the
+// C compiler laid it out as the script did.
+static void emit_struct(Bindgen *gen, BoundStruct *bound) {
+    if (bound->emitted) {
+        return;
+    }
+
+    bound->emitted = true;
+
+    const Type *type = bound->type;
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        BoundStruct *held =
+            type->fields[i].type->kind == TYPE_STRUCT ? find_struct(gen, type->fields[i].type) : NULL;
+
+        if (held) {
+            emit_struct(gen, held);
+        }
+    }
+
+    const char *name = type->name->data;
+
+    fprintf(gen->out, "struct %s {\n", name);
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        fputs("    ", gen->out);
+        emit_declarator(gen->out, type->fields[i].type, type->fields[i].name->data);
+        fputs(";\n", gen->out);
+    }
+
+    fputs("};\n\n", gen->out);
+
+    fprintf(gen->out, "_Static_assert(sizeof(%s) == %zu, \"%s: size differs from the script's\");\n", name,
+            type->size, name);
+    fprintf(gen->out, "_Static_assert(_Alignof(%s) == %zu, \"%s: alignment differs from the script's\");\n",
+            name, type->alignment, name);
+
+    for (size_t i = 0; i < type->field_count; i++) {
+        const char *field = type->fields[i].name->data;
+
+        fprintf(gen->out,
+                "_Static_assert(offsetof(%s, %s) == %zu, \"%s.%s: offset differs from the script's\");\n",
+                name, field, type->fields[i].offset, name, field);
+    }
+
+    fputs("\n", gen->out);
+}
+
+static void emit_bind(Bindgen *gen, GabVM *vm, const ASTScript *script) {
+    FILE *out = gen->out;
+    const char *module = gen->module;
+
+    fprintf(out, "typedef struct {\n    GabVM *vm;\n");
+
+    for (size_t i = 0; i < script->statements.size; i++) {
+        const ASTStmt *stmt = script->statements.data[i];
+
+        if (func_is_bound(stmt)) {
+            char name[128];
+            func_name(stmt, name, sizeof(name));
+
+            fprintf(out, "    GabFunc *%s;\n", name);
+        }
+    }
+
+    fprintf(out, "} %s_Bindings;\n\n", module);
+
+    fprintf(out, "static inline bool %s_bind_failed(GabError *err, const char *what) {\n", module);
+    fputs("    if (err) {\n"
+          "        snprintf(err->message, sizeof(err->message), \"%s does not match the loaded script\", what);\n"
+          "        err->line = 0;\n"
+          "        err->column = 0;\n"
+          "    }\n\n"
+          "    return false;\n"
+          "}\n\n",
+          out);
+
+    fprintf(out, "// Resolves every handle and checks the loaded script still has the layout and\n"
+                 "// signatures this header was generated from. Call once per VM, after loading.\n");
+    fprintf(out, "static inline bool %s_bind(%s_Bindings *bindings, GabVM *vm, GabError *err) {\n", module,
+            module);
+    fputs("    bindings->vm = vm;\n", out);
+
+    for (size_t i = 0; i < gen->structs.size; i++) {
+        const BoundStruct *bound = &gen->structs.data[i];
+
+        if (!bound->needed) {
+            continue;
+        }
+
+        const char *name = bound->type->name->data;
+
+        fprintf(out, "\n    {\n");
+        fprintf(out, "        const GabType *type = gab_find_type(vm, \"%s\", \"%s\");\n",
+                bound->module->data, name);
+        fprintf(out, "        size_t offset = 0;\n\n");
+        fprintf(out,
+                "        if (!type || gab_type_size(type) != sizeof(%s) || "
+                "gab_type_align(type) != _Alignof(%s)",
+                name, name);
+
+        for (size_t f = 0; f < bound->type->field_count; f++) {
+            const char *field = bound->type->fields[f].name->data;
+
+            fprintf(out,
+                    " ||\n            !gab_field_offset(type, \"%s\", &offset) || offset != offsetof(%s, %s)",
+                    field, name, field);
+        }
+
+        fprintf(out, ") {\n            return %s_bind_failed(err, \"struct '%s'\");\n        }\n    }\n",
+                module, name);
+    }
+
+    for (size_t i = 0; i < script->statements.size; i++) {
+        const ASTStmt *stmt = script->statements.data[i];
+
+        if (!func_is_bound(stmt)) {
+            continue;
+        }
+
+        char name[128];
+        func_name(stmt, name, sizeof(name));
+
+        char signature[256];
+        GabFunc *fn = gab_lookup(vm, module, name, NULL);
+        gab_func_signature(fn, signature, sizeof(signature));
+
+        fprintf(out, "\n    bindings->%s = gab_lookup_typed(vm, \"%s\", \"%s\", \"%s\", err);\n",
+                name, module, name, signature);
+        fprintf(out, "    if (!bindings->%s) {\n        return false;\n    }\n", name);
+    }
+
+    fputs("\n    return true;\n}\n\n", out);
+}
+
+// One wrapper: typed parameters written straight into the callee's frame at
+// offsets fixed here, the result copied once out of the slot it landed in.
+static void emit_wrapper(Bindgen *gen, const ASTStmt *stmt) {
+    FILE *out = gen->out;
+    const Symbol *symbol = stmt->func_decl.symbol;
+
+    char name[128];
+    func_name(stmt, name, sizeof(name));
+
+    fprintf(out, "static inline GabStatus %s_%s(const %s_Bindings *bindings", gen->module, name, gen->module);
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        const Type *param = symbol->func.params[i];
+
+        fputs(", ", out);
+
+        char declarator[256];
+        snprintf(declarator, sizeof(declarator), "%.*s", (int)stmt->func_decl.params.data[i]->name.length,
+                 stmt->func_decl.params.data[i]->name.data);
+
+        // A struct crosses by value, but is passed in by address: the wrapper
+        // copies it into the frame either way.
+        if (param->kind == TYPE_STRUCT) {
+            fprintf(out, "const %s *%s", param->name->data, declarator);
+        } else {
+            emit_declarator(out, param, declarator);
+        }
+    }
+
+    if (symbol->func.return_type) {
+        fputs(", ", out);
+        emit_c_type(out, symbol->func.return_type);
+        fputs(symbol->func.return_type->kind == TYPE_POINTER ? "*out" : " *out", out);
+    }
+
+    fputs(", GabError *err) {\n", out);
+
+    unsigned int slots = 0;
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        slots += args_type_slots(symbol->func.params[i]);
+    }
+
+    if (slots > 0) {
+        fprintf(out, "    uint8_t *args = gab_frame_args(bindings->vm, bindings->%s);\n\n", name);
+    }
+
+    unsigned int at = 0;
+
+    for (size_t i = 0; i < symbol->func.param_count; i++) {
+        const Type *param = symbol->func.params[i];
+        int length = (int)stmt->func_decl.params.data[i]->name.length;
+        const char *param_name = stmt->func_decl.params.data[i]->name.data;
+
+        if (param->kind == TYPE_BOOL) {
+            // A bool is widened to the word the frame holds it in.
+            fprintf(out, "    int32_t %.*s_word = %.*s ? 1 : 0;\n", length, param_name, length, param_name);
+            fprintf(out, "    memcpy(args + %u, &%.*s_word, sizeof(int32_t));\n", at, length, param_name);
+        } else if (param->kind == TYPE_STRUCT) {
+            fprintf(out, "    memcpy(args + %u, %.*s, sizeof(%s));\n", at, length, param_name,
+                    param->name->data);
+        } else {
+            fprintf(out, "    memcpy(args + %u, &%.*s, sizeof(%.*s));\n", at, length, param_name, length,
+                    param_name);
+        }
+
+        at += args_type_slots(param) * VM_SLOT_SIZE;
+    }
+
+    if (slots > 0) {
+        fputs("\n", out);
+    }
+
+    if (!symbol->func.return_type) {
+        fprintf(out, "    return gab_frame_call(bindings->vm, bindings->%s, err);\n}\n\n", name);
+        return;
+    }
+
+    // The result is read where it landed, and only as wide as the C type: a
+    // bool is one byte in the frame as it is in C.
+    fprintf(out, "    GabStatus status = gab_frame_call(bindings->vm, bindings->%s, err);\n\n", name);
+    fprintf(out, "    if (status == GAB_OK && out) {\n"
+                 "        memcpy(out, gab_frame_result(bindings->vm, bindings->%s), sizeof(*out));\n"
+                 "    }\n\n"
+                 "    return status;\n}\n\n",
+            name);
+}
+
+// The include guard, from the output's file name.
+static void guard_for(const char *path, const char *module, char *guard, size_t size) {
+    const char *base = path ? strrchr(path, '/') : NULL;
+    base = base ? base + 1 : path;
+
+    if (!base) {
+        snprintf(guard, size, "GAB_BINDINGS_%s_H", module);
+    } else {
+        snprintf(guard, size, "GAB_BINDINGS_%s", base);
+    }
+
+    for (char *c = guard; *c; c++) {
+        *c = isalnum((unsigned char)*c) ? (char)toupper((unsigned char)*c) : '_';
+    }
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: gab-bindgen [-I dependency.gab]... [-o bindings.h] unit.gab\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    const char *unit = NULL;
+
+    const char **dependencies = calloc((size_t)argc, sizeof(const char *));
+    size_t dependency_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+            dependencies[dependency_count++] = argv[++i];
+        } else if (argv[i][0] != '-' && !unit) {
+            unit = argv[i];
+        } else {
+            free(dependencies);
+            return usage();
+        }
+    }
+
+    if (!unit) {
+        free(dependencies);
+        return usage();
+    }
+
+    GabVM *handle = gab_vm_new();
+    VM *vm = (VM *)handle;
+
+    Bindgen gen = {.structs = bound_struct_list_create()};
+
+    // Each source backs the names its script points into, so all of them live
+    // until the header is written.
+    char **sources = calloc(dependency_count + 1, sizeof(char *));
+    ASTScript *script = NULL;
+    int status = 1;
+
+    for (size_t i = 0; i < dependency_count; i++) {
+        ASTScript *dependency = declare_unit(vm, &gen, dependencies[i], &sources[i]);
+
+        if (!dependency) {
+            goto done;
+        }
+
+        ast_script_destroy(dependency);
+    }
+
+    script = declare_unit(vm, &gen, unit, &sources[dependency_count]);
+
+    if (!script) {
+        goto done;
+    }
+
+    char module[128];
+    snprintf(module, sizeof(module), "%.*s", (int)script->module_name.length, script->module_name.data);
+    gen.module = module;
+
+    for (size_t i = 0; i < script->statements.size; i++) {
+        const ASTStmt *stmt = script->statements.data[i];
+
+        if (stmt->kind == STMT_STRUCT_DECL && stmt->struct_decl.type) {
+            need_type(&gen, stmt->struct_decl.type);
+        }
+
+        if (func_is_bound(stmt)) {
+            const Symbol *symbol = stmt->func_decl.symbol;
+
+            for (size_t p = 0; p < symbol->func.param_count; p++) {
+                need_type(&gen, symbol->func.params[p]);
+            }
+
+            need_type(&gen, symbol->func.return_type);
+        }
+    }
+
+    gen.out = output ? fopen(output, "w") : stdout;
+
+    if (!gen.out) {
+        fprintf(stderr, "gab-bindgen: cannot write '%s'\n", output);
+        goto done;
+    }
+
+    char guard[256];
+    guard_for(output, module, guard, sizeof(guard));
+
+    fprintf(gen.out,
+            "// Generated by gab-bindgen from %s. Do not edit: regenerate it from the\n"
+            "// script instead.\n"
+            "#ifndef %s\n#define %s\n\n"
+            "#include \"gab.h\"\n\n"
+            "#include <stdbool.h>\n#include <stddef.h>\n#include <stdint.h>\n#include <stdio.h>\n"
+            "#include <string.h>\n\n",
+            unit, guard, guard);
+
+    for (size_t i = 0; i < gen.structs.size; i++) {
+        if (gen.structs.data[i].needed) {
+            fprintf(gen.out, "typedef struct %s %s;\n", gen.structs.data[i].type->name->data,
+                    gen.structs.data[i].type->name->data);
+        }
+    }
+
+    fputs("\n", gen.out);
+
+    for (size_t i = 0; i < gen.structs.size; i++) {
+        if (gen.structs.data[i].needed) {
+            emit_struct(&gen, &gen.structs.data[i]);
+        }
+    }
+
+    emit_bind(&gen, handle, script);
+
+    for (size_t i = 0; i < script->statements.size; i++) {
+        if (func_is_bound(script->statements.data[i])) {
+            emit_wrapper(&gen, script->statements.data[i]);
+        }
+    }
+
+    fprintf(gen.out, "#endif\n");
+
+    status = ferror(gen.out) ? 1 : 0;
+
+    if (output) {
+        fclose(gen.out);
+    }
+
+done:
+    if (script) {
+        ast_script_destroy(script);
+    }
+
+    for (size_t i = 0; i <= dependency_count; i++) {
+        free(sources[i]);
+    }
+
+    free(sources);
+    free(dependencies);
+    bound_struct_list_free(&gen.structs);
+    gab_vm_free(handle);
+
+    return status;
+}